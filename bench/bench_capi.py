@@ -0,0 +1,233 @@
+#!/usr/bin/env python
+"""Benchmarks of the native read paths.
+
+The benchmarks run against the synthetic vendor library built from
+``mock/nsMock.c``, i.e. they measure the glue code (and the Python layer
+on top of it) independently of any real vendor library. For each
+benchmark the latency percentiles of a single call and the throughput in
+items (samples, events, segments, ...) and bytes per second are reported.
+
+Usage (or ``make bench`` in a CMake build directory)::
+
+  bench_capi.py --library build/libnsMock.so [--capi build/_capi.so]
+                [--spec layout.mock] [--repeat 50] [--filter analog]
+                [--json results.json]
+
+``--spec`` selects the layout of the synthetic file (entity counts,
+rates, gaps, injected latency, ...), cf. the comment at the top of
+``mock/nsMock.c``; by default the built-in layout is used.
+"""
+
+import os
+import sys
+import json
+import time
+import argparse
+
+srcdir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+_timer = getattr(time, 'perf_counter', time.time)
+
+
+def load_capi(path):
+    """Use the native module at ``path`` (e.g. fresh out of a CMake build
+    directory) instead of the one in the neuroshare package"""
+    try:
+        from importlib.util import spec_from_file_location, module_from_spec
+        spec = spec_from_file_location('neuroshare._capi', path)
+        module = module_from_spec(spec)
+        spec.loader.exec_module(module)
+    except ImportError:
+        import imp
+        module = imp.load_dynamic('neuroshare._capi', path)
+    sys.modules['neuroshare._capi'] = module
+
+
+class Result(object):
+    def __init__(self, name, latencies, items, nbytes):
+        self.name = name
+        self.latencies = sorted(latencies)
+        self.items = items
+        self.nbytes = nbytes
+
+    def percentile(self, p):
+        lat = self.latencies
+        return lat[min(len(lat) - 1, int(p / 100.0 * len(lat)))]
+
+    @property
+    def total(self):
+        return sum(self.latencies) or 1e-12
+
+    def as_dict(self):
+        return {'name': self.name,
+                'calls': len(self.latencies),
+                'p50_us': self.percentile(50) * 1e6,
+                'p90_us': self.percentile(90) * 1e6,
+                'p99_us': self.percentile(99) * 1e6,
+                'items_per_s': self.items / self.total,
+                'bytes_per_s': self.nbytes / self.total}
+
+
+class Bench(object):
+    """Collection of the benchmarks, all of them reading from a single
+    synthetic file"""
+
+    def __init__(self, library, repeat, name_filter=None, spec='synthetic.mock'):
+        import neuroshare as ns
+
+        self.ns = ns
+        self.repeat = repeat
+        self.name_filter = name_filter
+        self.spec = spec
+        self.library = ns.Library('nsMock', library)
+        self.fd = ns.File(spec, library=self.library)
+
+        types = self.fd.scan()['EntityType']
+        self.ids = dict((t, [i for i in range(len(types)) if types[i] == t])
+                        for t in (ns.EntityType.Event, ns.EntityType.Analog,
+                                  ns.EntityType.Segment, ns.EntityType.Neural))
+
+    def entity(self, entity_type):
+        return self.fd.get_entity(self.ids[entity_type][0])
+
+    def run(self, name, fn, calls, items, nbytes):
+        """Time ``calls`` calls of ``fn(i)``, each of which reads ``items``
+        items of ``nbytes`` bytes. Returns ``None`` for benchmarks that
+        are filtered out."""
+        if self.name_filter and self.name_filter not in name:
+            return None
+
+        fn(0)  # warm up
+        latencies = []
+        for i in range(calls):
+            start = _timer()
+            fn(i)
+            latencies.append(_timer() - start)
+        return Result(name, latencies, items * calls, nbytes * calls)
+
+    def benchmarks(self):
+        ns = self.ns
+        repeat = self.repeat
+
+        event = self.entity(ns.EntityType.Event)
+        yield self.run('event single', lambda i: event.get_data(i % event.item_count),
+                       repeat * 100, 1, 10)
+        n = min(10000, event.item_count)
+        yield self.run('event batch %d' % n, lambda i: event.get_data(slice(0, n)),
+                       repeat, n, 10 * n)
+
+        analog = self.entity(ns.EntityType.Analog)
+        for chunk in (1 << 10, 1 << 16, 1 << 20):
+            chunk = min(chunk, analog.item_count)
+            starts = max(1, analog.item_count - chunk)
+            for times in (True, False):
+                read = lambda i: analog.get_data((i * chunk) % starts, chunk, times=times)
+                yield self.run('analog %d%s' % (chunk, '' if times else ' no times'),
+                               read, repeat, chunk, chunk * (16 if times else 8))
+
+        import numpy as np
+        out = np.empty(1 << 16)
+        yield self.run('analog %d out=' % len(out),
+                       lambda i: analog.get_data(0, len(out), times=False, out=out),
+                       repeat, len(out), 8 * len(out))
+        for dtype in ('float32', 'int16'):
+            size = np.dtype(dtype).itemsize
+            yield self.run('analog %d %s' % (len(out), dtype),
+                           lambda i: analog.get_data(0, len(out), times=False, dtype=dtype),
+                           repeat, len(out), size * len(out))
+
+        n = analog.item_count
+        yield self.run('analog envelope %d -> 2000' % n,
+                       lambda i: analog.get_envelope(0, n, 2000), repeat, n, 8 * n)
+        yield self.run('analog decimated %d / 10' % n,
+                       lambda i: analog.get_decimated(10, 0, n), repeat, n, 8 * n)
+
+        segment = self.entity(ns.EntityType.Segment)
+        seg_size = 8 * segment.source_count * segment.max_sample_count + 16
+        yield self.run('segment single', lambda i: segment.get_data(i % segment.item_count),
+                       repeat * 100, 1, seg_size)
+        n = min(1000, segment.item_count)
+        yield self.run('segment range %d' % n, lambda i: segment.get_data(slice(0, n)),
+                       repeat, n, n * seg_size)
+
+        neural = self.entity(ns.EntityType.Neural)
+        yield self.run('neural %d' % neural.item_count,
+                       lambda i: neural.get_data(), repeat, neural.item_count,
+                       8 * neural.item_count)
+
+        count = self.fd.entity_count
+        open_file = lambda: ns.File(self.spec, library=self.library)
+        yield self.run('open + scan %d entities' % count,
+                       lambda i: open_file().scan(), repeat, count, 0)
+
+        def entity_infos(i):
+            fd = open_file()
+            for eid in range(count):
+                fd.get_entity(eid).metadata_raw
+        yield self.run('open + entity info %d entities' % count,
+                       entity_infos, repeat, count, 0)
+
+        span = analog.item_count / analog.sample_rate
+        timepoints = np.linspace(0, span, 100000, endpoint=False)
+        yield self.run('index by time',
+                       lambda i: analog.get_index_by_time(timepoints[i % len(timepoints)]),
+                       repeat * 100, 1, 4)
+        yield self.run('index by time x%d' % len(timepoints),
+                       lambda i: analog.get_index_by_time(timepoints), repeat,
+                       len(timepoints), 4 * len(timepoints))
+        indices = np.arange(0, analog.item_count, max(1, analog.item_count // 100000))
+        yield self.run('time by index',
+                       lambda i: analog.get_time_by_index(int(indices[i % len(indices)])),
+                       repeat * 100, 1, 8)
+        yield self.run('time by index x%d' % len(indices),
+                       lambda i: analog.get_time_by_index(indices), repeat,
+                       len(indices), 8 * len(indices))
+
+        yield self.run('slice 1s all entities',
+                       lambda i: self.fd.slice(i % 10, i % 10 + 1.0), repeat, 1, 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark the native read paths')
+    parser.add_argument('--library', required=True,
+                        help='path of the synthetic vendor library (libnsMock)')
+    parser.add_argument('--capi', default=None,
+                        help='path of the native module to use')
+    parser.add_argument('--spec', default='synthetic.mock',
+                        help='spec of the synthetic file (default: built-in layout)')
+    parser.add_argument('--repeat', type=int, default=50)
+    parser.add_argument('--filter', default=None,
+                        help='only run the benchmarks whose name contain this')
+    parser.add_argument('--json', default=None, help='write the results to this file')
+    args = parser.parse_args()
+
+    sys.path.insert(0, srcdir)
+    if args.capi is not None:
+        load_capi(args.capi)
+
+    bench = Bench(args.library, args.repeat, args.filter, args.spec)
+
+    header = '%-34s %7s %10s %10s %10s %12s %10s' % ('benchmark', 'calls', 'p50 [us]',
+                                                    'p90 [us]', 'p99 [us]',
+                                                    'items/s', 'MB/s')
+    print(header)
+    print('-' * len(header))
+
+    results = []
+    for result in bench.benchmarks():
+        if result is None:
+            continue
+        r = result.as_dict()
+        results.append(r)
+        print('%-34s %7d %10.1f %10.1f %10.1f %12.4g %10.1f' % (
+            r['name'], r['calls'], r['p50_us'], r['p90_us'], r['p99_us'],
+            r['items_per_s'], r['bytes_per_s'] / 1e6))
+        sys.stdout.flush()
+
+    if args.json:
+        with open(args.json, 'w') as fd:
+            json.dump(results, fd, indent=2)
+
+
+if __name__ == '__main__':
+    main()
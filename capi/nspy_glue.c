@@ -28,15 +28,23 @@
 #include <numpy/ndarrayobject.h>
 
 #include <stdio.h>
+#include <stddef.h>
+#include <math.h>
 
 #ifndef _WIN32
 #include <arpa/inet.h>
 #include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #else
-#define _WIN32_WINNT 0x0500
-#define WINVER 0x0500
+#define _WIN32_WINNT 0x0600
+#define WINVER 0x0600
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
 #ifdef _MSC_VER
 # define _POSIX_
 #endif
@@ -45,1191 +53,8239 @@
 
 #include "nsAPItypes.h"
 #include "nsAPIdllimp.h"
+#include "nspy_thread.h"
+#include "nspy_remote.h"
 
 static PyObject *PgError;
 
+/* Locking policies for vendor libraries, many of them are not reentrant */
+#define NS_LOCK_NONE    0  /* library is thread-safe, no locking at all */
+#define NS_LOCK_FILE    1  /* calls concerning the same file are serialized */
+#define NS_LOCK_GLOBAL  2  /* every call into the library is serialized */
+
+/* number of mutexes file handles are spread over for NS_LOCK_FILE */
+#define NS_FILE_LOCKS  16
+
+/* Vendor functions, for the call statistics */
+enum {
+  NS_FN_GetLibraryInfo,
+  NS_FN_OpenFile,
+  NS_FN_CloseFile,
+  NS_FN_GetFileInfo,
+  NS_FN_GetEntityInfo,
+  NS_FN_GetEventInfo,
+  NS_FN_GetEventData,
+  NS_FN_GetAnalogInfo,
+  NS_FN_GetAnalogData,
+  NS_FN_GetSegmentInfo,
+  NS_FN_GetSegmentSourceInfo,
+  NS_FN_GetSegmentData,
+  NS_FN_GetNeuralInfo,
+  NS_FN_GetNeuralData,
+  NS_FN_GetIndexByTime,
+  NS_FN_GetTimeByIndex,
+  NS_FN_GetLastErrorMsg,
+  NS_FN_COUNT
+};
+
+static const char *ns_function_names[NS_FN_COUNT] = {
+  "GetLibraryInfo",
+  "OpenFile",
+  "CloseFile",
+  "GetFileInfo",
+  "GetEntityInfo",
+  "GetEventInfo",
+  "GetEventData",
+  "GetAnalogInfo",
+  "GetAnalogData",
+  "GetSegmentInfo",
+  "GetSegmentSourceInfo",
+  "GetSegmentData",
+  "GetNeuralInfo",
+  "GetNeuralData",
+  "GetIndexByTime",
+  "GetTimeByIndex",
+  "GetLastErrorMsg"
+};
+
+/* number of file handles whose calls are counted individually */
+#define NS_STATS_FILES  64
+
+/* number of free scratch buffers kept per library and the size limit of
+ * a buffer that is kept */
+#define NS_SCRATCH_SLOTS  16
+#define NS_SCRATCH_KEEP   (16 << 20)
+
+/* pseudo file id for calls that do not concern a file */
+#define NS_NO_FILE      ((uint32) -1)
+
 typedef struct {
+  volatile uint64_t calls;
+  volatile uint64_t ns;         /* time spent in the vendor function */
+  volatile uint64_t bytes;      /* size of the data returned */
+  volatile uint64_t errors;     /* calls that did not return ns_OK */
+} NsCallStats;
 
-#ifdef _WIN32
-  HMODULE            dl_handle;
-#else
-  void              *dl_handle;
-#endif
+typedef struct {
+  volatile uint32_t key;        /* file id + 1, 0 if the slot is free */
+  NsCallStats       calls[NS_FN_COUNT];
+} NsFileStats;
 
-  NS_GETLIBRARYINFO       GetLibraryInfo;
-  NS_OPENFILE             OpenFile;
-  NS_CLOSEFILE            CloseFile;
-  NS_GETFILEINFO          GetFileInfo;
-  NS_GETENTITYINFO        GetEntityInfo;
-  NS_GETEVENTINFO         GetEventInfo;
-  NS_GETEVENTDATA         GetEventData;
-  NS_GETANALOGINFO        GetAnalogInfo;
-  NS_GETANALOGDATA        GetAnalogData;
-  NS_GETSEGMENTINFO       GetSegmentInfo;
-  NS_GETSEGMENTSOURCEINFO GetSegmentSourceInfo;
-  NS_GETSEGMENTDATA       GetSegmentData;
-  NS_GETNEURALINFO        GetNeuralInfo;
-  NS_GETNEURALDATA        GetNeuralData;
-  NS_GETINDEXBYTIME       GetIndexByTime;
-  NS_GETTIMEBYINDEX       GetTimeByIndex;
-  NS_GETLASTERRORMSG      GetLastErrorMsg;
+/* Statistics of the reads queued on the worker pool (see pool_submit);
+ * only changed with the lock of the pool held */
+typedef struct {
+  volatile uint32_t queued;     /* jobs waiting right now */
+  volatile uint32_t max_queued;
+  volatile uint64_t requests;   /* jobs run */
+  volatile uint64_t reads;      /* vendor reads they took, merged ones once */
+  volatile uint64_t ns;         /* time from submitting to finishing jobs */
+  volatile uint64_t max_ns;
+} NsSchedStats;
+
+/* Statistics are only collected while enabled, otherwise the cost is a
+ * single branch per call */
+static volatile int ns_stats_enabled = 0;
 
-} NsLibrary;
+/* ************************************************************************** */
+/* Remote backend: the calls of a library go to one or more reader servers
+ * (nspy_server.c) instead of a loaded vendor library. Each server is
+ * reached via a pool of connections, so concurrent calls do not wait for
+ * each other on the client side; files are spread over the servers as
+ * they are opened and their handles are mapped to the ones of the server.
+ * Unix domain connections copy bulk data out of shared memory. */
 
-uint8
-uint8_from_data (void *data, size_t data_len)
+#ifndef _WIN32
+
+/* number of idle connections kept per server */
+#define NS_REMOTE_IDLE  16
+
+typedef struct _NsRemoteConn NsRemoteConn;
+
+struct _NsRemoteConn {
+  int           fd;
+  void         *shm;
+  size_t        shm_size;
+  NsRemoteConn *next;
+};
+
+typedef struct {
+  char         *address;
+  uint32_t      session;
+  NsRemoteConn *idle;
+  int           n_idle;
+} NsRemoteServer;
+
+typedef struct {
+  uint32        server;
+  uint32        file_id;   /* handle on the server */
+  int           used;
+} NsRemoteFile;
+
+typedef struct {
+  NsMutex         lock;
+  pid_t           pid;       /* connections are not shared with children */
+  NsRemoteServer *servers;
+  int             n_servers;
+  int             next_server;
+  NsRemoteFile   *files;
+  uint32          n_files;
+  uint32          max_files;
+} NsRemote;
+
+/* message of the last call of this thread that failed */
+static __thread char nsremote_error[1024];
+
+static ns_RESULT
+nsremote_fail (const char *message)
 {
-  uint8 ret;
-  
-  if (data_len == 1)
+  snprintf (nsremote_error, sizeof (nsremote_error), "%s: %s", message,
+            strerror (errno));
+  return ns_LIBERROR;
+}
+
+static void
+nsremote_conn_free (NsRemoteConn *conn)
+{
+  if (conn->shm != NULL)
+    munmap (conn->shm, conn->shm_size);
+  close (conn->fd);
+  free (conn);
+}
+
+/* New connection to server, attached to the session of the client */
+static NsRemoteConn *
+nsremote_connect (NsRemote *remote, NsRemoteServer *server)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+  NsRemoteConn   *conn;
+  int             is_unix;
+  int             shm_fd = -1;
+  int             res;
+
+  conn = calloc (1, sizeof (NsRemoteConn));
+
+  if (conn == NULL)
     {
-      memcpy (&ret, data, 1);
+      nsremote_fail ("Could not connect to the reader server");
+      return NULL;
     }
-  else if (data_len == 2)
+
+  conn->fd = ns_remote_socket (server->address, 0, &is_unix);
+
+  if (conn->fd < 0)
     {
-      uint16 u16;
-      memcpy (&u16, data, 2);
-      ret = (uint8) u16;
+      nsremote_fail ("Could not connect to the reader server");
+      free (conn);
+      return NULL;
     }
-  else if (data_len == 4)
+
+  memset (&req, 0, sizeof (req));
+  req.op = NS_OP_HELLO;
+  req.flag = NS_REMOTE_VERSION;
+  ns_mutex_lock (&remote->lock);
+  req.index = server->session;
+  ns_mutex_unlock (&remote->lock);
+  req.count = is_unix;
+
+  res = ns_remote_write_all (conn->fd, &req, sizeof (req));
+
+  if (res == 0 && is_unix)
+    res = ns_remote_recv_fd (conn->fd, &reply, sizeof (reply), &shm_fd);
+  else if (res == 0)
+    res = ns_remote_read_all (conn->fd, &reply, sizeof (reply));
+
+  if (res == 0 && reply.result != ns_OK)
     {
-      uint32 u32;
-      memcpy (&u32, data, 4);
-      ret = (uint8) u32;
+      errno = EPROTO;
+      res = -1;
     }
-  else
+
+  if (res == 0 && shm_fd >= 0 && reply.value[1] > 0)
     {
-      ret = 0;
+      conn->shm = mmap (NULL, reply.value[1], PROT_READ, MAP_SHARED, shm_fd, 0);
+
+      if (conn->shm == MAP_FAILED)
+        {
+          conn->shm = NULL;
+          res = -1;
+        }
+      else
+        conn->shm_size = reply.value[1];
     }
-  
-  return ret;
+
+  if (shm_fd >= 0)
+    close (shm_fd);
+
+  if (res != 0)
+    {
+      nsremote_fail ("Could not connect to the reader server");
+      nsremote_conn_free (conn);
+      return NULL;
+    }
+
+  ns_mutex_lock (&remote->lock);
+  server->session = reply.value[0];
+  ns_mutex_unlock (&remote->lock);
+
+  return conn;
 }
 
-static uint16
-uint16_from_data (void *data, size_t data_len)
+static void
+nsremote_drop_idle (NsRemoteServer *server)
 {
-  uint16 ret;
-  
-  if (data_len == 1)
+  NsRemoteConn *conn;
+
+  while ((conn = server->idle) != NULL)
     {
-      uint8 u8;
-      memcpy (&u8, data, 1);
-      ret = (uint16) u8;
+      server->idle = conn->next;
+      nsremote_conn_free (conn);
     }
-  else if (data_len == 2)
+
+  server->n_idle = 0;
+}
+
+static NsRemoteConn *
+nsremote_acquire (NsRemote *remote, uint32 index)
+{
+  NsRemoteServer *server = &remote->servers[index];
+  NsRemoteConn   *conn;
+  int             i;
+
+  ns_mutex_lock (&remote->lock);
+
+  /* in a forked child: the connections belong to the parent, new ones
+   * join the same sessions (i.e. the open files stay valid) */
+  if (remote->pid != getpid ())
     {
-      memcpy (&ret, data, 2);
+      for (i = 0; i < remote->n_servers; i++)
+        nsremote_drop_idle (&remote->servers[i]);
+      remote->pid = getpid ();
     }
-  else if (data_len == 4)
+
+  conn = server->idle;
+
+  if (conn != NULL)
     {
-      uint32 u32;
-      memcpy (&u32, data, 4);
-      ret =  (uint16) u32;
+      server->idle = conn->next;
+      server->n_idle--;
     }
-  else
+
+  ns_mutex_unlock (&remote->lock);
+
+  if (conn == NULL)
+    conn = nsremote_connect (remote, server);
+
+  return conn;
+}
+
+static void
+nsremote_release (NsRemote *remote, uint32 index, NsRemoteConn *conn, int broken)
+{
+  NsRemoteServer *server = &remote->servers[index];
+
+  if (!broken)
     {
-      ret = 0;
+      ns_mutex_lock (&remote->lock);
+
+      if (remote->pid == getpid () && server->n_idle < NS_REMOTE_IDLE)
+        {
+          conn->next = server->idle;
+          server->idle = conn;
+          server->n_idle++;
+          conn = NULL;
+        }
+
+      ns_mutex_unlock (&remote->lock);
     }
-  
-  return ret;
+
+  if (conn != NULL)
+    nsremote_conn_free (conn);
 }
 
-static uint32
-uint32_from_data (void *data, size_t data_len)
+/* One call on the server index: send req (and size bytes of data), read
+ * the reply and its payload (at most out_size bytes) into out */
+static ns_RESULT
+nsremote_call (NsRemote        *remote,
+               uint32           index,
+               NsRemoteRequest *req,
+               const void      *data,
+               void            *out,
+               size_t           out_size,
+               NsRemoteReply   *reply)
 {
-  uint32 ret;
-  
-  if (data_len == 1)
+  NsRemoteConn *conn;
+  int           res;
+
+  nsremote_error[0] = '\0';
+  conn = nsremote_acquire (remote, index);
+
+  if (conn == NULL)
+    return ns_LIBERROR;
+
+  res = ns_remote_write_all (conn->fd, req, sizeof (NsRemoteRequest));
+
+  if (res == 0 && req->size > 0)
+    res = ns_remote_write_all (conn->fd, data, req->size);
+
+  if (res == 0)
+    res = ns_remote_read_all (conn->fd, reply, sizeof (NsRemoteReply));
+
+  if (res != 0)
     {
-      uint8 u8;
-      memcpy (&u8, data, 1);
-      ret = (uint32) u8;
+      nsremote_release (remote, index, conn, 1);
+      return nsremote_fail ("Lost the connection to the reader server");
     }
-  else if (data_len == 2)
+
+  if (reply->result != ns_OK)
     {
-      uint16 u16;
-      memcpy (&u16, data, 2);
-      ret =  (uint32) u16;
+      size_t n = reply->size < sizeof (nsremote_error) ? reply->size : sizeof (nsremote_error);
+
+      res = ns_remote_read_all (conn->fd, nsremote_error, n);
+      if (res == 0)
+        res = ns_remote_skip (conn->fd, reply->size - n);
+      nsremote_error[sizeof (nsremote_error) - 1] = '\0';
     }
-  else if (data_len == 4)
+  else if (reply->size > out_size ||
+           (reply->in_shm && reply->size > conn->shm_size))
     {
-      memcpy (&ret, data, 4);
+      /* a well-behaved server never does that */
+      res = reply->in_shm ? 0 : ns_remote_skip (conn->fd, reply->size);
+      errno = EPROTO;
+      nsremote_fail ("Invalid reply from the reader server");
+      reply->result = ns_LIBERROR;
     }
+  else if (reply->in_shm && reply->size > 0)
+    memcpy (out, conn->shm, reply->size);
   else
-    {
-      ret = 0;
-    }
-  
-  return ret;
+    res = ns_remote_read_all (conn->fd, out, reply->size);
+
+  nsremote_release (remote, index, conn, res != 0);
+
+  if (res != 0)
+    return nsremote_fail ("Lost the connection to the reader server");
+
+  return reply->result;
 }
 
-static int
-check_result_is_error (ns_RESULT res, NsLibrary *lib)
+static void
+nsremote_request (NsRemoteRequest *req, uint32 op, uint32 file_id, uint32 entity_id)
 {
-  char buf[1024] = {0, };
-  ns_RESULT err_res;
+  memset (req, 0, sizeof (NsRemoteRequest));
+  req->op = op;
+  req->file = file_id;
+  req->entity = entity_id;
+}
 
-  if (res == ns_OK)
-    return 0;
+/* Call concerning the file req->file, on the server that file is on */
+static ns_RESULT
+nsremote_file_call (NsRemote        *remote,
+                    NsRemoteRequest *req,
+                    void            *out,
+                    size_t           out_size,
+                    NsRemoteReply   *reply)
+{
+  uint32 index = 0;
+  int    valid;
 
-  err_res = lib->GetLastErrorMsg (buf, sizeof (buf));
+  ns_mutex_lock (&remote->lock);
+  valid = req->file < remote->n_files && remote->files[req->file].used;
+  if (valid)
+    {
+      index = remote->files[req->file].server;
+      req->file = remote->files[req->file].file_id;
+    }
+  ns_mutex_unlock (&remote->lock);
 
-  if (err_res == ns_OK)
-    PyErr_Format (PgError, "Neuroshare-Error (%d): %s", res, buf);
-  else
-    PyErr_Format (PgError, "Internal Neuroshare-Error: %d", res);
+  if (!valid)
+    {
+      snprintf (nsremote_error, sizeof (nsremote_error), "Invalid file handle");
+      return ns_BADFILE;
+    }
 
-  return 1;
+  return nsremote_call (remote, index, req, NULL, out, out_size, reply);
 }
 
-static int
-dict_set_item_eat_ref (PyObject *dict, const char *string, PyObject *item)
+static ns_RESULT
+nsremote_GetLibraryInfo (NsRemote *remote, ns_LIBRARYINFO *info, uint32 size)
 {
-  int res;
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
 
-  res = PyDict_SetItemString (dict, string, item);
-  Py_DECREF (item);
-
-  return res;
+  nsremote_request (&req, NS_OP_GetLibraryInfo, 0, 0);
+  req.count = size;
+  return nsremote_call (remote, 0, &req, NULL, info, size, &reply);
 }
 
-/* ************************************************************************** */
+static ns_RESULT
+nsremote_OpenFile (NsRemote *remote, const char *filename, uint32 *file_id)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+  ns_RESULT       res;
+  uint32          index;
+  uint32          slot;
 
-#ifndef _WIN32
-#define GetProcAddress dlsym
-#endif
+  ns_mutex_lock (&remote->lock);
+  index = (uint32) remote->next_server;
+  remote->next_server = (remote->next_server + 1) % remote->n_servers;
+  ns_mutex_unlock (&remote->lock);
 
-#define PROC_ADDR(_struct, _function, _variable) \
-  _struct->_variable = (_function) GetProcAddress (_struct->dl_handle, "ns_" #_variable); \
-  if (_struct->_variable == NULL)					    \
-    {                                                                       \
-      PyErr_Format (PgError, "Could not lookup function: %s", #_variable);  \
-      return -1;                                                            \
+  nsremote_request (&req, NS_OP_OpenFile, 0, 0);
+  req.size = (uint32) strlen (filename);
+  res = nsremote_call (remote, index, &req, filename, NULL, 0, &reply);
+
+  if (res != ns_OK)
+    return res;
+
+  ns_mutex_lock (&remote->lock);
+
+  for (slot = 0; slot < remote->n_files; slot++)
+    if (!remote->files[slot].used)
+      break;
+
+  if (slot == remote->max_files)
+    {
+      uint32        max_files = remote->max_files ? 2 * remote->max_files : 16;
+      NsRemoteFile *files = realloc (remote->files, max_files * sizeof (NsRemoteFile));
+
+      if (files == NULL)
+        {
+          ns_mutex_unlock (&remote->lock);
+          nsremote_request (&req, NS_OP_CloseFile, reply.value[0], 0);
+          nsremote_call (remote, index, &req, NULL, NULL, 0, &reply);
+          errno = ENOMEM;
+          return nsremote_fail ("Could not open file");
+        }
+
+      remote->files = files;
+      remote->max_files = max_files;
     }
 
-static int
-dl_assign_pointers (NsLibrary *lib)
-{
-  PROC_ADDR (lib, NS_GETLIBRARYINFO, GetLibraryInfo);
-  PROC_ADDR (lib, NS_OPENFILE, OpenFile);
-  PROC_ADDR (lib, NS_CLOSEFILE, CloseFile);
-  PROC_ADDR (lib, NS_GETFILEINFO, GetFileInfo);
-  PROC_ADDR (lib, NS_GETENTITYINFO, GetEntityInfo);
-  PROC_ADDR (lib, NS_GETEVENTINFO, GetEventInfo);
-  PROC_ADDR (lib, NS_GETEVENTDATA, GetEventData);
-  PROC_ADDR (lib, NS_GETANALOGINFO, GetAnalogInfo);
-  PROC_ADDR (lib, NS_GETANALOGDATA, GetAnalogData);
-  PROC_ADDR (lib, NS_GETSEGMENTINFO, GetSegmentInfo);
-  PROC_ADDR (lib, NS_GETSEGMENTSOURCEINFO, GetSegmentSourceInfo);
-  PROC_ADDR (lib, NS_GETSEGMENTDATA, GetSegmentData);
-  PROC_ADDR (lib, NS_GETNEURALINFO, GetNeuralInfo);
-  PROC_ADDR (lib, NS_GETNEURALDATA, GetNeuralData);
-  PROC_ADDR (lib, NS_GETINDEXBYTIME, GetIndexByTime);
-  PROC_ADDR (lib, NS_GETINDEXBYTIME, GetIndexByTime);
-  PROC_ADDR (lib, NS_GETTIMEBYINDEX, GetTimeByIndex);
-  PROC_ADDR (lib, NS_GETLASTERRORMSG, GetLastErrorMsg);
+  if (slot == remote->n_files)
+    remote->n_files++;
 
-  return 0;
+  remote->files[slot].server = index;
+  remote->files[slot].file_id = reply.value[0];
+  remote->files[slot].used = 1;
+  ns_mutex_unlock (&remote->lock);
+
+  *file_id = slot;
+  return ns_OK;
 }
 
-static void
-dl_set_error (const char *message)
+static ns_RESULT
+nsremote_CloseFile (NsRemote *remote, uint32 file_id)
 {
-#ifdef _WIN32
-  DWORD  last_error;
-  DWORD  res;
-  LPVOID buf_msg;
-  char   buf_str[1024] = {0,};
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+  ns_RESULT       res;
 
-  last_error = GetLastError ();
+  nsremote_request (&req, NS_OP_CloseFile, file_id, 0);
+  res = nsremote_file_call (remote, &req, NULL, 0, &reply);
 
-  res = FormatMessage (FORMAT_MESSAGE_ALLOCATE_BUFFER |
-                       FORMAT_MESSAGE_FROM_SYSTEM |
-                       FORMAT_MESSAGE_IGNORE_INSERTS,
-                       NULL,
-                       last_error,
-                       MAKELANGID (LANG_NEUTRAL, SUBLANG_DEFAULT),
-                       (LPTSTR) &buf_msg,
-                       0, NULL);
+  if (res == ns_OK)
+    {
+      ns_mutex_lock (&remote->lock);
+      remote->files[file_id].used = 0;
+      ns_mutex_unlock (&remote->lock);
+    }
 
-  if (res > 0)
+  return res;
+}
+
+/* Get{File,Entity,Event,Analog,Segment,Neural}Info: a struct of size
+ * bytes for file_id (and entity_id) */
+static ns_RESULT
+nsremote_get_info (NsRemote *remote,
+                   uint32    op,
+                   uint32    file_id,
+                   uint32    entity_id,
+                   void     *info,
+                   uint32    size)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+
+  nsremote_request (&req, op, file_id, entity_id);
+  req.count = size;
+  return nsremote_file_call (remote, &req, info, size, &reply);
+}
+
+static ns_RESULT
+nsremote_GetFileInfo (NsRemote *remote, uint32 file_id, ns_FILEINFO *info, uint32 size)
+{
+  return nsremote_get_info (remote, NS_OP_GetFileInfo, file_id, 0, info, size);
+}
+
+static ns_RESULT
+nsremote_GetEntityInfo (NsRemote      *remote,
+                        uint32         file_id,
+                        uint32         entity_id,
+                        ns_ENTITYINFO *info,
+                        uint32         size)
+{
+  return nsremote_get_info (remote, NS_OP_GetEntityInfo, file_id, entity_id, info, size);
+}
+
+static ns_RESULT
+nsremote_GetEventInfo (NsRemote     *remote,
+                       uint32        file_id,
+                       uint32        entity_id,
+                       ns_EVENTINFO *info,
+                       uint32        size)
+{
+  return nsremote_get_info (remote, NS_OP_GetEventInfo, file_id, entity_id, info, size);
+}
+
+static ns_RESULT
+nsremote_GetAnalogInfo (NsRemote      *remote,
+                        uint32         file_id,
+                        uint32         entity_id,
+                        ns_ANALOGINFO *info,
+                        uint32         size)
+{
+  return nsremote_get_info (remote, NS_OP_GetAnalogInfo, file_id, entity_id, info, size);
+}
+
+static ns_RESULT
+nsremote_GetSegmentInfo (NsRemote       *remote,
+                         uint32          file_id,
+                         uint32          entity_id,
+                         ns_SEGMENTINFO *info,
+                         uint32          size)
+{
+  return nsremote_get_info (remote, NS_OP_GetSegmentInfo, file_id, entity_id, info, size);
+}
+
+static ns_RESULT
+nsremote_GetNeuralInfo (NsRemote      *remote,
+                        uint32         file_id,
+                        uint32         entity_id,
+                        ns_NEURALINFO *info,
+                        uint32         size)
+{
+  return nsremote_get_info (remote, NS_OP_GetNeuralInfo, file_id, entity_id, info, size);
+}
+
+static ns_RESULT
+nsremote_GetSegmentSourceInfo (NsRemote         *remote,
+                               uint32            file_id,
+                               uint32            entity_id,
+                               uint32            source_id,
+                               ns_SEGSOURCEINFO *info,
+                               uint32            size)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+
+  nsremote_request (&req, NS_OP_GetSegmentSourceInfo, file_id, entity_id);
+  req.index = source_id;
+  req.count = size;
+  return nsremote_file_call (remote, &req, info, size, &reply);
+}
+
+static ns_RESULT
+nsremote_GetEventData (NsRemote *remote,
+                       uint32    file_id,
+                       uint32    entity_id,
+                       uint32    index,
+                       double   *timestamp,
+                       void     *data,
+                       uint32    data_size,
+                       uint32   *data_returned)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+  ns_RESULT       res;
+
+  nsremote_request (&req, NS_OP_GetEventData, file_id, entity_id);
+  req.index = index;
+  req.count = data_size;
+  res = nsremote_file_call (remote, &req, data, data_size, &reply);
+
+  if (res == ns_OK)
+    {
+      *timestamp = reply.time;
+      *data_returned = reply.value[0];
+    }
+
+  return res;
+}
+
+/* Items of a read per request, cf. NS_REMOTE_MAX_DATA */
+#define NSREMOTE_CHUNK  (NS_REMOTE_MAX_DATA / sizeof (double))
+
+/* The continuous count of a split read is the one of its first parts as
+ * long as those are continuous to their end (a gap right at the start of
+ * one is not seen). */
+static ns_RESULT
+nsremote_GetAnalogData (NsRemote *remote,
+                        uint32    file_id,
+                        uint32    entity_id,
+                        uint32    index,
+                        uint32    count,
+                        uint32   *cont_count,
+                        double   *data)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+  ns_RESULT       res = ns_OK;
+  uint32          done = 0;
+  uint32          n;
+  int             continuous = 1;
+
+  *cont_count = 0;
+
+  do
+    {
+      n = count - done < NSREMOTE_CHUNK ? count - done : NSREMOTE_CHUNK;
+
+      nsremote_request (&req, NS_OP_GetAnalogData, file_id, entity_id);
+      req.index = index + done;
+      req.count = n;
+      res = nsremote_file_call (remote, &req, data + done,
+                                (size_t) n * sizeof (double), &reply);
+
+      if (res != ns_OK)
+        break;
+
+      if (continuous)
+        *cont_count += reply.value[0];
+      continuous = continuous && reply.value[0] == n;
+      done += n;
+    }
+  while (done < count);
+
+  return res;
+}
+
+static ns_RESULT
+nsremote_GetSegmentData (NsRemote *remote,
+                         uint32    file_id,
+                         uint32    entity_id,
+                         int32     index,
+                         double   *timestamp,
+                         double   *data,
+                         uint32    data_size,
+                         uint32   *sample_count,
+                         uint32   *unit_id)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+  ns_RESULT       res;
+
+  nsremote_request (&req, NS_OP_GetSegmentData, file_id, entity_id);
+  req.index = (uint32) index;
+  req.count = data_size;
+  res = nsremote_file_call (remote, &req, data, data_size, &reply);
+
+  if (res == ns_OK)
+    {
+      *timestamp = reply.time;
+      *sample_count = reply.value[0];
+      *unit_id = reply.value[1];
+    }
+
+  return res;
+}
+
+static ns_RESULT
+nsremote_GetNeuralData (NsRemote *remote,
+                        uint32    file_id,
+                        uint32    entity_id,
+                        uint32    index,
+                        uint32    count,
+                        double   *data)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+  ns_RESULT       res = ns_OK;
+  uint32          done = 0;
+  uint32          n;
+
+  do
+    {
+      n = count - done < NSREMOTE_CHUNK ? count - done : NSREMOTE_CHUNK;
+
+      nsremote_request (&req, NS_OP_GetNeuralData, file_id, entity_id);
+      req.index = index + done;
+      req.count = n;
+      res = nsremote_file_call (remote, &req, data + done,
+                                (size_t) n * sizeof (double), &reply);
+      done += n;
+    }
+  while (res == ns_OK && done < count);
+
+  return res;
+}
+
+static ns_RESULT
+nsremote_GetIndexByTime (NsRemote *remote,
+                         uint32    file_id,
+                         uint32    entity_id,
+                         double    time,
+                         int32     flag,
+                         uint32   *index)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+  ns_RESULT       res;
+
+  nsremote_request (&req, NS_OP_GetIndexByTime, file_id, entity_id);
+  req.time = time;
+  req.flag = flag;
+  res = nsremote_file_call (remote, &req, NULL, 0, &reply);
+
+  if (res == ns_OK)
+    *index = reply.value[0];
+
+  return res;
+}
+
+static ns_RESULT
+nsremote_GetTimeByIndex (NsRemote *remote,
+                         uint32    file_id,
+                         uint32    entity_id,
+                         uint32    index,
+                         double   *time)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+  ns_RESULT       res;
+
+  nsremote_request (&req, NS_OP_GetTimeByIndex, file_id, entity_id);
+  req.index = index;
+  res = nsremote_file_call (remote, &req, NULL, 0, &reply);
+
+  if (res == ns_OK)
+    *time = reply.time;
+
+  return res;
+}
+
+/* The message of the last failed call of this thread came with its
+ * reply; only ask the server if there was none */
+static ns_RESULT
+nsremote_GetLastErrorMsg (NsRemote *remote, char *buffer, uint32 size)
+{
+  NsRemoteRequest req;
+  NsRemoteReply   reply;
+  ns_RESULT       res;
+
+  if (size == 0)
+    return ns_LIBERROR;
+
+  if (nsremote_error[0] != '\0')
+    {
+      snprintf (buffer, size, "%s", nsremote_error);
+      return ns_OK;
+    }
+
+  nsremote_request (&req, NS_OP_GetLastErrorMsg, 0, 0);
+  req.count = size;
+  res = nsremote_call (remote, 0, &req, NULL, buffer, size, &reply);
+  buffer[size - 1] = '\0';
+  return res;
+}
+
+static void
+nsremote_free (NsRemote *remote)
+{
+  int i;
+
+  for (i = 0; i < remote->n_servers; i++)
+    {
+      nsremote_drop_idle (&remote->servers[i]);
+      free (remote->servers[i].address);
+    }
+
+  ns_mutex_clear (&remote->lock);
+  free (remote->servers);
+  free (remote->files);
+  free (remote);
+}
+
+/* Backend for the servers in addresses (separated by commas); a first
+ * connection to each of them is made right away. Returns NULL (with the
+ * reason in nsremote_error) on errors. */
+static NsRemote *
+nsremote_new (const char *addresses)
+{
+  NsRemote     *remote;
+  NsRemoteConn *conn;
+  const char   *start;
+  const char   *end;
+  int           n;
+  int           i;
+
+  remote = calloc (1, sizeof (NsRemote));
+
+  for (n = 1, start = addresses; (start = strchr (start, ',')) != NULL; start++)
+    n++;
+
+  if (remote == NULL ||
+      (remote->servers = calloc ((size_t) n, sizeof (NsRemoteServer))) == NULL)
+    {
+      free (remote);
+      errno = ENOMEM;
+      nsremote_fail ("Could not connect to the reader server");
+      return NULL;
+    }
+
+  ns_mutex_init (&remote->lock);
+  remote->pid = getpid ();
+
+  for (start = addresses; *start != '\0'; start = *end ? end + 1 : end)
+    {
+      end = strchr (start, ',');
+      if (end == NULL)
+        end = start + strlen (start);
+      if (end > start)
+        remote->servers[remote->n_servers++].address =
+          strndup (start, (size_t) (end - start));
+    }
+
+  if (remote->n_servers == 0)
+    {
+      errno = EINVAL;
+      nsremote_fail ("No reader server address");
+      nsremote_free (remote);
+      return NULL;
+    }
+
+  for (i = 0; i < remote->n_servers; i++)
+    {
+      if (remote->servers[i].address == NULL ||
+          (conn = nsremote_acquire (remote, (uint32) i)) == NULL)
+        {
+          if (remote->servers[i].address == NULL)
+            {
+              errno = ENOMEM;
+              nsremote_fail ("Could not connect to the reader server");
+            }
+          nsremote_free (remote);
+          return NULL;
+        }
+
+      nsremote_release (remote, (uint32) i, conn, 0);
+    }
+
+  return remote;
+}
+
+/* Calls into the library of _lib, i.e. the vendor library or the server */
+#define NS_VENDOR_CALL(_lib, _function, ...)                            \
+  ((_lib)->remote != NULL ?                                             \
+   nsremote_##_function ((_lib)->remote, __VA_ARGS__) :                 \
+   (_lib)->_function (__VA_ARGS__))
+
+#else
+
+typedef struct _NsRemote NsRemote;
+
+#define NS_VENDOR_CALL(_lib, _function, ...)                            \
+  ((_lib)->_function (__VA_ARGS__))
+
+#endif
+
+typedef struct {
+
+#ifdef _WIN32
+  HMODULE            dl_handle;
+#else
+  void              *dl_handle;
+#endif
+
+  NS_GETLIBRARYINFO       GetLibraryInfo;
+  NS_OPENFILE             OpenFile;
+  NS_CLOSEFILE            CloseFile;
+  NS_GETFILEINFO          GetFileInfo;
+  NS_GETENTITYINFO        GetEntityInfo;
+  NS_GETEVENTINFO         GetEventInfo;
+  NS_GETEVENTDATA         GetEventData;
+  NS_GETANALOGINFO        GetAnalogInfo;
+  NS_GETANALOGDATA        GetAnalogData;
+  NS_GETSEGMENTINFO       GetSegmentInfo;
+  NS_GETSEGMENTSOURCEINFO GetSegmentSourceInfo;
+  NS_GETSEGMENTDATA       GetSegmentData;
+  NS_GETNEURALINFO        GetNeuralInfo;
+  NS_GETNEURALDATA        GetNeuralData;
+  NS_GETINDEXBYTIME       GetIndexByTime;
+  NS_GETTIMEBYINDEX       GetTimeByIndex;
+  NS_GETLASTERRORMSG      GetLastErrorMsg;
+
+  int                     lock_policy;
+  NsMutex                 lib_lock;
+  NsMutex                 file_locks[NS_FILE_LOCKS];
+
+  NsCallStats             stats[NS_FN_COUNT];
+  NsFileStats             file_stats[NS_STATS_FILES];
+  volatile uint64_t       errors_raised; /* cf. check_result_is_error */
+  NsSchedStats            sched;
+  int                     pool_running;  /* jobs on the pool, under its lock */
+
+  /* free scratch buffers for the read paths, see nslib_scratch */
+  NsMutex                 scratch_lock;
+  void                   *scratch[NS_SCRATCH_SLOTS];
+  int                     n_scratch;
+
+  /* reader server the calls go to instead, see library_connect */
+  NsRemote               *remote;
+
+  /* process-wide registry of loaded libraries, see library_open */
+  char                   *path;
+  int                     lazy;          /* loaded with RTLD_LAZY */
+  int                     refcount;
+  void                   *next;
+
+} NsLibrary;
+
+/* Libraries loaded so far, keyed by their resolved path. Only accessed
+ * with the GIL held. */
+static NsLibrary *library_registry = NULL;
+
+/* The lock helpers return the mutex they acquired (or NULL), so that
+ * a concurrent change of the policy cannot unbalance a call. They
+ * never need the GIL and are meant to be called with it released. */
+static NsMutex *
+nslib_lock_file (NsLibrary *lib, uint32 file_id)
+{
+  NsMutex *mutex;
+
+  switch (lib->lock_policy)
+    {
+    case NS_LOCK_GLOBAL:
+      mutex = &lib->lib_lock;
+      break;
+
+    case NS_LOCK_FILE:
+      mutex = &lib->file_locks[file_id % NS_FILE_LOCKS];
+      break;
+
+    default:
+      return NULL;
+    }
+
+  ns_mutex_lock (mutex);
+  return mutex;
+}
+
+static NsMutex *
+nslib_lock_library (NsLibrary *lib)
+{
+  if (lib->lock_policy == NS_LOCK_NONE)
+    return NULL;
+
+  ns_mutex_lock (&lib->lib_lock);
+  return &lib->lib_lock;
+}
+
+static void
+nslib_unlock (NsMutex *mutex)
+{
+  if (mutex != NULL)
+    ns_mutex_unlock (mutex);
+}
+
+/* Scratch buffers of the read paths are reused across calls (and
+ * threads): a buffer is taken from the library's free list and grown if
+ * needed, and put back after the call, so that in steady state a read
+ * does not allocate. Their size is stored in front of the data. Neither
+ * needs the GIL. */
+typedef union {
+  size_t size;
+  double align;
+} NsScratchHeader;
+
+static void *
+nslib_scratch (NsLibrary *lib, size_t size)
+{
+  NsScratchHeader *header = NULL;
+  NsScratchHeader *p;
+
+  ns_mutex_lock (&lib->scratch_lock);
+  if (lib->n_scratch > 0)
+    header = lib->scratch[--lib->n_scratch];
+  ns_mutex_unlock (&lib->scratch_lock);
+
+  if (header != NULL && header->size >= size)
+    return header + 1;
+
+  size = size > 0 ? size : 1;
+
+  /* grow to (at least) twice the previous size, to settle quickly */
+  if (header != NULL && size < 2 * header->size)
+    size = 2 * header->size;
+
+  free (header);
+  p = malloc (sizeof (NsScratchHeader) + size);
+
+  if (p == NULL)
+    return NULL;
+
+  p->size = size;
+  return p + 1;
+}
+
+static void
+nslib_scratch_release (NsLibrary *lib, void *data)
+{
+  NsScratchHeader *header;
+
+  if (data == NULL)
+    return;
+
+  header = (NsScratchHeader *) data - 1;
+
+  if (header->size <= NS_SCRATCH_KEEP)
+    {
+      ns_mutex_lock (&lib->scratch_lock);
+      if (lib->n_scratch < NS_SCRATCH_SLOTS)
+        {
+          lib->scratch[lib->n_scratch++] = header;
+          header = NULL;
+        }
+      ns_mutex_unlock (&lib->scratch_lock);
+    }
+
+  free (header);
+}
+
+static void
+nscall_stats_add (NsCallStats *stats, uint64_t ns, ns_RESULT res, uint64_t bytes)
+{
+  ns_atomic_add (&stats->calls, 1);
+  ns_atomic_add (&stats->ns, ns);
+
+  if (res == ns_OK)
+    ns_atomic_add (&stats->bytes, bytes);
+  else
+    ns_atomic_add (&stats->errors, 1);
+}
+
+/* Slot for the statistics of file_id (or NULL if all slots are taken) */
+static NsFileStats *
+nslib_file_stats (NsLibrary *lib, uint32 file_id)
+{
+  uint32 key = file_id + 1;
+  uint32 i, slot;
+
+  for (i = 0; i < NS_STATS_FILES; i++)
+    {
+      slot = (file_id + i) % NS_STATS_FILES;
+
+      if (lib->file_stats[slot].key == key ||
+          (lib->file_stats[slot].key == 0 &&
+           (ns_atomic_cas (&lib->file_stats[slot].key, 0, key) ||
+            lib->file_stats[slot].key == key)))
+        return &lib->file_stats[slot];
+    }
+
+  return NULL;
+}
+
+static void
+nslib_stats_record (NsLibrary *lib,
+                    uint32     file_id,
+                    int        function,
+                    uint64_t   start,
+                    ns_RESULT  res,
+                    uint64_t   bytes)
+{
+  NsFileStats *file_stats;
+  uint64_t     ns = ns_time_ns () - start;
+
+  nscall_stats_add (&lib->stats[function], ns, res, bytes);
+
+  if (file_id == NS_NO_FILE)
+    return;
+
+  file_stats = nslib_file_stats (lib, file_id);
+
+  if (file_stats != NULL)
+    nscall_stats_add (&file_stats->calls[function], ns, res, bytes);
+}
+
+/* Call into the vendor library honoring its locking policy, NS_CALL for
+ * functions that operate on an open file, NS_LIB_CALL for the others.
+ * NS_CALL_BYTES also accounts the size of the returned data, _bytes is
+ * evaluated after the call. The time spent waiting for the lock is not
+ * included in the statistics.
+ * The GIL should be released by the caller (Py_BEGIN_ALLOW_THREADS). */
+#define NS_CALL_BYTES(_res, _lib, _file_id, _bytes, _function, ...)     \
+  do {                                                                  \
+    NsMutex *_mutex = nslib_lock_file (_lib, _file_id);                 \
+    int      _stats = ns_stats_enabled;                                 \
+    uint64_t _start = _stats ? ns_time_ns () : 0;                       \
+    _res = NS_VENDOR_CALL (_lib, _function, __VA_ARGS__);               \
+    nslib_unlock (_mutex);                                              \
+    if (_stats)                                                         \
+      nslib_stats_record (_lib, _file_id, NS_FN_##_function, _start,    \
+                          _res, _res == ns_OK ? (uint64_t) (_bytes) : 0); \
+  } while (0)
+
+/* Bytes of the samples an ns_GetAnalogData call for _count of them
+ * returned (its continuous count _cont), for NS_CALL_BYTES */
+#define NS_ANALOG_BYTES(_cont, _count)                                  \
+  ((uint64_t) ((_cont) < (_count) ? (_cont) : (_count)) * sizeof (double))
+
+#define NS_CALL(_res, _lib, _file_id, _function, ...)                   \
+  NS_CALL_BYTES (_res, _lib, _file_id, 0, _function, __VA_ARGS__)
+
+#define NS_LIB_CALL(_res, _lib, _function, ...)                         \
+  do {                                                                  \
+    NsMutex *_mutex = nslib_lock_library (_lib);                        \
+    int      _stats = ns_stats_enabled;                                 \
+    uint64_t _start = _stats ? ns_time_ns () : 0;                       \
+    _res = NS_VENDOR_CALL (_lib, _function, __VA_ARGS__);               \
+    nslib_unlock (_mutex);                                              \
+    if (_stats)                                                         \
+      nslib_stats_record (_lib, NS_NO_FILE, NS_FN_##_function, _start,  \
+                          _res, 0);                                     \
+  } while (0)
+
+uint8
+uint8_from_data (void *data, size_t data_len)
+{
+  uint8 ret;
+  
+  if (data_len == 1)
+    {
+      memcpy (&ret, data, 1);
+    }
+  else if (data_len == 2)
+    {
+      uint16 u16;
+      memcpy (&u16, data, 2);
+      ret = (uint8) u16;
+    }
+  else if (data_len == 4)
+    {
+      uint32 u32;
+      memcpy (&u32, data, 4);
+      ret = (uint8) u32;
+    }
+  else
+    {
+      ret = 0;
+    }
+  
+  return ret;
+}
+
+static uint16
+uint16_from_data (void *data, size_t data_len)
+{
+  uint16 ret;
+  
+  if (data_len == 1)
+    {
+      uint8 u8;
+      memcpy (&u8, data, 1);
+      ret = (uint16) u8;
+    }
+  else if (data_len == 2)
+    {
+      memcpy (&ret, data, 2);
+    }
+  else if (data_len == 4)
+    {
+      uint32 u32;
+      memcpy (&u32, data, 4);
+      ret =  (uint16) u32;
+    }
+  else
+    {
+      ret = 0;
+    }
+  
+  return ret;
+}
+
+static uint32
+uint32_from_data (void *data, size_t data_len)
+{
+  uint32 ret;
+  
+  if (data_len == 1)
+    {
+      uint8 u8;
+      memcpy (&u8, data, 1);
+      ret = (uint32) u8;
+    }
+  else if (data_len == 2)
+    {
+      uint16 u16;
+      memcpy (&u16, data, 2);
+      ret =  (uint32) u16;
+    }
+  else if (data_len == 4)
+    {
+      memcpy (&ret, data, 4);
+    }
+  else
+    {
+      ret = 0;
+    }
+  
+  return ret;
+}
+
+/* Raise the error res of lib, with the message of the library (or
+ * NULL if there is none) */
+static void
+raise_result_error (ns_RESULT res, NsLibrary *lib, const char *msg)
+{
+  if (ns_stats_enabled)
+    ns_atomic_add (&lib->errors_raised, 1);
+
+  if (msg != NULL)
+    PyErr_Format (PgError, "Neuroshare-Error (%d): %s", res, msg);
+  else
+    PyErr_Format (PgError, "Internal Neuroshare-Error: %d", res);
+}
+
+static int
+check_result_is_error (ns_RESULT res, NsLibrary *lib)
+{
+  char buf[1024] = {0, };
+  ns_RESULT err_res;
+
+  if (res == ns_OK)
+    return 0;
+
+  Py_BEGIN_ALLOW_THREADS
+  NS_LIB_CALL (err_res, lib, GetLastErrorMsg, buf, sizeof (buf));
+  Py_END_ALLOW_THREADS
+
+  raise_result_error (res, lib, err_res == ns_OK ? buf : NULL);
+  return 1;
+}
+
+static int
+dict_set_item_eat_ref (PyObject *dict, const char *string, PyObject *item)
+{
+  int res;
+
+  res = PyDict_SetItemString (dict, string, item);
+  Py_DECREF (item);
+
+  return res;
+}
+
+/* Check that a caller provided output array can be written to directly:
+ * it must be an aligned, writable, C-contiguous array of type_num with
+ * room for at least size items. Returns a borrowed reference. */
+static PyArrayObject *
+check_out_array (PyObject *out, int type_num, npy_intp size)
+{
+  PyArrayObject *array;
+
+  if (!PyArray_Check (out))
+    {
+      PyErr_SetString (PyExc_TypeError, "out must be a numpy.ndarray");
+      return NULL;
+    }
+
+  array = (PyArrayObject *) out;
+
+  if (PyArray_TYPE (array) != type_num)
+    {
+      PyErr_SetString (PyExc_TypeError, "out has the wrong dtype");
+      return NULL;
+    }
+
+  if (!PyArray_ISCARRAY (array))
+    {
+      PyErr_SetString (PyExc_ValueError, "out must be a writable, C-contiguous array");
+      return NULL;
+    }
+
+  if (PyArray_SIZE (array) < size)
+    {
+      PyErr_Format (PyExc_ValueError, "out is too small (%ld < %ld items)",
+                    (long) PyArray_SIZE (array), (long) size);
+      return NULL;
+    }
+
+  return array;
+}
+
+/* ************************************************************************** */
+
+#ifndef _WIN32
+#define GetProcAddress dlsym
+#endif
+
+#define PROC_ADDR(_struct, _function, _variable) \
+  _struct->_variable = (_function) GetProcAddress (_struct->dl_handle, "ns_" #_variable); \
+  if (_struct->_variable == NULL)					    \
+    {                                                                       \
+      PyErr_Format (PgError, "Could not lookup function: %s", #_variable);  \
+      return -1;                                                            \
+    }
+
+static int
+dl_assign_pointers (NsLibrary *lib)
+{
+  PROC_ADDR (lib, NS_GETLIBRARYINFO, GetLibraryInfo);
+  PROC_ADDR (lib, NS_OPENFILE, OpenFile);
+  PROC_ADDR (lib, NS_CLOSEFILE, CloseFile);
+  PROC_ADDR (lib, NS_GETFILEINFO, GetFileInfo);
+  PROC_ADDR (lib, NS_GETENTITYINFO, GetEntityInfo);
+  PROC_ADDR (lib, NS_GETEVENTINFO, GetEventInfo);
+  PROC_ADDR (lib, NS_GETEVENTDATA, GetEventData);
+  PROC_ADDR (lib, NS_GETANALOGINFO, GetAnalogInfo);
+  PROC_ADDR (lib, NS_GETANALOGDATA, GetAnalogData);
+  PROC_ADDR (lib, NS_GETSEGMENTINFO, GetSegmentInfo);
+  PROC_ADDR (lib, NS_GETSEGMENTSOURCEINFO, GetSegmentSourceInfo);
+  PROC_ADDR (lib, NS_GETSEGMENTDATA, GetSegmentData);
+  PROC_ADDR (lib, NS_GETNEURALINFO, GetNeuralInfo);
+  PROC_ADDR (lib, NS_GETNEURALDATA, GetNeuralData);
+  PROC_ADDR (lib, NS_GETINDEXBYTIME, GetIndexByTime);
+  PROC_ADDR (lib, NS_GETINDEXBYTIME, GetIndexByTime);
+  PROC_ADDR (lib, NS_GETTIMEBYINDEX, GetTimeByIndex);
+  PROC_ADDR (lib, NS_GETLASTERRORMSG, GetLastErrorMsg);
+
+  return 0;
+}
+
+static void
+dl_set_error (const char *message)
+{
+#ifdef _WIN32
+  DWORD  last_error;
+  DWORD  res;
+  LPVOID buf_msg;
+  char   buf_str[1024] = {0,};
+
+  last_error = GetLastError ();
+
+  res = FormatMessage (FORMAT_MESSAGE_ALLOCATE_BUFFER |
+                       FORMAT_MESSAGE_FROM_SYSTEM |
+                       FORMAT_MESSAGE_IGNORE_INSERTS,
+                       NULL,
+                       last_error,
+                       MAKELANGID (LANG_NEUTRAL, SUBLANG_DEFAULT),
+                       (LPTSTR) &buf_msg,
+                       0, NULL);
+
+  if (res > 0)
     res = WideCharToMultiByte (CP_ACP, 0, buf_msg, -1,
                                buf_str, sizeof (buf_str),
                                NULL, NULL);
 
-  if (res == 0)
-    _snprintf (buf_str, sizeof (buf_str), "%s",
-               "Internal error");
+  if (res == 0)
+    _snprintf (buf_str, sizeof (buf_str), "%s",
+               "Internal error");
+
+  PyErr_Format (PgError, "%s: %s", message, buf_str);
+  LocalFree (buf_msg);
+#else
+  PyErr_Format (PgError, "%s: %s", message, dlerror ());
+#endif
+}
+
+#ifdef _WIN32
+static int
+dl_load_library_win32 (const char *filename, NsLibrary *lib)
+{
+  HMODULE handle;
+
+  /* FIXME: set errors */
+  handle = LoadLibraryEx (filename, 0, 0);
+
+  if (handle == NULL)
+    return -1;
+
+  lib->dl_handle = handle;
+
+  return 0;
+}
+
+#else
+
+static int
+dl_load_library_unix (const char *filename, int lazy, NsLibrary *lib)
+{
+   int         flags;
+   void       *dlh;
+
+  /* lazy binding defers the symbol resolution to the first call */
+  flags = lazy ? RTLD_LAZY : RTLD_NOW;
+
+  dlh = dlopen (filename, flags);
+
+  if (dlh == NULL)
+    return -1;
+
+  lib->dl_handle = dlh;
+
+  return 0;
+}
+#endif
+
+/* New library without a backend, with its locks set up */
+static NsLibrary *
+nslib_new (void)
+{
+  NsLibrary *lib;
+  int i;
+
+  lib = calloc (1, sizeof (NsLibrary));
+
+  if (lib == NULL)
+    {
+      PyErr_NoMemory ();
+      return NULL;
+    }
+
+  lib->lock_policy = NS_LOCK_GLOBAL;
+  ns_mutex_init (&lib->lib_lock);
+  ns_mutex_init (&lib->scratch_lock);
+
+  for (i = 0; i < NS_FILE_LOCKS; i++)
+    ns_mutex_init (&lib->file_locks[i]);
+
+  return lib;
+}
+
+static void
+nslib_free (NsLibrary *lib)
+{
+  int i;
+
+  ns_mutex_clear (&lib->lib_lock);
+
+  for (i = 0; i < NS_FILE_LOCKS; i++)
+    ns_mutex_clear (&lib->file_locks[i]);
+
+  for (i = 0; i < lib->n_scratch; i++)
+    free (lib->scratch[i]);
+  ns_mutex_clear (&lib->scratch_lock);
+
+  free (lib->path);
+  free (lib);
+}
+
+static NsLibrary *
+dl_load_library (const char *filename, int lazy)
+{
+  int res;
+  NsLibrary *lib;
+
+  lib = nslib_new ();
+
+  if (lib == NULL)
+    return NULL;
+
+#ifdef _WIN32
+  res = dl_load_library_win32 (filename, lib);
+#else
+  res = dl_load_library_unix (filename, lazy, lib);
+#endif
+
+  if (res != 0)
+    {
+      dl_set_error ("Could not load library");
+      nslib_free (lib);
+      return NULL;
+    }
+
+  return lib;
+}
+
+static int
+dl_unload_library (NsLibrary *lib)
+{
+  int res;
+
+#ifndef _WIN32
+  if (lib->remote != NULL)
+    {
+      nsremote_free (lib->remote);
+      nslib_free (lib);
+      return 0;
+    }
+#endif
+
+#ifdef _WIN32
+  res = ! FreeLibrary (lib->dl_handle);
+#else
+  res = dlclose (lib->dl_handle);
+#endif
+
+  if (res != 0)
+    dl_set_error ("Could not unload library");
+
+  nslib_free (lib);
+  return res;
+}
+
+/* Canonical path of filename (symlinks resolved), to be free'd */
+static char *
+library_resolve_path (const char *filename)
+{
+  char *path;
+
+#ifdef _WIN32
+  path = _fullpath (NULL, filename, 0);
+#else
+  path = realpath (filename, NULL);
+#endif
+
+  if (path == NULL)
+    path = strdup (filename);
+
+  return path;
+}
+
+static NsLibrary *
+library_registry_lookup (const char *path)
+{
+  NsLibrary *lib;
+
+  for (lib = library_registry; lib != NULL; lib = lib->next)
+    if (strcmp (lib->path, path) == 0)
+      return lib;
+
+  return NULL;
+}
+
+static void
+library_registry_remove (NsLibrary *lib)
+{
+  NsLibrary **iter;
+
+  for (iter = &library_registry; *iter != NULL;
+       iter = (NsLibrary **) &(*iter)->next)
+    if (*iter == lib)
+      {
+        *iter = lib->next;
+        break;
+      }
+}
+
+static int
+check_lock_policy (int policy)
+{
+  if (policy == NS_LOCK_NONE || policy == NS_LOCK_FILE || policy == NS_LOCK_GLOBAL)
+    return 0;
+
+  PyErr_Format (PyExc_ValueError, "Unknown locking policy: %d", policy);
+  return -1;
+}
+
+/* Whether a library from the registry can be handed out for a request
+ * with the (explicitly given, i.e. non-negative) lock policy and lazy
+ * flag: the lock policy is shared, so a different one is an error; the
+ * symbols of a lazily loaded library stay unresolved until used, which
+ * only warrants a warning. */
+static int
+library_check_shared (NsLibrary *lib, int policy, int lazy)
+{
+  if (policy >= 0 && policy != lib->lock_policy)
+    {
+      PyErr_Format (PgError,
+                    "Library %s is already loaded with lock policy %d",
+                    lib->path, lib->lock_policy);
+      return -1;
+    }
+
+  if (lazy == 0 && lib->lazy)
+    {
+      char msg[512];
+
+      snprintf (msg, sizeof (msg),
+                "Library %s is already loaded with lazy binding", lib->path);
+      return PyErr_WarnEx (PyExc_RuntimeWarning, msg, 1);
+    }
+
+  return 0;
+}
+
+/* Libraries are shared: opening a library that is already loaded (no
+ * matter via which path) only increases its reference count, i.e. the
+ * dlopen and the initialization of the vendor library happen once per
+ * process. Because of that a process that loaded its libraries before
+ * forking hands them down to its children. */
+static PyObject *
+library_open (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"filename", "lock_policy", "lazy", NULL};
+  NsLibrary  *lib;
+  PyObject   *lib_handle;
+  const char *filename;
+  char       *path;
+  int         policy = -1;
+  int         lazy = -1;
+  int         res;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "s|ii", kwlist,
+                                    &filename, &policy, &lazy))
+    return NULL;
+
+  if (policy >= 0 && check_lock_policy (policy) != 0)
+    return NULL;
+
+  path = library_resolve_path (filename);
+
+  if (path == NULL)
+    return PyErr_NoMemory ();
+
+  lib = library_registry_lookup (path);
+
+  if (lib != NULL)
+    {
+      free (path);
+
+      if (library_check_shared (lib, policy, lazy) != 0)
+        return NULL;
+
+      lib->refcount++;
+      return PyCapsule_New (lib, "capi", NULL);
+    }
+
+  lib = dl_load_library (path, lazy > 0);
+
+  if (lib == NULL)
+    {
+      free (path);
+      return NULL;
+    }
+
+  lib->lock_policy = policy >= 0 ? policy : NS_LOCK_GLOBAL;
+  lib->lazy = lazy > 0;
+  lib->path = path;
+
+  res = dl_assign_pointers (lib);
+
+  if (res != 0)
+    {
+      dl_unload_library (lib);
+      return NULL;
+    }
+
+  lib_handle = PyCapsule_New (lib, "capi", NULL);
+
+  if (lib_handle == NULL)
+    {
+      dl_unload_library (lib);
+      return NULL;
+    }
+
+  lib->refcount = 1;
+  lib->next = library_registry;
+  library_registry = lib;
+
+  return lib_handle;
+}
+
+/* Library whose calls go to the reader servers at address (several of
+ * them separated by commas, cf. nspy_server.c), instead of a vendor
+ * library loaded into this process. Like loaded libraries, connections
+ * to the same address are shared. */
+static PyObject *
+library_connect (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"address", "lock_policy", NULL};
+  NsLibrary  *lib;
+  PyObject   *lib_handle;
+  const char *address;
+  char       *path;
+  int         policy = -1;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "s|i", kwlist,
+                                    &address, &policy))
+    return NULL;
+
+  if (policy >= 0 && check_lock_policy (policy) != 0)
+    return NULL;
+
+#ifdef _WIN32
+  PyErr_SetString (PgError, "Reader servers are not supported on this platform");
+  return NULL;
+#else
+  path = malloc (strlen (address) + 8);
+
+  if (path == NULL)
+    return PyErr_NoMemory ();
+
+  sprintf (path, "remote:%s", address);
+  lib = library_registry_lookup (path);
+
+  if (lib != NULL)
+    {
+      free (path);
+
+      if (library_check_shared (lib, policy, -1) != 0)
+        return NULL;
+
+      lib->refcount++;
+      return PyCapsule_New (lib, "capi", NULL);
+    }
+
+  lib = nslib_new ();
+
+  if (lib == NULL)
+    {
+      free (path);
+      return NULL;
+    }
+
+  lib->lock_policy = policy >= 0 ? policy : NS_LOCK_NONE;
+  lib->path = path;
+
+  Py_BEGIN_ALLOW_THREADS
+  lib->remote = nsremote_new (address);
+  Py_END_ALLOW_THREADS
+
+  if (lib->remote == NULL)
+    {
+      PyErr_Format (PgError, "%s (%s)", nsremote_error, address);
+      nslib_free (lib);
+      return NULL;
+    }
+
+  lib_handle = PyCapsule_New (lib, "capi", NULL);
+
+  if (lib_handle == NULL)
+    {
+      dl_unload_library (lib);
+      return NULL;
+    }
+
+  lib->refcount = 1;
+  lib->next = library_registry;
+  library_registry = lib;
+
+  return lib_handle;
+#endif
+}
+
+/************* python3 function redefinition*********/ 
+#if PY_MAJOR_VERSION >= 3
+#define PyString_FromString(mystring) PyUnicode_FromString(mystring)
+#define PyString_FromStringAndSize(buffer, data_ret_size) PyUnicode_FromStringAndSize(buffer, data_ret_size)
+#define PyInt_AsUnsignedLongMask(integer) PyLong_AsUnsignedLongMask(integer)
+#define PyInt_FromLong(integer) PyLong_FromLong(integer)
+#define PyInt_Check(integer) PyLong_Check(integer)
+#define init_capi(void) PyInit__capi(void)
+#endif
+
+/* Drop a reference to lib (with the GIL held), unloading it with the
+ * last one; returns non-zero if unloading failed */
+static int
+library_release (NsLibrary *lib)
+{
+  if (--lib->refcount > 0)
+    return 0;
+
+  library_registry_remove (lib);
+  return dl_unload_library (lib);
+}
+
+static PyObject *
+library_close (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  PyObject  *cobj;
+  NsLibrary *lib;
+  int        res;
+
+  if (!PyArg_ParseTuple (args, "O", &cobj))
+    return NULL;
+
+
+  if (!PyCapsule_CheckExact (cobj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Expected NsLibrary type");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+
+  if (lib == NULL)
+    return NULL;
+
+  res = library_release (lib);
+
+  if (res != 0)
+    return NULL;
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+library_registry_list (PyObject *self, PyObject *args)
+{
+  PyObject  *dict;
+  PyObject  *count;
+  NsLibrary *lib;
+
+  dict = PyDict_New ();
+
+  if (dict == NULL)
+    return NULL;
+
+  for (lib = library_registry; lib != NULL; lib = lib->next)
+    {
+      count = PyInt_FromLong (lib->refcount);
+
+      if (count == NULL || PyDict_SetItemString (dict, lib->path, count) != 0)
+        {
+          Py_XDECREF (count);
+          Py_DECREF (dict);
+          return NULL;
+        }
+
+      Py_DECREF (count);
+    }
+
+  return dict;
+}
+
+/* {function name: {calls, ns, bytes, errors}} of the functions called */
+static PyObject *
+call_stats_to_dict (NsCallStats *stats)
+{
+  PyObject *dict;
+  PyObject *item;
+  int       i;
+
+  dict = PyDict_New ();
+
+  if (dict == NULL)
+    return NULL;
+
+  for (i = 0; i < NS_FN_COUNT; i++)
+    {
+      if (stats[i].calls == 0)
+        continue;
+
+      item = Py_BuildValue ("{s:K,s:K,s:K,s:K}",
+                            "calls", (unsigned long long) stats[i].calls,
+                            "ns", (unsigned long long) stats[i].ns,
+                            "bytes", (unsigned long long) stats[i].bytes,
+                            "errors", (unsigned long long) stats[i].errors);
+
+      if (item == NULL || dict_set_item_eat_ref (dict, ns_function_names[i], item))
+        {
+          Py_DECREF (dict);
+          return NULL;
+        }
+    }
+
+  return dict;
+}
+
+/* defined with the worker pool, whose lock protects the statistics */
+static void pool_sched_stats (NsLibrary *lib, NsSchedStats *stats, int reset);
+
+/* The counters of the reads queued on the worker pool, plus the number
+ * of requests per vendor read (coalescing) and their mean latency */
+static PyObject *
+sched_stats_to_dict (NsSchedStats *stats)
+{
+  uint64_t requests = stats->requests;
+  uint64_t reads = stats->reads;
+  uint64_t ns = stats->ns;
+
+  return Py_BuildValue ("{s:I,s:I,s:K,s:K,s:d,s:K,s:K,s:d}",
+                        "queued", (unsigned int) stats->queued,
+                        "max_queued", (unsigned int) stats->max_queued,
+                        "requests", (unsigned long long) requests,
+                        "reads", (unsigned long long) reads,
+                        "coalescing", reads > 0 ? (double) requests / reads : 1.0,
+                        "ns", (unsigned long long) ns,
+                        "max_ns", (unsigned long long) stats->max_ns,
+                        "mean_ns", requests > 0 ? (double) ns / requests : 0.0);
+}
+
+static PyObject *
+library_stats (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"library", "reset", NULL};
+  PyObject    *cobj;
+  PyObject    *result;
+  PyObject    *calls;
+  PyObject    *sched_dict;
+  PyObject    *files;
+  PyObject    *item;
+  PyObject    *key;
+  NsLibrary   *lib;
+  NsSchedStats sched;
+  int          reset = 0;
+  int          i;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "O|i", kwlist, &cobj, &reset))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Expected NsLibrary type");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  pool_sched_stats (lib, &sched, reset);
+
+  calls = call_stats_to_dict (lib->stats);
+  sched_dict = sched_stats_to_dict (&sched);
+  files = PyDict_New ();
+
+  if (calls == NULL || sched_dict == NULL || files == NULL)
+    {
+      Py_XDECREF (calls);
+      Py_XDECREF (sched_dict);
+      Py_XDECREF (files);
+      return NULL;
+    }
+
+  result = Py_BuildValue ("{s:N,s:O,s:K,s:O,s:O}",
+                          "enabled", PyBool_FromLong (ns_stats_enabled),
+                          "calls", calls,
+                          "errors_raised", (unsigned long long) lib->errors_raised,
+                          "files", files,
+                          "scheduler", sched_dict);
+  Py_DECREF (calls);
+  Py_DECREF (sched_dict);
+  Py_DECREF (files);
+
+  if (result == NULL)
+    return NULL;
+
+  for (i = 0; i < NS_STATS_FILES; i++)
+    {
+      if (lib->file_stats[i].key == 0)
+        continue;
+
+      key = PyInt_FromLong (lib->file_stats[i].key - 1);
+      item = call_stats_to_dict (lib->file_stats[i].calls);
+
+      if (key == NULL || item == NULL || PyDict_SetItem (files, key, item))
+        {
+          Py_XDECREF (key);
+          Py_XDECREF (item);
+          Py_DECREF (result);
+          return NULL;
+        }
+
+      Py_DECREF (key);
+      Py_DECREF (item);
+    }
+
+  /* counters of calls still in flight may get lost */
+  if (reset)
+    {
+      memset ((void *) lib->stats, 0, sizeof (lib->stats));
+      memset ((void *) lib->file_stats, 0, sizeof (lib->file_stats));
+      lib->errors_raised = 0;
+    }
+
+  return result;
+}
+
+static PyObject *
+library_stats_enable (PyObject *self, PyObject *args)
+{
+  int enabled;
+  int previous = ns_stats_enabled;
+
+  if (!PyArg_ParseTuple (args, "i", &enabled))
+    return NULL;
+
+  ns_stats_enabled = enabled != 0;
+
+  return PyBool_FromLong (previous);
+}
+
+static PyObject *
+library_set_lock_policy (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  PyObject  *cobj;
+  NsLibrary *lib;
+  int        policy;
+
+  if (!PyArg_ParseTuple (args, "Oi", &cobj, &policy))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Expected NsLibrary type");
+      return NULL;
+    }
+
+  if (check_lock_policy (policy) != 0)
+    return NULL;
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  lib->lock_policy = policy;
+
+  Py_RETURN_NONE;
+}
+
+/* (lock policy, reference count) of a library handle; a count above one
+ * means the library is shared with other handles (cf. library_open) */
+static PyObject *
+library_get_state (PyObject *self, PyObject *args)
+{
+  PyObject  *cobj;
+  NsLibrary *lib;
+
+  if (!PyArg_ParseTuple (args, "O", &cobj))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Expected NsLibrary type");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  return Py_BuildValue ("(ii)", lib->lock_policy, lib->refcount);
+}
+
+/* ************************************************************************** */
+/* Metadata: the raw info structs of the vendor library, with the fields
+ * decoded on access (as items, like the dicts returned before, or as
+ * attributes). The raw bytes are exposed via the buffer protocol. */
+
+#define NS_META_UINT32  0
+#define NS_META_DOUBLE  1
+#define NS_META_STRING  2
+
+typedef struct {
+  const char *name;
+  int         kind;
+  size_t      offset;
+  size_t      size;
+} NsMetaField;
+
+#define NS_META(_struct, _kind, _name, _member)                          \
+  { _name, NS_META_##_kind, offsetof (_struct, _member),                \
+    sizeof (((_struct *) 0)->_member) }
+
+static const NsMetaField library_info_fields[] = {
+  NS_META (ns_LIBRARYINFO, STRING, "Description", szDescription),
+  NS_META (ns_LIBRARYINFO, STRING, "Creator", szCreator),
+  NS_META (ns_LIBRARYINFO, UINT32, "LibVersionMaj", dwLibVersionMaj),
+  NS_META (ns_LIBRARYINFO, UINT32, "LibVersionMin", dwLibVersionMin),
+  NS_META (ns_LIBRARYINFO, UINT32, "APIVersionMaj", dwAPIVersionMaj),
+  NS_META (ns_LIBRARYINFO, UINT32, "APIVersionMin", dwAPIVersionMin),
+  NS_META (ns_LIBRARYINFO, UINT32, "Time_Year", dwTime_Year),
+  NS_META (ns_LIBRARYINFO, UINT32, "Time_Month", dwTime_Month),
+  NS_META (ns_LIBRARYINFO, UINT32, "Time_Day", dwTime_Day),
+  NS_META (ns_LIBRARYINFO, UINT32, "MaxFiles", dwMaxFiles),
+  NS_META (ns_LIBRARYINFO, UINT32, "Flags", dwFlags),
+  { NULL, 0, 0, 0 }
+};
+
+static const NsMetaField file_info_fields[] = {
+  NS_META (ns_FILEINFO, STRING, "FileType", szFileType),
+  NS_META (ns_FILEINFO, STRING, "AppName", szAppName),
+  NS_META (ns_FILEINFO, STRING, "FileComment", szFileComment),
+  NS_META (ns_FILEINFO, UINT32, "EntityCount", dwEntityCount),
+  NS_META (ns_FILEINFO, DOUBLE, "TimeStampResolution", dTimeStampResolution),
+  NS_META (ns_FILEINFO, DOUBLE, "TimeSpan", dTimeSpan),
+  NS_META (ns_FILEINFO, UINT32, "Time_Year", dwTime_Year),
+  NS_META (ns_FILEINFO, UINT32, "Time_Month", dwTime_Month),
+  NS_META (ns_FILEINFO, UINT32, "Time_Day", dwTime_Day),
+  NS_META (ns_FILEINFO, UINT32, "Time_Hour", dwTime_Hour),
+  NS_META (ns_FILEINFO, UINT32, "Time_Min", dwTime_Min),
+  NS_META (ns_FILEINFO, UINT32, "Time_Sec", dwTime_Sec),
+  NS_META (ns_FILEINFO, UINT32, "Time_MilliSec", dwTime_MilliSec),
+  { NULL, 0, 0, 0 }
+};
+
+static const NsMetaField entity_info_fields[] = {
+  NS_META (ns_ENTITYINFO, STRING, "EntityLabel", szEntityLabel),
+  NS_META (ns_ENTITYINFO, UINT32, "EntityType", dwEntityType),
+  NS_META (ns_ENTITYINFO, UINT32, "ItemCount", dwItemCount),
+  { NULL, 0, 0, 0 }
+};
+
+static const NsMetaField event_info_fields[] = {
+  NS_META (ns_EVENTINFO, UINT32, "EventType", dwEventType),
+  NS_META (ns_EVENTINFO, UINT32, "MinDataLength", dwMinDataLength),
+  NS_META (ns_EVENTINFO, UINT32, "MaxDataLength", dwMaxDataLength),
+  NS_META (ns_EVENTINFO, STRING, "CSVDesc", szCSVDesc),
+  { NULL, 0, 0, 0 }
+};
+
+static const NsMetaField analog_info_fields[] = {
+  NS_META (ns_ANALOGINFO, DOUBLE, "SampleRate", dSampleRate),
+  NS_META (ns_ANALOGINFO, DOUBLE, "MinVal", dMinVal),
+  NS_META (ns_ANALOGINFO, DOUBLE, "MaxVal", dMaxVal),
+  NS_META (ns_ANALOGINFO, STRING, "Units", szUnits),
+  NS_META (ns_ANALOGINFO, DOUBLE, "Resolution", dResolution),
+  NS_META (ns_ANALOGINFO, DOUBLE, "LocationX", dLocationX),
+  NS_META (ns_ANALOGINFO, DOUBLE, "LocationY", dLocationY),
+  NS_META (ns_ANALOGINFO, DOUBLE, "LocationZ", dLocationZ),
+  NS_META (ns_ANALOGINFO, DOUBLE, "LocationUser", dLocationUser),
+  NS_META (ns_ANALOGINFO, DOUBLE, "HighFreqCorner", dHighFreqCorner),
+  NS_META (ns_ANALOGINFO, UINT32, "HighFreqOrder", dwHighFreqOrder),
+  NS_META (ns_ANALOGINFO, STRING, "HighFilterType", szHighFilterType),
+  NS_META (ns_ANALOGINFO, DOUBLE, "LowFreqCorner", dLowFreqCorner),
+  NS_META (ns_ANALOGINFO, UINT32, "LowFreqOrder", dwLowFreqOrder),
+  NS_META (ns_ANALOGINFO, STRING, "LowFilterType", szLowFilterType),
+  NS_META (ns_ANALOGINFO, STRING, "ProbeInfo", szProbeInfo),
+  { NULL, 0, 0, 0 }
+};
+
+static const NsMetaField segment_info_fields[] = {
+  NS_META (ns_SEGMENTINFO, UINT32, "SourceCount", dwSourceCount),
+  NS_META (ns_SEGMENTINFO, UINT32, "MinSampleCount", dwMinSampleCount),
+  NS_META (ns_SEGMENTINFO, UINT32, "MaxSampleCount", dwMaxSampleCount),
+  NS_META (ns_SEGMENTINFO, DOUBLE, "SampleRate", dSampleRate),
+  NS_META (ns_SEGMENTINFO, STRING, "Units", szUnits),
+  { NULL, 0, 0, 0 }
+};
+
+static const NsMetaField source_info_fields[] = {
+  NS_META (ns_SEGSOURCEINFO, DOUBLE, "MinVal", dMinVal),
+  NS_META (ns_SEGSOURCEINFO, DOUBLE, "MaxVal", dMaxVal),
+  NS_META (ns_SEGSOURCEINFO, DOUBLE, "SubSampleShift", dSubSampleShift),
+  NS_META (ns_SEGSOURCEINFO, DOUBLE, "Resolution", dResolution),
+  NS_META (ns_SEGSOURCEINFO, DOUBLE, "LocationX", dLocationX),
+  NS_META (ns_SEGSOURCEINFO, DOUBLE, "LocationY", dLocationY),
+  NS_META (ns_SEGSOURCEINFO, DOUBLE, "LocationZ", dLocationZ),
+  NS_META (ns_SEGSOURCEINFO, DOUBLE, "LocationUser", dLocationUser),
+  NS_META (ns_SEGSOURCEINFO, DOUBLE, "HighFreqCorner", dHighFreqCorner),
+  NS_META (ns_SEGSOURCEINFO, UINT32, "HighFreqOrder", dwHighFreqOrder),
+  NS_META (ns_SEGSOURCEINFO, STRING, "HighFilterType", szHighFilterType),
+  NS_META (ns_SEGSOURCEINFO, DOUBLE, "LowFreqCorner", dLowFreqCorner),
+  NS_META (ns_SEGSOURCEINFO, UINT32, "LowFreqOrder", dwLowFreqOrder),
+  NS_META (ns_SEGSOURCEINFO, STRING, "LowFilterType", szLowFilterType),
+  NS_META (ns_SEGSOURCEINFO, STRING, "ProbeInfo", szProbeInfo),
+  { NULL, 0, 0, 0 }
+};
+
+static const NsMetaField neural_info_fields[] = {
+  NS_META (ns_NEURALINFO, UINT32, "SourceEntityID", dwSourceEntityID),
+  NS_META (ns_NEURALINFO, UINT32, "SourceUnitID", dwSourceUnitID),
+  NS_META (ns_NEURALINFO, STRING, "ProbeInfo", szProbeInfo),
+  { NULL, 0, 0, 0 }
+};
+
+#define NS_META_PARTS 2
+
+typedef struct {
+  PyObject_VAR_HEAD
+  const NsMetaField *fields[NS_META_PARTS];  /* per struct, may be NULL */
+  Py_ssize_t         base[NS_META_PARTS];    /* offset of each struct */
+  PyObject          *extra;                  /* further items, or NULL */
+  double             data[1];                /* the structs (aligned) */
+} NsMetadata;
+
+static PyTypeObject NsMetadataType;
+
+/* New metadata of one or two (s1 may be NULL) info structs */
+static PyObject *
+metadata_new (const NsMetaField *f0, const void *s0, size_t n0,
+              const NsMetaField *f1, const void *s1, size_t n1)
+{
+  NsMetadata *meta;
+  size_t      base1;
+
+  base1 = (n0 + sizeof (double) - 1) / sizeof (double) * sizeof (double);
+  meta = PyObject_NewVar (NsMetadata, &NsMetadataType,
+                          (Py_ssize_t) (base1 + (s1 ? n1 : 0)));
+
+  if (meta == NULL)
+    return NULL;
+
+  meta->fields[0] = f0;
+  meta->base[0] = 0;
+  meta->fields[1] = s1 ? f1 : NULL;
+  meta->base[1] = (Py_ssize_t) base1;
+  meta->extra = NULL;
+
+  memcpy (meta->data, s0, n0);
+  if (s1 != NULL)
+    memcpy ((char *) meta->data + base1, s1, n1);
+
+  return (PyObject *) meta;
+}
+
+/* Set an item that is not part of the structs (takes the reference) */
+static int
+metadata_set_extra (PyObject *obj, const char *name, PyObject *value)
+{
+  NsMetadata *meta = (NsMetadata *) obj;
+
+  if (value == NULL)
+    return -1;
+
+  if (meta->extra == NULL && (meta->extra = PyDict_New ()) == NULL)
+    {
+      Py_DECREF (value);
+      return -1;
+    }
+
+  return dict_set_item_eat_ref (meta->extra, name, value);
+}
+
+static PyObject *
+metadata_decode (NsMetadata *meta, int part, const NsMetaField *field)
+{
+  const char *p = (const char *) meta->data + meta->base[part] + field->offset;
+  size_t      len;
+  uint32      u32;
+  double      d;
+
+  switch (field->kind)
+    {
+    case NS_META_UINT32:
+      memcpy (&u32, p, sizeof (u32));
+      return PyInt_FromLong (u32);
+
+    case NS_META_DOUBLE:
+      memcpy (&d, p, sizeof (d));
+      return PyFloat_FromDouble (d);
+
+    default:
+      for (len = 0; len < field->size && p[len] != '\0'; len++)
+        ;
+      return PyString_FromStringAndSize (p, len);
+    }
+}
+
+static const char *
+metadata_key (PyObject *key)
+{
+#if PY_MAJOR_VERSION >= 3
+  if (PyUnicode_Check (key))
+    return PyUnicode_AsUTF8 (key);
+#else
+  if (PyString_Check (key))
+    return PyString_AsString (key);
+#endif
+  return NULL;
+}
+
+/* The value of key (a new reference), or NULL without an exception set
+ * if there is no such item */
+static PyObject *
+metadata_lookup (NsMetadata *meta, PyObject *key)
+{
+  const NsMetaField *field;
+  const char        *name;
+  PyObject          *value;
+  int                part;
+
+  if (meta->extra != NULL && (value = PyDict_GetItem (meta->extra, key)) != NULL)
+    {
+      Py_INCREF (value);
+      return value;
+    }
+
+  name = metadata_key (key);
+
+  if (name == NULL)
+    {
+      PyErr_Clear ();
+      return NULL;
+    }
+
+  for (part = 0; part < NS_META_PARTS; part++)
+    for (field = meta->fields[part]; field && field->name; field++)
+      if (strcmp (field->name, name) == 0)
+        return metadata_decode (meta, part, field);
+
+  return NULL;
+}
+
+/* Whether key names a struct field; such a key in extra overrides the
+ * field instead of being another item */
+static int
+metadata_is_field (NsMetadata *meta, PyObject *key)
+{
+  const NsMetaField *field;
+  const char        *name;
+  int                part;
+
+  name = metadata_key (key);
+
+  if (name == NULL)
+    {
+      PyErr_Clear ();
+      return 0;
+    }
+
+  for (part = 0; part < NS_META_PARTS; part++)
+    for (field = meta->fields[part]; field && field->name; field++)
+      if (strcmp (field->name, name) == 0)
+        return 1;
+
+  return 0;
+}
+
+static PyObject *
+metadata_keys (PyObject *self, PyObject *args)
+{
+  NsMetadata        *meta = (NsMetadata *) self;
+  const NsMetaField *field;
+  PyObject          *list, *key, *value;
+  Py_ssize_t         pos = 0;
+  int                part;
+
+  list = PyList_New (0);
+
+  for (part = 0; list != NULL && part < NS_META_PARTS; part++)
+    for (field = meta->fields[part]; field && field->name; field++)
+      {
+        key = PyString_FromString (field->name);
+        if (key == NULL || PyList_Append (list, key) != 0)
+          {
+            Py_XDECREF (key);
+            Py_CLEAR (list);
+            return NULL;
+          }
+        Py_DECREF (key);
+      }
+
+  while (list != NULL && meta->extra != NULL &&
+         PyDict_Next (meta->extra, &pos, &key, &value))
+    if (!metadata_is_field (meta, key) && PyList_Append (list, key) != 0)
+      Py_CLEAR (list);
+
+  return list;
+}
+
+/* The items as dict, e.g. for repr, comparisons and pickling */
+static PyObject *
+metadata_to_dict (PyObject *self, PyObject *args)
+{
+  PyObject   *keys, *dict, *value;
+  Py_ssize_t  i;
+
+  keys = metadata_keys (self, NULL);
+  dict = keys ? PyDict_New () : NULL;
+
+  for (i = 0; dict != NULL && i < PyList_GET_SIZE (keys); i++)
+    {
+      value = metadata_lookup ((NsMetadata *) self, PyList_GET_ITEM (keys, i));
+      if (value == NULL || PyDict_SetItem (dict, PyList_GET_ITEM (keys, i), value) != 0)
+        Py_CLEAR (dict);
+      Py_XDECREF (value);
+    }
+
+  Py_XDECREF (keys);
+  return dict;
+}
+
+static PyObject *
+metadata_values_or_items (PyObject *self, int items)
+{
+  PyObject   *keys, *list, *key, *value;
+  Py_ssize_t  i;
+
+  keys = metadata_keys (self, NULL);
+  list = keys ? PyList_New (PyList_GET_SIZE (keys)) : NULL;
+
+  for (i = 0; list != NULL && i < PyList_GET_SIZE (keys); i++)
+    {
+      key = PyList_GET_ITEM (keys, i);
+      value = metadata_lookup ((NsMetadata *) self, key);
+
+      if (value != NULL && items)
+        value = Py_BuildValue ("(ON)", key, value);
+
+      if (value == NULL)
+        Py_CLEAR (list);
+      else
+        PyList_SET_ITEM (list, i, value);
+    }
+
+  Py_XDECREF (keys);
+  return list;
+}
+
+static PyObject *
+metadata_values (PyObject *self, PyObject *args)
+{
+  return metadata_values_or_items (self, 0);
+}
+
+static PyObject *
+metadata_items (PyObject *self, PyObject *args)
+{
+  return metadata_values_or_items (self, 1);
+}
+
+static PyObject *
+metadata_get (PyObject *self, PyObject *args)
+{
+  PyObject *key, *value;
+  PyObject *def = Py_None;
+
+  if (!PyArg_ParseTuple (args, "O|O", &key, &def))
+    return NULL;
+
+  value = metadata_lookup ((NsMetadata *) self, key);
+
+  if (value == NULL && !PyErr_Occurred ())
+    {
+      Py_INCREF (def);
+      value = def;
+    }
+
+  return value;
+}
+
+/* Pickled (and copied) as plain dict */
+static PyObject *
+metadata_reduce (PyObject *self, PyObject *args)
+{
+  PyObject *dict = metadata_to_dict (self, NULL);
+
+  if (dict == NULL)
+    return NULL;
+
+  return Py_BuildValue ("(O(N))", (PyObject *) &PyDict_Type, dict);
+}
+
+static PyObject *
+metadata_subscript (PyObject *self, PyObject *key)
+{
+  PyObject *value = metadata_lookup ((NsMetadata *) self, key);
+
+  if (value == NULL && !PyErr_Occurred ())
+    PyErr_SetObject (PyExc_KeyError, key);
+
+  return value;
+}
+
+static int
+metadata_ass_subscript (PyObject *self, PyObject *key, PyObject *value)
+{
+  NsMetadata *meta = (NsMetadata *) self;
+
+  if (value == NULL)
+    {
+      if (meta->extra == NULL || PyDict_DelItem (meta->extra, key) != 0)
+        {
+          PyErr_Clear ();
+          PyErr_SetObject (PyExc_KeyError, key);
+          return -1;
+        }
+      return 0;
+    }
+
+  if (meta->extra == NULL && (meta->extra = PyDict_New ()) == NULL)
+    return -1;
+
+  return PyDict_SetItem (meta->extra, key, value);
+}
+
+static Py_ssize_t
+metadata_length (PyObject *self)
+{
+  NsMetadata        *meta = (NsMetadata *) self;
+  const NsMetaField *field;
+  PyObject          *key, *value;
+  Py_ssize_t         pos = 0;
+  Py_ssize_t         n = 0;
+  int                part;
+
+  while (meta->extra != NULL && PyDict_Next (meta->extra, &pos, &key, &value))
+    if (!metadata_is_field (meta, key))
+      n++;
+
+  for (part = 0; part < NS_META_PARTS; part++)
+    for (field = meta->fields[part]; field && field->name; field++)
+      n++;
+
+  return n;
+}
+
+static int
+metadata_contains (PyObject *self, PyObject *key)
+{
+  PyObject *value = metadata_lookup ((NsMetadata *) self, key);
+
+  if (value == NULL)
+    return PyErr_Occurred () ? -1 : 0;
+
+  Py_DECREF (value);
+  return 1;
+}
+
+static PyObject *
+metadata_iter (PyObject *self)
+{
+  PyObject *keys = metadata_keys (self, NULL);
+  PyObject *iter;
+
+  if (keys == NULL)
+    return NULL;
+
+  iter = PyObject_GetIter (keys);
+  Py_DECREF (keys);
+  return iter;
+}
+
+/* Fields are also accessible as attributes, e.g. info.SampleRate */
+static PyObject *
+metadata_getattro (PyObject *self, PyObject *name)
+{
+  PyObject *value = PyObject_GenericGetAttr (self, name);
+
+  if (value != NULL || !PyErr_ExceptionMatches (PyExc_AttributeError))
+    return value;
+
+  PyErr_Clear ();
+  value = metadata_lookup ((NsMetadata *) self, name);
+
+  if (value == NULL && !PyErr_Occurred ())
+    PyErr_SetObject (PyExc_AttributeError, name);
+
+  return value;
+}
+
+static PyObject *
+metadata_repr (PyObject *self)
+{
+  PyObject *dict = metadata_to_dict (self, NULL);
+  PyObject *repr;
+
+  if (dict == NULL)
+    return NULL;
+
+  repr = PyObject_Repr (dict);
+  Py_DECREF (dict);
+  return repr;
+}
+
+static PyObject *
+metadata_richcompare (PyObject *self, PyObject *other, int op)
+{
+  PyObject *a, *b, *res;
+
+  if ((op != Py_EQ && op != Py_NE) ||
+      (!PyDict_Check (other) && !PyObject_TypeCheck (other, &NsMetadataType)))
+    {
+      Py_INCREF (Py_NotImplemented);
+      return Py_NotImplemented;
+    }
+
+  a = metadata_to_dict (self, NULL);
+  if (PyDict_Check (other))
+    {
+      Py_INCREF (other);
+      b = other;
+    }
+  else
+    b = metadata_to_dict (other, NULL);
+
+  res = (a && b) ? PyObject_RichCompare (a, b, op) : NULL;
+  Py_XDECREF (a);
+  Py_XDECREF (b);
+  return res;
+}
+
+static int
+metadata_getbuffer (PyObject *self, Py_buffer *view, int flags)
+{
+  return PyBuffer_FillInfo (view, self, ((NsMetadata *) self)->data,
+                            Py_SIZE (self), 1, flags);
+}
+
+static void
+metadata_dealloc (PyObject *self)
+{
+  Py_XDECREF (((NsMetadata *) self)->extra);
+  PyObject_Del (self);
+}
+
+static PyMethodDef metadata_methods[] = {
+  {"keys", (PyCFunction) metadata_keys, METH_NOARGS, NULL},
+  {"values", (PyCFunction) metadata_values, METH_NOARGS, NULL},
+  {"items", (PyCFunction) metadata_items, METH_NOARGS, NULL},
+  {"get", (PyCFunction) metadata_get, METH_VARARGS, NULL},
+  {"to_dict", (PyCFunction) metadata_to_dict, METH_NOARGS,
+   "All items as dict"},
+  {"__reduce__", (PyCFunction) metadata_reduce, METH_NOARGS, NULL},
+  {NULL, NULL, 0, NULL}
+};
+
+static PyMappingMethods metadata_as_mapping = {
+  metadata_length,
+  metadata_subscript,
+  metadata_ass_subscript
+};
+
+static PySequenceMethods metadata_as_sequence;
+static PyBufferProcs     metadata_as_buffer;
+
+static int
+metadata_type_ready (void)
+{
+  PyTypeObject *type = &NsMetadataType;
+
+  metadata_as_sequence.sq_contains = metadata_contains;
+  metadata_as_buffer.bf_getbuffer = metadata_getbuffer;
+
+  type->tp_name = "neuroshare._capi.Metadata";
+  type->tp_doc = "Info of the vendor library, decoded on access";
+  type->tp_basicsize = offsetof (NsMetadata, data);
+  type->tp_itemsize = 1;
+  type->tp_flags = Py_TPFLAGS_DEFAULT;
+  type->tp_dealloc = metadata_dealloc;
+  type->tp_repr = metadata_repr;
+  type->tp_as_mapping = &metadata_as_mapping;
+  type->tp_as_sequence = &metadata_as_sequence;
+  type->tp_as_buffer = &metadata_as_buffer;
+  type->tp_getattro = metadata_getattro;
+  type->tp_richcompare = metadata_richcompare;
+  type->tp_iter = metadata_iter;
+  type->tp_methods = metadata_methods;
+#if PY_MAJOR_VERSION < 3
+  type->tp_flags |= Py_TPFLAGS_HAVE_NEWBUFFER;
+#endif
+
+  return PyType_Ready (type);
+}
+
+static PyObject *
+do_get_library_info (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  PyObject       *cobj;
+  NsLibrary      *lib;
+  ns_LIBRARYINFO  info;
+  ns_RESULT       res;
+
+  if (!PyArg_ParseTuple (args, "O", &cobj))
+    return NULL;
+
+  
+  if (!PyCapsule_CheckExact (cobj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Expected NsLibrary type");
+      return NULL;
+    }
+  
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  Py_BEGIN_ALLOW_THREADS
+  NS_LIB_CALL (res, lib, GetLibraryInfo, &info, sizeof (info));
+  Py_END_ALLOW_THREADS
+
+  if (check_result_is_error (res, lib))
+    return NULL;
+
+  return metadata_new (library_info_fields, &info, sizeof (info), NULL, NULL, 0);
+}
+
+static PyObject *
+do_open_file (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  const char     *filename;
+  PyObject       *cobj;
+  PyObject       *meta;
+  NsLibrary      *lib;
+  ns_FILEINFO     info;
+  ns_RESULT       res;
+  uint32          file_id;
+
+  if (!PyArg_ParseTuple (args, "Os", &cobj, &filename))
+    return NULL;
+  
+  if (!PyCapsule_CheckExact (cobj)) 
+    {
+      PyErr_SetString (PyExc_TypeError, "Expected NsLibrary type");
+      return NULL;
+    }
+  
+  lib = PyCapsule_GetPointer (cobj, "capi");
+
+  Py_BEGIN_ALLOW_THREADS
+  NS_LIB_CALL (res, lib, OpenFile, filename, &file_id);
+  Py_END_ALLOW_THREADS
+
+  if (res == ns_OK)
+    {
+      Py_BEGIN_ALLOW_THREADS
+      NS_CALL (res, lib, file_id, GetFileInfo, file_id, &info, sizeof (info));
+      Py_END_ALLOW_THREADS
+    }
+
+  if (check_result_is_error (res, lib))
+    return NULL;
+
+  meta = metadata_new (file_info_fields, &info, sizeof (info), NULL, NULL, 0);
+
+  if (meta == NULL)
+    return NULL;
+
+  return Py_BuildValue ("(NN)", PyInt_FromLong (file_id), meta);
+}
+
+static PyObject *
+do_close_file (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  PyObject       *cobj;
+  PyObject       *iobj;
+  NsLibrary      *lib;
+  ns_RESULT       res;
+  uint32          file_id;
+
+  if (!PyArg_ParseTuple (args, "OO", &cobj, &iobj))
+    return NULL;
+
+  
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+
+  Py_BEGIN_ALLOW_THREADS
+  NS_CALL (res, lib, file_id, CloseFile, file_id);
+  Py_END_ALLOW_THREADS
+
+  if (check_result_is_error (res, lib))
+      return NULL;
+
+  Py_RETURN_NONE;
+}
+
+/* The file info of an open file, e.g. again after it grew */
+static PyObject *
+do_get_file_info (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  PyObject       *cobj;
+  PyObject       *iobj;
+  NsLibrary      *lib;
+  ns_FILEINFO     info;
+  ns_RESULT       res;
+  uint32          file_id;
+
+  if (!PyArg_ParseTuple (args, "OO", &cobj, &iobj))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+
+  Py_BEGIN_ALLOW_THREADS
+  NS_CALL (res, lib, file_id, GetFileInfo, file_id, &info, sizeof (info));
+  Py_END_ALLOW_THREADS
+
+  if (check_result_is_error (res, lib))
+    return NULL;
+
+  return metadata_new (file_info_fields, &info, sizeof (info), NULL, NULL, 0);
+}
+
+/* *********************************** */
+/* entity infos */
+
+/* The source infos of a segment entity as list of Metadata */
+static PyObject *
+get_segment_source_infos (NsLibrary *lib,
+                          uint32     file_id,
+                          uint32     entity_id,
+                          uint32     source_count)
+{
+  ns_SEGSOURCEINFO  info;
+  ns_RESULT         res;
+  PyObject         *list;
+  PyObject         *item;
+  uint32            i;
+
+  list = PyList_New (source_count);
+
+  for (i = 0; list != NULL && i < source_count; i++)
+    {
+      Py_BEGIN_ALLOW_THREADS
+      NS_CALL (res, lib, file_id, GetSegmentSourceInfo,
+               file_id, entity_id, i, &info, sizeof (info));
+      Py_END_ALLOW_THREADS
+
+      /* an unreadable source has no items, as it always had */
+      if (res == ns_OK)
+        item = metadata_new (source_info_fields, &info, sizeof (info), NULL, NULL, 0);
+      else
+        item = PyDict_New ();
+
+      if (item == NULL)
+        Py_CLEAR (list);
+      else
+        PyList_SET_ITEM (list, i, item);
+    }
+
+  return list;
+}
+
+/* Timestamps of uniformly sampled data are t0 + i / sample_rate; keep this
+ * loop trivial so that the compiler can vectorize it */
+static void
+fill_times_affine (double *times, uint32 length, double t0, double sample_rate)
+{
+  uint32 i;
+
+  for (i = 0; i < length; i++)
+    times[i] = t0 + (double) i / sample_rate;
+}
+
+typedef struct {
+  NsLibrary *lib;
+  uint32     file_id;
+  uint32     entity_id;
+  uint32     index;
+  double     sample_rate;
+  double    *times;
+} TimesCtx;
+
+/* Fill times[a..b] given the (vendor) timestamps of both ends: if the
+ * span matches the sampling rate it contains no gap (gaps only ever add
+ * time) and is filled in closed form, otherwise it is bisected. Thus a
+ * range with n samples and k gaps costs O(k log n) vendor calls. */
+static ns_RESULT
+fill_times_bisect (TimesCtx *ctx, uint32 a, double ta, uint32 b, double tb)
+{
+  ns_RESULT res;
+  uint32    m;
+  double    tm;
+  double    expected;
+
+  expected = ta + (double) (b - a) / ctx->sample_rate;
+
+  if (fabs (tb - expected) <= 0.5 / ctx->sample_rate)
+    {
+      fill_times_affine (ctx->times + a, b - a + 1, ta, ctx->sample_rate);
+      return ns_OK;
+    }
+
+  if (b - a <= 1)
+    {
+      ctx->times[a] = ta;
+      ctx->times[b] = tb;
+      return ns_OK;
+    }
+
+  m = a + (b - a) / 2;
+
+  NS_CALL (res, ctx->lib, ctx->file_id, GetTimeByIndex,
+           ctx->file_id, ctx->entity_id, ctx->index + m, &tm);
+
+  if (res != ns_OK)
+    return res;
+
+  res = fill_times_bisect (ctx, a, ta, m, tm);
+
+  if (res != ns_OK)
+    return res;
+
+  return fill_times_bisect (ctx, m, tm, b, tb);
+}
+
+/* Compute the timestamps for length samples starting at index, of which
+ * the first cont_count are known to be continuous. Without a (valid)
+ * sample rate every timestamp is looked up individually.
+ * Does not need the GIL. */
+static ns_RESULT
+compute_times (NsLibrary *lib,
+               uint32     file_id,
+               uint32     entity_id,
+               uint32     index,
+               uint32     length,
+               uint32     cont_count,
+               double     sample_rate,
+               double    *times)
+{
+  TimesCtx   ctx;
+  ns_RESULT  res;
+  uint32     first;
+  uint32     i;
+  double     t0, tn;
+
+  res = ns_OK;
+
+  if (length == 0)
+    return res;
+
+  if (! (sample_rate > 0.0))
+    {
+      for (i = 0; i < length; i++)
+        {
+          NS_CALL (res, lib, file_id, GetTimeByIndex,
+                   file_id,
+                   entity_id,
+                   index + i,
+                   (times + i));
+          if (res != ns_OK)
+            break;
+        }
+
+      return res;
+    }
+
+  NS_CALL (res, lib, file_id, GetTimeByIndex, file_id, entity_id, index, &t0);
+
+  if (res != ns_OK)
+    return res;
+
+  if (cont_count > length)
+    cont_count = length;
+
+  if (cont_count > 0)
+    fill_times_affine (times, cont_count, t0, sample_rate);
+
+  if (cont_count == length)
+    return ns_OK;
+
+  /* data is discontinuous, look for the gaps in the remainder */
+  ctx.lib = lib;
+  ctx.file_id = file_id;
+  ctx.entity_id = entity_id;
+  ctx.index = index;
+  ctx.sample_rate = sample_rate;
+  ctx.times = times;
+
+  first = cont_count;
+
+  if (first > 0)
+    {
+      NS_CALL (res, lib, file_id, GetTimeByIndex,
+               file_id, entity_id, index + first, &t0);
+      if (res != ns_OK)
+        return res;
+    }
+
+  times[first] = t0;
+
+  if (first == length - 1)
+    return ns_OK;
+
+  NS_CALL (res, lib, file_id, GetTimeByIndex,
+           file_id, entity_id, index + length - 1, &tn);
+
+  if (res != ns_OK)
+    return res;
+
+  return fill_times_bisect (&ctx, first, t0, length - 1, tn);
+}
+
+/* The continuous segments of an analog entity: sample starts[j] is at
+ * times[j] and the samples up to the next start follow at sample_rate */
+typedef struct {
+  uint32    n_segs;
+  uint32    alloc;
+  uint32   *starts;
+  double   *times;
+  uint32    count;
+  double    sample_rate;
+} AffineTable;
+
+static int
+affine_table_append (AffineTable *table, uint32 start, double t)
+{
+  if (table->n_segs == table->alloc)
+    {
+      uint32  alloc = table->alloc ? table->alloc * 2 : 16;
+      uint32 *starts = realloc (table->starts, alloc * sizeof (uint32));
+      double *times;
+
+      if (starts == NULL)
+        return -1;
+      table->starts = starts;
+
+      times = realloc (table->times, alloc * sizeof (double));
+      if (times == NULL)
+        return -1;
+      table->times = times;
+
+      table->alloc = alloc;
+    }
+
+  table->starts[table->n_segs] = start;
+  table->times[table->n_segs] = t;
+  table->n_segs++;
+  return 0;
+}
+
+/* Record the segment starts in (a, b], cf. fill_times_bisect */
+static ns_RESULT
+affine_table_bisect (NsLibrary   *lib,
+                     uint32       file_id,
+                     uint32       entity_id,
+                     AffineTable *table,
+                     uint32       a,
+                     double       ta,
+                     uint32       b,
+                     double       tb)
+{
+  ns_RESULT res;
+  uint32    m;
+  double    tm;
+  double    rate = table->sample_rate;
+
+  if (fabs (tb - (ta + (double) (b - a) / rate)) <= 0.5 / rate)
+    return ns_OK;
+
+  if (b - a <= 1)
+    return affine_table_append (table, b, tb) ? ns_LIBERROR : ns_OK;
+
+  m = a + (b - a) / 2;
+
+  NS_CALL (res, lib, file_id, GetTimeByIndex, file_id, entity_id, m, &tm);
+
+  if (res != ns_OK)
+    return res;
+
+  res = affine_table_bisect (lib, file_id, entity_id, table, a, ta, m, tm);
+
+  if (res != ns_OK)
+    return res;
+
+  return affine_table_bisect (lib, file_id, entity_id, table, m, tm, b, tb);
+}
+
+/* Find the segments of all table->count samples with O(gaps log n) vendor
+ * calls. Does not need the GIL. */
+static ns_RESULT
+affine_table_build (NsLibrary *lib, uint32 file_id, uint32 entity_id,
+                    AffineTable *table)
+{
+  ns_RESULT res;
+  double    t0, tn;
+  uint32    n = table->count;
+
+  if (n == 0)
+    return ns_OK;
+
+  NS_CALL (res, lib, file_id, GetTimeByIndex, file_id, entity_id, 0, &t0);
+
+  if (res != ns_OK)
+    return res;
+
+  if (affine_table_append (table, 0, t0))
+    return ns_LIBERROR;
+
+  if (n == 1)
+    return ns_OK;
+
+  NS_CALL (res, lib, file_id, GetTimeByIndex, file_id, entity_id, n - 1, &tn);
+
+  if (res != ns_OK)
+    return res;
+
+  return affine_table_bisect (lib, file_id, entity_id, table, 0, t0, n - 1, tn);
+}
+
+/* Segment that contains index */
+static uint32
+affine_table_find (const AffineTable *table, uint32 index)
+{
+  uint32 lo = 0, hi = table->n_segs;
+
+  while (hi - lo > 1)
+    {
+      uint32 mid = lo + (hi - lo) / 2;
+
+      if (table->starts[mid] <= index)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static double
+affine_table_time (const AffineTable *table, uint32 index)
+{
+  uint32 j = affine_table_find (table, index);
+
+  return table->times[j] + (double) (index - table->starts[j]) / table->sample_rate;
+}
+
+/* Index for timepoint in closed form; returns 0 if there is no such index
+ * (e.g. no sample before the timepoint), which is then left to the vendor */
+static int
+affine_table_index (const AffineTable *table,
+                    double             timepoint,
+                    int                position,
+                    uint32            *index)
+{
+  const double eps = 1e-6;
+  uint32 lo = 0, hi = table->n_segs;
+  uint32 last;
+  double x, before, after;
+  int    have_before, have_after;
+
+  if (table->n_segs == 0)
+    return 0;
+
+  if (timepoint < table->times[0])
+    {
+      have_before = 0;
+      before = 0;
+      after = 0;
+      have_after = 1;
+    }
+  else
+    {
+      while (hi - lo > 1)
+        {
+          uint32 mid = lo + (hi - lo) / 2;
+
+          if (table->times[mid] <= timepoint)
+            lo = mid;
+          else
+            hi = mid;
+        }
+
+      last = (lo + 1 < table->n_segs ? table->starts[lo + 1] : table->count) - 1;
+      x = table->starts[lo] + (timepoint - table->times[lo]) * table->sample_rate;
+
+      before = floor (x + eps);
+      if (before > last)
+        before = last;
+      have_before = 1;
+
+      after = ceil (x - eps);
+      if (after > last)
+        after = (double) last + 1;
+      have_after = after < table->count;
+    }
+
+  if (position == ns_BEFORE)
+    {
+      *index = (uint32) before;
+      return have_before;
+    }
+  else if (position == ns_AFTER || !have_before)
+    {
+      *index = (uint32) after;
+      return have_after;
+    }
+  else if (!have_after)
+    {
+      *index = (uint32) before;
+      return have_before;
+    }
+
+  if (timepoint - affine_table_time (table, (uint32) before) <=
+      affine_table_time (table, (uint32) after) - timepoint)
+    *index = (uint32) before;
+  else
+    *index = (uint32) after;
+
+  return 1;
+}
+
+/* Vectorized lookups: with a table (n_segs > 0) in closed form, otherwise
+ * (and for what the table can't answer) via the vendor. Do not need the GIL */
+static ns_RESULT
+times_by_index (NsLibrary         *lib,
+                uint32             file_id,
+                uint32             entity_id,
+                const AffineTable *table,
+                const uint32      *indices,
+                npy_intp           n,
+                double            *times)
+{
+  ns_RESULT res = ns_OK;
+  npy_intp  i;
+
+  for (i = 0; i < n; i++)
+    {
+      if (table->n_segs > 0 && indices[i] < table->count)
+        {
+          times[i] = affine_table_time (table, indices[i]);
+          continue;
+        }
+
+      NS_CALL (res, lib, file_id, GetTimeByIndex,
+               file_id, entity_id, indices[i], times + i);
+
+      if (res != ns_OK)
+        break;
+    }
+
+  return res;
+}
+
+static ns_RESULT
+indices_by_time (NsLibrary         *lib,
+                 uint32             file_id,
+                 uint32             entity_id,
+                 const AffineTable *table,
+                 const double      *times,
+                 npy_intp           n,
+                 int                position,
+                 uint32            *indices)
+{
+  ns_RESULT res = ns_OK;
+  npy_intp  i;
+
+  for (i = 0; i < n; i++)
+    {
+      if (affine_table_index (table, times[i], position, indices + i))
+        continue;
+
+      NS_CALL (res, lib, file_id, GetIndexByTime,
+               file_id, entity_id, times[i], position, indices + i);
+
+      if (res != ns_OK)
+        break;
+    }
+
+  return res;
+}
+
+/* First index at or after timepoint, item_count if there is none */
+static ns_RESULT
+index_at_or_after (NsLibrary *lib,
+                   uint32     file_id,
+                   uint32     entity_id,
+                   uint32     item_count,
+                   double     timepoint,
+                   uint32    *index)
+{
+  ns_RESULT res;
+
+  if (item_count == 0)
+    {
+      *index = 0;
+      return ns_OK;
+    }
+
+  NS_CALL (res, lib, file_id, GetIndexByTime,
+           file_id, entity_id, timepoint, ns_AFTER, index);
+
+  if (res == ns_BADINDEX)
+    {
+      *index = item_count;
+      return ns_OK;
+    }
+
+  if (res == ns_OK && *index > item_count)
+    *index = item_count;
+
+  return res;
+}
+
+/* Index ranges [first, first + count) of the items of n_entities entities
+ * within each of the n_windows windows [t_start, t_stop); the outputs are
+ * (n_entities, n_windows). Does not need the GIL. */
+static ns_RESULT
+index_ranges (NsLibrary    *lib,
+              uint32        file_id,
+              const uint32 *entities,
+              const uint32 *item_counts,
+              npy_intp      n_entities,
+              const double *t_start,
+              const double *t_stop,
+              npy_intp      n_windows,
+              uint32       *first,
+              uint32       *count)
+{
+  ns_RESULT res = ns_OK;
+  npy_intp  i, w;
+  uint32    a, b;
+
+  for (i = 0; i < n_entities; i++)
+    for (w = 0; w < n_windows; w++)
+      {
+        a = b = 0;
+
+        res = index_at_or_after (lib, file_id, entities[i], item_counts[i],
+                                 t_start[w], &a);
+
+        if (res == ns_OK && t_stop[w] > t_start[w])
+          res = index_at_or_after (lib, file_id, entities[i], item_counts[i],
+                                   t_stop[w], &b);
+
+        if (res != ns_OK)
+          return res;
+
+        first[i * n_windows + w] = a;
+        count[i * n_windows + w] = b > a ? b - a : 0;
+      }
+
+  return res;
+}
+
+static PyObject *
+get_times_for_entity (NsLibrary *lib,
+                      uint32     file_id,
+                      uint32     entity_id,
+                      uint32     index,
+                      uint32     length,
+                      uint32     cont_count,
+                      double     sample_rate)
+{
+  PyObject  *array;
+  ns_RESULT  res;
+  npy_intp   dims[1];
+  double    *data;
+
+  dims[0] = length;
+
+  array = PyArray_New (&PyArray_Type,
+		       1,
+		       dims,
+		       NPY_DOUBLE,
+		       NULL,
+		       NULL /* data */,
+		       0 /* itemsize */,
+		       NPY_ARRAY_CARRAY,
+		       NULL);
+
+  if (array == NULL)
+    return NULL;
+
+  data = (double *) PyArray_DATA ((PyArrayObject *) array);
+
+  Py_BEGIN_ALLOW_THREADS
+  res = compute_times (lib, file_id, entity_id, index, length,
+                       cont_count, sample_rate, data);
+  Py_END_ALLOW_THREADS
+
+    if (check_result_is_error (res, lib))
+      {
+        Py_DECREF (array);
+        return NULL;
+      }
+
+  return array;
+}
+
+/* ************************************************************************** */
+/* "public" API */
+
+static PyObject *
+do_get_entity_info (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  ns_ENTITYINFO   info;
+  union {
+    ns_EVENTINFO   event;
+    ns_ANALOGINFO  analog;
+    ns_SEGMENTINFO segment;
+    ns_NEURALINFO  neural;
+  }               detail;
+  const NsMetaField *fields;
+  size_t          size;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj;
+  PyObject       *meta;
+  NsLibrary      *lib;
+  ns_RESULT       res;
+  uint32          file_id;
+  uint32          entity_id;
+
+  if (!PyArg_ParseTuple (args, "OOO", &cobj, &iobj, &id_obj))
+    return NULL;
+
+  
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj)) 
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+
+  Py_BEGIN_ALLOW_THREADS
+  NS_CALL (res, lib, file_id, GetEntityInfo,
+           file_id, entity_id, &info, sizeof (info));
+  Py_END_ALLOW_THREADS
+
+  if (check_result_is_error (res, lib))
+    return NULL;
+
+  switch (info.dwEntityType)
+    {
+    case ns_ENTITY_EVENT:
+      fields = event_info_fields;
+      size = sizeof (detail.event);
+      Py_BEGIN_ALLOW_THREADS
+      NS_CALL (res, lib, file_id, GetEventInfo,
+               file_id, entity_id, &detail.event, sizeof (detail.event));
+      Py_END_ALLOW_THREADS
+      break;
+
+    case ns_ENTITY_ANALOG:
+      fields = analog_info_fields;
+      size = sizeof (detail.analog);
+      Py_BEGIN_ALLOW_THREADS
+      NS_CALL (res, lib, file_id, GetAnalogInfo,
+               file_id, entity_id, &detail.analog, sizeof (detail.analog));
+      Py_END_ALLOW_THREADS
+      break;
+
+    case ns_ENTITY_SEGMENT:
+      fields = segment_info_fields;
+      size = sizeof (detail.segment);
+      Py_BEGIN_ALLOW_THREADS
+      NS_CALL (res, lib, file_id, GetSegmentInfo,
+               file_id, entity_id, &detail.segment, sizeof (detail.segment));
+      Py_END_ALLOW_THREADS
+      break;
+
+    case ns_ENTITY_NEURALEVENT:
+      fields = neural_info_fields;
+      size = sizeof (detail.neural);
+      Py_BEGIN_ALLOW_THREADS
+      NS_CALL (res, lib, file_id, GetNeuralInfo,
+               file_id, entity_id, &detail.neural, sizeof (detail.neural));
+      Py_END_ALLOW_THREADS
+      break;
+
+    default:
+      fields = NULL;
+      size = 0;
+      break;
+    }
+
+  if (check_result_is_error (res, lib))
+    return NULL;
+
+  meta = metadata_new (entity_info_fields, &info, sizeof (info),
+                       fields, fields ? &detail : NULL, size);
+
+  if (meta != NULL && info.dwEntityType == ns_ENTITY_SEGMENT &&
+      metadata_set_extra (meta, "SourceInfos",
+                          get_segment_source_infos (lib, file_id, entity_id,
+                                                    detail.segment.dwSourceCount)))
+    Py_CLEAR (meta);
+
+  return meta;
+}
+
+/* Basic information of all entities of a file as struct-of-arrays */
+typedef struct {
+  uint32   first;
+  uint32   count;
+  uint32  *types;
+  uint32  *item_counts;
+  double  *sample_rates;
+  char   (*labels)[32];
+} EntityScan;
+
+/* Does not need the GIL */
+static ns_RESULT
+scan_entities (NsLibrary *lib, uint32 file_id, EntityScan *scan)
+{
+  ns_ENTITYINFO info;
+  ns_ANALOGINFO analog;
+  ns_RESULT     res;
+  uint32        entity_id;
+  uint32        i;
+
+  res = ns_OK;
+
+  for (i = 0; i < scan->count; i++)
+    {
+      entity_id = scan->first + i;
+
+      NS_CALL (res, lib, file_id, GetEntityInfo,
+               file_id, entity_id, &info, sizeof (info));
+
+      if (res != ns_OK)
+        break;
+
+      memcpy (scan->labels[i], info.szEntityLabel, sizeof (scan->labels[i]));
+      scan->labels[i][sizeof (scan->labels[i]) - 1] = '\0';
+      scan->types[i] = info.dwEntityType;
+      scan->item_counts[i] = info.dwItemCount;
+      scan->sample_rates[i] = NAN;
+
+      if (info.dwEntityType != ns_ENTITY_ANALOG)
+        continue;
+
+      NS_CALL (res, lib, file_id, GetAnalogInfo,
+               file_id, entity_id, &analog, sizeof (analog));
+
+      if (res != ns_OK)
+        break;
+
+      scan->sample_rates[i] = analog.dSampleRate;
+    }
+
+  return res;
+}
+
+static PyObject *
+do_scan_entities (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "count", "first", NULL};
+  EntityScan      scan;
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *sz_obj;
+  PyObject       *types, *counts, *rates, *labels;
+  PyObject       *dict;
+  ns_RESULT       res;
+  npy_intp        dims[1];
+  uint32          file_id;
+  unsigned int    first = 0;
+  uint32          i;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOO|I", kwlist,
+                                    &cobj, &iobj, &sz_obj, &first))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (sz_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+
+  scan.first = first;
+  scan.count = (uint32) PyInt_AsUnsignedLongMask (sz_obj);
+  dims[0] = scan.count;
+
+  types = PyArray_SimpleNew (1, dims, NPY_UINT32);
+  counts = PyArray_SimpleNew (1, dims, NPY_UINT32);
+  rates = PyArray_SimpleNew (1, dims, NPY_DOUBLE);
+  scan.labels = malloc (sizeof (*scan.labels) * (scan.count > 0 ? scan.count : 1));
+
+  if (types == NULL || counts == NULL || rates == NULL || scan.labels == NULL)
+    {
+      Py_XDECREF (types);
+      Py_XDECREF (counts);
+      Py_XDECREF (rates);
+      free (scan.labels);
+      return PyErr_Occurred () ? NULL : PyErr_NoMemory ();
+    }
+
+  scan.types = (uint32 *) PyArray_DATA ((PyArrayObject *) types);
+  scan.item_counts = (uint32 *) PyArray_DATA ((PyArrayObject *) counts);
+  scan.sample_rates = (double *) PyArray_DATA ((PyArrayObject *) rates);
+
+  Py_BEGIN_ALLOW_THREADS
+  res = scan_entities (lib, file_id, &scan);
+  Py_END_ALLOW_THREADS
+
+  if (check_result_is_error (res, lib))
+    {
+      Py_DECREF (types);
+      Py_DECREF (counts);
+      Py_DECREF (rates);
+      free (scan.labels);
+      return NULL;
+    }
+
+  labels = PyList_New (scan.count);
+
+  for (i = 0; i < scan.count; i++)
+    PyList_SetItem (labels, i, PyString_FromString (scan.labels[i]));
+
+  free (scan.labels);
+
+  dict = PyDict_New ();
+  dict_set_item_eat_ref (dict, "EntityLabel", labels);
+  dict_set_item_eat_ref (dict, "EntityType", types);
+  dict_set_item_eat_ref (dict, "ItemCount", counts);
+  dict_set_item_eat_ref (dict, "SampleRate", rates);
+
+  return dict;
+}
+
+/* Only the item counts of the entities [first, first + count), the
+ * cheap part of a scan for polling files that are still growing */
+static PyObject *
+do_get_item_counts (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "count", "first", NULL};
+  ns_ENTITYINFO   info;
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *sz_obj;
+  PyObject       *counts;
+  ns_RESULT       res;
+  npy_intp        dims[1];
+  uint32          file_id;
+  uint32         *out;
+  uint32          count;
+  unsigned int    first = 0;
+  uint32          i;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOO|I", kwlist,
+                                    &cobj, &iobj, &sz_obj, &first))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (sz_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  count = (uint32) PyInt_AsUnsignedLongMask (sz_obj);
+  dims[0] = count;
+
+  counts = PyArray_SimpleNew (1, dims, NPY_UINT32);
+
+  if (counts == NULL)
+    return NULL;
+
+  out = (uint32 *) PyArray_DATA ((PyArrayObject *) counts);
+  res = ns_OK;
+
+  Py_BEGIN_ALLOW_THREADS
+  for (i = 0; i < count; i++)
+    {
+      NS_CALL (res, lib, file_id, GetEntityInfo,
+               file_id, first + i, &info, sizeof (info));
+
+      if (res != ns_OK)
+        break;
+
+      out[i] = info.dwItemCount;
+    }
+  Py_END_ALLOW_THREADS
+
+  if (check_result_is_error (res, lib))
+    {
+      Py_DECREF (counts);
+      return NULL;
+    }
+
+  return counts;
+}
+
+/* ************************************ */
+
+static PyObject *
+do_get_event_data (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj, *tp_obj, *sz_obj;
+  PyObject       *data_obj, *res_obj;
+  uint32          file_id;
+  uint32          entity_id;
+  uint32          index;
+  uint32          event_type;
+  uint32          data_size;
+  uint32          data_ret_size;
+  double          time_stamp;
+  ns_RESULT       res;
+  void           *buffer;
+
+
+  if (!PyArg_ParseTuple (args, "OOOOOO", &cobj, &iobj, &id_obj, &idx_obj, &tp_obj, &sz_obj))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
+      !PyInt_Check (tp_obj) || !PyInt_Check (sz_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+  
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+  event_type = (uint32) PyInt_AsUnsignedLongMask (tp_obj);
+  data_size = (uint32) PyInt_AsUnsignedLongMask (sz_obj);
+
+  /* ** */
+  buffer = nslib_scratch (lib, data_size);
+
+  if (buffer == NULL)
+    return PyErr_NoMemory ();
+
+  Py_BEGIN_ALLOW_THREADS
+  NS_CALL_BYTES (res, lib, file_id, sizeof (double) + data_ret_size,
+                 GetEventData,
+                 file_id,
+                 entity_id,
+                 index,
+                 &time_stamp,
+                 buffer,
+                 data_size,
+                 &data_ret_size);
+  Py_END_ALLOW_THREADS
+  
+  if (check_result_is_error (res, lib))
+    {
+      nslib_scratch_release (lib, buffer);
+      return NULL;
+    }
+	   
+  switch (event_type)
+    {
+    case ns_EVENT_TEXT:
+    case ns_EVENT_CSV:
+      data_obj = PyString_FromStringAndSize (buffer, data_ret_size);
+      break;
+      
+    case ns_EVENT_BYTE:
+      data_obj = PyInt_FromLong (uint8_from_data (buffer, data_ret_size));
+      break;
+      
+    case ns_EVENT_WORD:
+      data_obj = PyInt_FromLong (uint16_from_data (buffer, data_ret_size));
+      break;
+      
+    case ns_EVENT_DWORD:
+      data_obj = PyInt_FromLong (uint32_from_data (buffer, data_ret_size));
+      break;
+      
+    default:
+      Py_INCREF (Py_None);
+      data_obj = Py_None;
+    }
+
+  res_obj = Py_BuildValue ("(d,O)", time_stamp, data_obj);
+  nslib_scratch_release (lib, buffer);
+  return res_obj;
+}
+
+static PyArray_Descr *
+event_range_descr (uint32 event_type, uint32 data_size)
+{
+  PyArray_Descr *descr;
+  PyObject      *spec;
+  char           value_type[32];
+
+  switch (event_type)
+    {
+    case ns_EVENT_TEXT:
+    case ns_EVENT_CSV:
+      snprintf (value_type, sizeof (value_type), "S%u", data_size);
+      break;
+
+    case ns_EVENT_BYTE:
+      snprintf (value_type, sizeof (value_type), "u1");
+      break;
+
+    case ns_EVENT_WORD:
+      snprintf (value_type, sizeof (value_type), "u2");
+      break;
+
+    case ns_EVENT_DWORD:
+      snprintf (value_type, sizeof (value_type), "u4");
+      break;
+
+    default:
+      PyErr_Format (PyExc_ValueError, "Unknown event type: %u", event_type);
+      return NULL;
+    }
+
+  spec = Py_BuildValue ("[(s,s),(s,s)]", "timestamp", "f8", "value", value_type);
+
+  if (spec == NULL)
+    return NULL;
+
+  if (!PyArray_DescrConverter (spec, &descr))
+    descr = NULL;
+
+  Py_DECREF (spec);
+  return descr;
+}
+
+/* Number of binary events staged per batch by read_event_range */
+#define NS_EVENT_BATCH 256
+
+/* Decoding kernels for binary event values. The values of a batch of n
+ * events were staged by the library at src_stride bytes each, their sizes
+ * in sizes; they are widened (or narrowed, as uint*_from_data would) to
+ * _type into the value fields of the rows at dst. The kernel is chosen
+ * once per batch by the event type and checks the sizes once: a batch of
+ * values of the same width in slots of a uint32 (the common case) takes
+ * a plain loop with constant strides that the compiler can vectorize */
+#define NS_EVENT_WIDEN(_src_type, _type)                                 \
+  for (i = 0; i < n; i++)                                               \
+    {                                                                   \
+      _src_type v;                                                      \
+      _type     w;                                                      \
+                                                                        \
+      memcpy (&v, src + (size_t) i * sizeof (uint32), sizeof (v));      \
+      w = (_type) v;                                                    \
+      memcpy (dst + i * dst_stride, &w, sizeof (w));                    \
+    }
+
+#define NS_DEFINE_EVENT_KERNEL(_name, _type, _from_data)                 \
+static void                                                             \
+_name (const char   *src,                                               \
+       size_t        src_stride,                                        \
+       const uint32 *sizes,                                             \
+       char         *dst,                                               \
+       npy_intp      dst_stride,                                        \
+       uint32        n)                                                 \
+{                                                                       \
+  uint32 width = n > 0 ? sizes[0] : 0;                                  \
+  uint32 i;                                                             \
+                                                                        \
+  for (i = 1; i < n && sizes[i] == width; i++)                          \
+    ;                                                                   \
+                                                                        \
+  if (i < n || src_stride != sizeof (uint32))                           \
+    width = 0;                                                          \
+                                                                        \
+  switch (width)                                                        \
+    {                                                                   \
+    case 1:                                                             \
+      NS_EVENT_WIDEN (uint8, _type);                                    \
+      break;                                                            \
+                                                                        \
+    case 2:                                                             \
+      NS_EVENT_WIDEN (uint16, _type);                                   \
+      break;                                                            \
+                                                                        \
+    case 4:                                                             \
+      NS_EVENT_WIDEN (uint32, _type);                                   \
+      break;                                                            \
+                                                                        \
+    default:                                                            \
+      for (i = 0; i < n; i++)                                           \
+        {                                                               \
+          _type w = _from_data ((void *) (src + i * src_stride), sizes[i]); \
+          memcpy (dst + i * dst_stride, &w, sizeof (w));                \
+        }                                                               \
+    }                                                                   \
+}
+
+NS_DEFINE_EVENT_KERNEL (decode_events_byte, uint8, uint8_from_data)
+NS_DEFINE_EVENT_KERNEL (decode_events_word, uint16, uint16_from_data)
+NS_DEFINE_EVENT_KERNEL (decode_events_dword, uint32, uint32_from_data)
+
+typedef void (*EventKernel) (const char   *src,
+                             size_t        src_stride,
+                             const uint32 *sizes,
+                             char         *dst,
+                             npy_intp      dst_stride,
+                             uint32        n);
+
+static EventKernel
+event_kernel (uint32 event_type)
+{
+  switch (event_type)
+    {
+    case ns_EVENT_BYTE:
+      return decode_events_byte;
+
+    case ns_EVENT_WORD:
+      return decode_events_word;
+
+    case ns_EVENT_DWORD:
+      return decode_events_dword;
+    }
+
+  return NULL;
+}
+
+/* Size of the buffer read_event_range needs to stage count events of
+ * event_type (and data_size bytes each); 0 for text, which needs none */
+static size_t
+event_staging_size (uint32 event_type, uint32 data_size, uint32 count)
+{
+  size_t batch = count < NS_EVENT_BATCH ? count : NS_EVENT_BATCH;
+
+  if (event_kernel (event_type) == NULL)
+    return 0;
+
+  data_size = data_size < sizeof (uint32) ? sizeof (uint32) : data_size;
+  return (batch > 0 ? batch : 1) * (sizeof (uint32) + data_size);
+}
+
+/* Read count events starting at index into the rows (of stride bytes) of
+ * a structured (timestamp, value) array. Text is written by the library
+ * straight into the (fixed width, packed) value field; binary values are
+ * staged in batches in buffer (of event_staging_size bytes) and decoded
+ * by the kernel of the event type. Does not need the GIL. */
+static ns_RESULT
+read_event_range (NsLibrary *lib,
+                  uint32     file_id,
+                  uint32     entity_id,
+                  uint32     index,
+                  uint32     count,
+                  uint32     event_type,
+                  uint32     data_size,
+                  char      *row,
+                  npy_intp   stride,
+                  void      *buffer)
+{
+  EventKernel kernel;
+  ns_RESULT   res;
+  uint32      data_ret_size;
+  uint32     *sizes;
+  char       *values;
+  uint32      batch;
+  uint32      done;
+  uint32      n;
+  uint32      i;
+  double      time_stamp;
+
+  res = ns_OK;
+  kernel = buffer != NULL ? event_kernel (event_type) : NULL;
+
+  if (kernel == NULL)
+    {
+      for (i = 0; i < count; i++, row += stride)
+        {
+          NS_CALL_BYTES (res, lib, file_id, sizeof (double) + data_ret_size,
+                         GetEventData,
+                         file_id,
+                         entity_id,
+                         index + i,
+                         &time_stamp,
+                         row + sizeof (double),
+                         data_size,
+                         &data_ret_size);
+          if (res != ns_OK)
+            break;
+
+          memcpy (row, &time_stamp, sizeof (double));
+        }
+
+      return res;
+    }
+
+  data_size = data_size < sizeof (uint32) ? sizeof (uint32) : data_size;
+  batch = count < NS_EVENT_BATCH ? count : NS_EVENT_BATCH;
+  sizes = buffer;
+  values = (char *) buffer + (size_t) batch * sizeof (uint32);
+
+  for (done = 0; done < count && res == ns_OK; done += n)
+    {
+      char *first = row + done * stride;
+
+      n = count - done < batch ? count - done : batch;
+
+      for (i = 0; i < n; i++)
+        {
+          NS_CALL_BYTES (res, lib, file_id, sizeof (double) + sizes[i],
+                         GetEventData,
+                         file_id,
+                         entity_id,
+                         index + done + i,
+                         &time_stamp,
+                         values + (size_t) i * data_size,
+                         data_size,
+                         &sizes[i]);
+          if (res != ns_OK)
+            break;
+
+          memcpy (first + i * stride, &time_stamp, sizeof (double));
+        }
+
+      /* decode what was read, also of a batch cut short by an error */
+      kernel (values, data_size, sizes, first + sizeof (double), stride, i);
+      n = i;
+    }
+
+  return res;
+}
+
+static PyObject *
+do_get_event_data_range (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj, *cnt_obj, *tp_obj, *sz_obj;
+  PyObject       *array;
+  PyArray_Descr  *descr;
+  uint32          file_id;
+  uint32          entity_id;
+  uint32          index;
+  uint32          count;
+  uint32          event_type;
+  uint32          data_size;
+  npy_intp        dims[1];
+  ns_RESULT       res;
+  void           *buffer;
+
+  if (!PyArg_ParseTuple (args, "OOOOOOO", &cobj, &iobj, &id_obj, &idx_obj, &cnt_obj, &tp_obj, &sz_obj))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
+      !PyInt_Check (cnt_obj) || !PyInt_Check (tp_obj) ||
+      !PyInt_Check (sz_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+  count = (uint32) PyInt_AsUnsignedLongMask (cnt_obj);
+  event_type = (uint32) PyInt_AsUnsignedLongMask (tp_obj);
+  data_size = (uint32) PyInt_AsUnsignedLongMask (sz_obj);
+
+  if (data_size == 0)
+    data_size = 1;
+
+  descr = event_range_descr (event_type, data_size);
+
+  if (descr == NULL)
+    return NULL;
+
+  /* ** */
+  dims[0] = count;
+  array = PyArray_Zeros (1, dims, descr, 0);
+
+  if (array == NULL)
+    return NULL;
+
+  /* text is written by the library straight into the fixed width
+   * value field of each row; binary values are staged in batches in
+   * a scratch buffer that is reused for every batch */
+  if (event_type == ns_EVENT_TEXT || event_type == ns_EVENT_CSV)
+    buffer = NULL;
+  else
+    {
+      buffer = nslib_scratch (lib, event_staging_size (event_type, data_size, count));
+
+      if (buffer == NULL)
+        {
+          Py_DECREF (array);
+          return PyErr_NoMemory ();
+        }
+    }
+
+  Py_BEGIN_ALLOW_THREADS
+  res = read_event_range (lib, file_id, entity_id, index, count, event_type,
+                          data_size, PyArray_BYTES ((PyArrayObject *) array),
+                          PyArray_ITEMSIZE ((PyArrayObject *) array), buffer);
+  Py_END_ALLOW_THREADS
+
+  nslib_scratch_release (lib, buffer);
+
+  if (check_result_is_error (res, lib))
+    {
+      Py_DECREF (array);
+      return NULL;
+    }
+
+  return array;
+}
+
+/* Split the text of each of n values (width bytes each, NUL padded) at
+ * commas into the columns fields (of width bytes) of the rows at dst;
+ * blanks around a field are dropped and the text after the last but one
+ * comma stays in the last field. Does not need the GIL. */
+static void
+split_csv_values (const char *src, size_t width, npy_intp n,
+                  char *dst, int columns)
+{
+  npy_intp i;
+
+  for (i = 0; i < n; i++, src += width)
+    {
+      const char *end = memchr (src, '\0', width);
+      const char *field = src;
+      char       *row = dst + (size_t) i * columns * width;
+      int         j;
+
+      if (end == NULL)
+        end = src + width;
+
+      for (j = 0; j < columns && field <= end; j++)
+        {
+          const char *stop = j + 1 < columns ? memchr (field, ',', end - field) : NULL;
+          const char *next;
+
+          if (stop == NULL)
+            stop = end;
+          next = stop + 1;
+
+          while (field < stop && (*field == ' ' || *field == '\t'))
+            field++;
+          while (stop > field && (stop[-1] == ' ' || stop[-1] == '\t'))
+            stop--;
+
+          memcpy (row + j * width, field, stop - field);
+          field = next;
+        }
+    }
+}
+
+static PyObject *
+do_split_csv (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"values", "columns", NULL};
+  PyArray_Descr  *descr;
+  PyObject       *values_obj;
+  PyObject       *values;
+  PyObject       *spec;
+  PyObject       *array;
+  npy_intp        dims[2];
+  size_t          width;
+  int             columns;
+  char            field_type[32];
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "Oi", kwlist,
+                                    &values_obj, &columns))
+    return NULL;
+
+  if (columns < 1)
+    {
+      PyErr_SetString (PyExc_ValueError, "Need at least one column");
+      return NULL;
+    }
+
+  values = PyArray_FROMANY (values_obj, NPY_STRING, 1, 1, NPY_ARRAY_CARRAY_RO);
+
+  if (values == NULL)
+    return NULL;
+
+  width = PyArray_ITEMSIZE ((PyArrayObject *) values);
+  snprintf (field_type, sizeof (field_type), "S%u", (unsigned int) (width > 0 ? width : 1));
+  spec = PyString_FromString (field_type);
+
+  if (spec == NULL || !PyArray_DescrConverter (spec, &descr))
+    {
+      Py_XDECREF (spec);
+      Py_DECREF (values);
+      return NULL;
+    }
+
+  Py_DECREF (spec);
+  dims[0] = PyArray_SIZE ((PyArrayObject *) values);
+  dims[1] = columns;
+  array = PyArray_Zeros (2, dims, descr, 0);
+
+  if (array == NULL)
+    {
+      Py_DECREF (values);
+      return NULL;
+    }
+
+  Py_BEGIN_ALLOW_THREADS
+  split_csv_values (PyArray_BYTES ((PyArrayObject *) values), width, dims[0],
+                    PyArray_BYTES ((PyArrayObject *) array), columns);
+  Py_END_ALLOW_THREADS
+
+  Py_DECREF (values);
+  return array;
+}
+
+/* Number of samples converted per vendor call for reduced precision reads */
+#define NS_CONVERT_BLOCK 65536
+
+/* Conversion kernels; kept trivial so that the compiler can vectorize them */
+static void
+convert_to_float (const double *src, float *dst, uint32 n)
+{
+  uint32 i;
+
+  for (i = 0; i < n; i++)
+    dst[i] = (float) src[i];
+}
+
+static void
+convert_to_int16 (const double *src,
+                  npy_int16    *dst,
+                  uint32        n,
+                  double        scale,
+                  double        offset)
+{
+  double inv_scale = 1.0 / scale;
+  uint32 i;
+
+  for (i = 0; i < n; i++)
+    {
+      double v = (src[i] - offset) * inv_scale;
+
+      v = v < -32768.0 ? -32768.0 : v;
+      v = v > 32767.0 ? 32767.0 : v;
+      v = v < 0.0 ? v - 0.5 : v + 0.5;
+      dst[i] = (npy_int16) v;
+    }
+}
+
+/* Read count samples starting at index as type_num (NPY_FLOAT or NPY_INT16
+ * with value = raw * scale + offset) into buffer, going through scratch (of
+ * block samples). Blocks that the vendor reports as fully continuous are
+ * checked for a gap at their start via the sample_rate, to compute
+ * cont_count for the whole range. Does not need the GIL. */
+static ns_RESULT
+read_analog_converted (NsLibrary *lib,
+                       uint32     file_id,
+                       uint32     entity_id,
+                       uint32     index,
+                       uint32     count,
+                       double     sample_rate,
+                       int        type_num,
+                       double     scale,
+                       double     offset,
+                       double    *scratch,
+                       uint32     block,
+                       void      *buffer,
+                       uint32    *cont_count)
+{
+  ns_RESULT  res;
+  uint32     done, n, cc;
+  double     ta, tb;
+  int        continuous;
+
+  res = ns_OK;
+  continuous = 1;
+  *cont_count = 0;
+
+  for (done = 0; done < count; done += n)
+    {
+      n = count - done < block ? count - done : block;
+
+      NS_CALL_BYTES (res, lib, file_id, NS_ANALOG_BYTES (cc, n), GetAnalogData,
+                     file_id, entity_id, index + done, n, &cc, scratch);
+
+      if (res != ns_OK)
+        return res;
+
+      if (continuous && done > 0)
+        {
+          NS_CALL (res, lib, file_id, GetTimeByIndex,
+                   file_id, entity_id, index + done - 1, &ta);
+          if (res == ns_OK)
+            NS_CALL (res, lib, file_id, GetTimeByIndex,
+                     file_id, entity_id, index + done, &tb);
+          if (res != ns_OK)
+            return res;
+
+          if (fabs (tb - ta - 1.0 / sample_rate) > 0.5 / sample_rate)
+            continuous = 0;
+        }
+
+      if (continuous)
+        {
+          *cont_count += cc < n ? cc : n;
+          continuous = cc >= n;
+        }
+
+      if (type_num == NPY_FLOAT)
+        convert_to_float (scratch, (float *) buffer + done, n);
+      else
+        convert_to_int16 (scratch, (npy_int16 *) buffer + done, n,
+                          scale, offset);
+    }
+
+  return res;
+}
+
+static PyObject *
+do_get_analog_data (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "index", "count",
+                              "sample_rate", "times", "out", "dtype",
+                              "scale", "offset", NULL};
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj;
+  PyObject       *res_obj;
+  PyObject       *array;
+  PyObject       *times;
+  PyObject       *times_obj = Py_True;
+  PyObject       *out = NULL;
+  PyArray_Descr  *descr = NULL;
+  double         *scratch = NULL;
+  uint32          block = 0;
+  int             type_num = NPY_DOUBLE;
+  int             want_times = 1;
+  double          scale = 1.0;
+  double          offset = 0.0;
+  uint32          file_id;
+  uint32          entity_id;
+  uint32          index;
+  uint32          count;
+  uint32          cont_count;
+  ns_RESULT       res;
+  void           *buffer;
+  npy_intp        dims[1];
+  double          sample_rate = 0.0;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOO|dOOO&dd", kwlist,
+                                    &cobj, &iobj, &id_obj, &idx_obj, &sz_obj,
+                                    &sample_rate, &times_obj, &out,
+                                    PyArray_DescrConverter2, &descr,
+                                    &scale, &offset))
+    return NULL;
+
+  if (descr != NULL)
+    {
+      type_num = descr->type_num;
+      Py_DECREF (descr);
+    }
+
+  if (type_num != NPY_DOUBLE && type_num != NPY_FLOAT && type_num != NPY_INT16)
+    {
+      PyErr_SetString (PyExc_TypeError, "dtype must be float64, float32 or int16");
+      return NULL;
+    }
+
+  if (type_num == NPY_INT16 && ! (scale > 0.0))
+    {
+      PyErr_SetString (PyExc_ValueError, "scale must be positive");
+      return NULL;
+    }
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
+      !PyInt_Check (sz_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+  count = (uint32)  PyInt_AsUnsignedLongMask (sz_obj);
+
+  /* ** */
+  dims[0] = count; //sample count
+
+  if (out != NULL && out != Py_None)
+    {
+      if (check_out_array (out, type_num, count) == NULL)
+        return NULL;
+
+      Py_INCREF (out);
+      array = out;
+    }
+  else
+    array = PyArray_New (&PyArray_Type,
+                         1,
+                         dims,
+                         type_num,
+                         NULL,
+                         NULL /* data */,
+                         0 /* itemsize */,
+                         NPY_ARRAY_CARRAY,
+                         NULL);
+
+  if (array == NULL)
+    return NULL;
+
+  buffer = PyArray_DATA ((PyArrayObject *) array);
+
+  /* times can also be an array to write the timestamps into */
+  if (PyArray_Check (times_obj))
+    {
+      if (check_out_array (times_obj, NPY_DOUBLE, count) == NULL)
+        {
+          Py_DECREF (array);
+          return NULL;
+        }
+    }
+  else if ((want_times = PyObject_IsTrue (times_obj)) < 0)
+    {
+      Py_DECREF (array);
+      return NULL;
+    }
+
+  if (type_num != NPY_DOUBLE)
+    {
+      /* without a sample rate gaps at block borders can't be detected */
+      block = count;
+      if (sample_rate > 0.0 && block > NS_CONVERT_BLOCK)
+        block = NS_CONVERT_BLOCK;
+
+      scratch = nslib_scratch (lib, sizeof (double) * block);
+
+      if (scratch == NULL)
+        {
+          Py_DECREF (array);
+          return PyErr_NoMemory ();
+        }
+    }
+
+  Py_BEGIN_ALLOW_THREADS
+  if (type_num == NPY_DOUBLE)
+    NS_CALL_BYTES (res, lib, file_id, NS_ANALOG_BYTES (cont_count, count),
+                   GetAnalogData,
+                   file_id,
+                   entity_id,
+                   index,
+                   count,
+                   &cont_count,
+                   buffer);
+  else
+    res = read_analog_converted (lib, file_id, entity_id, index, count,
+                                 sample_rate, type_num, scale, offset,
+                                 scratch, block, buffer, &cont_count);
+  Py_END_ALLOW_THREADS
+
+  nslib_scratch_release (lib, scratch);
+
+  if (check_result_is_error (res, lib))
+    {
+      Py_DECREF (array);
+      return NULL;
+    }
+
+  if (PyArray_Check (times_obj))
+    {
+      double *data = PyArray_DATA ((PyArrayObject *) times_obj);
+
+      Py_BEGIN_ALLOW_THREADS
+      res = compute_times (lib, file_id, entity_id, index, count,
+                           cont_count, sample_rate, data);
+      Py_END_ALLOW_THREADS
+
+      if (check_result_is_error (res, lib))
+        {
+          Py_DECREF (array);
+          return NULL;
+        }
+
+      Py_INCREF (times_obj);
+      times = times_obj;
+    }
+  else if (want_times)
+    {
+      times = get_times_for_entity (lib,
+                                    file_id,
+                                    entity_id,
+                                    index,
+                                    count,
+                                    cont_count,
+                                    sample_rate);
+
+      if (times == NULL)
+        {
+          Py_DECREF (array);
+          return NULL;
+        }
+    }
+  else
+    {
+      Py_INCREF (Py_None);
+      times = Py_None;
+    }
+
+  res_obj = PyTuple_New (3);
+  PyTuple_SetItem (res_obj, 0, array);
+  PyTuple_SetItem (res_obj, 1, times);
+  PyTuple_SetItem (res_obj, 2, PyInt_FromLong (cont_count));
+
+  return res_obj;
+}
+
+/* Number of samples per vendor call when reducing analog data, small
+ * enough for the block to stay in the (L2) cache while it is reduced */
+#define NS_REDUCE_BLOCK 16384
+
+/* Reduction kernels; the four independent lanes let the compiler
+ * vectorize them without having to reorder the floating point sums */
+static void
+reduce_min_max_sum (const double *x,
+                    uint32        n,
+                    double       *min_val,
+                    double       *max_val,
+                    double       *sum)
+{
+  double mn[4], mx[4], s[4];
+  uint32 i, k;
+
+  for (k = 0; k < 4; k++)
+    {
+      mn[k] = *min_val;
+      mx[k] = *max_val;
+      s[k] = 0.0;
+    }
+
+  for (i = 0; i + 4 <= n; i += 4)
+    for (k = 0; k < 4; k++)
+      {
+        mn[k] = x[i + k] < mn[k] ? x[i + k] : mn[k];
+        mx[k] = x[i + k] > mx[k] ? x[i + k] : mx[k];
+        s[k] += x[i + k];
+      }
+
+  for (k = 0; i < n; i++, k++)
+    {
+      mn[k] = x[i] < mn[k] ? x[i] : mn[k];
+      mx[k] = x[i] > mx[k] ? x[i] : mx[k];
+      s[k] += x[i];
+    }
+
+  for (k = 0; k < 4; k++)
+    {
+      *min_val = mn[k] < *min_val ? mn[k] : *min_val;
+      *max_val = mx[k] > *max_val ? mx[k] : *max_val;
+    }
+
+  *sum += (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+static double
+fir_dot (const double *x, const double *taps, uint32 n)
+{
+  double s[4] = {0.0, 0.0, 0.0, 0.0};
+  uint32 i, k;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    for (k = 0; k < 4; k++)
+      s[k] += x[i + k] * taps[i + k];
+
+  for (k = 0; i < n; i++, k++)
+    s[k] += x[i] * taps[i];
+
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+/* First sample of bin b when count samples are split into bins bins */
+#define ENVELOPE_BIN_START(_count, _bins, _b) \
+  ((uint32) ((uint64_t) (_count) * (_b) / (_bins)))
+
+/* Minimum, maximum and mean of each of bins (roughly) equal parts of the
+ * count samples starting at index, streaming through scratch (of block
+ * samples). Empty bins (if bins > count) are NaN; gaps (cf. the continuous
+ * count of GetAnalogData) are not. Does not need the GIL. */
+static ns_RESULT
+analog_envelope (NsLibrary *lib,
+                 uint32     file_id,
+                 uint32     entity_id,
+                 uint32     index,
+                 uint32     count,
+                 uint32     bins,
+                 double    *scratch,
+                 uint32     block,
+                 double    *min_val,
+                 double    *max_val,
+                 double    *mean)
+{
+  ns_RESULT  res;
+  uint32     pos, off, n, take, end, cc;
+  uint32     b;
+  double     mn, mx, sum;
+
+  res = ns_OK;
+  b = 0;
+  mn = HUGE_VAL;
+  mx = -HUGE_VAL;
+  sum = 0.0;
+
+  for (pos = 0; pos < count; pos += n)
+    {
+      n = count - pos < block ? count - pos : block;
+
+      NS_CALL_BYTES (res, lib, file_id, NS_ANALOG_BYTES (cc, n), GetAnalogData,
+                     file_id, entity_id, index + pos, n, &cc, scratch);
+
+      if (res != ns_OK)
+        return res;
+
+      for (off = 0; off < n; off += take)
+        {
+          /* bins that end here, including empty ones */
+          while ((end = ENVELOPE_BIN_START (count, bins, b + 1)) <= pos + off)
+            {
+              min_val[b] = max_val[b] = mean[b] = NAN;
+              b++;
+            }
+
+          take = end - (pos + off) < n - off ? end - (pos + off) : n - off;
+          reduce_min_max_sum (scratch + off, take, &mn, &mx, &sum);
+
+          if (pos + off + take == end)
+            {
+              min_val[b] = mn;
+              max_val[b] = mx;
+              mean[b] = sum / (end - ENVELOPE_BIN_START (count, bins, b));
+              mn = HUGE_VAL;
+              mx = -HUGE_VAL;
+              sum = 0.0;
+              b++;
+            }
+        }
+    }
+
+  for (; b < bins; b++)
+    min_val[b] = max_val[b] = mean[b] = NAN;
+
+  return res;
+}
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Low-pass filter for decimating by factor: a Hamming windowed sinc with
+ * its cutoff at the new Nyquist frequency and 2 * half + 1 taps, where
+ * half = 10 * factor (as scipy.signal.decimate with ftype='fir'). The
+ * taps are normalized to unity gain at DC. */
+static double *
+decimation_taps (uint32 factor, uint32 *half)
+{
+  double *taps;
+  double  sum, x;
+  uint32  h, k;
+
+  h = factor > 1 ? 10 * factor : 0;
+  taps = malloc (sizeof (double) * (2 * h + 1));
+
+  if (taps == NULL)
+    return NULL;
+
+  sum = 0.0;
+  for (k = 0; k <= 2 * h; k++)
+    {
+      x = (double) k - (double) h;
+      taps[k] = x == 0.0 ? 1.0 : sin (M_PI * x / factor) / (M_PI * x / factor);
+      if (h > 0)
+        taps[k] *= 0.54 + 0.46 * cos (M_PI * x / h);
+      sum += taps[k];
+    }
+
+  for (k = 0; k <= 2 * h; k++)
+    taps[k] /= sum;
+
+  *half = h;
+  return taps;
+}
+
+/* Add the part of the filter sums of out (n_out outputs, cf.
+ * analog_decimate) that falls onto the n samples of x, which are at
+ * position pos relative to the index of the read */
+static void
+decimate_accumulate (const double *x,
+                     int64_t       pos,
+                     uint32        n,
+                     uint32        factor,
+                     const double *taps,
+                     uint32        half,
+                     double       *out,
+                     uint32        n_out)
+{
+  int64_t  j, j_end, w, t0, t1;
+
+  /* the window of out[j] is [j * factor - half, j * factor + half] */
+  j = pos - half > 0 ? (pos - half + factor - 1) / factor : 0;
+  j_end = (pos + n - 1 + half) / factor + 1;
+  if (j_end > n_out)
+    j_end = n_out;
+
+  for (; j < j_end; j++)
+    {
+      w = j * factor - half;
+      t0 = pos > w ? pos : w;
+      t1 = pos + n < w + 2 * half + 1 ? pos + n : w + 2 * half + 1;
+
+      if (t1 > t0)
+        out[j] += fir_dot (x + (t0 - pos), taps + (t0 - w), (uint32) (t1 - t0));
+    }
+}
+
+/* Decimate the count samples starting at index by factor, i.e. out[j] is
+ * the filtered sample index + j * factor; samples beyond either end of the
+ * range are taken to be equal to the one at that end. The samples are
+ * read once, in blocks of scratch (of block samples), and every block adds
+ * its share to the sums of the outputs whose filter window it overlaps.
+ * count must not be 0. Does not need the GIL. */
+static ns_RESULT
+analog_decimate (NsLibrary    *lib,
+                 uint32        file_id,
+                 uint32        entity_id,
+                 uint32        index,
+                 uint32        count,
+                 uint32        factor,
+                 const double *taps,
+                 uint32        half,
+                 double       *scratch,
+                 uint32        block,
+                 double       *out,
+                 uint32        n_out)
+{
+  ns_RESULT  res;
+  uint32     pos, n, k, cc;
+  int64_t    pad, edge;
+  double     first = 0.0;
+  double     last = 0.0;
+
+  res = ns_OK;
+
+  for (k = 0; k < n_out; k++)
+    out[k] = 0.0;
+
+  for (pos = 0; pos < count; pos += n)
+    {
+      n = count - pos < block ? count - pos : block;
+
+      NS_CALL_BYTES (res, lib, file_id, NS_ANALOG_BYTES (cc, n), GetAnalogData,
+                     file_id, entity_id, index + pos, n, &cc, scratch);
+
+      if (res != ns_OK)
+        return res;
+
+      if (pos == 0)
+        first = scratch[0];
+      last = scratch[n - 1];
+
+      decimate_accumulate (scratch, pos, n, factor, taps, half, out, n_out);
+    }
+
+  /* the padding at both ends, half samples each at most */
+  for (k = 0; k < 2; k++)
+    {
+      edge = k == 0 ? -(int64_t) half : (int64_t) count;
+
+      for (pad = 0; pad < half; pad += n)
+        {
+          n = half - pad < block ? (uint32) (half - pad) : block;
+
+          for (cc = 0; cc < n; cc++)
+            scratch[cc] = k == 0 ? first : last;
+
+          decimate_accumulate (scratch, edge + pad, n, factor, taps, half,
+                               out, n_out);
+        }
+    }
+
+  return res;
+}
+
+static PyObject *
+do_get_analog_envelope (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "index", "count",
+                              "bins", NULL};
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj;
+  PyObject       *arrays[3];
+  double         *scratch;
+  uint32          file_id;
+  uint32          entity_id;
+  uint32          index;
+  uint32          count;
+  uint32          bins;
+  uint32          block;
+  ns_RESULT       res;
+  npy_intp        dims[1];
+  int             i;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOOI", kwlist,
+                                    &cobj, &iobj, &id_obj, &idx_obj, &sz_obj,
+                                    &bins))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
+      !PyInt_Check (sz_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  if (bins == 0)
+    {
+      PyErr_SetString (PyExc_ValueError, "bins must be positive");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+  count = (uint32) PyInt_AsUnsignedLongMask (sz_obj);
+
+  dims[0] = bins;
+  for (i = 0; i < 3; i++)
+    {
+      arrays[i] = PyArray_SimpleNew (1, dims, NPY_DOUBLE);
+      if (arrays[i] == NULL)
+        {
+          while (i-- > 0)
+            Py_DECREF (arrays[i]);
+          return NULL;
+        }
+    }
+
+  block = count < NS_REDUCE_BLOCK ? count : NS_REDUCE_BLOCK;
+  scratch = nslib_scratch (lib, sizeof (double) * block);
+
+  if (scratch == NULL)
+    {
+      for (i = 0; i < 3; i++)
+        Py_DECREF (arrays[i]);
+      return PyErr_NoMemory ();
+    }
+
+  Py_BEGIN_ALLOW_THREADS
+  res = analog_envelope (lib, file_id, entity_id, index, count, bins,
+                         scratch, block,
+                         PyArray_DATA ((PyArrayObject *) arrays[0]),
+                         PyArray_DATA ((PyArrayObject *) arrays[1]),
+                         PyArray_DATA ((PyArrayObject *) arrays[2]));
+  Py_END_ALLOW_THREADS
+
+  nslib_scratch_release (lib, scratch);
+
+  if (check_result_is_error (res, lib))
+    {
+      for (i = 0; i < 3; i++)
+        Py_DECREF (arrays[i]);
+      return NULL;
+    }
+
+  return Py_BuildValue ("(NNN)", arrays[0], arrays[1], arrays[2]);
+}
+
+static PyObject *
+do_get_analog_decimated (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "index", "count",
+                              "factor", NULL};
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj;
+  PyObject       *array;
+  double         *scratch;
+  double         *taps;
+  uint32          file_id;
+  uint32          entity_id;
+  uint32          index;
+  uint32          count;
+  uint32          factor;
+  uint32          half = 0;
+  uint32          n_out;
+  uint32          block;
+  ns_RESULT       res;
+  npy_intp        dims[1];
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOOI", kwlist,
+                                    &cobj, &iobj, &id_obj, &idx_obj, &sz_obj,
+                                    &factor))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
+      !PyInt_Check (sz_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  if (factor == 0 || factor > 1000000)
+    {
+      PyErr_SetString (PyExc_ValueError, "factor must be in [1, 1000000]");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+  count = (uint32) PyInt_AsUnsignedLongMask (sz_obj);
+
+  n_out = count / factor + (count % factor ? 1 : 0);
+  dims[0] = n_out;
+  array = PyArray_SimpleNew (1, dims, NPY_DOUBLE);
+
+  if (array == NULL)
+    return NULL;
+
+  if (n_out == 0)
+    return array;
+
+  block = count < NS_REDUCE_BLOCK ? count : NS_REDUCE_BLOCK;
+  taps = decimation_taps (factor, &half);
+  scratch = nslib_scratch (lib, sizeof (double) * block);
+
+  if (taps == NULL || scratch == NULL)
+    {
+      free (taps);
+      nslib_scratch_release (lib, scratch);
+      Py_DECREF (array);
+      return PyErr_NoMemory ();
+    }
+
+  Py_BEGIN_ALLOW_THREADS
+  res = analog_decimate (lib, file_id, entity_id, index, count, factor,
+                         taps, half, scratch, block,
+                         PyArray_DATA ((PyArrayObject *) array), n_out);
+  Py_END_ALLOW_THREADS
+
+  free (taps);
+  nslib_scratch_release (lib, scratch);
+
+  if (check_result_is_error (res, lib))
+    {
+      Py_DECREF (array);
+      return NULL;
+    }
+
+  return array;
+}
+
+/* Run job (ctx, i) for i in [0, n_jobs) on up to n_threads threads (the
+ * calling one included). Does not need, and must not hold, the GIL. */
+typedef void (*NsJobFunc) (void *ctx, uint32 i);
+
+typedef struct {
+  NsMutex    lock;
+  NsJobFunc  job;
+  void      *ctx;
+  uint32     next;
+  uint32     n_jobs;
+} ParallelFor;
+
+static void
+parallel_for_worker (void *data)
+{
+  ParallelFor *pf = data;
+  uint32       i;
+
+  for (;;)
+    {
+      ns_mutex_lock (&pf->lock);
+      i = pf->next++;
+      ns_mutex_unlock (&pf->lock);
+
+      if (i >= pf->n_jobs)
+        break;
+
+      pf->job (pf->ctx, i);
+    }
+}
+
+static void
+parallel_for (int n_threads, uint32 n_jobs, NsJobFunc job, void *ctx)
+{
+  ParallelFor  pf;
+  NsThread    *threads;
+  int          n_started;
+  int          i;
+
+  if (n_threads > (int) n_jobs)
+    n_threads = (int) n_jobs;
+
+  if (n_threads <= 1)
+    {
+      uint32 k;
+
+      for (k = 0; k < n_jobs; k++)
+        job (ctx, k);
+
+      return;
+    }
+
+  ns_mutex_init (&pf.lock);
+  pf.job = job;
+  pf.ctx = ctx;
+  pf.next = 0;
+  pf.n_jobs = n_jobs;
+
+  threads = malloc (sizeof (NsThread) * (n_threads - 1));
+  n_started = 0;
+
+  for (i = 0; threads != NULL && i < n_threads - 1; i++)
+    {
+      if (ns_thread_start (&threads[i], parallel_for_worker, &pf) != 0)
+        break;
+      n_started++;
+    }
+
+  parallel_for_worker (&pf);
+
+  for (i = 0; i < n_started; i++)
+    ns_thread_join (threads[i]);
+
+  free (threads);
+  ns_mutex_clear (&pf.lock);
+}
+
+typedef struct {
+  NsLibrary    *lib;
+  uint32        file_id;
+  const uint32 *entities;
+  uint32        n_entities;
+  uint32        index;
+  uint32        count;
+  int           fortran;
+  double       *data;
+  uint32       *cont_counts;
+  NsMutex       lock;
+  ns_RESULT     res;
+} AnalogBlock;
+
+static void
+analog_block_read_row (void *data, uint32 row)
+{
+  AnalogBlock *block = data;
+  ns_RESULT    res;
+  double      *buffer;
+  uint32       i;
+
+  if (block->fortran)
+    {
+      /* rows are not contiguous, read into a bounce buffer */
+      buffer = nslib_scratch (block->lib, sizeof (double) * block->count);
+
+      if (buffer == NULL)
+        {
+          res = ns_LIBERROR;
+          goto out;
+        }
+    }
+  else
+    buffer = block->data + (size_t) row * block->count;
+
+  NS_CALL_BYTES (res, block->lib, block->file_id,
+                 NS_ANALOG_BYTES (block->cont_counts[row], block->count),
+                 GetAnalogData,
+                 block->file_id,
+                 block->entities[row],
+                 block->index,
+                 block->count,
+                 &block->cont_counts[row],
+                 buffer);
+
+  if (block->fortran)
+    {
+      double *dest = block->data + row;
+
+      for (i = 0; res == ns_OK && i < block->count; i++)
+        dest[(size_t) i * block->n_entities] = buffer[i];
+
+      nslib_scratch_release (block->lib, buffer);
+    }
+
+ out:
+  if (res != ns_OK)
+    {
+      ns_mutex_lock (&block->lock);
+      if (block->res == ns_OK)
+        block->res = res;
+      ns_mutex_unlock (&block->lock);
+    }
+}
+
+static PyObject *
+do_get_analog_block (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entities", "index", "count",
+                              "fortran", "threads", NULL};
+  AnalogBlock     block;
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *ids_obj, *idx_obj, *sz_obj;
+  PyObject       *seq;
+  PyObject       *array;
+  PyObject       *counts;
+  PyObject       *res_obj;
+  uint32         *entities;
+  npy_intp        dims[2];
+  Py_ssize_t      n, i;
+  int             fortran = 0;
+  int             threads = 1;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOO|ii", kwlist,
+                                    &cobj, &iobj, &ids_obj, &idx_obj, &sz_obj,
+                                    &fortran, &threads))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (idx_obj) || !PyInt_Check (sz_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  seq = PySequence_Fast (ids_obj, "entities must be a sequence of entity ids");
+
+  if (seq == NULL)
+    return NULL;
+
+  n = PySequence_Fast_GET_SIZE (seq);
+  entities = malloc (sizeof (uint32) * (n > 0 ? n : 1));
+
+  if (entities == NULL)
+    {
+      Py_DECREF (seq);
+      return PyErr_NoMemory ();
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      PyObject *item = PySequence_Fast_GET_ITEM (seq, i);
+
+      if (!PyInt_Check (item))
+        {
+          PyErr_SetString (PyExc_TypeError, "entity ids must be integers");
+          Py_DECREF (seq);
+          free (entities);
+          return NULL;
+        }
+
+      entities[i] = (uint32) PyInt_AsUnsignedLongMask (item);
+    }
+
+  Py_DECREF (seq);
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+
+  block.lib = lib;
+  block.file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  block.entities = entities;
+  block.n_entities = (uint32) n;
+  block.index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+  block.count = (uint32) PyInt_AsUnsignedLongMask (sz_obj);
+  block.fortran = fortran;
+  block.res = ns_OK;
+
+  /* ** */
+  dims[0] = n;
+  dims[1] = block.count;
+
+  array = PyArray_New (&PyArray_Type,
+                       2,
+                       dims,
+                       NPY_DOUBLE,
+                       NULL,
+                       NULL /* data */,
+                       0 /* itemsize */,
+                       fortran ? NPY_ARRAY_FARRAY : NPY_ARRAY_CARRAY,
+                       NULL);
+
+  counts = PyArray_New (&PyArray_Type,
+                        1,
+                        dims,
+                        NPY_UINT32,
+                        NULL,
+                        NULL /* data */,
+                        0 /* itemsize */,
+                        NPY_ARRAY_CARRAY,
+                        NULL);
+
+  if (array == NULL || counts == NULL)
+    {
+      Py_XDECREF (array);
+      Py_XDECREF (counts);
+      free (entities);
+      return NULL;
+    }
+
+  block.data = PyArray_DATA ((PyArrayObject *) array);
+  block.cont_counts = PyArray_DATA ((PyArrayObject *) counts);
+
+  /* parallel reads only pay off if the library does no locking at all,
+   * since all rows belong to the same file */
+  if (lib->lock_policy != NS_LOCK_NONE)
+    threads = 1;
+
+  ns_mutex_init (&block.lock);
+
+  Py_BEGIN_ALLOW_THREADS
+  parallel_for (threads, block.n_entities, analog_block_read_row, &block);
+  Py_END_ALLOW_THREADS
+
+  ns_mutex_clear (&block.lock);
+  free (entities);
+
+  if (check_result_is_error (block.res, lib))
+    {
+      Py_DECREF (array);
+      Py_DECREF (counts);
+      return NULL;
+    }
+
+  res_obj = PyTuple_New (2);
+  PyTuple_SetItem (res_obj, 0, array);
+  PyTuple_SetItem (res_obj, 1, counts);
+
+  return res_obj;
+}
+
+/* ************************************ */
+/* streaming analog reads */
+
+/* A stream reads fixed size chunks of an analog entity on a background
+ * thread into a small ring of reused buffers, so that reading chunk k+1
+ * overlaps with the processing of chunk k. */
+
+#define STREAM_SLOT_FREE   0
+#define STREAM_SLOT_READY  1
+#define STREAM_SLOT_HELD   2
+
+typedef struct {
+  double     *data;
+  uint32      index;
+  uint32      count;
+  uint32      cont_count;
+  ns_RESULT   res;
+  int         state;
+} StreamSlot;
+
+typedef struct {
+  NsLibrary  *lib;
+  PyObject   *lib_obj;
+  uint32      file_id;
+  uint32      entity_id;
+  uint32      start;
+  uint32      stop;
+  uint32      chunk;
+  uint32      step;
+  uint32      n_chunks;
+
+  StreamSlot *slots;
+  int         n_slots;
+  uint32      next_read;
+  int         held;
+
+  NsMutex     lock;
+  NsCond      cond;
+  int         cancelled;
+  int         running;
+  NsThread    thread;
+} AnalogStream;
+
+static void
+analog_stream_producer (void *data)
+{
+  AnalogStream *stream = data;
+  StreamSlot   *slot;
+  ns_RESULT     res;
+  uint32        k;
+
+  for (k = 0; k < stream->n_chunks; k++)
+    {
+      slot = &stream->slots[k % stream->n_slots];
+
+      ns_mutex_lock (&stream->lock);
+      while (slot->state != STREAM_SLOT_FREE && !stream->cancelled)
+        ns_cond_wait (&stream->cond, &stream->lock);
+      ns_mutex_unlock (&stream->lock);
+
+      if (stream->cancelled)
+        break;
+
+      slot->index = stream->start + k * stream->step;
+      slot->count = stream->stop - slot->index;
+
+      if (slot->count > stream->chunk)
+        slot->count = stream->chunk;
+
+      NS_CALL_BYTES (res, stream->lib, stream->file_id,
+                     NS_ANALOG_BYTES (slot->cont_count, slot->count),
+                     GetAnalogData,
+                     stream->file_id,
+                     stream->entity_id,
+                     slot->index,
+                     slot->count,
+                     &slot->cont_count,
+                     slot->data);
+
+      ns_mutex_lock (&stream->lock);
+      slot->res = res;
+      slot->state = STREAM_SLOT_READY;
+      ns_cond_broadcast (&stream->cond);
+      ns_mutex_unlock (&stream->lock);
+
+      if (res != ns_OK)
+        break;
+    }
+}
+
+static void
+analog_stream_cancel (AnalogStream *stream)
+{
+  if (!stream->running)
+    return;
+
+  ns_mutex_lock (&stream->lock);
+  stream->cancelled = 1;
+  ns_cond_broadcast (&stream->cond);
+  ns_mutex_unlock (&stream->lock);
+
+  Py_BEGIN_ALLOW_THREADS
+  ns_thread_join (stream->thread);
+  Py_END_ALLOW_THREADS
+
+  stream->running = 0;
+}
+
+static void
+analog_stream_destroy (PyObject *capsule)
+{
+  AnalogStream *stream;
+  int           i;
+
+  stream = PyCapsule_GetPointer (capsule, "capi.AnalogStream");
+
+  analog_stream_cancel (stream);
+
+  for (i = 0; i < stream->n_slots; i++)
+    free (stream->slots[i].data);
+
+  free (stream->slots);
+  ns_cond_clear (&stream->cond);
+  ns_mutex_clear (&stream->lock);
+  Py_DECREF (stream->lib_obj);
+  free (stream);
+}
+
+static AnalogStream *
+analog_stream_from_capsule (PyObject *cobj)
+{
+  if (!PyCapsule_IsValid (cobj, "capi.AnalogStream"))
+    {
+      PyErr_SetString (PyExc_TypeError, "Expected AnalogStream type");
+      return NULL;
+    }
+
+  return PyCapsule_GetPointer (cobj, "capi.AnalogStream");
+}
+
+static PyObject *
+do_analog_stream_open (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "index", "count",
+                              "chunk", "overlap", "prefetch", NULL};
+  AnalogStream   *stream;
+  PyObject       *cobj;
+  PyObject       *capsule;
+  unsigned int    file_id, entity_id, index, count, chunk, overlap = 0;
+  int             prefetch = 2;
+  int             i;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OIIIII|Ii", kwlist,
+                                    &cobj, &file_id, &entity_id, &index, &count,
+                                    &chunk, &overlap, &prefetch))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Expected NsLibrary type");
+      return NULL;
+    }
+
+  if (chunk == 0 || overlap >= chunk)
+    {
+      PyErr_SetString (PyExc_ValueError, "chunk must be positive and larger than overlap");
+      return NULL;
+    }
+
+  if (prefetch < 1)
+    prefetch = 1;
+
+  stream = calloc (1, sizeof (AnalogStream));
+
+  if (stream == NULL)
+    return PyErr_NoMemory ();
+
+  stream->lib = PyCapsule_GetPointer (cobj, "capi");
+  stream->lib_obj = cobj;
+  Py_INCREF (cobj);
+
+  stream->file_id = file_id;
+  stream->entity_id = entity_id;
+  stream->start = index;
+  stream->stop = index + count;
+  stream->chunk = chunk;
+  stream->step = chunk - overlap;
+
+  if (count == 0)
+    stream->n_chunks = 0;
+  else if (count <= chunk)
+    stream->n_chunks = 1;
+  else
+    stream->n_chunks = 1 + (count - chunk + stream->step - 1) / stream->step;
+
+  /* one buffer is held by the consumer, the others are read ahead */
+  stream->n_slots = prefetch + 1;
+  stream->slots = calloc (stream->n_slots, sizeof (StreamSlot));
+  stream->held = -1;
+
+  if (stream->slots == NULL)
+    stream->n_slots = 0;
+
+  ns_mutex_init (&stream->lock);
+  ns_cond_init (&stream->cond);
+
+  capsule = PyCapsule_New (stream, "capi.AnalogStream", analog_stream_destroy);
+
+  if (capsule == NULL)
+    {
+      Py_DECREF (cobj);
+      free (stream->slots);
+      free (stream);
+      return NULL;
+    }
+
+  if (stream->slots == NULL)
+    {
+      Py_DECREF (capsule);
+      return PyErr_NoMemory ();
+    }
+
+  for (i = 0; i < stream->n_slots; i++)
+    {
+      stream->slots[i].data = malloc (sizeof (double) * chunk);
+
+      if (stream->slots[i].data == NULL)
+        {
+          Py_DECREF (capsule);
+          return PyErr_NoMemory ();
+        }
+    }
+
+  if (stream->n_chunks > 0)
+    {
+      if (ns_thread_start (&stream->thread, analog_stream_producer, stream) != 0)
+        {
+          PyErr_SetString (PgError, "Could not start reader thread");
+          Py_DECREF (capsule);
+          return NULL;
+        }
+
+      stream->running = 1;
+    }
+
+  return capsule;
+}
+
+static PyObject *
+do_analog_stream_next (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  AnalogStream *stream;
+  StreamSlot   *slot;
+  PyObject     *cobj;
+  PyObject     *array;
+  PyObject     *res_obj;
+  npy_intp      dims[1];
+
+  if (!PyArg_ParseTuple (args, "O", &cobj))
+    return NULL;
+
+  stream = analog_stream_from_capsule (cobj);
+
+  if (stream == NULL)
+    return NULL;
+
+  /* the previously returned chunk may now be reused */
+  ns_mutex_lock (&stream->lock);
+
+  if (stream->held >= 0)
+    {
+      stream->slots[stream->held].state = STREAM_SLOT_FREE;
+      stream->held = -1;
+      ns_cond_broadcast (&stream->cond);
+    }
+
+  ns_mutex_unlock (&stream->lock);
+
+  if (stream->next_read >= stream->n_chunks || !stream->running)
+    Py_RETURN_NONE;
+
+  slot = &stream->slots[stream->next_read % stream->n_slots];
+
+  Py_BEGIN_ALLOW_THREADS
+  ns_mutex_lock (&stream->lock);
+  while (slot->state != STREAM_SLOT_READY)
+    ns_cond_wait (&stream->cond, &stream->lock);
+  slot->state = STREAM_SLOT_HELD;
+  stream->held = (int) (stream->next_read % stream->n_slots);
+  ns_mutex_unlock (&stream->lock);
+  Py_END_ALLOW_THREADS
+
+  stream->next_read++;
+
+  if (check_result_is_error (slot->res, stream->lib))
+    {
+      stream->next_read = stream->n_chunks;
+      return NULL;
+    }
+
+  dims[0] = slot->count;
+  array = PyArray_SimpleNewFromData (1, dims, NPY_DOUBLE, slot->data);
+
+  if (array == NULL)
+    return NULL;
+
+  /* the buffers live as long as the stream */
+  Py_INCREF (cobj);
+  PyArray_SetBaseObject ((PyArrayObject *) array, cobj);
+
+  res_obj = PyTuple_New (3);
+  PyTuple_SetItem (res_obj, 0, PyInt_FromLong (slot->index));
+  PyTuple_SetItem (res_obj, 1, array);
+  PyTuple_SetItem (res_obj, 2, PyInt_FromLong (slot->cont_count));
+
+  return res_obj;
+}
+
+static PyObject *
+do_analog_stream_close (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  AnalogStream *stream;
+  PyObject     *cobj;
+
+  if (!PyArg_ParseTuple (args, "O", &cobj))
+    return NULL;
+
+  stream = analog_stream_from_capsule (cobj);
+
+  if (stream == NULL)
+    return NULL;
+
+  analog_stream_cancel (stream);
+  stream->next_read = stream->n_chunks;
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+do_get_segment_data (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "index", "sources",
+                              "count", "out", NULL};
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj, *src_obj;
+  PyObject       *res_obj;
+  PyObject       *array;
+  PyObject       *out = NULL;
+  uint32          file_id;
+  uint32          entity_id;
+  uint32          index;
+  uint32          count;
+  uint32          sources;
+  uint32          sample_count;
+  uint32          uint_id;
+  uint32          buffer_size;
+  ns_RESULT       res;
+  double         *buffer;
+  npy_intp        dims[2];
+  double          time_stamp;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOOO|O", kwlist,
+                                    &cobj, &iobj, &id_obj, &idx_obj, &src_obj, &sz_obj,
+                                    &out))
+    return NULL;
+
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
+      !PyInt_Check (sz_obj) || !PyInt_Check (src_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+  count = (uint32)  PyInt_AsUnsignedLongMask (sz_obj);
+  sources = (uint32)  PyInt_AsUnsignedLongMask (src_obj);
+
+  /* ** */
+  dims[0] = sources; //source count
+  dims[1] = count; //sample count
+
+  if (out != NULL && out != Py_None)
+    {
+      if (check_out_array (out, NPY_DOUBLE, dims[0] * dims[1]) == NULL)
+        return NULL;
+
+      Py_INCREF (out);
+      array = out;
+    }
+  else
+    array = PyArray_New (&PyArray_Type,
+                         2,
+                         dims,
+                         NPY_DOUBLE,
+                         NULL,
+                         NULL /* data */,
+                         0 /* itemsize */,
+                         0,
+                         NULL);
+
+  if (array == NULL)
+    return NULL;
+
+  buffer = (double *) PyArray_DATA ((PyArrayObject *) array);
+  buffer_size = (uint32) (dims[0] * dims[1] * sizeof (double));
+
+  Py_BEGIN_ALLOW_THREADS
+  NS_CALL_BYTES (res, lib, file_id, buffer_size, GetSegmentData,
+                 file_id,
+                 entity_id,
+                 index,
+                 &time_stamp,
+                 buffer,
+                 buffer_size,
+                 &sample_count,
+                 &uint_id);
+  Py_END_ALLOW_THREADS
+
+  if (check_result_is_error (res, lib))
+    {
+      Py_DECREF (array);
+      return NULL;
+    }
+  
+  res_obj = PyTuple_New (4);
+  PyTuple_SetItem (res_obj, 0, array);
+  PyTuple_SetItem (res_obj, 1, PyFloat_FromDouble (time_stamp));
+  PyTuple_SetItem (res_obj, 2, PyInt_FromLong (sample_count));
+  PyTuple_SetItem (res_obj, 3, PyInt_FromLong (uint_id));
+
+  return res_obj;
+}
+
+/* Read count segments, either starting at index or at the given indices,
+ * into data (count x stride samples), zeroing the samples the vendor does
+ * not fill. If data_step is 0, data is a scratch buffer for a single
+ * segment and only timestamps and unit ids are of interest; sample_counts
+ * may then be NULL. Does not need the GIL. */
+static ns_RESULT
+read_segment_range (NsLibrary    *lib,
+                    uint32        file_id,
+                    uint32        entity_id,
+                    uint32        index,
+                    const uint32 *indices,
+                    uint32        count,
+                    uint32        stride,
+                    double       *data,
+                    size_t        data_step,
+                    double       *timestamps,
+                    uint32       *sample_counts,
+                    uint32       *unit_ids)
+{
+  ns_RESULT  res;
+  uint32     i;
+  uint32     sample_count;
+  double    *item;
+
+  res = ns_OK;
+
+  for (i = 0; i < count; i++)
+    {
+      item = data + i * data_step;
+      if (data_step)
+        memset (item, 0, stride * sizeof (double));
+
+      NS_CALL_BYTES (res, lib, file_id, stride * sizeof (double),
+                     GetSegmentData,
+                     file_id,
+                     entity_id,
+                     indices ? indices[i] : index + i,
+                     timestamps + i,
+                     item,
+                     stride * sizeof (double),
+                     &sample_count,
+                     unit_ids + i);
+
+      if (res != ns_OK)
+        break;
+
+      if (sample_counts)
+        sample_counts[i] = sample_count;
+    }
+
+  return res;
+}
+
+/* (data, timestamps, sample counts, unit ids) of count segments */
+static PyObject *
+get_segment_range (NsLibrary    *lib,
+                   uint32        file_id,
+                   uint32        entity_id,
+                   uint32        index,
+                   const uint32 *indices,
+                   uint32        count,
+                   uint32        sources,
+                   uint32        max_samples,
+                   PyObject     *out)
+{
+  PyObject       *res_obj;
+  PyObject       *array;
+  PyObject       *times, *counts, *units;
+  ns_RESULT       res;
+  npy_intp        dims[3];
+
+  dims[0] = count;
+  dims[1] = sources;
+  dims[2] = max_samples;
+
+  if (out != NULL && out != Py_None)
+    {
+      if (check_out_array (out, NPY_DOUBLE, dims[0] * dims[1] * dims[2]) == NULL)
+        return NULL;
+
+      Py_INCREF (out);
+      array = out;
+    }
+  else
+    array = PyArray_SimpleNew (3, dims, NPY_DOUBLE);
+
+  times = PyArray_SimpleNew (1, dims, NPY_DOUBLE);
+  counts = PyArray_SimpleNew (1, dims, NPY_UINT32);
+  units = PyArray_SimpleNew (1, dims, NPY_UINT32);
+
+  if (array == NULL || times == NULL || counts == NULL || units == NULL)
+    {
+      Py_XDECREF (array);
+      Py_XDECREF (times);
+      Py_XDECREF (counts);
+      Py_XDECREF (units);
+      return NULL;
+    }
+
+  Py_BEGIN_ALLOW_THREADS
+  res = read_segment_range (lib, file_id, entity_id, index, indices, count,
+                            sources * max_samples,
+                            (double *) PyArray_DATA ((PyArrayObject *) array),
+                            (size_t) sources * max_samples,
+                            (double *) PyArray_DATA ((PyArrayObject *) times),
+                            (uint32 *) PyArray_DATA ((PyArrayObject *) counts),
+                            (uint32 *) PyArray_DATA ((PyArrayObject *) units));
+  Py_END_ALLOW_THREADS
+
+  if (check_result_is_error (res, lib))
+    {
+      Py_DECREF (array);
+      Py_DECREF (times);
+      Py_DECREF (counts);
+      Py_DECREF (units);
+      return NULL;
+    }
+
+  res_obj = PyTuple_New (4);
+  PyTuple_SetItem (res_obj, 0, array);
+  PyTuple_SetItem (res_obj, 1, times);
+  PyTuple_SetItem (res_obj, 2, counts);
+  PyTuple_SetItem (res_obj, 3, units);
+
+  return res_obj;
+}
+
+static PyObject *
+do_get_segment_data_range (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "index", "count",
+                              "sources", "max_samples", "out", NULL};
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj, *src_obj, *ms_obj;
+  PyObject       *out = NULL;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOOOO|O", kwlist,
+                                    &cobj, &iobj, &id_obj, &idx_obj, &sz_obj,
+                                    &src_obj, &ms_obj, &out))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
+      !PyInt_Check (sz_obj) || !PyInt_Check (src_obj) ||
+      !PyInt_Check (ms_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+
+  return get_segment_range (lib,
+                            (uint32) PyInt_AsUnsignedLongMask (iobj),
+                            (uint32) PyInt_AsUnsignedLongMask (id_obj),
+                            (uint32) PyInt_AsUnsignedLongMask (idx_obj),
+                            NULL,
+                            (uint32) PyInt_AsUnsignedLongMask (sz_obj),
+                            (uint32) PyInt_AsUnsignedLongMask (src_obj),
+                            (uint32) PyInt_AsUnsignedLongMask (ms_obj),
+                            out);
+}
+
+static PyObject *
+do_get_segment_data_at (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "indices",
+                              "sources", "max_samples", "out", NULL};
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *ids_obj, *src_obj, *ms_obj;
+  PyObject       *indices;
+  PyObject       *res_obj;
+  PyObject       *out = NULL;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOOO|O", kwlist,
+                                    &cobj, &iobj, &id_obj, &ids_obj,
+                                    &src_obj, &ms_obj, &out))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (src_obj) ||
+      !PyInt_Check (ms_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  indices = PyArray_FROMANY (ids_obj, NPY_UINT32, 1, 1,
+                             NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+
+  if (indices == NULL)
+    return NULL;
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+
+  res_obj = get_segment_range (lib,
+                               (uint32) PyInt_AsUnsignedLongMask (iobj),
+                               (uint32) PyInt_AsUnsignedLongMask (id_obj),
+                               0,
+                               (uint32 *) PyArray_DATA ((PyArrayObject *) indices),
+                               (uint32) PyArray_SIZE ((PyArrayObject *) indices),
+                               (uint32) PyInt_AsUnsignedLongMask (src_obj),
+                               (uint32) PyInt_AsUnsignedLongMask (ms_obj),
+                               out);
+  Py_DECREF (indices);
+  return res_obj;
+}
+
+typedef struct {
+  uint32 unit;
+  uint32 index;
+} UnitEntry;
+
+static int
+unit_entry_compare (const void *a, const void *b)
+{
+  const UnitEntry *x = a;
+  const UnitEntry *y = b;
+
+  if (x->unit != y->unit)
+    return x->unit < y->unit ? -1 : 1;
+
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* Map unit id -> (segment indices, timestamps) of all count segments of an
+ * entity, determined in a single pass over the segments */
+static PyObject *
+do_get_segment_unit_index (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "count",
+                              "sources", "max_samples", NULL};
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *sz_obj, *src_obj, *ms_obj;
+  PyObject       *dict;
+  UnitEntry      *entries;
+  ns_RESULT       res;
+  npy_intp        dims[1];
+  double         *scratch;
+  double         *timestamps;
+  uint32         *units;
+  uint32          count;
+  uint32          stride;
+  uint32          i, j, k;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOOO", kwlist,
+                                    &cobj, &iobj, &id_obj, &sz_obj,
+                                    &src_obj, &ms_obj))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (sz_obj) ||
+      !PyInt_Check (src_obj) || !PyInt_Check (ms_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  count = (uint32) PyInt_AsUnsignedLongMask (sz_obj);
+  stride = (uint32) (PyInt_AsUnsignedLongMask (src_obj) *
+                     PyInt_AsUnsignedLongMask (ms_obj));
+
+  scratch = nslib_scratch (lib, sizeof (double) * stride);
+  timestamps = malloc (sizeof (double) * (count > 0 ? count : 1));
+  units = nslib_scratch (lib, sizeof (uint32) * count);
+  entries = malloc (sizeof (UnitEntry) * (count > 0 ? count : 1));
+
+  if (scratch == NULL || timestamps == NULL || units == NULL || entries == NULL)
+    {
+      nslib_scratch_release (lib, scratch);
+      free (timestamps);
+      nslib_scratch_release (lib, units);
+      free (entries);
+      return PyErr_NoMemory ();
+    }
+
+  Py_BEGIN_ALLOW_THREADS
+  res = read_segment_range (lib,
+                            (uint32) PyInt_AsUnsignedLongMask (iobj),
+                            (uint32) PyInt_AsUnsignedLongMask (id_obj),
+                            0, NULL, count, stride, scratch, 0,
+                            timestamps, NULL, units);
+
+  for (i = 0; i < count; i++)
+    {
+      entries[i].unit = units[i];
+      entries[i].index = i;
+    }
+
+  qsort (entries, count, sizeof (UnitEntry), unit_entry_compare);
+  Py_END_ALLOW_THREADS
+
+  nslib_scratch_release (lib, scratch);
+  nslib_scratch_release (lib, units);
+
+  if (check_result_is_error (res, lib))
+    {
+      free (timestamps);
+      free (entries);
+      return NULL;
+    }
+
+  dict = PyDict_New ();
+
+  for (i = 0; i < count; i = j)
+    {
+      PyObject *indices, *times, *key, *value;
+      uint32   *idx_data;
+      double   *time_data;
+
+      for (j = i; j < count && entries[j].unit == entries[i].unit; j++)
+        ;
+
+      dims[0] = j - i;
+      indices = PyArray_SimpleNew (1, dims, NPY_UINT32);
+      times = PyArray_SimpleNew (1, dims, NPY_DOUBLE);
+
+      if (indices == NULL || times == NULL)
+        {
+          Py_XDECREF (indices);
+          Py_XDECREF (times);
+          Py_DECREF (dict);
+          dict = NULL;
+          break;
+        }
+
+      idx_data = (uint32 *) PyArray_DATA ((PyArrayObject *) indices);
+      time_data = (double *) PyArray_DATA ((PyArrayObject *) times);
+
+      for (k = i; k < j; k++)
+        {
+          idx_data[k - i] = entries[k].index;
+          time_data[k - i] = timestamps[entries[k].index];
+        }
+
+      key = PyInt_FromLong (entries[i].unit);
+      value = Py_BuildValue ("(NN)", indices, times);
+      PyDict_SetItem (dict, key, value);
+      Py_DECREF (value);
+      Py_DECREF (key);
+    }
+
+  free (timestamps);
+  free (entries);
+
+  return dict;
+}
+
+static PyObject *
+do_get_neural_data (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "index", "count",
+                              "out", NULL};
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj;
+  PyObject       *array;
+  PyObject       *out = NULL;
+  uint32          file_id;
+  uint32          entity_id;
+  uint32          index;
+  uint32          index_count;
+  ns_RESULT       res;
+  void           *buffer;
+  npy_intp        dims[1];
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOO|O", kwlist,
+                                    &cobj, &iobj, &id_obj, &idx_obj, &sz_obj,
+                                    &out))
+    return NULL;
 
-  PyErr_Format (PgError, "%s: %s", message, buf_str);
-  LocalFree (buf_msg);
-#else
-  PyErr_Format (PgError, "%s: %s", message, dlerror ());
-#endif
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
+      !PyInt_Check (sz_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+  index_count = (uint32)  PyInt_AsUnsignedLongMask (sz_obj);
+
+  /* ** */
+  dims[0] = index_count;
+
+  if (out != NULL && out != Py_None)
+    {
+      if (check_out_array (out, NPY_DOUBLE, index_count) == NULL)
+        return NULL;
+
+      Py_INCREF (out);
+      array = out;
+    }
+  else
+    array = PyArray_New (&PyArray_Type,
+                         1,
+                         dims,
+                         NPY_DOUBLE,
+                         NULL,
+                         NULL /* data */,
+                         0 /* itemsize */,
+                         NPY_ARRAY_CARRAY,
+                         NULL);
+
+  if (array == NULL)
+    return NULL;
+
+  buffer = PyArray_DATA ((PyArrayObject *) array);
+
+  Py_BEGIN_ALLOW_THREADS
+  NS_CALL_BYTES (res, lib, file_id, index_count * sizeof (double),
+                 GetNeuralData,
+                 file_id,
+                 entity_id,
+                 index,
+                 index_count,
+                 buffer);
+  Py_END_ALLOW_THREADS
+
+  if (check_result_is_error (res, lib))
+    {
+      Py_DECREF (array);
+      return NULL;
+    }
+
+  return array;
 }
 
-#ifdef _WIN32
+/* Spike counts of neural entities in the bins [t_start + k * bin_width,
+ * t_start + (k + 1) * bin_width) of [t_start, t_stop), per entity either
+ * as row of a dense matrix or as the (bin, count) pairs of its non-empty
+ * bins (for a CSR matrix) */
+typedef struct {
+  uint32 *bins;
+  uint32 *counts;
+  uint32  n;
+  uint32  size;
+} NeuralBinRow;
+
+typedef struct {
+  NsLibrary     *lib;
+  uint32         file_id;
+  const uint32  *entities;
+  const uint32  *item_counts;
+  double         t_start;
+  double         t_stop;
+  double         bin_width;
+  uint32         n_bins;
+  uint32        *dense;       /* (n_entities, n_bins) or NULL */
+  NeuralBinRow  *rows;        /* n_entities, if dense is NULL */
+  NsMutex        lock;
+  ns_RESULT      res;
+} NeuralBins;
+
 static int
-dl_load_library_win32 (const char *filename, NsLibrary *lib)
+neural_bin_row_add (NeuralBinRow *row, uint32 bin)
 {
-  HMODULE handle;
+  uint32  size;
+  void   *p;
 
-  /* FIXME: set errors */
-  handle = LoadLibraryEx (filename, 0, 0);
+  if (row->n > 0 && row->bins[row->n - 1] == bin)
+    {
+      row->counts[row->n - 1]++;
+      return 0;
+    }
 
-  if (handle == NULL)
-    return -1;
+  if (row->n == row->size)
+    {
+      size = row->size ? 2 * row->size : 64;
 
-  lib->dl_handle = handle;
+      if ((p = realloc (row->bins, sizeof (uint32) * size)) == NULL)
+        return -1;
+      row->bins = p;
+
+      if ((p = realloc (row->counts, sizeof (uint32) * size)) == NULL)
+        return -1;
+      row->counts = p;
+
+      row->size = size;
+    }
 
+  row->bins[row->n] = bin;
+  row->counts[row->n] = 1;
+  row->n++;
   return 0;
 }
 
-#else
+/* The timestamps are read in blocks; as they are sorted, each one is
+ * binned in constant time and the bins of a row come out in order. */
+static void
+neural_bins_row (void *data, uint32 i)
+{
+  NeuralBins *nb = data;
+  ns_RESULT   res;
+  double     *scratch;
+  uint32     *dense;
+  uint32      first, count, pos, n, k, bin;
+  double      x;
 
-static int
-dl_load_library_unix (const char *filename, NsLibrary *lib)
+  dense = nb->dense ? nb->dense + (size_t) i * nb->n_bins : NULL;
+  scratch = nslib_scratch (nb->lib, sizeof (double) * NS_REDUCE_BLOCK);
+
+  if (scratch == NULL)
+    {
+      res = ns_LIBERROR;
+      goto out;
+    }
+
+  res = index_ranges (nb->lib, nb->file_id, nb->entities + i,
+                      nb->item_counts + i, 1, &nb->t_start, &nb->t_stop, 1,
+                      &first, &count);
+
+  for (pos = 0; res == ns_OK && pos < count; pos += n)
+    {
+      n = count - pos < NS_REDUCE_BLOCK ? count - pos : NS_REDUCE_BLOCK;
+
+      NS_CALL_BYTES (res, nb->lib, nb->file_id, n * sizeof (double),
+                     GetNeuralData, nb->file_id, nb->entities[i],
+                     first + pos, n, scratch);
+
+      for (k = 0; res == ns_OK && k < n; k++)
+        {
+          x = floor ((scratch[k] - nb->t_start) / nb->bin_width);
+
+          /* timestamps outside the window through rounding */
+          if (! (x >= 0.0))
+            continue;
+
+          bin = x < nb->n_bins ? (uint32) x : nb->n_bins - 1;
+
+          if (dense != NULL)
+            dense[bin]++;
+          else if (neural_bin_row_add (&nb->rows[i], bin))
+            res = ns_LIBERROR;
+        }
+    }
+
+  nslib_scratch_release (nb->lib, scratch);
+
+ out:
+  if (res != ns_OK)
+    {
+      ns_mutex_lock (&nb->lock);
+      if (nb->res == ns_OK)
+        nb->res = res;
+      ns_mutex_unlock (&nb->lock);
+    }
+}
+
+/* The rows as CSR matrix (data, indices, indptr, n_bins) */
+static PyObject *
+neural_bins_to_csr (NeuralBins *nb, uint32 n_entities)
 {
-   int         flags;
-   void       *dlh;
+  PyObject  *data, *indices, *indptr;
+  npy_intp   dims[1];
+  npy_intp  *ptr;
+  npy_intp   nnz;
+  uint32     i;
 
-  flags = RTLD_NOW;
+  for (nnz = 0, i = 0; i < n_entities; i++)
+    nnz += nb->rows[i].n;
 
-  dlh = dlopen (filename, flags);
+  dims[0] = nnz;
+  data = PyArray_SimpleNew (1, dims, NPY_UINT32);
+  indices = PyArray_SimpleNew (1, dims, NPY_INT32);
+  dims[0] = (npy_intp) n_entities + 1;
+  indptr = PyArray_SimpleNew (1, dims, NPY_INTP);
 
-  if (dlh == NULL)
-    return -1;
+  if (data == NULL || indices == NULL || indptr == NULL)
+    {
+      Py_XDECREF (data);
+      Py_XDECREF (indices);
+      Py_XDECREF (indptr);
+      return NULL;
+    }
+
+  ptr = PyArray_DATA ((PyArrayObject *) indptr);
+  ptr[0] = 0;
+
+  for (i = 0; i < n_entities; i++)
+    {
+      NeuralBinRow *row = &nb->rows[i];
+
+      memcpy ((uint32 *) PyArray_DATA ((PyArrayObject *) data) + ptr[i],
+              row->counts, sizeof (uint32) * row->n);
+      memcpy ((uint32 *) PyArray_DATA ((PyArrayObject *) indices) + ptr[i],
+              row->bins, sizeof (uint32) * row->n);
+      ptr[i + 1] = ptr[i] + row->n;
+    }
+
+  return Py_BuildValue ("(NNNI)", data, indices, indptr, nb->n_bins);
+}
+
+static PyObject *
+do_bin_neural (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entities", "item_counts",
+                              "t_start", "t_stop", "bin_width", "sparse",
+                              "threads", NULL};
+  NeuralBins      nb;
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *ent_obj, *cnt_obj;
+  PyObject       *entities, *item_counts;
+  PyObject       *result = NULL;
+  npy_intp        dims[2];
+  npy_intp        n_entities = 0;
+  double          t_start, t_stop, bin_width, span;
+  int             sparse = 0;
+  int             threads = 1;
+  npy_intp        i;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOddd|ii", kwlist,
+                                    &cobj, &iobj, &ent_obj, &cnt_obj,
+                                    &t_start, &t_stop, &bin_width,
+                                    &sparse, &threads))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  if (! (bin_width > 0.0) || ! (t_stop >= t_start))
+    {
+      PyErr_SetString (PyExc_ValueError,
+                       "bin_width must be positive and t_stop >= t_start");
+      return NULL;
+    }
+
+  /* the last bin may be partial; a quotient that is integral up to
+   * rounding (e.g. 1.0 / 0.1) gives exactly that many bins */
+  span = (t_stop - t_start) / bin_width;
+
+  if (span > 4294967295.0)
+    {
+      PyErr_SetString (PyExc_ValueError, "Too many bins");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  nb.rows = NULL;
+
+  entities = PyArray_FROMANY (ent_obj, NPY_UINT32, 1, 1,
+                              NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+  item_counts = PyArray_FROMANY (cnt_obj, NPY_UINT32, 1, 1,
+                                 NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+
+  if (entities == NULL || item_counts == NULL)
+    goto out;
+
+  n_entities = PyArray_SIZE ((PyArrayObject *) entities);
+
+  if (PyArray_SIZE ((PyArrayObject *) item_counts) != n_entities)
+    {
+      PyErr_SetString (PyExc_ValueError,
+                       "entities and item_counts must have the same length");
+      goto out;
+    }
+
+  nb.lib = lib;
+  nb.file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  nb.entities = PyArray_DATA ((PyArrayObject *) entities);
+  nb.item_counts = PyArray_DATA ((PyArrayObject *) item_counts);
+  nb.t_start = t_start;
+  nb.t_stop = t_stop;
+  nb.bin_width = bin_width;
+  nb.n_bins = (uint32) floor (span);
+  if (span - nb.n_bins > 1e-9)
+    nb.n_bins++;
+  nb.dense = NULL;
+  nb.res = ns_OK;
+
+  if (sparse)
+    {
+      nb.rows = calloc (n_entities > 0 ? n_entities : 1, sizeof (NeuralBinRow));
+
+      if (nb.rows == NULL)
+        {
+          PyErr_NoMemory ();
+          goto out;
+        }
+    }
+  else
+    {
+      dims[0] = n_entities;
+      dims[1] = nb.n_bins;
+      result = PyArray_ZEROS (2, dims, NPY_UINT32, 0);
+
+      if (result == NULL)
+        goto out;
+
+      nb.dense = PyArray_DATA ((PyArrayObject *) result);
+    }
+
+  /* as for get_analog_block, entities are only read in parallel if the
+   * library does no locking */
+  if (lib->lock_policy != NS_LOCK_NONE)
+    threads = 1;
+
+  ns_mutex_init (&nb.lock);
+
+  if (nb.n_bins > 0)
+    {
+      Py_BEGIN_ALLOW_THREADS
+      parallel_for (threads, (uint32) n_entities, neural_bins_row, &nb);
+      Py_END_ALLOW_THREADS
+    }
+
+  ns_mutex_clear (&nb.lock);
+
+  if (check_result_is_error (nb.res, lib))
+    Py_CLEAR (result);
+  else if (sparse)
+    result = neural_bins_to_csr (&nb, (uint32) n_entities);
+
+ out:
+  if (nb.rows != NULL)
+    {
+      for (i = 0; i < n_entities; i++)
+        {
+          free (nb.rows[i].bins);
+          free (nb.rows[i].counts);
+        }
+      free (nb.rows);
+    }
+
+  Py_XDECREF (entities);
+  Py_XDECREF (item_counts);
+  return result;
+}
+
+static PyObject *
+do_get_index_by_time(PyObject *self, PyObject *args, PyObject *kwds)
+{
+  NsLibrary  *lib;
+  PyObject   *cobj;
+  PyObject   *iobj, *id_obj, *tp_obj, *fl_obj;
+  double      timepoint;
+  uint32      file_id;
+  uint32      entity_id;
+  uint32      index;
+  uint32      flags;
+  ns_RESULT   res;
+
+
+  if (!PyArg_ParseTuple (args, "OOOOO", &cobj, &iobj, &id_obj, &tp_obj, &fl_obj))
+    return NULL;
+
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) ||
+      !(PyFloat_Check (tp_obj) || PyInt_Check (tp_obj)) ||
+      !PyInt_Check (fl_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+  timepoint = PyFloat_AsDouble (tp_obj);
+  flags = (uint32) PyInt_AsUnsignedLongMask (fl_obj);
+
+  Py_BEGIN_ALLOW_THREADS
+  NS_CALL (res, lib, file_id, GetIndexByTime,
+           file_id,
+           entity_id,
+           timepoint,
+           flags,
+           &index);
+  Py_END_ALLOW_THREADS
+  
+  if (check_result_is_error (res, lib))
+    return NULL;
+
+  return PyInt_FromLong (index);
+}
+
+static PyObject *
+do_get_time_by_index (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj;
+  uint32          file_id;
+  uint32          entity_id;
+  uint32          index;
+  double          timepoint;
+  ns_RESULT       res;
+
+  if (!PyArg_ParseTuple (args, "OOOO", &cobj, &iobj, &id_obj, &idx_obj))
+    return NULL;
+
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+
+  Py_BEGIN_ALLOW_THREADS
+  NS_CALL (res, lib, file_id, GetTimeByIndex,
+           file_id,
+           entity_id,
+           index,
+           &timepoint);
+  Py_END_ALLOW_THREADS
+  
+  if (check_result_is_error (res, lib))
+    return NULL;
+
+  return Py_BuildValue ("d", timepoint);
+}
+
+static PyObject *
+do_get_analog_segments (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "count",
+                              "sample_rate", NULL};
+  AffineTable     table;
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *sz_obj;
+  PyObject       *starts, *times;
+  ns_RESULT       res;
+  npy_intp        dims[1];
+  double          sample_rate;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOd", kwlist,
+                                    &cobj, &iobj, &id_obj, &sz_obj,
+                                    &sample_rate))
+    return NULL;
+
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj) || !PyInt_Check (sz_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
+
+  if (! (sample_rate > 0.0))
+    {
+      PyErr_SetString (PyExc_ValueError, "sample_rate must be positive");
+      return NULL;
+    }
+
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  memset (&table, 0, sizeof (table));
+  table.count = (uint32) PyInt_AsUnsignedLongMask (sz_obj);
+  table.sample_rate = sample_rate;
 
-  lib->dl_handle = dlh;
+  Py_BEGIN_ALLOW_THREADS
+  res = affine_table_build (lib,
+                            (uint32) PyInt_AsUnsignedLongMask (iobj),
+                            (uint32) PyInt_AsUnsignedLongMask (id_obj),
+                            &table);
+  Py_END_ALLOW_THREADS
 
-  return 0;
-}
-#endif
+  if (check_result_is_error (res, lib))
+    {
+      free (table.starts);
+      free (table.times);
+      return NULL;
+    }
 
-static NsLibrary *
-dl_load_library (const char *filename)
-{
-  int res;
-  NsLibrary *lib;
+  dims[0] = table.n_segs;
+  starts = PyArray_SimpleNew (1, dims, NPY_UINT32);
+  times = PyArray_SimpleNew (1, dims, NPY_DOUBLE);
 
-  lib = malloc (sizeof (NsLibrary));
+  if (starts != NULL && times != NULL)
+    {
+      memcpy (PyArray_DATA ((PyArrayObject *) starts), table.starts,
+              table.n_segs * sizeof (uint32));
+      memcpy (PyArray_DATA ((PyArrayObject *) times), table.times,
+              table.n_segs * sizeof (double));
+    }
 
-#ifdef _WIN32
-  res = dl_load_library_win32 (filename, lib);
-#else
-  res = dl_load_library_unix (filename, lib);
-#endif
+  free (table.starts);
+  free (table.times);
 
-  if (res != 0)
+  if (starts == NULL || times == NULL)
     {
-      dl_set_error ("Could not load library");
-      free (lib);
-      lib = NULL;
+      Py_XDECREF (starts);
+      Py_XDECREF (times);
+      return NULL;
     }
 
-  return lib;
+  return Py_BuildValue ("(NN)", starts, times);
 }
 
+/* Optional segment table (starts, times) for the vectorized lookups;
+ * returns the converted arrays in *objs that need to be released */
 static int
-dl_unload_library (NsLibrary *lib)
+affine_table_from_args (AffineTable *table,
+                        PyObject    *starts_obj,
+                        PyObject    *times_obj,
+                        uint32       count,
+                        double       sample_rate,
+                        PyObject   **objs)
 {
-  int res;
+  memset (table, 0, sizeof (AffineTable));
+  objs[0] = objs[1] = NULL;
 
-#ifdef _WIN32
-  res = ! FreeLibrary (lib->dl_handle);
-#else
-  res = dlclose (lib->dl_handle);
-#endif
+  if (starts_obj == NULL || starts_obj == Py_None ||
+      times_obj == NULL || times_obj == Py_None || ! (sample_rate > 0.0))
+    return 0;
 
-  if (res != 0)
-    dl_set_error ("Could not unload library");
+  objs[0] = PyArray_FROMANY (starts_obj, NPY_UINT32, 1, 1,
+                             NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+  objs[1] = PyArray_FROMANY (times_obj, NPY_DOUBLE, 1, 1,
+                             NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
 
-  free (lib);
-  return res;
+  if (objs[0] == NULL || objs[1] == NULL)
+    {
+      Py_XDECREF (objs[0]);
+      Py_XDECREF (objs[1]);
+      return -1;
+    }
+
+  if (PyArray_SIZE ((PyArrayObject *) objs[0]) !=
+      PyArray_SIZE ((PyArrayObject *) objs[1]))
+    {
+      PyErr_SetString (PyExc_ValueError, "starts and times differ in size");
+      Py_DECREF (objs[0]);
+      Py_DECREF (objs[1]);
+      return -1;
+    }
+
+  table->n_segs = (uint32) PyArray_SIZE ((PyArrayObject *) objs[0]);
+  table->starts = (uint32 *) PyArray_DATA ((PyArrayObject *) objs[0]);
+  table->times = (double *) PyArray_DATA ((PyArrayObject *) objs[1]);
+  table->count = count;
+  table->sample_rate = sample_rate;
+
+  return 0;
 }
 
 static PyObject *
-library_open (PyObject *self, PyObject *args, PyObject *kwds)
+do_get_times_by_index (PyObject *self, PyObject *args, PyObject *kwds)
 {
-  NsLibrary  *lib;
-  PyObject   *lib_handle;
-  const char *filename;
-  int         res;
+  static char    *kwlist[] = {"library", "file", "entity", "indices",
+                              "count", "sample_rate", "starts", "times", NULL};
+  AffineTable     table;
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *ids_obj;
+  PyObject       *starts_obj = NULL, *times_obj = NULL;
+  PyObject       *objs[2];
+  PyObject       *indices;
+  PyObject       *result;
+  ns_RESULT       res;
+  unsigned int    count = 0;
+  double          sample_rate = 0.0;
 
-  if (!PyArg_ParseTuple (args, "s", &filename))
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOO|IdOO", kwlist,
+                                    &cobj, &iobj, &id_obj, &ids_obj,
+                                    &count, &sample_rate,
+                                    &starts_obj, &times_obj))
     return NULL;
 
-  lib = dl_load_library (filename);
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
+    }
 
-  if (lib == NULL)
+  if (affine_table_from_args (&table, starts_obj, times_obj, count,
+                              sample_rate, objs))
     return NULL;
 
-  res = dl_assign_pointers (lib);
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  indices = PyArray_FROMANY (ids_obj, NPY_UINT32, 0, 0,
+                             NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+  result = NULL;
 
-  if (res != 0)
+  if (indices != NULL)
+    result = PyArray_SimpleNew (PyArray_NDIM ((PyArrayObject *) indices),
+                                PyArray_DIMS ((PyArrayObject *) indices),
+                                NPY_DOUBLE);
+
+  if (result != NULL)
     {
-      dl_unload_library (lib);
-      return NULL;
+      Py_BEGIN_ALLOW_THREADS
+      res = times_by_index (lib,
+                            (uint32) PyInt_AsUnsignedLongMask (iobj),
+                            (uint32) PyInt_AsUnsignedLongMask (id_obj),
+                            &table,
+                            (uint32 *) PyArray_DATA ((PyArrayObject *) indices),
+                            PyArray_SIZE ((PyArrayObject *) indices),
+                            (double *) PyArray_DATA ((PyArrayObject *) result));
+      Py_END_ALLOW_THREADS
+
+      if (check_result_is_error (res, lib))
+        {
+          Py_DECREF (result);
+          result = NULL;
+        }
     }
 
-  lib_handle = PyCapsule_New (lib, "capi", NULL);
-
-  return lib_handle;
+  Py_XDECREF (indices);
+  Py_XDECREF (objs[0]);
+  Py_XDECREF (objs[1]);
+  return result;
 }
 
-/************* python3 function redefinition*********/ 
-#if PY_MAJOR_VERSION >= 3
-#define PyString_FromString(mystring) PyUnicode_FromString(mystring)
-#define PyString_FromStringAndSize(buffer, data_ret_size) PyUnicode_FromStringAndSize(buffer, data_ret_size)
-#define PyInt_AsUnsignedLongMask(integer) PyLong_AsUnsignedLongMask(integer)
-#define PyInt_FromLong(integer) PyLong_FromLong(integer)
-#define PyInt_Check(integer) PyLong_Check(integer)
-#define init_capi(void) PyInit__capi(void)
-#endif
-
 static PyObject *
-library_close (PyObject *self, PyObject *args, PyObject *kwds)
+do_get_indices_by_time (PyObject *self, PyObject *args, PyObject *kwds)
 {
-  PyObject  *cobj;
-  NsLibrary *lib;
-  int        res;
-
-  if (!PyArg_ParseTuple (args, "O", &cobj))
+  static char    *kwlist[] = {"library", "file", "entity", "times", "position",
+                              "count", "sample_rate", "starts", "seg_times",
+                              NULL};
+  AffineTable     table;
+  NsLibrary      *lib;
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *tp_obj;
+  PyObject       *starts_obj = NULL, *times_obj = NULL;
+  PyObject       *objs[2];
+  PyObject       *times;
+  PyObject       *result;
+  ns_RESULT       res;
+  int             position;
+  unsigned int    count = 0;
+  double          sample_rate = 0.0;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOi|IdOO", kwlist,
+                                    &cobj, &iobj, &id_obj, &tp_obj, &position,
+                                    &count, &sample_rate,
+                                    &starts_obj, &times_obj))
     return NULL;
 
-
-  if (!PyCapsule_CheckExact (cobj))
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      !PyInt_Check (id_obj))
     {
-      PyErr_SetString (PyExc_TypeError, "Expected NsLibrary type");
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
       return NULL;
     }
 
-  lib = PyCapsule_GetPointer (cobj, "capi");
+  if (affine_table_from_args (&table, starts_obj, times_obj, count,
+                              sample_rate, objs))
+    return NULL;
 
-  res = dl_unload_library (lib);
+  lib = PyCapsule_GetPointer (cobj, "capi");
+  times = PyArray_FROMANY (tp_obj, NPY_DOUBLE, 0, 0,
+                           NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+  result = NULL;
 
-  Py_DECREF(cobj);
+  if (times != NULL)
+    result = PyArray_SimpleNew (PyArray_NDIM ((PyArrayObject *) times),
+                                PyArray_DIMS ((PyArrayObject *) times),
+                                NPY_UINT32);
 
-  if (res != 0)
-    return NULL;
+  if (result != NULL)
+    {
+      Py_BEGIN_ALLOW_THREADS
+      res = indices_by_time (lib,
+                             (uint32) PyInt_AsUnsignedLongMask (iobj),
+                             (uint32) PyInt_AsUnsignedLongMask (id_obj),
+                             &table,
+                             (double *) PyArray_DATA ((PyArrayObject *) times),
+                             PyArray_SIZE ((PyArrayObject *) times),
+                             position,
+                             (uint32 *) PyArray_DATA ((PyArrayObject *) result));
+      Py_END_ALLOW_THREADS
+
+      if (check_result_is_error (res, lib))
+        {
+          Py_DECREF (result);
+          result = NULL;
+        }
+    }
 
-  Py_RETURN_NONE;
+  Py_XDECREF (times);
+  Py_XDECREF (objs[0]);
+  Py_XDECREF (objs[1]);
+  return result;
 }
 
 static PyObject *
-do_get_library_info (PyObject *self, PyObject *args, PyObject *kwds)
+do_get_index_ranges (PyObject *self, PyObject *args, PyObject *kwds)
 {
-  PyObject       *cobj;
-  PyObject       *dict;
+  static char    *kwlist[] = {"library", "file", "entities", "item_counts",
+                              "t_start", "t_stop", NULL};
   NsLibrary      *lib;
-  ns_LIBRARYINFO  info;
+  PyObject       *cobj;
+  PyObject       *iobj, *ent_obj, *cnt_obj, *start_obj, *stop_obj;
+  PyObject       *entities, *item_counts, *t_start, *t_stop;
+  PyObject       *first = NULL, *count = NULL;
+  PyObject       *result = NULL;
   ns_RESULT       res;
+  npy_intp        dims[2];
 
-  if (!PyArg_ParseTuple (args, "O", &cobj))
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOOO", kwlist,
+                                    &cobj, &iobj, &ent_obj, &cnt_obj,
+                                    &start_obj, &stop_obj))
     return NULL;
 
-  
-  if (!PyCapsule_CheckExact (cobj))
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj))
     {
-      PyErr_SetString (PyExc_TypeError, "Expected NsLibrary type");
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
       return NULL;
     }
-  
+
   lib = PyCapsule_GetPointer (cobj, "capi");
-  res = lib->GetLibraryInfo (&info, sizeof (info));
 
-  if (check_result_is_error (res, lib))
-    return NULL;
+  entities = PyArray_FROMANY (ent_obj, NPY_UINT32, 1, 1,
+                              NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+  item_counts = PyArray_FROMANY (cnt_obj, NPY_UINT32, 1, 1,
+                                 NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+  t_start = PyArray_FROMANY (start_obj, NPY_DOUBLE, 1, 1,
+                             NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+  t_stop = PyArray_FROMANY (stop_obj, NPY_DOUBLE, 1, 1,
+                            NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+
+  if (entities == NULL || item_counts == NULL ||
+      t_start == NULL || t_stop == NULL)
+    goto out;
+
+  if (PyArray_SIZE ((PyArrayObject *) entities) !=
+      PyArray_SIZE ((PyArrayObject *) item_counts) ||
+      PyArray_SIZE ((PyArrayObject *) t_start) !=
+      PyArray_SIZE ((PyArrayObject *) t_stop))
+    {
+      PyErr_SetString (PyExc_ValueError, "Argument sizes do not match");
+      goto out;
+    }
 
-  dict = PyDict_New ();
-  dict_set_item_eat_ref (dict, "Description", PyString_FromString (info.szDescription));
-  dict_set_item_eat_ref (dict, "Creator", PyString_FromString (info.szCreator));
+  dims[0] = PyArray_SIZE ((PyArrayObject *) entities);
+  dims[1] = PyArray_SIZE ((PyArrayObject *) t_start);
 
-  dict_set_item_eat_ref (dict, "LibVersionMaj", PyInt_FromLong (info.dwLibVersionMaj));
-  dict_set_item_eat_ref (dict, "LibVersionMin", PyInt_FromLong (info.dwLibVersionMin));
-  dict_set_item_eat_ref (dict, "APIVersionMaj", PyInt_FromLong (info.dwAPIVersionMaj));
-  dict_set_item_eat_ref (dict, "APIVersionMin", PyInt_FromLong (info.dwAPIVersionMin));
-  
-  dict_set_item_eat_ref (dict, "Time_Year", PyInt_FromLong (info.dwTime_Year));
-  dict_set_item_eat_ref (dict, "Time_Month", PyInt_FromLong (info.dwTime_Month));
-  dict_set_item_eat_ref (dict, "Time_Day", PyInt_FromLong (info.dwTime_Day));
+  first = PyArray_SimpleNew (2, dims, NPY_UINT32);
+  count = PyArray_SimpleNew (2, dims, NPY_UINT32);
 
-  dict_set_item_eat_ref (dict, "MaxFiles", PyInt_FromLong (info.dwMaxFiles));
+  if (first == NULL || count == NULL)
+    goto out;
 
-  return dict;
+  Py_BEGIN_ALLOW_THREADS
+  res = index_ranges (lib,
+                      (uint32) PyInt_AsUnsignedLongMask (iobj),
+                      (uint32 *) PyArray_DATA ((PyArrayObject *) entities),
+                      (uint32 *) PyArray_DATA ((PyArrayObject *) item_counts),
+                      dims[0],
+                      (double *) PyArray_DATA ((PyArrayObject *) t_start),
+                      (double *) PyArray_DATA ((PyArrayObject *) t_stop),
+                      dims[1],
+                      (uint32 *) PyArray_DATA ((PyArrayObject *) first),
+                      (uint32 *) PyArray_DATA ((PyArrayObject *) count));
+  Py_END_ALLOW_THREADS
+
+  if (check_result_is_error (res, lib))
+    goto out;
+
+  result = Py_BuildValue ("(OO)", first, count);
+
+ out:
+  Py_XDECREF (entities);
+  Py_XDECREF (item_counts);
+  Py_XDECREF (t_start);
+  Py_XDECREF (t_stop);
+  Py_XDECREF (first);
+  Py_XDECREF (count);
+  return result;
 }
 
+/* ************************************************************************** */
+/* Worker pool for asynchronous reads: the submit_* functions queue a job
+ * and return a token right away, the job runs on one of the pool threads
+ * (calls are serialized per the lock policy of the library, as everywhere
+ * else) and its result is collected with pool_reap. Whenever results
+ * become available a byte is written to the wakeup fd (cf. pool_start),
+ * which an event loop can watch. The pool lives as long as the process;
+ * a forked child starts a pool of its own (cf. pool_current).
+ *
+ * Jobs are queued per file of a library, in a skip list sorted by entity
+ * and index and in the order they were submitted. The threads take turns
+ * over the files, skipping those whose calls would
+ * only wait for the lock of the library (cf. pool_file_ready), and within
+ * a file sweep upwards from where the last read ended, so the vendor
+ * library sees its file read sequentially. Queued analog (float64) and
+ * neural reads of an entity that overlap or touch are merged into one
+ * vendor call, whose data is then split among them (cf. job_run_batch). */
+
+enum {
+  NS_JOB_ANALOG,
+  NS_JOB_NEURAL,
+  NS_JOB_EVENTS,
+  NS_JOB_SEGMENTS,
+  NS_JOB_RANGES
+};
+
+#define NS_JOB_ARRAYS 6
+
+/* Threads of the pool unless started with another number (pool_start,
+ * i.e. WorkerPool.threads, which defaults to it as POOL_THREADS) */
+#define NS_POOL_THREADS 4
+
+/* Levels of the skip lists of the file queues, with one in four jobs on
+ * the next level that covers some 16 million queued jobs */
+#define NS_POOL_LEVELS 12
+
+typedef struct _NsJob NsJob;
+
+struct _NsJob {
+  NsJob      *next;
+  NsJob      *batch;                /* jobs merged into this one */
+  NsJob      *forward[NS_POOL_LEVELS]; /* while queued, cf. NsFileQueue */
+  int         levels;
+  NsJob      *older;                /* while queued, in submission order */
+  NsJob      *newer;
+  long        token;
+  uint64_t    submitted;            /* ns_time_ns () */
+  int         kind;
+  NsLibrary  *lib;                  /* referenced while the job exists */
+  uint32      file_id;
+  uint32      entity_id;
+  uint32      index;
+  uint32      count;
+  ns_RESULT   res;
+  char       *error;                /* message of the library, if res failed */
+
+  int         type_num;             /* analog: dtype of the data */
+  double      sample_rate;          /* analog */
+  double      scale;                /* analog: int16 encoding */
+  double      offset;
+  uint32      cont_count;           /* analog: result */
+  uint32      event_type;           /* events */
+  uint32      data_size;            /* events: size of the value */
+  int         single;               /* events: (timestamp, value) of one */
+  uint32      sources;              /* segments */
+  uint32      max_samples;
+
+  /* arrays read into (or from), owned; the Python objects are only
+   * touched with the GIL held */
+  PyObject   *arrays[NS_JOB_ARRAYS];
+};
+
+typedef struct _NsFileQueue NsFileQueue;
+
+/* The jobs queued for one file of a library */
+struct _NsFileQueue {
+  NsFileQueue *next;
+  NsLibrary   *lib;
+  uint32       file_id;
+  NsJob       *jobs[NS_POOL_LEVELS]; /* skip list, by entity, index, token */
+  NsJob       *oldest;              /* the jobs by submission */
+  NsJob       *newest;
+  int          running;
+  uint32       cursor_entity;       /* where the last read ended */
+  uint32       cursor_index;
+};
+
+typedef struct {
+  NsMutex      lock;
+  NsCond       cond;
+  NsFileQueue *files;               /* files with queued or running jobs */
+  NsFileQueue *turn;                /* the file to look at first */
+  NsJob       *done;                /* LIFO */
+  int          n_threads;
+  int          wakeup[2];
+  long         next_token;
+  uint32_t     seed;                /* for the levels of queued jobs */
+  int          running;             /* jobs taken off the queues */
+#ifndef _WIN32
+  int          forking;             /* cf. pool_atfork_prepare */
+  pid_t        pid;                 /* the threads are not forked along */
+#endif
+} NsPool;
+
+/* Upper bound of the items of a merged read */
+#define NS_POOL_MERGE_MAX  (1 << 20)
+
+/* Jobs that waited that long are run next, whatever the sweep */
+#define NS_POOL_MAX_WAIT_NS  100000000
+
+/* Created (with the GIL held) by pool_start or the first submit */
+static NsPool *ns_pool = NULL;
+
+#define JOB_DATA(_job, _i) PyArray_DATA ((PyArrayObject *) (_job)->arrays[_i])
+
+/* Does not need the GIL */
 static ns_RESULT
-get_and_add_file_info (NsLibrary *lib,
-		       uint32     file_id,
-		       PyObject  *dict)
+job_run (NsJob *job)
 {
-  ns_FILEINFO     info;
-  ns_RESULT       res;
+  NsLibrary *lib = job->lib;
+  ns_RESULT  res = ns_OK;
+  double    *scratch;
+  void      *buffer;
+  uint32     block;
 
-  res = lib->GetFileInfo (file_id, &info, sizeof (info));
+  switch (job->kind)
+    {
+    case NS_JOB_ANALOG:
+      if (job->type_num == NPY_DOUBLE)
+        NS_CALL_BYTES (res, lib, job->file_id,
+                       NS_ANALOG_BYTES (job->cont_count, job->count),
+                       GetAnalogData, job->file_id, job->entity_id,
+                       job->index, job->count, &job->cont_count,
+                       JOB_DATA (job, 0));
+      else
+        {
+          block = job->count;
+          if (job->sample_rate > 0.0 && block > NS_CONVERT_BLOCK)
+            block = NS_CONVERT_BLOCK;
+
+          scratch = nslib_scratch (lib, sizeof (double) * block);
+
+          if (scratch == NULL)
+            return ns_LIBERROR;
+
+          res = read_analog_converted (lib, job->file_id, job->entity_id,
+                                       job->index, job->count,
+                                       job->sample_rate, job->type_num,
+                                       job->scale, job->offset, scratch,
+                                       block, JOB_DATA (job, 0),
+                                       &job->cont_count);
+          nslib_scratch_release (lib, scratch);
+        }
+
+      if (res == ns_OK && job->arrays[1] != NULL)
+        res = compute_times (lib, job->file_id, job->entity_id, job->index,
+                             job->count, job->cont_count, job->sample_rate,
+                             JOB_DATA (job, 1));
+      break;
 
-  if (res != ns_OK)
-    return res;
+    case NS_JOB_NEURAL:
+      NS_CALL_BYTES (res, lib, job->file_id, job->count * sizeof (double),
+                     GetNeuralData, job->file_id, job->entity_id,
+                     job->index, job->count, JOB_DATA (job, 0));
+      break;
 
-  dict_set_item_eat_ref (dict, "FileType", PyString_FromString (info.szFileType));
-  dict_set_item_eat_ref (dict, "AppName", PyString_FromString (info.szAppName));
-  dict_set_item_eat_ref (dict, "FileComment", PyString_FromString (info.szFileComment));
+    case NS_JOB_EVENTS:
+      buffer = NULL;
+      if (job->event_type != ns_EVENT_TEXT && job->event_type != ns_EVENT_CSV)
+        {
+          buffer = nslib_scratch (lib, event_staging_size (job->event_type,
+                                                           job->data_size,
+                                                           job->count));
+          if (buffer == NULL)
+            return ns_LIBERROR;
+        }
+
+      res = read_event_range (lib, job->file_id, job->entity_id, job->index,
+                              job->count, job->event_type, job->data_size,
+                              JOB_DATA (job, 0),
+                              PyArray_ITEMSIZE ((PyArrayObject *) job->arrays[0]),
+                              buffer);
+      nslib_scratch_release (lib, buffer);
+      break;
 
-  dict_set_item_eat_ref (dict, "EntityCount", PyInt_FromLong (info.dwEntityCount));
-  dict_set_item_eat_ref (dict, "TimeStampResolution", PyFloat_FromDouble (info.dTimeStampResolution));
-  dict_set_item_eat_ref (dict, "TimeSpan", PyFloat_FromDouble (info.dTimeSpan));
+    case NS_JOB_SEGMENTS:
+      res = read_segment_range (lib, job->file_id, job->entity_id, job->index,
+                                NULL, job->count,
+                                job->sources * job->max_samples,
+                                JOB_DATA (job, 0),
+                                (size_t) job->sources * job->max_samples,
+                                JOB_DATA (job, 1), JOB_DATA (job, 2),
+                                JOB_DATA (job, 3));
+      break;
 
-  dict_set_item_eat_ref (dict, "Time_Year", PyInt_FromLong (info.dwTime_Year));
-  dict_set_item_eat_ref (dict, "Time_Month", PyInt_FromLong (info.dwTime_Month));
-  dict_set_item_eat_ref (dict, "Time_Day", PyInt_FromLong (info.dwTime_Day));
-  dict_set_item_eat_ref (dict, "Time_Hour", PyInt_FromLong (info.dwTime_Hour));
-  dict_set_item_eat_ref (dict, "Time_Min", PyInt_FromLong (info.dwTime_Min));
-  dict_set_item_eat_ref (dict, "Time_Sec", PyInt_FromLong (info.dwTime_Sec));
-  dict_set_item_eat_ref (dict, "Time_MilliSec", PyInt_FromLong (info.dwTime_MilliSec));
+    case NS_JOB_RANGES:
+      res = index_ranges (lib, job->file_id, JOB_DATA (job, 0),
+                          JOB_DATA (job, 1),
+                          PyArray_SIZE ((PyArrayObject *) job->arrays[0]),
+                          JOB_DATA (job, 2), JOB_DATA (job, 3),
+                          PyArray_SIZE ((PyArrayObject *) job->arrays[2]),
+                          JOB_DATA (job, 4), JOB_DATA (job, 5));
+      break;
+    }
 
   return res;
 }
 
-static PyObject *
-do_open_file (PyObject *self, PyObject *args, PyObject *kwds)
+/* Whether job (queued behind first, which reads up to end) can be merged
+ * into the read of first */
+static int
+job_can_merge (NsJob *first, NsJob *job, uint32 end)
 {
-  const char     *filename;
-  PyObject       *cobj;
-  PyObject       *tuple;
-  PyObject       *dict = NULL;
-  NsLibrary      *lib;
-  ns_RESULT       res;
-  uint32          file_id;
+  if (job->kind != first->kind || job->entity_id != first->entity_id ||
+      job->index > end || job->count == 0 ||
+      (uint64_t) job->index + job->count - first->index > NS_POOL_MERGE_MAX)
+    return 0;
 
-  if (!PyArg_ParseTuple (args, "Os", &cobj, &filename))
-    return NULL;
-  
-  if (!PyCapsule_CheckExact (cobj)) 
+  if (job->kind == NS_JOB_NEURAL)
+    return 1;
+
+  return job->kind == NS_JOB_ANALOG && job->type_num == NPY_DOUBLE &&
+         first->type_num == NPY_DOUBLE && job->sample_rate == first->sample_rate;
+}
+
+/* Run job and the jobs merged into it with one read into a scratch
+ * buffer, that is then copied into the arrays of every job; the times
+ * are computed per job, from its own first index, so that they are the
+ * same as for a read of its own. A job whose range starts after a gap
+ * the merged read ran into does not learn its continuous count that way
+ * and is read on its own, as is every job if the merged read failed.
+ * Returns the number of reads it took. Does not need the GIL. */
+static int
+job_run_batch (NsJob *job)
+{
+  NsLibrary *lib = job->lib;
+  ns_RESULT  res = ns_OK;
+  NsJob     *j;
+  double    *data;
+  uint32     first = job->index;
+  uint32     end = job->index + job->count;
+  uint32     cont_count = 0;
+  uint32     count;
+  int        reads = 1;
+
+  if (job->batch == NULL)
     {
-      PyErr_SetString (PyExc_TypeError, "Expected NsLibrary type");
-      return NULL;
+      job->res = job_run (job);
+      return reads;
     }
-  
-  lib = PyCapsule_GetPointer (cobj, "capi");
 
-  res = lib->OpenFile (filename, &file_id);
+  for (j = job; j != NULL; j = j->batch)
+    if (j->index + j->count > end)
+      end = j->index + j->count;
 
-  if (res == ns_OK)
+  count = end - first;
+  data = nslib_scratch (lib, sizeof (double) * count);
+
+  if (data == NULL)
+    {
+      for (reads = 0, j = job; j != NULL; j = j->batch, reads++)
+        j->res = job_run (j);
+      return reads;
+    }
+
+  if (job->kind == NS_JOB_ANALOG)
+    NS_CALL_BYTES (res, lib, job->file_id, NS_ANALOG_BYTES (cont_count, count),
+                   GetAnalogData, job->file_id, job->entity_id,
+                   first, count, &cont_count, data);
+  else
+    NS_CALL_BYTES (res, lib, job->file_id, count * sizeof (double),
+                   GetNeuralData, job->file_id, job->entity_id,
+                   first, count, data);
+
+  for (j = job; j != NULL; j = j->batch)
+    {
+      uint32 offset = j->index - first;
+
+      /* the merged read may fail for a single bad range: every job gets
+       * the result of its own read then */
+      if (res != ns_OK ||
+          (j->kind == NS_JOB_ANALOG && offset > 0 && cont_count <= offset))
+        {
+          j->res = job_run (j);
+          reads++;
+          continue;
+        }
+
+      j->res = ns_OK;
+      memcpy (JOB_DATA (j, 0), data + offset, sizeof (double) * j->count);
+
+      if (j->kind != NS_JOB_ANALOG)
+        continue;
+
+      j->cont_count = cont_count - offset < j->count ? cont_count - offset : j->count;
+
+      if (j->arrays[1] != NULL)
+        j->res = compute_times (lib, j->file_id, j->entity_id, j->index,
+                                j->count, j->cont_count, j->sample_rate,
+                                JOB_DATA (j, 1));
+    }
+
+  nslib_scratch_release (lib, data);
+  return reads;
+}
+
+static void
+pool_notify (NsPool *pool)
+{
+  char byte = 0;
+
+#ifdef _WIN32
+  _write (pool->wakeup[1], &byte, 1);
+#else
+  /* a full pipe means there is a wakeup pending anyway */
+  while (write (pool->wakeup[1], &byte, 1) < 0 && errno == EINTR)
+    ;
+#endif
+}
+
+static void
+pool_drain (NsPool *pool)
+{
+  char   buf[64];
+
+#ifdef _WIN32
+  DWORD  avail = 0;
+  HANDLE pipe = (HANDLE) _get_osfhandle (pool->wakeup[0]);
+
+  while (PeekNamedPipe (pipe, NULL, 0, NULL, &avail, NULL) && avail > 0)
+    _read (pool->wakeup[0], buf, avail < sizeof (buf) ? avail : sizeof (buf));
+#else
+  while (read (pool->wakeup[0], buf, sizeof (buf)) > 0)
+    ;
+#endif
+}
+
+/* Whether the next job of queue can run without waiting for the jobs
+ * that are running already; with the lock of the pool */
+static int
+pool_file_ready (NsFileQueue *queue)
+{
+  if (queue->jobs[0] == NULL)
+    return 0;
+
+  switch (queue->lib->lock_policy)
+    {
+    case NS_LOCK_FILE:
+      return queue->running == 0;
+
+    case NS_LOCK_GLOBAL:
+      return queue->lib->pool_running == 0;
+    }
+
+  return 1;
+}
+
+/* Whether a job for (entity_id, index) submitted as token is queued
+ * before job */
+static int
+job_is_before (NsJob *job, uint32 entity_id, uint32 index, long token)
+{
+  if (job->entity_id != entity_id)
+    return job->entity_id < entity_id;
+  if (job->index != index)
+    return job->index < index;
+  return job->token < token;
+}
+
+/* Fill links with the links (per level) behind which a job for
+ * (entity_id, index, token) belongs in queue; with the lock of the pool */
+static void
+pool_queue_find (NsFileQueue *queue,
+                 uint32       entity_id,
+                 uint32       index,
+                 long         token,
+                 NsJob      **links[NS_POOL_LEVELS])
+{
+  NsJob **forward = queue->jobs;
+  int     level;
+
+  for (level = NS_POOL_LEVELS - 1; level >= 0; level--)
     {
-      dict = PyDict_New ();
-      res = get_and_add_file_info (lib, file_id, dict);
+      while (forward[level] != NULL &&
+             job_is_before (forward[level], entity_id, index, token))
+        forward = forward[level]->forward;
+
+      links[level] = &forward[level];
     }
+}
+
+/* with the lock of the pool */
+static void
+pool_queue_insert (NsPool *pool, NsFileQueue *queue, NsJob *job)
+{
+  NsJob    **links[NS_POOL_LEVELS];
+  uint32_t   bits;
+  int        level;
 
-  if (! check_result_is_error (res, lib))
+  /* xorshift */
+  bits = pool->seed;
+  bits ^= bits << 13;
+  bits ^= bits >> 17;
+  bits ^= bits << 5;
+  pool->seed = bits;
+
+  for (job->levels = 1; job->levels < NS_POOL_LEVELS && (bits & 3) == 0;
+       bits >>= 2)
+    job->levels++;
+
+  pool_queue_find (queue, job->entity_id, job->index, job->token, links);
+
+  for (level = 0; level < job->levels; level++)
     {
-      tuple = PyTuple_New (2);
-      PyTuple_SetItem (tuple, 0, PyInt_FromLong (file_id));
-      PyTuple_SetItem (tuple, 1, dict);
+      job->forward[level] = *links[level];
+      *links[level] = job;
     }
+
+  job->older = queue->newest;
+  job->newer = NULL;
+  if (queue->newest != NULL)
+    queue->newest->newer = job;
+  else
+    queue->oldest = job;
+  queue->newest = job;
+}
+
+/* with the lock of the pool */
+static void
+pool_queue_remove (NsFileQueue *queue, NsJob *job)
+{
+  NsJob **links[NS_POOL_LEVELS];
+  int     level;
+
+  pool_queue_find (queue, job->entity_id, job->index, job->token, links);
+
+  for (level = 0; level < job->levels; level++)
+    *links[level] = job->forward[level];
+
+  if (job->older != NULL)
+    job->older->newer = job->newer;
   else
-    tuple = NULL;
+    queue->oldest = job->newer;
 
-  return tuple;
+  if (job->newer != NULL)
+    job->newer->older = job->older;
+  else
+    queue->newest = job->older;
+
+  job->older = job->newer = NULL;
 }
 
-static PyObject *
-do_close_file (PyObject *self, PyObject *args, PyObject *kwds)
+/* Take the next job (with the jobs merged into it) off the queues, NULL
+ * if there is none that can run now; with the lock of the pool */
+static NsJob *
+pool_next_job (NsPool *pool)
 {
-  PyObject       *cobj;
-  PyObject       *iobj;
-  NsLibrary      *lib;
-  ns_RESULT       res;
-  uint32          file_id;
+  NsFileQueue *queue;
+  NsJob      **links[NS_POOL_LEVELS];
+  NsJob       *job;
+  NsJob       *next;
+  NsJob       *tail;
+  uint32       end;
+
+#ifndef _WIN32
+  if (pool->forking)
+    return NULL;
+#endif
+
+  queue = pool->turn != NULL ? pool->turn : pool->files;
+
+  while (queue != NULL && !pool_file_ready (queue))
+    queue = queue->next;
+
+  if (queue == NULL)
+    for (queue = pool->files; queue != pool->turn && !pool_file_ready (queue); )
+      queue = queue->next;
 
-  if (!PyArg_ParseTuple (args, "OO", &cobj, &iobj))
+  if (queue == NULL || !pool_file_ready (queue))
     return NULL;
 
-  
-  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj))
+  pool->turn = queue->next;
+
+  /* the first job at or after the cursor, unless one waited too long */
+  job = queue->oldest;
+
+  if (ns_time_ns () - job->submitted <= NS_POOL_MAX_WAIT_NS)
     {
-      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
-      return NULL;
+      pool_queue_find (queue, queue->cursor_entity, queue->cursor_index, 0,
+                       links);
+      job = *links[0] != NULL ? *links[0] : queue->jobs[0];
     }
 
-  lib = PyCapsule_GetPointer (cobj, "capi");
-  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
+  next = job->forward[0];
+  pool_queue_remove (queue, job);
+  job->next = NULL;
 
-  res = lib->CloseFile (file_id);
+  /* merge the jobs behind it that continue its range */
+  end = job->index + job->count;
+  tail = job;
 
-  if (check_result_is_error (res, lib))
-      return NULL;
+  if (job->kind == NS_JOB_ANALOG || job->kind == NS_JOB_NEURAL)
+    while (next != NULL && job_can_merge (job, next, end))
+      {
+        tail->batch = next;
+        tail = next;
+        next = next->forward[0];
+        pool_queue_remove (queue, tail);
 
-  Py_RETURN_NONE;
+        if (tail->index + tail->count > end)
+          end = tail->index + tail->count;
+      }
+
+  queue->cursor_entity = job->entity_id;
+  queue->cursor_index = end;
+  queue->running++;
+  queue->lib->pool_running++;
+  pool->running++;
+
+  for (tail = job; tail != NULL; tail = tail->batch)
+    queue->lib->sched.queued--;
+
+  return job;
 }
 
-/* *********************************** */
-/* entity infos */
+/* The queue of the file of job, created if need be; with the lock of
+ * the pool */
+static NsFileQueue *
+pool_file_queue (NsPool *pool, NsJob *job)
+{
+  NsFileQueue *queue;
 
-static int
-get_and_add_event_info (NsLibrary *lib,
-			uint32     file_id,
-			uint32     entity_id,
-			PyObject  *dict)
+  for (queue = pool->files; queue != NULL; queue = queue->next)
+    if (queue->lib == job->lib && queue->file_id == job->file_id)
+      return queue;
+
+  queue = calloc (1, sizeof (NsFileQueue));
+
+  if (queue == NULL)
+    return NULL;
+
+  queue->lib = job->lib;
+  queue->file_id = job->file_id;
+  queue->next = pool->files;
+  pool->files = queue;
+  return queue;
+}
+
+/* Account the finished job (and the jobs merged into it) and drop the
+ * queue of its file if it is done; with the lock of the pool */
+static void
+pool_job_done (NsPool *pool, NsJob *job, int reads)
 {
-  ns_EVENTINFO info;
-  ns_RESULT    res;
+  NsFileQueue **link;
+  NsFileQueue  *queue;
+  NsLibrary    *lib = job->lib;
+  NsJob        *j;
+  uint64_t      now;
+
+  lib->pool_running--;
+  pool->running--;
+  lib->sched.reads += reads;
+  now = ns_time_ns ();
+
+  for (j = job; j != NULL; j = j->batch)
+    {
+      lib->sched.requests++;
+      lib->sched.ns += now - j->submitted;
+      if (now - j->submitted > lib->sched.max_ns)
+        lib->sched.max_ns = now - j->submitted;
+    }
+
+  for (link = &pool->files; (queue = *link) != NULL; link = &queue->next)
+    if (queue->lib == lib && queue->file_id == job->file_id)
+      break;
 
-  res = lib->GetEventInfo (file_id, entity_id, &info, sizeof (info));
+  if (queue == NULL)
+    return;
 
-  if (res != ns_OK)
-    return res;
+  queue->running--;
 
-  dict_set_item_eat_ref (dict, "EventType", PyInt_FromLong (info.dwEventType));
-  dict_set_item_eat_ref (dict, "MinDataLength", PyInt_FromLong (info.dwMinDataLength));
-  dict_set_item_eat_ref (dict, "MaxDataLength", PyInt_FromLong (info.dwMaxDataLength));
-  dict_set_item_eat_ref (dict, "CSVDesc", PyString_FromString (info.szCSVDesc));
+  if (queue->running > 0 || queue->jobs[0] != NULL)
+    return;
 
-  return ns_OK;
+  if (pool->turn == queue)
+    pool->turn = queue->next;
+  *link = queue->next;
+  free (queue);
 }
 
-static int
-get_and_add_analog_info (NsLibrary *lib,
-			 uint32     file_id,
-			 uint32     entity_id,
-			 PyObject *dict)
+/* Keep the message of the library for the failed jobs of the batch of
+ * job, taken right away: the thread (its messages may be per thread, as
+ * for reader servers) and the state of the library are not the same any
+ * more by the time it is reaped. Does not need the GIL. */
+static void
+job_capture_errors (NsJob *job)
 {
-  ns_ANALOGINFO info;
-  ns_RESULT     res;
+  char       buf[1024];
+  ns_RESULT  res;
 
-  res = lib->GetAnalogInfo (file_id, entity_id, &info, sizeof (info));
-  if (res != ns_OK)
-    return res;
+  for (; job != NULL; job = job->batch)
+    {
+      if (job->res == ns_OK)
+        continue;
 
-  dict_set_item_eat_ref (dict, "SampleRate", PyFloat_FromDouble (info.dSampleRate));
-  dict_set_item_eat_ref (dict, "MinVal", PyFloat_FromDouble (info.dMinVal));
-  dict_set_item_eat_ref (dict, "MaxVal", PyFloat_FromDouble (info.dMaxVal));
-  dict_set_item_eat_ref (dict, "Units", PyString_FromString (info.szUnits));
-
-  dict_set_item_eat_ref (dict, "Resolution", PyFloat_FromDouble (info.dResolution));
-  dict_set_item_eat_ref (dict, "LocationX", PyFloat_FromDouble (info.dLocationX));
-  dict_set_item_eat_ref (dict, "LocationY", PyFloat_FromDouble (info.dLocationY));
-  dict_set_item_eat_ref (dict, "LocationZ", PyFloat_FromDouble (info.dLocationZ));
-  dict_set_item_eat_ref (dict, "LocationUser", PyFloat_FromDouble (info.dLocationUser));
-  dict_set_item_eat_ref (dict, "HighFreqCorner", PyFloat_FromDouble (info.dHighFreqCorner));
-
-  dict_set_item_eat_ref (dict, "HighFreqOrder", PyInt_FromLong (info.dwHighFreqOrder));
-  dict_set_item_eat_ref (dict, "HighFilterType", PyString_FromString (info.szHighFilterType));
-  dict_set_item_eat_ref (dict, "LowFreqCorner", PyFloat_FromDouble (info.dLowFreqCorner));
-  dict_set_item_eat_ref (dict, "LowFreqOrder", PyInt_FromLong (info.dwLowFreqOrder));
-  dict_set_item_eat_ref (dict, "LowFilterType", PyString_FromString (info.szLowFilterType));
-  dict_set_item_eat_ref (dict, "ProbeInfo", PyString_FromString (info.szProbeInfo));
+      buf[0] = '\0';
+      NS_LIB_CALL (res, job->lib, GetLastErrorMsg, buf, sizeof (buf));
+      buf[sizeof (buf) - 1] = '\0';
 
-  return ns_OK;
+      if (res == ns_OK)
+        job->error = strdup (buf);
+    }
 }
 
-static int
-get_and_add_segment_source_info (NsLibrary *lib,
-				 uint32     file_id,
-				 uint32     entity_id,
-				 uint32     source_id,
-				 PyObject  *list)
+static void
+pool_worker (void *data)
 {
-  ns_SEGSOURCEINFO  info;
-  ns_RESULT         res;
-  PyObject         *dict;
+  NsPool *pool = data;
+  NsJob  *job;
+  NsJob  *j;
+  int     notify;
+  int     reads;
 
+  for (;;)
+    {
+      ns_mutex_lock (&pool->lock);
 
-  dict = PyDict_New ();
-  PyList_SetItem (list, source_id, dict);
-  
-  res = lib->GetSegmentSourceInfo (file_id,
-				   entity_id,
-				   source_id,
-				   &info,
-				   sizeof (info));
+      while ((job = pool_next_job (pool)) == NULL)
+        ns_cond_wait (&pool->cond, &pool->lock);
 
-  if (res != ns_OK)
-    return res;
-  
-  dict_set_item_eat_ref (dict, "MinVal", PyFloat_FromDouble (info.dMinVal));
-  dict_set_item_eat_ref (dict, "MaxVal", PyFloat_FromDouble (info.dMaxVal));
-  dict_set_item_eat_ref (dict, "SubSampleShift", PyFloat_FromDouble (info.dSubSampleShift));
-  dict_set_item_eat_ref (dict, "Resolution", PyFloat_FromDouble (info.dResolution));
+      ns_mutex_unlock (&pool->lock);
 
-  dict_set_item_eat_ref (dict, "LocationX", PyFloat_FromDouble (info.dLocationX));
-  dict_set_item_eat_ref (dict, "LocationY", PyFloat_FromDouble (info.dLocationY));
-  dict_set_item_eat_ref (dict, "LocationZ", PyFloat_FromDouble (info.dLocationZ));
-  dict_set_item_eat_ref (dict, "LocationUser", PyFloat_FromDouble (info.dLocationUser));
-  dict_set_item_eat_ref (dict, "HighFreqCorner", PyFloat_FromDouble (info.dHighFreqCorner));
+      reads = job_run_batch (job);
+      job_capture_errors (job);
 
-  dict_set_item_eat_ref (dict, "HighFreqOrder", PyInt_FromLong (info.dwHighFreqOrder));
-  dict_set_item_eat_ref (dict, "HighFilterType", PyString_FromString (info.szHighFilterType));
-  dict_set_item_eat_ref (dict, "LowFreqCorner", PyFloat_FromDouble (info.dLowFreqCorner));
-  dict_set_item_eat_ref (dict, "LowFreqOrder", PyInt_FromLong (info.dwLowFreqOrder));
-  dict_set_item_eat_ref (dict, "LowFilterType", PyString_FromString (info.szLowFilterType));
-  dict_set_item_eat_ref (dict, "ProbeInfo", PyString_FromString (info.szProbeInfo));
+      /* only the first result after a reap needs to wake the reader */
+      ns_mutex_lock (&pool->lock);
+      pool_job_done (pool, job, reads);
+      notify = pool->done == NULL;
 
+      while (job != NULL)
+        {
+          j = job->batch;
+          job->batch = NULL;
+          job->next = pool->done;
+          pool->done = job;
+          job = j;
+        }
 
-  return ns_OK;
-}
+      /* the file (or library) of the job may be ready again */
+      ns_cond_broadcast (&pool->cond);
+      ns_mutex_unlock (&pool->lock);
 
+      if (notify)
+        pool_notify (pool);
+    }
+}
 
 static int
-get_and_add_segment_info (NsLibrary *lib,
-			  uint32     file_id,
-			  uint32     entity_id,
-			  PyObject  *dict)
+pool_pipe (int fds[2])
 {
-  ns_SEGMENTINFO  info;
-  ns_RESULT       res;
-  PyObject       *list;
-  unsigned int    i;
+#ifdef _WIN32
+  return _pipe (fds, 256, _O_BINARY | _O_NOINHERIT);
+#else
+  int i;
 
-  res = lib->GetSegmentInfo (file_id, entity_id, &info, sizeof (info));
+  if (pipe (fds) != 0)
+    return -1;
 
-  if (res != ns_OK)
-    return res;
+  for (i = 0; i < 2; i++)
+    {
+      fcntl (fds[i], F_SETFL, fcntl (fds[i], F_GETFL) | O_NONBLOCK);
+      fcntl (fds[i], F_SETFD, FD_CLOEXEC);
+    }
 
-  dict_set_item_eat_ref (dict, "SourceCount", PyInt_FromLong (info.dwSourceCount));
-  dict_set_item_eat_ref (dict, "MinSampleCount", PyInt_FromLong (info.dwMinSampleCount));
-  dict_set_item_eat_ref (dict, "MaxSampleCount", PyInt_FromLong (info.dwMaxSampleCount));
-  dict_set_item_eat_ref (dict, "SampleRate", PyFloat_FromDouble (info.dSampleRate));
-  dict_set_item_eat_ref (dict, "Units", PyString_FromString (info.szUnits));
+  return 0;
+#endif
+}
 
-  list = PyList_New (info.dwSourceCount);
+#ifndef _WIN32
+/* fork () waits for the running jobs and holds the lock of the pool, so
+ * that the child does not inherit a lock (of the pool, of a scratch
+ * buffer or inside the vendor library) taken by a pool thread */
+static void
+pool_atfork_prepare (void)
+{
+  NsPool *pool = ns_pool;
 
-  for (i = 0; i < info.dwSourceCount; i++)
-    get_and_add_segment_source_info (lib, file_id, entity_id, i, list);
-    
+  if (pool == NULL || pool->pid != getpid ())
+    return;
 
-  dict_set_item_eat_ref (dict, "SourceInfos", list);
+  ns_mutex_lock (&pool->lock);
+  pool->forking = 1;
 
-  return res;
+  while (pool->running > 0)
+    ns_cond_wait (&pool->cond, &pool->lock);
 }
 
-static int
-get_and_add_neural_info (NsLibrary *lib,
-			 uint32     file_id,
-			 uint32     entity_id,
-			 PyObject *dict)
+static void
+pool_atfork_parent (void)
 {
-  ns_NEURALINFO info;
-  ns_RESULT     res;
+  NsPool *pool = ns_pool;
 
-  res = lib->GetNeuralInfo (file_id, entity_id, &info, sizeof (info));
+  if (pool == NULL || pool->pid != getpid ())
+    return;
 
-  if (res != ns_OK)
-    return res;
+  pool->forking = 0;
+  ns_cond_broadcast (&pool->cond);
+  ns_mutex_unlock (&pool->lock);
+}
 
-  dict_set_item_eat_ref (dict, "SourceEntityID", PyInt_FromLong (info.dwSourceEntityID));
-  dict_set_item_eat_ref (dict, "SourceUnitID", PyInt_FromLong (info.dwSourceUnitID));
-  dict_set_item_eat_ref (dict, "ProbeInfo", PyString_FromString (info.szProbeInfo));
+/* the pool itself is dropped by pool_current */
+static void
+pool_atfork_child (void)
+{
+  NsPool *pool = ns_pool;
 
-  return ns_OK;
+  if (pool != NULL && pool->forking)
+    ns_mutex_unlock (&pool->lock);
 }
+#endif
 
-static PyObject *
-get_times_for_entity (NsLibrary *lib,
-                      uint32     file_id,
-                      uint32     entity_id,
-                      uint32     index,
-                      uint32     length)
+/* The pool of the process, NULL if it was not started yet. A forked
+ * child inherits the pool of its parent but not its threads: there it
+ * is abandoned, with the jobs of the parent, and a new one is started
+ * on demand; needs the GIL */
+static NsPool *
+pool_current (void)
 {
-  PyObject  *array;
-  ns_RESULT  res;
-  npy_intp   dims[1];
-  double    *data;
-  uint32     i;
-
-  res = ns_OK;
-  dims[0] = length;
+#ifndef _WIN32
+  NsLibrary *lib;
 
-  array = PyArray_New (&PyArray_Type,
-		       1,
-		       dims,
-		       NPY_DOUBLE,
-		       NULL,
-		       NULL /* data */,
-		       0 /* itemsize */,
-		       NPY_ARRAY_CARRAY,
-		       NULL);
+  if (ns_pool == NULL || ns_pool->pid == getpid ())
+    return ns_pool;
 
-  data = (double *) PyArray_DATA ((PyArrayObject *) array);
+  close (ns_pool->wakeup[0]);
+  close (ns_pool->wakeup[1]);
+  ns_pool = NULL;
 
-  for (i = 0; i < length; i++)
+  /* the jobs of the parent never finish here */
+  for (lib = library_registry; lib != NULL; lib = lib->next)
     {
-       res = lib->GetTimeByIndex (file_id,
-                                  entity_id,
-                                  index + i,
-                                  (data + i));
-       if (res != ns_OK)
-         break;
+      lib->pool_running = 0;
+      lib->sched.queued = 0;
     }
+#endif
 
-    if (check_result_is_error (res, lib))
-      {
-        Py_DECREF (array);
-        return NULL;
-      }
-
-  return array;
+  return ns_pool;
 }
 
-/* ************************************************************************** */
-/* "public" API */
-
-static PyObject *
-do_get_entity_info (PyObject *self, PyObject *args, PyObject *kwds)
+/* The pool, started with n_threads threads if it does not exist yet;
+ * needs the GIL */
+static NsPool *
+pool_get (int n_threads)
 {
-  ns_ENTITYINFO   info;
-  PyObject       *cobj;
-  PyObject       *iobj, *id_obj;
-  PyObject       *dict;
-  NsLibrary      *lib;
-  ns_RESULT       res;
-  uint32          file_id;
-  uint32          entity_id;
+  NsPool   *pool;
+  NsThread  thread;
+  int       i;
+#ifndef _WIN32
+  static int atfork = 0;
+#endif
 
-  if (!PyArg_ParseTuple (args, "OOO", &cobj, &iobj, &id_obj))
-    return NULL;
+  if ((pool = pool_current ()) != NULL)
+    return pool;
 
-  
-  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
-      !PyInt_Check (id_obj)) 
+#ifndef _WIN32
+  if (!atfork && pthread_atfork (pool_atfork_prepare, pool_atfork_parent,
+                                 pool_atfork_child) == 0)
+    atfork = 1;
+#endif
+
+  pool = calloc (1, sizeof (NsPool));
+
+  if (pool == NULL)
     {
-      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      PyErr_NoMemory ();
       return NULL;
     }
 
-  lib = PyCapsule_GetPointer (cobj, "capi");
-  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
-  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+  if (pool_pipe (pool->wakeup) != 0)
+    {
+      free (pool);
+      PyErr_SetFromErrno (PyExc_OSError);
+      return NULL;
+    }
 
-  res = lib->GetEntityInfo (file_id, entity_id, &info, sizeof (info));
+  ns_mutex_init (&pool->lock);
+  ns_cond_init (&pool->cond);
+  pool->seed = 2463534242u;
+#ifndef _WIN32
+  pool->pid = getpid ();
+#endif
 
-  if (check_result_is_error (res, lib))
-    return NULL;
+  for (i = 0; i < n_threads; i++)
+    if (ns_thread_start (&thread, pool_worker, pool) == 0)
+      pool->n_threads++;
 
-  dict = PyDict_New ();
-  dict_set_item_eat_ref (dict, "EntityLabel", PyString_FromString (info.szEntityLabel));
-  dict_set_item_eat_ref (dict, "EntityType", PyInt_FromLong (info.dwEntityType));
-  dict_set_item_eat_ref (dict, "ItemCount", PyInt_FromLong (info.dwItemCount));
+  if (pool->n_threads == 0)
+    {
+      PyErr_SetString (PgError, "Could not start any pool thread");
+      ns_cond_clear (&pool->cond);
+      ns_mutex_clear (&pool->lock);
+      close (pool->wakeup[0]);
+      close (pool->wakeup[1]);
+      free (pool);
+      return NULL;
+    }
 
-  switch (info.dwEntityType)
+  ns_pool = pool;
+  return pool;
+}
+
+/* A copy of the scheduler statistics of lib, which are reset after if
+ * reset is set; needs the GIL */
+static void
+pool_sched_stats (NsLibrary *lib, NsSchedStats *stats, int reset)
+{
+  NsPool *pool = pool_current ();
+
+  if (pool != NULL)
+    ns_mutex_lock (&pool->lock);
+
+  memcpy (stats, (void *) &lib->sched, sizeof (NsSchedStats));
+
+  if (reset)
     {
-    case ns_ENTITY_EVENT:
-      res = get_and_add_event_info (lib, file_id, entity_id, dict);
-      break;
+      lib->sched.max_queued = lib->sched.queued;
+      lib->sched.requests = 0;
+      lib->sched.reads = 0;
+      lib->sched.ns = 0;
+      lib->sched.max_ns = 0;
+    }
 
-    case ns_ENTITY_ANALOG:
-      res = get_and_add_analog_info (lib, file_id, entity_id, dict);
-      break;
+  if (pool != NULL)
+    ns_mutex_unlock (&pool->lock);
+}
 
-    case ns_ENTITY_SEGMENT:
-      res = get_and_add_segment_info (lib, file_id, entity_id, dict);
-      break;
+/* A new job for the entity (or, if id_obj is NULL, file) of a library;
+ * needs the GIL */
+static NsJob *
+job_new (int       kind,
+         PyObject *cobj,
+         PyObject *iobj,
+         PyObject *id_obj,
+         PyObject *idx_obj,
+         PyObject *cnt_obj)
+{
+  NsJob *job;
 
-    case ns_ENTITY_NEURALEVENT:
-      res = get_and_add_neural_info (lib, file_id, entity_id, dict);
-      break;
+  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
+      (id_obj != NULL && (!PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
+                          !PyInt_Check (cnt_obj))))
+    {
+      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      return NULL;
     }
 
-  if (check_result_is_error (res, lib))
+  job = calloc (1, sizeof (NsJob));
+
+  if (job == NULL)
     {
-      Py_DECREF (dict);
+      PyErr_NoMemory ();
       return NULL;
     }
 
-  return dict;
-}
+  job->kind = kind;
+  job->lib = PyCapsule_GetPointer (cobj, "capi");
+  job->lib->refcount++;
+  job->file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
 
-/* ************************************ */
+  if (id_obj != NULL)
+    {
+      job->entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
+      job->index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+      job->count = (uint32) PyInt_AsUnsignedLongMask (cnt_obj);
+    }
 
-static PyObject *
-do_get_event_data (PyObject *self, PyObject *args, PyObject *kwds)
+  return job;
+}
+
+static void
+job_free (NsJob *job)
 {
-  NsLibrary      *lib;
-  PyObject       *cobj;
-  PyObject       *iobj, *id_obj, *idx_obj, *tp_obj, *sz_obj;
-  PyObject       *data_obj, *res_obj;
-  uint32          file_id;
-  uint32          entity_id;
-  uint32          index;
-  uint32          event_type;
-  uint32          data_size;
-  uint32          data_ret_size;
-  double          time_stamp;
-  ns_RESULT       res;
-  void           *buffer;
+  int i;
 
+  for (i = 0; i < NS_JOB_ARRAYS; i++)
+    Py_XDECREF (job->arrays[i]);
 
-  if (!PyArg_ParseTuple (args, "OOOOOO", &cobj, &iobj, &id_obj, &idx_obj, &tp_obj, &sz_obj))
-    return NULL;
+  free (job->error);
+  library_release (job->lib);
+  free (job);
+}
 
-  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
-      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
-      !PyInt_Check (tp_obj) || !PyInt_Check (sz_obj))
+/* Queue job (taking ownership); returns its token. Setting up the job
+ * failed (with an exception set) if its first array is missing. */
+static PyObject *
+pool_submit (NsJob *job)
+{
+  NsPool       *pool = NULL;
+  NsFileQueue  *queue;
+
+  if (job->arrays[0] == NULL || (pool = pool_get (NS_POOL_THREADS)) == NULL)
     {
-      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      job_free (job);
       return NULL;
     }
-  
-  lib = PyCapsule_GetPointer (cobj, "capi");
-  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
-  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
-  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
-  event_type = (uint32) PyInt_AsUnsignedLongMask (tp_obj);
-  data_size = (uint32) PyInt_AsUnsignedLongMask (sz_obj);
 
-  /* ** */
-  buffer = malloc (data_size);
-
-  res = lib->GetEventData (file_id,
-			   entity_id,
-			   index,
-			   &time_stamp,
-			   buffer,
-			   data_size, 
-			   &data_ret_size);
-  
-  if (check_result_is_error (res, lib))
+  job->token = ++pool->next_token;
+  job->submitted = ns_time_ns ();
+
+  ns_mutex_lock (&pool->lock);
+  queue = pool_file_queue (pool, job);
+
+  if (queue == NULL)
     {
-      free (buffer);
-      return NULL;
+      ns_mutex_unlock (&pool->lock);
+      job_free (job);
+      return PyErr_NoMemory ();
     }
-	   
-  switch (event_type)
-    {
-    case ns_EVENT_TEXT:
-    case ns_EVENT_CSV:
-      data_obj = PyString_FromStringAndSize (buffer, data_ret_size);
-      break;
-      
-    case ns_EVENT_BYTE:
-      data_obj = PyInt_FromLong (uint8_from_data (buffer, data_ret_size));
-      break;
-      
-    case ns_EVENT_WORD:
-      data_obj = PyInt_FromLong (uint16_from_data (buffer, data_ret_size));
-      break;
-      
-    case ns_EVENT_DWORD:
-      data_obj = PyInt_FromLong (uint32_from_data (buffer, data_ret_size));
-      break;
-      
-    default:
-      Py_INCREF (Py_None);
-      data_obj = Py_None;
+
+  pool_queue_insert (pool, queue, job);
+
+  if (++job->lib->sched.queued > job->lib->sched.max_queued)
+    job->lib->sched.max_queued = job->lib->sched.queued;
+
+  ns_cond_broadcast (&pool->cond);
+  ns_mutex_unlock (&pool->lock);
+
+  return PyLong_FromLong (job->token);
+}
+
+/* The result of a finished job, NULL with an exception set if it failed */
+static PyObject *
+job_result (NsJob *job)
+{
+  PyObject *value;
+  char     *row;
+
+  if (job->res != ns_OK)
+    {
+      raise_result_error (job->res, job->lib, job->error);
+      return NULL;
     }
 
-  res_obj = Py_BuildValue ("(d,O)", time_stamp, data_obj);
-  free (buffer);
-  return res_obj;
+  switch (job->kind)
+    {
+    case NS_JOB_ANALOG:
+      return Py_BuildValue ("(OOI)", job->arrays[0],
+                            job->arrays[1] ? job->arrays[1] : Py_None,
+                            job->cont_count);
+
+    case NS_JOB_EVENTS:
+      if (!job->single)
+        break;
+
+      row = JOB_DATA (job, 0);
+
+      if (job->event_type == ns_EVENT_TEXT || job->event_type == ns_EVENT_CSV)
+        {
+          const char *text = row + sizeof (double);
+          size_t      len = 0;
+
+          while (len < job->data_size && text[len] != '\0')
+            len++;
+
+          value = PyString_FromStringAndSize (text, len);
+        }
+      else if (job->event_type == ns_EVENT_BYTE)
+        value = PyInt_FromLong (* (uint8 *) (row + sizeof (double)));
+      else if (job->event_type == ns_EVENT_WORD)
+        value = PyInt_FromLong (uint16_from_data (row + sizeof (double), 2));
+      else
+        value = PyInt_FromLong (uint32_from_data (row + sizeof (double), 4));
+
+      if (value == NULL)
+        return NULL;
+
+      return Py_BuildValue ("(dN)", * (double *) row, value);
+
+    case NS_JOB_SEGMENTS:
+      return Py_BuildValue ("(OOOO)", job->arrays[0], job->arrays[1],
+                            job->arrays[2], job->arrays[3]);
+
+    case NS_JOB_RANGES:
+      return Py_BuildValue ("(OO)", job->arrays[4], job->arrays[5]);
+    }
+
+  Py_INCREF (job->arrays[0]);
+  return job->arrays[0];
 }
 
 static PyObject *
-do_get_analog_data (PyObject *self, PyObject *args, PyObject *kwds)
+do_pool_start (PyObject *self, PyObject *args, PyObject *kwds)
 {
-  NsLibrary      *lib;
-  PyObject       *cobj;
-  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj;
-  PyObject       *res_obj;
-  PyObject       *array;
-  PyObject       *times;
-  uint32          file_id;
-  uint32          entity_id;
-  uint32          index;
-  uint32          count;
-  uint32          cont_count;
-  ns_RESULT       res;
-  void           *buffer;
-  npy_intp        dims[1];
+  static char *kwlist[] = {"threads", NULL};
+  NsPool      *pool;
+  int          n_threads = NS_POOL_THREADS;
 
-  if (!PyArg_ParseTuple (args, "OOOOO", &cobj, &iobj, &id_obj, &idx_obj, &sz_obj))
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "|i", kwlist, &n_threads))
     return NULL;
 
-  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
-      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
-      !PyInt_Check (sz_obj))
+  if (n_threads < 1)
     {
-      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      PyErr_SetString (PyExc_ValueError, "threads must be positive");
       return NULL;
     }
 
-  lib = PyCapsule_GetPointer (cobj, "capi");
-  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
-  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
-  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
-  count = (uint32)  PyInt_AsUnsignedLongMask (sz_obj);
+  pool = pool_get (n_threads);
 
-  /* ** */
-  dims[0] = count; //sample count
+  if (pool == NULL)
+    return NULL;
 
-  array = PyArray_New (&PyArray_Type,
-		       1,
-		       dims,
-		       NPY_DOUBLE,
-		       NULL,
-		       NULL /* data */,
-		       0 /* itemsize */,
-		       NPY_ARRAY_CARRAY,
-		       NULL);
-  
-  buffer = PyArray_DATA ((PyArrayObject *) array);
+  return Py_BuildValue ("(ii)", pool->wakeup[0], pool->n_threads);
+}
+
+static PyObject *
+do_pool_reap (PyObject *self, PyObject *args)
+{
+  PyObject *list;
+  PyObject *item;
+  PyObject *result;
+  PyObject *type, *value, *tb;
+  NsPool   *pool;
+  NsJob    *done, *job;
 
-  res = lib->GetAnalogData (file_id,
-			    entity_id,
-			    index,
-			    count,
-			    &cont_count,
-			    buffer);
+  list = PyList_New (0);
 
-  if (check_result_is_error (res, lib))
-    {
-      Py_DECREF (array);
-      return NULL;
-    }
+  if (list == NULL || (pool = pool_current ()) == NULL)
+    return list;
 
-  times = get_times_for_entity (lib,
-                                file_id,
-                                entity_id,
-                                index,
-                                count);
+  pool_drain (pool);
 
-  if (times == NULL)
+  ns_mutex_lock (&pool->lock);
+  done = pool->done;
+  pool->done = NULL;
+  ns_mutex_unlock (&pool->lock);
+
+  /* in the order of completion */
+  for (job = NULL; done != NULL; )
     {
-      Py_DECREF (array);
-      return NULL;
+      NsJob *next = done->next;
+      done->next = job;
+      job = done;
+      done = next;
     }
 
-  res_obj = PyTuple_New (3);
-  PyTuple_SetItem (res_obj, 0, array);
-  PyTuple_SetItem (res_obj, 1, times);
-  PyTuple_SetItem (res_obj, 2, PyInt_FromLong (cont_count));
+  while (job != NULL)
+    {
+      NsJob **tail;
+      NsJob  *next = job->next;
+
+      result = job_result (job);
+      item = NULL;
+
+      if (result != NULL)
+        {
+          item = Py_BuildValue ("(lOO)", job->token, result, Py_None);
+          Py_DECREF (result);
+        }
+
+      /* a failed read, or no memory for its result: the error is
+         delivered for the token */
+      if (item == NULL)
+        {
+          PyErr_Fetch (&type, &value, &tb);
+          PyErr_NormalizeException (&type, &value, &tb);
+          item = Py_BuildValue ("(lOO)", job->token, Py_None,
+                                value ? value : Py_None);
+          Py_XDECREF (type);
+          Py_XDECREF (value);
+          Py_XDECREF (tb);
+        }
+
+      if (item != NULL && PyList_Append (list, item) == 0)
+        {
+          Py_DECREF (item);
+          job_free (job);
+          job = next;
+          continue;
+        }
+
+      /* out of memory even for that: the job and the ones after it are
+         handed out (in the same order) by the next reap */
+      Py_XDECREF (item);
+      PyErr_Clear ();
+
+      for (done = NULL; job != NULL; job = next)
+        {
+          next = job->next;
+          job->next = done;
+          done = job;
+        }
+
+      ns_mutex_lock (&pool->lock);
+      for (tail = &pool->done; *tail != NULL; tail = &(*tail)->next)
+        ;
+      *tail = done;
+      ns_mutex_unlock (&pool->lock);
+
+      pool_notify (pool);
+      break;
+    }
 
-  return res_obj;
+  return list;
 }
 
 static PyObject *
-do_get_segment_data (PyObject *self, PyObject *args, PyObject *kwds)
+do_submit_analog_data (PyObject *self, PyObject *args, PyObject *kwds)
 {
-  NsLibrary      *lib;
+  static char    *kwlist[] = {"library", "file", "entity", "index", "count",
+                              "sample_rate", "times", "out", "dtype",
+                              "scale", "offset", NULL};
   PyObject       *cobj;
-  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj, *src_obj;
-  PyObject       *res_obj;
-  PyObject       *array;
-  uint32          file_id;
-  uint32          entity_id;
-  uint32          index;
-  uint32          count;
-  uint32          sources;
-  uint32          sample_count;
-  uint32          uint_id;
-  uint32          buffer_size;
-  ns_RESULT       res;
-  double         *buffer;
-  npy_intp        dims[2];
-  double          time_stamp;
-
-  if (!PyArg_ParseTuple (args, "OOOOOO", &cobj, &iobj, &id_obj, &idx_obj, &src_obj, &sz_obj))
+  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj;
+  PyObject       *times_obj = Py_True;
+  PyObject       *out = NULL;
+  PyArray_Descr  *descr = NULL;
+  NsJob          *job;
+  npy_intp        dims[1];
+  double          sample_rate = 0.0;
+  double          scale = 1.0;
+  double          offset = 0.0;
+  int             type_num = NPY_DOUBLE;
+  int             want_times;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOO|dOOO&dd", kwlist,
+                                    &cobj, &iobj, &id_obj, &idx_obj, &sz_obj,
+                                    &sample_rate, &times_obj, &out,
+                                    PyArray_DescrConverter2, &descr,
+                                    &scale, &offset))
     return NULL;
 
+  if (descr != NULL)
+    {
+      type_num = descr->type_num;
+      Py_DECREF (descr);
+    }
 
-  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
-      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
-      !PyInt_Check (sz_obj) || !PyInt_Check (src_obj))
+  if (type_num != NPY_DOUBLE && type_num != NPY_FLOAT && type_num != NPY_INT16)
     {
-      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
+      PyErr_SetString (PyExc_TypeError, "dtype must be float64, float32 or int16");
       return NULL;
     }
 
-  lib = PyCapsule_GetPointer (cobj, "capi");
-  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
-  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
-  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
-  count = (uint32)  PyInt_AsUnsignedLongMask (sz_obj);
-  sources = (uint32)  PyInt_AsUnsignedLongMask (src_obj);
+  if (type_num == NPY_INT16 && ! (scale > 0.0))
+    {
+      PyErr_SetString (PyExc_ValueError, "scale must be positive");
+      return NULL;
+    }
 
-  /* ** */
-  dims[0] = sources; //source count
-  dims[1] = count; //sample count
+  want_times = PyArray_Check (times_obj) ? 1 : PyObject_IsTrue (times_obj);
 
-  array = PyArray_New (&PyArray_Type,
-		       2,
-		       dims,
-		       NPY_DOUBLE,
-		       NULL,
-		       NULL /* data */,
-		       0 /* itemsize */,
-		       0,
-		       NULL);
-  
-  buffer = (double *) PyArray_DATA ((PyArrayObject *) array);
-  buffer_size = (uint32) PyArray_NBYTES ((PyArrayObject *) array);
+  if (want_times < 0)
+    return NULL;
 
-  res = lib->GetSegmentData (file_id,
-			     entity_id,
-			     index,
-			     &time_stamp,
-			     buffer,
-			     buffer_size,
-			     &sample_count,
-			     &uint_id);
+  job = job_new (NS_JOB_ANALOG, cobj, iobj, id_obj, idx_obj, sz_obj);
 
-  if (check_result_is_error (res, lib))
+  if (job == NULL)
+    return NULL;
+
+  job->type_num = type_num;
+  job->sample_rate = sample_rate;
+  job->scale = scale;
+  job->offset = offset;
+  dims[0] = job->count;
+
+  if (out != NULL && out != Py_None)
     {
-      Py_DECREF (array);
-      return NULL;
+      if (check_out_array (out, type_num, job->count) != NULL)
+        {
+          Py_INCREF (out);
+          job->arrays[0] = out;
+        }
     }
-  
-  res_obj = PyTuple_New (4);
-  PyTuple_SetItem (res_obj, 0, array);
-  PyTuple_SetItem (res_obj, 1, PyFloat_FromDouble (time_stamp));
-  PyTuple_SetItem (res_obj, 2, PyInt_FromLong (sample_count));
-  PyTuple_SetItem (res_obj, 3, PyInt_FromLong (uint_id));
+  else
+    job->arrays[0] = PyArray_SimpleNew (1, dims, type_num);
 
-  return res_obj;
+  if (job->arrays[0] != NULL && PyArray_Check (times_obj))
+    {
+      if (check_out_array (times_obj, NPY_DOUBLE, job->count) != NULL)
+        {
+          Py_INCREF (times_obj);
+          job->arrays[1] = times_obj;
+        }
+      else
+        Py_CLEAR (job->arrays[0]);
+    }
+  else if (job->arrays[0] != NULL && want_times)
+    {
+      job->arrays[1] = PyArray_SimpleNew (1, dims, NPY_DOUBLE);
+      if (job->arrays[1] == NULL)
+        Py_CLEAR (job->arrays[0]);
+    }
+
+  return pool_submit (job);
 }
 
 static PyObject *
-do_get_neural_data (PyObject *self, PyObject *args, PyObject *kwds)
+do_submit_neural_data (PyObject *self, PyObject *args, PyObject *kwds)
 {
-  NsLibrary      *lib;
+  static char    *kwlist[] = {"library", "file", "entity", "index", "count",
+                              "out", NULL};
   PyObject       *cobj;
   PyObject       *iobj, *id_obj, *idx_obj, *sz_obj;
-  PyObject       *array;
-  uint32          file_id;
-  uint32          entity_id;
-  uint32          index;
-  uint32          index_count;
-  ns_RESULT       res;
-  void           *buffer;
+  PyObject       *out = NULL;
+  NsJob          *job;
   npy_intp        dims[1];
 
-  if (!PyArg_ParseTuple (args, "OOOOO", &cobj, &iobj, &id_obj, &idx_obj, &sz_obj))
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOO|O", kwlist,
+                                    &cobj, &iobj, &id_obj, &idx_obj, &sz_obj,
+                                    &out))
     return NULL;
 
+  job = job_new (NS_JOB_NEURAL, cobj, iobj, id_obj, idx_obj, sz_obj);
 
-  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
-      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj) ||
-      !PyInt_Check (sz_obj))
+  if (job == NULL)
+    return NULL;
+
+  dims[0] = job->count;
+
+  if (out != NULL && out != Py_None)
     {
-      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
-      return NULL;
+      if (check_out_array (out, NPY_DOUBLE, job->count) != NULL)
+        {
+          Py_INCREF (out);
+          job->arrays[0] = out;
+        }
     }
+  else
+    job->arrays[0] = PyArray_SimpleNew (1, dims, NPY_DOUBLE);
 
-  lib = PyCapsule_GetPointer (cobj, "capi");
-  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
-  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
-  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
-  index_count = (uint32)  PyInt_AsUnsignedLongMask (sz_obj);
+  return pool_submit (job);
+}
 
-  /* ** */
-  dims[0] = index_count;
-  array = PyArray_New (&PyArray_Type,
-		       1,
-		       dims,
-		       NPY_DOUBLE,
-		       NULL,
-		       NULL /* data */,
-		       0 /* itemsize */,
-		       NPY_ARRAY_CARRAY,
-		       NULL);
-  
-  buffer = PyArray_DATA ((PyArrayObject *) array);
+static PyObject *
+do_submit_event_data_range (PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char    *kwlist[] = {"library", "file", "entity", "index", "count",
+                              "event_type", "data_size", "single", NULL};
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj;
+  PyArray_Descr  *descr;
+  NsJob          *job;
+  npy_intp        dims[1];
+  unsigned int    event_type, data_size;
+  int             single = 0;
 
-  res = lib->GetNeuralData (file_id,
-			    entity_id,
-			    index,
-			    index_count,
-			    buffer);
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOOII|i", kwlist,
+                                    &cobj, &iobj, &id_obj, &idx_obj, &sz_obj,
+                                    &event_type, &data_size, &single))
+    return NULL;
 
-  if (check_result_is_error (res, lib))
+  if (data_size == 0)
+    data_size = 1;
+
+  descr = event_range_descr (event_type, data_size);
+
+  if (descr == NULL)
+    return NULL;
+
+  job = job_new (NS_JOB_EVENTS, cobj, iobj, id_obj, idx_obj, sz_obj);
+
+  if (job == NULL)
     {
-      Py_DECREF (array);
+      Py_DECREF (descr);
       return NULL;
     }
 
-  return array;
+  if (single)
+    job->count = 1;
+
+  job->event_type = event_type;
+  job->single = single;
+
+  /* cf. do_get_event_data_range */
+  if (event_type == ns_EVENT_TEXT || event_type == ns_EVENT_CSV)
+    job->data_size = data_size;
+  else
+    job->data_size = data_size < sizeof (uint32) ? sizeof (uint32) : data_size;
+
+  dims[0] = job->count;
+  job->arrays[0] = PyArray_Zeros (1, dims, descr, 0);
+
+  return pool_submit (job);
 }
 
 static PyObject *
-do_get_index_by_time(PyObject *self, PyObject *args, PyObject *kwds)
+do_submit_segment_data_range (PyObject *self, PyObject *args, PyObject *kwds)
 {
-  NsLibrary  *lib;
-  PyObject   *cobj;
-  PyObject   *iobj, *id_obj, *tp_obj, *fl_obj;
-  double      timepoint;
-  uint32      file_id;
-  uint32      entity_id;
-  uint32      index;
-  uint32      flags;
-  ns_RESULT   res;
+  static char    *kwlist[] = {"library", "file", "entity", "index", "count",
+                              "sources", "max_samples", "out", NULL};
+  PyObject       *cobj;
+  PyObject       *iobj, *id_obj, *idx_obj, *sz_obj;
+  PyObject       *out = NULL;
+  NsJob          *job;
+  npy_intp        dims[3];
+  unsigned int    sources, max_samples;
+  int             i;
+
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOOII|O", kwlist,
+                                    &cobj, &iobj, &id_obj, &idx_obj, &sz_obj,
+                                    &sources, &max_samples, &out))
+    return NULL;
 
+  job = job_new (NS_JOB_SEGMENTS, cobj, iobj, id_obj, idx_obj, sz_obj);
 
-  if (!PyArg_ParseTuple (args, "OOOOO", &cobj, &iobj, &id_obj, &tp_obj, &fl_obj))
+  if (job == NULL)
     return NULL;
 
+  job->sources = sources;
+  job->max_samples = max_samples;
+  dims[0] = job->count;
+  dims[1] = sources;
+  dims[2] = max_samples;
 
-  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
-      !PyInt_Check (id_obj) || !PyFloat_Check (tp_obj) ||
-      !PyInt_Check (fl_obj))
+  if (out != NULL && out != Py_None)
     {
-      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
-      return NULL;
+      if (check_out_array (out, NPY_DOUBLE, dims[0] * dims[1] * dims[2]) != NULL)
+        {
+          Py_INCREF (out);
+          job->arrays[0] = out;
+        }
     }
+  else
+    job->arrays[0] = PyArray_SimpleNew (3, dims, NPY_DOUBLE);
 
-  lib = PyCapsule_GetPointer (cobj, "capi");
-  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
-  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
-  timepoint = PyFloat_AsDouble (tp_obj);
-  flags = (uint32) PyInt_AsUnsignedLongMask (fl_obj);
+  job->arrays[1] = PyArray_SimpleNew (1, dims, NPY_DOUBLE);
+  job->arrays[2] = PyArray_SimpleNew (1, dims, NPY_UINT32);
+  job->arrays[3] = PyArray_SimpleNew (1, dims, NPY_UINT32);
 
-  res = lib->GetIndexByTime (file_id,
-			     entity_id,
-			     timepoint,
-			     flags,
-			     &index);
-  
-  if (check_result_is_error (res, lib))
-    return NULL;
+  for (i = 1; i < 4; i++)
+    if (job->arrays[i] == NULL)
+      Py_CLEAR (job->arrays[0]);
 
-  return PyInt_FromLong (index);
+  return pool_submit (job);
 }
 
 static PyObject *
-do_get_time_by_index (PyObject *self, PyObject *args, PyObject *kwds)
+do_submit_index_ranges (PyObject *self, PyObject *args, PyObject *kwds)
 {
-  NsLibrary      *lib;
+  static char    *kwlist[] = {"library", "file", "entities", "item_counts",
+                              "t_start", "t_stop", NULL};
   PyObject       *cobj;
-  PyObject       *iobj, *id_obj, *idx_obj;
-  uint32          file_id;
-  uint32          entity_id;
-  uint32          index;
-  double          timepoint;
-  ns_RESULT       res;
+  PyObject       *iobj, *ent_obj, *cnt_obj, *start_obj, *stop_obj;
+  PyObject      **arrays;
+  NsJob          *job;
+  npy_intp        dims[2];
+  int             i;
 
-  if (!PyArg_ParseTuple (args, "OOOO", &cobj, &iobj, &id_obj, &idx_obj))
+  if (!PyArg_ParseTupleAndKeywords (args, kwds, "OOOOOO", kwlist,
+                                    &cobj, &iobj, &ent_obj, &cnt_obj,
+                                    &start_obj, &stop_obj))
     return NULL;
 
+  job = job_new (NS_JOB_RANGES, cobj, iobj, NULL, NULL, NULL);
 
-  if (!PyCapsule_CheckExact (cobj) || !PyInt_Check (iobj) ||
-      !PyInt_Check (id_obj) || !PyInt_Check (idx_obj))
+  if (job == NULL)
+    return NULL;
+
+  arrays = job->arrays;
+  arrays[0] = PyArray_FROMANY (ent_obj, NPY_UINT32, 1, 1,
+                               NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+  arrays[1] = PyArray_FROMANY (cnt_obj, NPY_UINT32, 1, 1,
+                               NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+  arrays[2] = PyArray_FROMANY (start_obj, NPY_DOUBLE, 1, 1,
+                               NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+  arrays[3] = PyArray_FROMANY (stop_obj, NPY_DOUBLE, 1, 1,
+                               NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);
+
+  for (i = 0; i < 4; i++)
+    if (arrays[i] == NULL)
+      break;
+
+  if (i == 4 &&
+      (PyArray_SIZE ((PyArrayObject *) arrays[0]) !=
+       PyArray_SIZE ((PyArrayObject *) arrays[1]) ||
+       PyArray_SIZE ((PyArrayObject *) arrays[2]) !=
+       PyArray_SIZE ((PyArrayObject *) arrays[3])))
     {
-      PyErr_SetString (PyExc_TypeError, "Wrong argument type(s)");
-      return NULL;
+      PyErr_SetString (PyExc_ValueError, "Argument sizes do not match");
+      i = 0;
     }
 
-  lib = PyCapsule_GetPointer (cobj, "capi");
-  file_id = (uint32) PyInt_AsUnsignedLongMask (iobj);
-  entity_id = (uint32) PyInt_AsUnsignedLongMask (id_obj);
-  index = (uint32) PyInt_AsUnsignedLongMask (idx_obj);
+  if (i == 4)
+    {
+      dims[0] = PyArray_SIZE ((PyArrayObject *) arrays[0]);
+      dims[1] = PyArray_SIZE ((PyArrayObject *) arrays[2]);
+      arrays[4] = PyArray_SimpleNew (2, dims, NPY_UINT32);
+      arrays[5] = PyArray_SimpleNew (2, dims, NPY_UINT32);
+    }
 
-  res = lib->GetTimeByIndex (file_id,
-			     entity_id,
-			     index,
-			     &timepoint);
-  
-  if (check_result_is_error (res, lib))
-    return NULL;
+  if (i < 4 || arrays[4] == NULL || arrays[5] == NULL)
+    Py_CLEAR (arrays[0]);
 
-  return Py_BuildValue ("d", timepoint);
+  return pool_submit (job);
 }
 
 
@@ -1237,8 +8293,20 @@ static PyMethodDef NativeMethods[] = {
 
   {"library_open", (PyCFunction) library_open, METH_VARARGS | METH_KEYWORDS,
    "Open a Neuroshare Library"},
+  {"library_connect", (PyCFunction) library_connect, METH_VARARGS | METH_KEYWORDS,
+   "Connect to reader servers hosting a Neuroshare Library"},
+  {"library_registry",  (PyCFunction) library_registry_list, METH_NOARGS,
+   "Paths and reference counts of the loaded libraries"},
+  {"stats",  (PyCFunction) library_stats, METH_VARARGS | METH_KEYWORDS,
+   "Call statistics of a library (and its files)"},
+  {"stats_enable",  (PyCFunction) library_stats_enable, METH_VARARGS,
+   "Enable or disable collecting call statistics"},
   {"library_close",  (PyCFunction) library_close, METH_VARARGS | METH_KEYWORDS,
    "Close an open Neuroshare Library"},
+  {"library_set_lock_policy",  (PyCFunction) library_set_lock_policy, METH_VARARGS | METH_KEYWORDS,
+   "Set the locking policy used for calls into the library"},
+  {"library_get_state",  (PyCFunction) library_get_state, METH_VARARGS,
+   "Locking policy and reference count of a library"},
 
   {"get_library_info",  (PyCFunction) do_get_library_info, METH_VARARGS | METH_KEYWORDS,
    "Retrieves information about the loaded API library"},
@@ -1246,22 +8314,75 @@ static PyMethodDef NativeMethods[] = {
    "Opens the data file and returns its file info."},
   {"close_file",  (PyCFunction) do_close_file, METH_VARARGS | METH_KEYWORDS,
    "Close the open data file"},
+  {"get_file_info",  (PyCFunction) do_get_file_info, METH_VARARGS | METH_KEYWORDS,
+   "Retrieve the file info of an open data file"},
   {"get_entity_info",  (PyCFunction) do_get_entity_info, METH_VARARGS | METH_KEYWORDS,
    "Retrieve Entity (general and specific) information"},
+  {"scan_entities",  (PyCFunction) do_scan_entities, METH_VARARGS | METH_KEYWORDS,
+   "Retrieve the basic information of all entities at once"},
+  {"get_item_counts",  (PyCFunction) do_get_item_counts, METH_VARARGS | METH_KEYWORDS,
+   "Retrieve the item counts of all entities at once"},
 
   {"get_event_data",  (PyCFunction) do_get_event_data, METH_VARARGS | METH_KEYWORDS,
    "Retrieve event data"},
+  {"get_event_data_range",  (PyCFunction) do_get_event_data_range, METH_VARARGS | METH_KEYWORDS,
+   "Retrieve a range of event data as structured array"},
+  {"split_csv",  (PyCFunction) do_split_csv, METH_VARARGS | METH_KEYWORDS,
+   "Split the text of csv event values into columns"},
   {"get_analog_data",  (PyCFunction) do_get_analog_data, METH_VARARGS | METH_KEYWORDS,
    "Retrieve analog data"},
+  {"get_analog_envelope",  (PyCFunction) do_get_analog_envelope, METH_VARARGS | METH_KEYWORDS,
+   "Minimum, maximum and mean of analog data per bin"},
+  {"get_analog_decimated",  (PyCFunction) do_get_analog_decimated, METH_VARARGS | METH_KEYWORDS,
+   "Retrieve low-pass filtered and decimated analog data"},
+  {"get_analog_block",  (PyCFunction) do_get_analog_block, METH_VARARGS | METH_KEYWORDS,
+   "Retrieve analog data of several entities as 2-D array"},
+  {"analog_stream_open",  (PyCFunction) do_analog_stream_open, METH_VARARGS | METH_KEYWORDS,
+   "Start reading chunks of analog data in the background"},
+  {"analog_stream_next",  (PyCFunction) do_analog_stream_next, METH_VARARGS | METH_KEYWORDS,
+   "Retrieve the next chunk of an analog stream"},
+  {"analog_stream_close",  (PyCFunction) do_analog_stream_close, METH_VARARGS | METH_KEYWORDS,
+   "Stop reading an analog stream"},
   {"get_segment_data",  (PyCFunction) do_get_segment_data, METH_VARARGS | METH_KEYWORDS,
    "Retrieve segment data"},
+  {"get_segment_data_range",  (PyCFunction) do_get_segment_data_range, METH_VARARGS | METH_KEYWORDS,
+   "Retrieve a range of segment data as 3-D array"},
+  {"get_segment_data_at",  (PyCFunction) do_get_segment_data_at, METH_VARARGS | METH_KEYWORDS,
+   "Retrieve the segments at the given indices as 3-D array"},
+  {"get_segment_unit_index",  (PyCFunction) do_get_segment_unit_index, METH_VARARGS | METH_KEYWORDS,
+   "Map unit ids to the indices and timestamps of their segments"},
   {"get_neural_data",  (PyCFunction) do_get_neural_data, METH_VARARGS | METH_KEYWORDS,
    "Retrieve analog data"},
+  {"bin_neural",  (PyCFunction) do_bin_neural, METH_VARARGS | METH_KEYWORDS,
+   "Spike counts of neural entities per time bin"},
 
   {"get_time_by_index",  (PyCFunction) do_get_time_by_index, METH_VARARGS | METH_KEYWORDS,
    "Timestamp of the index"},
   {"get_index_by_time",  (PyCFunction) do_get_index_by_time, METH_VARARGS | METH_KEYWORDS,
    "Index by timepoint"},
+  {"get_times_by_index",  (PyCFunction) do_get_times_by_index, METH_VARARGS | METH_KEYWORDS,
+   "Timestamps of an array of indices"},
+  {"get_indices_by_time",  (PyCFunction) do_get_indices_by_time, METH_VARARGS | METH_KEYWORDS,
+   "Indices of an array of timepoints"},
+  {"get_index_ranges",  (PyCFunction) do_get_index_ranges, METH_VARARGS | METH_KEYWORDS,
+   "Index ranges of entities within time windows"},
+  {"get_analog_segments",  (PyCFunction) do_get_analog_segments, METH_VARARGS | METH_KEYWORDS,
+   "Start indices and times of the continuous segments of analog data"},
+
+  {"pool_start",  (PyCFunction) do_pool_start, METH_VARARGS | METH_KEYWORDS,
+   "Start the worker pool, returns its wakeup fd and number of threads"},
+  {"pool_reap",  (PyCFunction) do_pool_reap, METH_NOARGS,
+   "Collect the results of finished jobs as (token, result, error) tuples"},
+  {"submit_analog_data",  (PyCFunction) do_submit_analog_data, METH_VARARGS | METH_KEYWORDS,
+   "Queue reading analog data, cf. get_analog_data"},
+  {"submit_neural_data",  (PyCFunction) do_submit_neural_data, METH_VARARGS | METH_KEYWORDS,
+   "Queue reading neural data, cf. get_neural_data"},
+  {"submit_event_data_range",  (PyCFunction) do_submit_event_data_range, METH_VARARGS | METH_KEYWORDS,
+   "Queue reading event data, cf. get_event_data_range"},
+  {"submit_segment_data_range",  (PyCFunction) do_submit_segment_data_range, METH_VARARGS | METH_KEYWORDS,
+   "Queue reading segment data, cf. get_segment_data_range"},
+  {"submit_index_ranges",  (PyCFunction) do_submit_index_ranges, METH_VARARGS | METH_KEYWORDS,
+   "Queue resolving index ranges, cf. get_index_ranges"},
 
 
 
@@ -1313,6 +8434,18 @@ init_capi(void)
   Py_INCREF (PgError);
   PyModule_AddObject (module, "error", PgError);
 
+  if (metadata_type_ready () < 0)
+    return INIT_RETURN_ERROR;
+
+  Py_INCREF (&NsMetadataType);
+  PyModule_AddObject (module, "Metadata", (PyObject *) &NsMetadataType);
+
+  PyModule_AddIntConstant (module, "LOCK_NONE", NS_LOCK_NONE);
+  PyModule_AddIntConstant (module, "LOCK_FILE", NS_LOCK_FILE);
+  PyModule_AddIntConstant (module, "LOCK_GLOBAL", NS_LOCK_GLOBAL);
+  PyModule_AddIntConstant (module, "LIBRARY_MULTITHREADED", ns_LIBRARY_MULTITHREADED);
+  PyModule_AddIntConstant (module, "POOL_THREADS", NS_POOL_THREADS);
+
 #if PY_MAJOR_VERSION >= 3
   return module;
 #endif
@@ -0,0 +1,382 @@
+/*
+ * Copyright © 2026 The python-neuroshare contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Wire protocol between the remote backend of the glue code and the
+ * reader server (nspy_server.c), which hosts a vendor library in its
+ * own process. Every call of the Neuroshare API is one request and one
+ * reply on a connection; a connection carries one call at a time.
+ *
+ * A request is an NsRemoteRequest followed by size bytes of data (the
+ * file name for OpenFile). A reply is an NsRemoteReply followed by its
+ * payload (the output buffer of the call, or the error message of the
+ * vendor library for a failed call), unless the payload was written to
+ * the shared memory segment of the connection (in_shm): connections
+ * over unix sockets get a segment, passed as a file descriptor with
+ * the reply to HELLO, and bulk data (analog, segment, ...) is written
+ * there by the vendor library directly and copied out of it once by the
+ * client. A payload is at most NS_REMOTE_MAX_DATA bytes, the client
+ * splits longer analog and neural reads.
+ *
+ * Both ends must have the same byte order; addresses are "unix:PATH"
+ * (or just an absolute PATH) and "tcp:HOST:PORT" (or "HOST:PORT"). */
+
+#ifndef NSPY_REMOTE_H
+#define NSPY_REMOTE_H
+
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define NS_REMOTE_VERSION  1
+
+/* largest payload of a reply */
+#define NS_REMOTE_MAX_DATA  (64 << 20)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* the order of the API functions is the one of NS_FN_* of the glue */
+enum {
+  NS_OP_GetLibraryInfo,
+  NS_OP_OpenFile,
+  NS_OP_CloseFile,
+  NS_OP_GetFileInfo,
+  NS_OP_GetEntityInfo,
+  NS_OP_GetEventInfo,
+  NS_OP_GetEventData,
+  NS_OP_GetAnalogInfo,
+  NS_OP_GetAnalogData,
+  NS_OP_GetSegmentInfo,
+  NS_OP_GetSegmentSourceInfo,
+  NS_OP_GetSegmentData,
+  NS_OP_GetNeuralInfo,
+  NS_OP_GetNeuralData,
+  NS_OP_GetIndexByTime,
+  NS_OP_GetTimeByIndex,
+  NS_OP_GetLastErrorMsg,
+  NS_OP_HELLO,
+  NS_OP_COUNT
+};
+
+typedef struct {
+  uint32_t op;
+  uint32_t file;
+  uint32_t entity;
+  uint32_t index;     /* item index, source id; session for HELLO */
+  uint32_t count;     /* item count, or the size of the output buffer */
+  int32_t  flag;      /* GetIndexByTime; protocol version for HELLO */
+  double   time;      /* GetIndexByTime */
+  uint32_t size;      /* bytes of data following the request */
+  uint32_t reserved;
+} NsRemoteRequest;
+
+typedef struct {
+  int32_t  result;
+  uint32_t value[2];  /* scalar outputs: file id, index, data size, ... */
+  uint32_t size;      /* bytes of the payload */
+  uint32_t in_shm;    /* payload is at the start of the shared memory */
+  uint32_t reserved;
+  double   time;      /* timestamp outputs */
+} NsRemoteReply;
+
+static inline int
+ns_remote_write_all (int fd, const void *data, size_t size)
+{
+  const char *ptr = data;
+
+  while (size > 0)
+    {
+      ssize_t n = send (fd, ptr, size, MSG_NOSIGNAL);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return -1;
+
+      ptr += n;
+      size -= (size_t) n;
+    }
+
+  return 0;
+}
+
+static inline int
+ns_remote_read_all (int fd, void *data, size_t size)
+{
+  char *ptr = data;
+
+  while (size > 0)
+    {
+      ssize_t n = recv (fd, ptr, size, 0);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n == 0)
+        errno = ECONNRESET;
+      if (n <= 0)
+        return -1;
+
+      ptr += n;
+      size -= (size_t) n;
+    }
+
+  return 0;
+}
+
+/* Discard size bytes, e.g. a payload that does not fit the buffer */
+static inline int
+ns_remote_skip (int fd, size_t size)
+{
+  char buf[4096];
+
+  while (size > 0)
+    {
+      size_t n = size < sizeof (buf) ? size : sizeof (buf);
+
+      if (ns_remote_read_all (fd, buf, n) != 0)
+        return -1;
+      size -= n;
+    }
+
+  return 0;
+}
+
+/* Send size bytes of data together with the file descriptor pass_fd
+ * (unix sockets only) */
+static inline int
+ns_remote_send_fd (int fd, const void *data, size_t size, int pass_fd)
+{
+  struct msghdr   msg;
+  struct iovec    iov;
+  struct cmsghdr *cmsg;
+  union {
+    char           buf[CMSG_SPACE (sizeof (int))];
+    struct cmsghdr align;
+  } control;
+  ssize_t n;
+
+  memset (&msg, 0, sizeof (msg));
+  memset (&control, 0, sizeof (control));
+  iov.iov_base = (void *) data;
+  iov.iov_len = size;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+  memcpy (CMSG_DATA (cmsg), &pass_fd, sizeof (int));
+
+  do
+    n = sendmsg (fd, &msg, MSG_NOSIGNAL);
+  while (n < 0 && errno == EINTR);
+
+  if (n < 0)
+    return -1;
+
+  /* the descriptor went with the first byte, the rest is plain data */
+  return ns_remote_write_all (fd, (const char *) data + n, size - (size_t) n);
+}
+
+/* Receive size bytes of data and, if one was sent along, a file
+ * descriptor (*pass_fd, -1 if there was none) */
+static inline int
+ns_remote_recv_fd (int fd, void *data, size_t size, int *pass_fd)
+{
+  struct msghdr   msg;
+  struct iovec    iov;
+  struct cmsghdr *cmsg;
+  union {
+    char           buf[CMSG_SPACE (sizeof (int))];
+    struct cmsghdr align;
+  } control;
+  ssize_t n;
+
+  *pass_fd = -1;
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = data;
+  iov.iov_len = size;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  do
+    n = recvmsg (fd, &msg, 0);
+  while (n < 0 && errno == EINTR);
+
+  if (n == 0)
+    errno = ECONNRESET;
+  if (n <= 0)
+    return -1;
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg != NULL; cmsg = CMSG_NXTHDR (&msg, cmsg))
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      memcpy (pass_fd, CMSG_DATA (cmsg), sizeof (int));
+
+  return ns_remote_read_all (fd, (char *) data + n, size - (size_t) n);
+}
+
+/* Split address into its parts: returns 1 for a unix socket (path in
+ * *host), 0 for tcp (*host and *port) and -1 for a malformed address;
+ * *host is to be free'd */
+static inline int
+ns_remote_parse_address (const char *address, char **host, const char **port)
+{
+  const char *sep;
+
+  *host = NULL;
+  *port = NULL;
+
+  if (strncmp (address, "unix:", 5) == 0 || address[0] == '/')
+    {
+      const char *path = address[0] == '/' ? address : address + 5;
+
+      if (*path == '\0' || strlen (path) >= sizeof (((struct sockaddr_un *) 0)->sun_path))
+        return -1;
+      *host = strdup (path);
+      return *host != NULL ? 1 : -1;
+    }
+
+  if (strncmp (address, "tcp:", 4) == 0)
+    address += 4;
+
+  sep = strrchr (address, ':');
+
+  if (sep == NULL || sep == address || sep[1] == '\0')
+    return -1;
+
+  *host = strndup (address, (size_t) (sep - address));
+  *port = sep + 1;
+  return *host != NULL ? 0 : -1;
+}
+
+/* Connected (listen == 0) or listening socket for address, -1 with
+ * errno set on errors; *is_unix tells the kind of socket */
+static inline int
+ns_remote_socket (const char *address, int listen_backlog, int *is_unix)
+{
+  struct addrinfo  hints;
+  struct addrinfo *res;
+  struct addrinfo *ai;
+  const char      *port;
+  char            *host;
+  int              kind;
+  int              fd = -1;
+  int              one = 1;
+
+  kind = ns_remote_parse_address (address, &host, &port);
+  *is_unix = kind == 1;
+
+  if (kind < 0)
+    {
+      free (host);
+      errno = EINVAL;
+      return -1;
+    }
+
+  if (kind == 1)
+    {
+      struct sockaddr_un sun;
+
+      memset (&sun, 0, sizeof (sun));
+      sun.sun_family = AF_UNIX;
+      strcpy (sun.sun_path, host);
+      free (host);
+
+      fd = socket (AF_UNIX, SOCK_STREAM, 0);
+      if (fd < 0)
+        return -1;
+
+      if (listen_backlog > 0)
+        {
+          unlink (sun.sun_path);
+          if (bind (fd, (struct sockaddr *) &sun, sizeof (sun)) == 0 &&
+              listen (fd, listen_backlog) == 0)
+            return fd;
+        }
+      else if (connect (fd, (struct sockaddr *) &sun, sizeof (sun)) == 0)
+        return fd;
+
+      kind = errno;
+      close (fd);
+      errno = kind;
+      return -1;
+    }
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listen_backlog > 0 ? AI_PASSIVE : 0;
+
+  if (getaddrinfo (host[0] == '*' ? NULL : host, port, &hints, &res) != 0)
+    {
+      free (host);
+      errno = EHOSTUNREACH;
+      return -1;
+    }
+  free (host);
+
+  for (ai = res; ai != NULL; ai = ai->ai_next)
+    {
+      fd = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0)
+        continue;
+
+      if (listen_backlog > 0)
+        {
+          setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+          if (bind (fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+              listen (fd, listen_backlog) == 0)
+            break;
+        }
+      else if (connect (fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+          setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+          break;
+        }
+
+      kind = errno;
+      close (fd);
+      errno = kind;
+      fd = -1;
+    }
+
+  freeaddrinfo (res);
+  return fd;
+}
+
+#endif /* _WIN32 */
+
+#endif /* NSPY_REMOTE_H */
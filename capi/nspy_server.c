@@ -0,0 +1,914 @@
+/*
+ * Copyright © 2026 The python-neuroshare contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Reader server: hosts a vendor library (e.g. nsWineLibrary, and with
+ * it a Windows DLL) in its own process and serves the Neuroshare API to
+ * the remote backend of the glue code (Library(..., address=...)), cf.
+ * nspy_remote.h for the protocol.
+ *
+ *   ns-server [-p none|file|global] [-m MiB] LIBRARY ADDRESS
+ *
+ * Every connection is served by a thread of its own; calls into the
+ * library are serialized according to the lock policy (-p, by default
+ * "none" for libraries that declare themselves thread-safe and
+ * "global" otherwise), as in the glue code. Connections over unix
+ * sockets get a shared memory segment of -m MiB (default 64) for the
+ * bulk data. Connections of a client share a session: the files it
+ * opened are closed when its last connection goes away.
+ *
+ * To use several cores for a library that is not thread-safe, run one
+ * server per core and pass all their addresses to the client.
+ *
+ * There is no authentication: a client that reaches the server can open
+ * any file the server can read (OpenFile takes a path on the server
+ * host). A session only sees the files it opened itself and its token
+ * is random, but a tcp server must not be exposed beyond a trusted
+ * network; bind it to 127.0.0.1 (and tunnel, e.g. with ssh) otherwise. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nsAPItypes.h"
+#include "nsAPIdllimp.h"
+#include "nspy_thread.h"
+#include "nspy_remote.h"
+
+#define NS_LOCK_NONE    0
+#define NS_LOCK_FILE    1
+#define NS_LOCK_GLOBAL  2
+
+#define NS_FILE_LOCKS   16
+
+/* largest output buffer a request may ask for, except for the data
+ * reads whose size is given by the item count */
+#define NS_MAX_BUFFER   (1 << 20)
+
+#define NS_SHM_DEFAULT  64
+
+typedef struct {
+  void                   *dl_handle;
+
+  NS_GETLIBRARYINFO       GetLibraryInfo;
+  NS_OPENFILE             OpenFile;
+  NS_CLOSEFILE            CloseFile;
+  NS_GETFILEINFO          GetFileInfo;
+  NS_GETENTITYINFO        GetEntityInfo;
+  NS_GETEVENTINFO         GetEventInfo;
+  NS_GETEVENTDATA         GetEventData;
+  NS_GETANALOGINFO        GetAnalogInfo;
+  NS_GETANALOGDATA        GetAnalogData;
+  NS_GETSEGMENTINFO       GetSegmentInfo;
+  NS_GETSEGMENTSOURCEINFO GetSegmentSourceInfo;
+  NS_GETSEGMENTDATA       GetSegmentData;
+  NS_GETNEURALINFO        GetNeuralInfo;
+  NS_GETNEURALDATA        GetNeuralData;
+  NS_GETINDEXBYTIME       GetIndexByTime;
+  NS_GETTIMEBYINDEX       GetTimeByIndex;
+  NS_GETLASTERRORMSG      GetLastErrorMsg;
+
+  int                     lock_policy;
+  NsMutex                 lib_lock;
+  NsMutex                 file_locks[NS_FILE_LOCKS];
+} NsServerLibrary;
+
+typedef struct _NsSession NsSession;
+
+struct _NsSession {
+  uint32_t   token;
+  int        refs;      /* connections attached */
+  uint32     *files;    /* files opened and not closed yet */
+  size_t      n_files;
+  size_t      max_files;
+  NsSession  *next;
+};
+
+typedef struct {
+  int         fd;
+  int         is_unix;
+  NsSession  *session;
+  void       *shm;
+  size_t      shm_size;
+  void       *buf;
+  size_t      buf_size;
+  char        error[1024];
+} NsConn;
+
+static NsServerLibrary lib;
+static size_t          shm_size = (size_t) NS_SHM_DEFAULT << 20;
+static char           *socket_path = NULL;
+
+static NsMutex    session_lock;
+static NsSession *sessions = NULL;
+static int        random_fd = -1;
+
+/* ************************************************************************** */
+
+static NsMutex *
+server_lock_file (uint32 file_id)
+{
+  NsMutex *mutex;
+
+  if (lib.lock_policy == NS_LOCK_NONE)
+    return NULL;
+
+  if (lib.lock_policy == NS_LOCK_FILE)
+    mutex = &lib.file_locks[file_id % NS_FILE_LOCKS];
+  else
+    mutex = &lib.lib_lock;
+
+  ns_mutex_lock (mutex);
+  return mutex;
+}
+
+static NsMutex *
+server_lock_library (void)
+{
+  if (lib.lock_policy == NS_LOCK_NONE)
+    return NULL;
+
+  ns_mutex_lock (&lib.lib_lock);
+  return &lib.lib_lock;
+}
+
+static void
+server_unlock (NsMutex *mutex)
+{
+  if (mutex != NULL)
+    ns_mutex_unlock (mutex);
+}
+
+#define PROC_ADDR(_function, _variable)                                      \
+  lib._variable = (_function) dlsym (lib.dl_handle, "ns_" #_variable);       \
+  if (lib._variable == NULL)                                                 \
+    {                                                                        \
+      fprintf (stderr, "ns-server: Could not lookup function: %s\n", #_variable); \
+      return -1;                                                             \
+    }
+
+static int
+server_load_library (const char *filename)
+{
+  int i;
+
+  lib.dl_handle = dlopen (filename, RTLD_NOW);
+
+  if (lib.dl_handle == NULL)
+    {
+      fprintf (stderr, "ns-server: Could not load library: %s\n", dlerror ());
+      return -1;
+    }
+
+  PROC_ADDR (NS_GETLIBRARYINFO, GetLibraryInfo);
+  PROC_ADDR (NS_OPENFILE, OpenFile);
+  PROC_ADDR (NS_CLOSEFILE, CloseFile);
+  PROC_ADDR (NS_GETFILEINFO, GetFileInfo);
+  PROC_ADDR (NS_GETENTITYINFO, GetEntityInfo);
+  PROC_ADDR (NS_GETEVENTINFO, GetEventInfo);
+  PROC_ADDR (NS_GETEVENTDATA, GetEventData);
+  PROC_ADDR (NS_GETANALOGINFO, GetAnalogInfo);
+  PROC_ADDR (NS_GETANALOGDATA, GetAnalogData);
+  PROC_ADDR (NS_GETSEGMENTINFO, GetSegmentInfo);
+  PROC_ADDR (NS_GETSEGMENTSOURCEINFO, GetSegmentSourceInfo);
+  PROC_ADDR (NS_GETSEGMENTDATA, GetSegmentData);
+  PROC_ADDR (NS_GETNEURALINFO, GetNeuralInfo);
+  PROC_ADDR (NS_GETNEURALDATA, GetNeuralData);
+  PROC_ADDR (NS_GETINDEXBYTIME, GetIndexByTime);
+  PROC_ADDR (NS_GETTIMEBYINDEX, GetTimeByIndex);
+  PROC_ADDR (NS_GETLASTERRORMSG, GetLastErrorMsg);
+
+  ns_mutex_init (&lib.lib_lock);
+  for (i = 0; i < NS_FILE_LOCKS; i++)
+    ns_mutex_init (&lib.file_locks[i]);
+
+  return 0;
+}
+
+/* ************************************************************************** */
+/* Sessions: the connections of a client and the files it opened */
+
+static NsSession *
+session_lookup (uint32_t token)
+{
+  NsSession *session;
+
+  for (session = sessions; session != NULL; session = session->next)
+    if (session->token == token)
+      break;
+
+  return session;
+}
+
+/* Random token for a new session that is not 0 and not in use, 0 if
+ * there is no randomness; called with session_lock held */
+static uint32_t
+session_new_token (void)
+{
+  uint32_t token = 0;
+  int      i;
+
+  for (i = 0; i < 16; i++)
+    {
+      if (read (random_fd, &token, sizeof (token)) != (ssize_t) sizeof (token))
+        return 0;
+
+      if (token != 0 && session_lookup (token) == NULL)
+        return token;
+    }
+
+  return 0;
+}
+
+static NsSession *
+session_attach (uint32_t token)
+{
+  NsSession *session = NULL;
+
+  ns_mutex_lock (&session_lock);
+
+  if (token != 0)
+    session = session_lookup (token);
+
+  if (session == NULL)
+    {
+      token = session_new_token ();
+      session = token != 0 ? calloc (1, sizeof (NsSession)) : NULL;
+
+      if (session != NULL)
+        {
+          session->token = token;
+          session->next = sessions;
+          sessions = session;
+        }
+    }
+
+  if (session != NULL)
+    session->refs++;
+
+  ns_mutex_unlock (&session_lock);
+  return session;
+}
+
+/* Add file_id to the files of session, -1 if there is no memory */
+static int
+session_add_file (NsSession *session, uint32 file_id)
+{
+  int res = -1;
+
+  ns_mutex_lock (&session_lock);
+
+  if (session->n_files == session->max_files)
+    {
+      size_t  max_files = session->max_files ? 2 * session->max_files : 16;
+      uint32 *files = realloc (session->files, max_files * sizeof (uint32));
+
+      if (files != NULL)
+        {
+          session->files = files;
+          session->max_files = max_files;
+        }
+    }
+
+  if (session->n_files < session->max_files)
+    {
+      session->files[session->n_files++] = file_id;
+      res = 0;
+    }
+
+  ns_mutex_unlock (&session_lock);
+  return res;
+}
+
+/* Whether file_id was opened by session (and not closed yet) */
+static int
+session_has_file (NsSession *session, uint32 file_id)
+{
+  size_t i;
+  int    found = 0;
+
+  ns_mutex_lock (&session_lock);
+
+  for (i = 0; i < session->n_files && !found; i++)
+    found = session->files[i] == file_id;
+
+  ns_mutex_unlock (&session_lock);
+  return found;
+}
+
+static void
+session_remove_file (NsSession *session, uint32 file_id)
+{
+  size_t i;
+
+  ns_mutex_lock (&session_lock);
+
+  for (i = 0; i < session->n_files; i++)
+    if (session->files[i] == file_id)
+      {
+        session->files[i] = session->files[--session->n_files];
+        break;
+      }
+
+  ns_mutex_unlock (&session_lock);
+}
+
+/* Drop a connection from session, closing the files that are still open
+ * with the last one */
+static void
+session_detach (NsSession *session)
+{
+  NsSession **iter;
+  NsMutex    *mutex;
+  size_t      i;
+
+  ns_mutex_lock (&session_lock);
+
+  if (--session->refs > 0)
+    {
+      ns_mutex_unlock (&session_lock);
+      return;
+    }
+
+  for (iter = &sessions; *iter != NULL; iter = &(*iter)->next)
+    if (*iter == session)
+      {
+        *iter = session->next;
+        break;
+      }
+
+  ns_mutex_unlock (&session_lock);
+
+  for (i = 0; i < session->n_files; i++)
+    {
+      mutex = server_lock_file (session->files[i]);
+      lib.CloseFile (session->files[i]);
+      server_unlock (mutex);
+    }
+
+  free (session->files);
+  free (session);
+}
+
+/* ************************************************************************** */
+
+/* Shared memory segment of size bytes, as an (unlinked) file in
+ * NSPY_SHM_DIR, /dev/shm or /tmp; returns its descriptor or -1 */
+static int
+shm_create (size_t size)
+{
+  const char *dirs[3];
+  char        path[4096];
+  int         fd;
+  int         i;
+
+  dirs[0] = getenv ("NSPY_SHM_DIR");
+  dirs[1] = "/dev/shm";
+  dirs[2] = "/tmp";
+
+  for (i = 0; i < 3; i++)
+    {
+      if (dirs[i] == NULL)
+        continue;
+
+      snprintf (path, sizeof (path), "%s/ns-server.XXXXXX", dirs[i]);
+      fd = mkstemp (path);
+
+      if (fd < 0)
+        continue;
+
+      unlink (path);
+
+      if (ftruncate (fd, (off_t) size) == 0)
+        return fd;
+
+      close (fd);
+    }
+
+  return -1;
+}
+
+/* Output buffer of size bytes for the reply to a call: the shared memory
+ * if it fits, *in_shm tells */
+static void *
+conn_buffer (NsConn *conn, size_t size, uint32_t *in_shm)
+{
+  *in_shm = 0;
+
+  if (size == 0)
+    return NULL;
+
+  if (conn->shm != NULL && size <= conn->shm_size)
+    {
+      *in_shm = 1;
+      return conn->shm;
+    }
+
+  if (size > conn->buf_size)
+    {
+      free (conn->buf);
+      conn->buf = malloc (size);
+      conn->buf_size = conn->buf != NULL ? size : 0;
+    }
+
+  return conn->buf;
+}
+
+static int
+serve_hello (NsConn *conn, const NsRemoteRequest *req)
+{
+  NsRemoteReply reply;
+  int           fd = -1;
+
+  memset (&reply, 0, sizeof (reply));
+
+  if (req->flag != NS_REMOTE_VERSION || conn->session != NULL)
+    {
+      reply.result = ns_LIBERROR;
+      return ns_remote_write_all (conn->fd, &reply, sizeof (reply));
+    }
+
+  conn->session = session_attach (req->index);
+
+  if (conn->session == NULL)
+    {
+      reply.result = ns_LIBERROR;
+      return ns_remote_write_all (conn->fd, &reply, sizeof (reply));
+    }
+
+  reply.result = ns_OK;
+  reply.value[0] = conn->session->token;
+
+  if (req->count && conn->is_unix && shm_size > 0)
+    fd = shm_create (shm_size);
+
+  if (fd >= 0)
+    {
+      conn->shm = mmap (NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+      if (conn->shm == MAP_FAILED)
+        {
+          conn->shm = NULL;
+          close (fd);
+          fd = -1;
+        }
+      else
+        conn->shm_size = shm_size;
+    }
+
+  if (fd < 0)
+    return ns_remote_write_all (conn->fd, &reply, sizeof (reply));
+
+  reply.value[1] = (uint32_t) conn->shm_size;
+  if (ns_remote_send_fd (conn->fd, &reply, sizeof (reply), fd) != 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  close (fd);
+  return 0;
+}
+
+/* Size of the output buffer of a call, 0 if it has none and (size_t) -1
+ * if the request is invalid or asks for more than NS_REMOTE_MAX_DATA */
+static size_t
+request_buffer_size (const NsRemoteRequest *req)
+{
+  size_t size;
+
+  switch (req->op)
+    {
+    case NS_OP_GetAnalogData:
+    case NS_OP_GetNeuralData:
+      size = (size_t) req->count * sizeof (double);
+      return size <= NS_REMOTE_MAX_DATA ? size : (size_t) -1;
+
+    case NS_OP_GetEventData:
+    case NS_OP_GetSegmentData:
+      return req->count <= NS_REMOTE_MAX_DATA ? req->count : (size_t) -1;
+
+    case NS_OP_GetLibraryInfo:
+    case NS_OP_GetFileInfo:
+    case NS_OP_GetEntityInfo:
+    case NS_OP_GetEventInfo:
+    case NS_OP_GetAnalogInfo:
+    case NS_OP_GetSegmentInfo:
+    case NS_OP_GetSegmentSourceInfo:
+    case NS_OP_GetNeuralInfo:
+    case NS_OP_GetLastErrorMsg:
+      return req->count <= NS_MAX_BUFFER ? req->count : (size_t) -1;
+
+    case NS_OP_OpenFile:
+    case NS_OP_CloseFile:
+    case NS_OP_GetIndexByTime:
+    case NS_OP_GetTimeByIndex:
+      return 0;
+    }
+
+  return (size_t) -1;
+}
+
+static int
+serve_call (NsConn *conn, const NsRemoteRequest *req, const char *data)
+{
+  NsRemoteReply reply;
+  NsMutex      *mutex;
+  ns_RESULT     res;
+  size_t        size;
+  void         *out;
+
+  memset (&reply, 0, sizeof (reply));
+  size = request_buffer_size (req);
+
+  if (size == (size_t) -1 || conn->session == NULL)
+    {
+      reply.result = ns_LIBERROR;
+      return ns_remote_write_all (conn->fd, &reply, sizeof (reply));
+    }
+
+  /* the file ids of the library are shared by all clients, a session
+   * may only use the ones it got from OpenFile */
+  if (req->op != NS_OP_GetLibraryInfo && req->op != NS_OP_OpenFile &&
+      req->op != NS_OP_GetLastErrorMsg &&
+      !session_has_file (conn->session, req->file))
+    {
+      reply.result = ns_BADFILE;
+      return ns_remote_write_all (conn->fd, &reply, sizeof (reply));
+    }
+
+  out = conn_buffer (conn, size, &reply.in_shm);
+
+  if (size > 0 && out == NULL)
+    {
+      reply.result = ns_LIBERROR;
+      return ns_remote_write_all (conn->fd, &reply, sizeof (reply));
+    }
+
+  if (req->op == NS_OP_GetLibraryInfo || req->op == NS_OP_OpenFile ||
+      req->op == NS_OP_GetLastErrorMsg)
+    mutex = server_lock_library ();
+  else
+    mutex = server_lock_file (req->file);
+
+  switch (req->op)
+    {
+    case NS_OP_GetLibraryInfo:
+      res = lib.GetLibraryInfo (out, req->count);
+      break;
+
+    case NS_OP_OpenFile:
+      res = lib.OpenFile (data, &reply.value[0]);
+      break;
+
+    case NS_OP_CloseFile:
+      res = lib.CloseFile (req->file);
+      break;
+
+    case NS_OP_GetFileInfo:
+      res = lib.GetFileInfo (req->file, out, req->count);
+      break;
+
+    case NS_OP_GetEntityInfo:
+      res = lib.GetEntityInfo (req->file, req->entity, out, req->count);
+      break;
+
+    case NS_OP_GetEventInfo:
+      res = lib.GetEventInfo (req->file, req->entity, out, req->count);
+      break;
+
+    case NS_OP_GetEventData:
+      res = lib.GetEventData (req->file, req->entity, req->index, &reply.time,
+                              out, req->count, &reply.value[0]);
+      break;
+
+    case NS_OP_GetAnalogInfo:
+      res = lib.GetAnalogInfo (req->file, req->entity, out, req->count);
+      break;
+
+    case NS_OP_GetAnalogData:
+      res = lib.GetAnalogData (req->file, req->entity, req->index, req->count,
+                               &reply.value[0], out);
+      break;
+
+    case NS_OP_GetSegmentInfo:
+      res = lib.GetSegmentInfo (req->file, req->entity, out, req->count);
+      break;
+
+    case NS_OP_GetSegmentSourceInfo:
+      res = lib.GetSegmentSourceInfo (req->file, req->entity, req->index, out,
+                                      req->count);
+      break;
+
+    case NS_OP_GetSegmentData:
+      res = lib.GetSegmentData (req->file, req->entity, (int32) req->index,
+                                &reply.time, out, req->count, &reply.value[0],
+                                &reply.value[1]);
+      break;
+
+    case NS_OP_GetNeuralInfo:
+      res = lib.GetNeuralInfo (req->file, req->entity, out, req->count);
+      break;
+
+    case NS_OP_GetNeuralData:
+      res = lib.GetNeuralData (req->file, req->entity, req->index, req->count, out);
+      break;
+
+    case NS_OP_GetIndexByTime:
+      res = lib.GetIndexByTime (req->file, req->entity, req->time, req->flag,
+                                &reply.value[0]);
+      break;
+
+    case NS_OP_GetTimeByIndex:
+      res = lib.GetTimeByIndex (req->file, req->entity, req->index, &reply.time);
+      break;
+
+    default:
+      res = lib.GetLastErrorMsg (out, req->count);
+      break;
+    }
+
+  /* the message of a failed call goes with its reply, the state of the
+   * library is shared by all clients */
+  conn->error[0] = '\0';
+  if (res != ns_OK && req->op != NS_OP_GetLastErrorMsg &&
+      lib.GetLastErrorMsg (conn->error, sizeof (conn->error)) != ns_OK)
+    conn->error[0] = '\0';
+  conn->error[sizeof (conn->error) - 1] = '\0';
+
+  server_unlock (mutex);
+
+  /* a file that cannot be added to the session could not be used */
+  if (res == ns_OK && req->op == NS_OP_OpenFile &&
+      session_add_file (conn->session, reply.value[0]) != 0)
+    {
+      mutex = server_lock_file (reply.value[0]);
+      lib.CloseFile (reply.value[0]);
+      server_unlock (mutex);
+      res = ns_LIBERROR;
+    }
+  else if (res == ns_OK && req->op == NS_OP_CloseFile)
+    session_remove_file (conn->session, req->file);
+
+  reply.result = res;
+
+  if (res != ns_OK)
+    {
+      reply.in_shm = 0;
+      out = conn->error;
+      size = conn->error[0] ? strlen (conn->error) + 1 : 0;
+    }
+
+  reply.size = (uint32_t) size;
+
+  if (ns_remote_write_all (conn->fd, &reply, sizeof (reply)) != 0)
+    return -1;
+
+  if (reply.in_shm || size == 0)
+    return 0;
+
+  return ns_remote_write_all (conn->fd, out, size);
+}
+
+static void
+serve_connection (void *data)
+{
+  NsConn          *conn = data;
+  NsRemoteRequest  req;
+  char            *name = NULL;
+
+  while (ns_remote_read_all (conn->fd, &req, sizeof (req)) == 0)
+    {
+      int res;
+
+      if (req.size > 0)
+        {
+          /* the file name of OpenFile, the only request with data */
+          if (req.size > 65536 || (name = malloc (req.size + 1)) == NULL)
+            break;
+
+          if (ns_remote_read_all (conn->fd, name, req.size) != 0)
+            break;
+          name[req.size] = '\0';
+        }
+
+      if (req.op == NS_OP_HELLO)
+        res = serve_hello (conn, &req);
+      else if (req.op == NS_OP_OpenFile && name == NULL)
+        res = -1;
+      else
+        res = serve_call (conn, &req, name);
+
+      free (name);
+      name = NULL;
+
+      if (res != 0)
+        break;
+    }
+
+  free (name);
+
+  if (conn->session != NULL)
+    session_detach (conn->session);
+  if (conn->shm != NULL)
+    munmap (conn->shm, conn->shm_size);
+
+  close (conn->fd);
+  free (conn->buf);
+  free (conn);
+}
+
+/* ************************************************************************** */
+
+static void
+server_quit (int signum)
+{
+  (void) signum;
+
+  if (socket_path != NULL)
+    unlink (socket_path);
+  _exit (0);
+}
+
+static int
+parse_lock_policy (const char *name)
+{
+  if (strcmp (name, "none") == 0)
+    return NS_LOCK_NONE;
+  if (strcmp (name, "file") == 0)
+    return NS_LOCK_FILE;
+  if (strcmp (name, "global") == 0)
+    return NS_LOCK_GLOBAL;
+  return -1;
+}
+
+static void
+usage (void)
+{
+  fprintf (stderr, "usage: ns-server [-p none|file|global] [-m MiB] LIBRARY ADDRESS\n"
+                   "  ADDRESS is unix:PATH or tcp:HOST:PORT (HOST * for any)\n"
+                   "  There is no authentication and clients can open any file the\n"
+                   "  server can read: use tcp:127.0.0.1:PORT (and e.g. a ssh tunnel)\n"
+                   "  unless the network is trusted.\n");
+  exit (2);
+}
+
+int
+main (int argc, char **argv)
+{
+  ns_LIBRARYINFO info;
+  const char    *policy = NULL;
+  const char    *address;
+  char          *host;
+  char          *port;
+  int            listen_fd;
+  int            is_unix;
+  int            exhausted = 0;  /* out of fds, reported once */
+  int            i;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+      if (strcmp (argv[i], "-p") == 0 && i + 1 < argc)
+        policy = argv[++i];
+      else if (strcmp (argv[i], "-m") == 0 && i + 1 < argc)
+        shm_size = (size_t) strtoul (argv[++i], NULL, 10) << 20;
+      else
+        usage ();
+    }
+
+  if (argc - i != 2)
+    usage ();
+
+  /* the reply to HELLO carries the size in 32 bits */
+  if (shm_size > 0xfff00000u)
+    shm_size = 0xfff00000u;
+
+  if (server_load_library (argv[i]) != 0)
+    return 1;
+
+  if (policy != NULL)
+    lib.lock_policy = parse_lock_policy (policy);
+  else if (lib.GetLibraryInfo (&info, sizeof (info)) == ns_OK &&
+           (info.dwFlags & ns_LIBRARY_MULTITHREADED))
+    lib.lock_policy = NS_LOCK_NONE;
+  else
+    lib.lock_policy = NS_LOCK_GLOBAL;
+
+  if (lib.lock_policy < 0)
+    usage ();
+
+  address = argv[i + 1];
+  listen_fd = ns_remote_socket (address, 64, &is_unix);
+
+  if (listen_fd < 0)
+    {
+      fprintf (stderr, "ns-server: Could not listen on %s: %s\n", address,
+               strerror (errno));
+      return 1;
+    }
+
+  if (is_unix)
+    ns_remote_parse_address (address, &socket_path, (const char **) &port);
+  else if (ns_remote_parse_address (address, &host, (const char **) &port) == 0)
+    {
+      if (strcmp (host, "127.0.0.1") != 0 && strcmp (host, "localhost") != 0 &&
+          strcmp (host, "::1") != 0 && strcmp (host, "[::1]") != 0)
+        fprintf (stderr, "ns-server: warning: listening on %s without "
+                 "authentication, any client that reaches it can read the "
+                 "files of this host\n", address);
+      free (host);
+    }
+
+  random_fd = open ("/dev/urandom", O_RDONLY);
+
+  if (random_fd < 0)
+    {
+      fprintf (stderr, "ns-server: Could not open /dev/urandom: %s\n",
+               strerror (errno));
+      return 1;
+    }
+
+  ns_mutex_init (&session_lock);
+  signal (SIGPIPE, SIG_IGN);
+  signal (SIGINT, server_quit);
+  signal (SIGTERM, server_quit);
+
+  for (;;)
+    {
+      NsConn  *conn;
+      NsThread thread;
+      int      fd;
+      int      one = 1;
+
+      fd = accept (listen_fd, NULL, NULL);
+
+      if (fd < 0)
+        {
+          if (errno == EMFILE || errno == ENFILE)
+            {
+              /* out of fds: the pending connection stays queued, so wait
+                 for connections to close instead of spinning on it */
+              struct timespec backoff = { 0, 100 * 1000 * 1000 };
+
+              if (!exhausted)
+                fprintf (stderr, "ns-server: accept failed: %s, retrying\n",
+                         strerror (errno));
+              exhausted = 1;
+              nanosleep (&backoff, NULL);
+              continue;
+            }
+          if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+          fprintf (stderr, "ns-server: accept failed: %s\n", strerror (errno));
+          return 1;
+        }
+
+      exhausted = 0;
+
+      if (!is_unix)
+        setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+      conn = calloc (1, sizeof (NsConn));
+
+      if (conn == NULL)
+        {
+          close (fd);
+          continue;
+        }
+
+      conn->fd = fd;
+      conn->is_unix = is_unix;
+
+      if (ns_thread_start (&thread, serve_connection, conn) != 0)
+        {
+          close (fd);
+          free (conn);
+          continue;
+        }
+
+      pthread_detach (thread);
+    }
+
+  return 0;
+}
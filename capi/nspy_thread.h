@@ -0,0 +1,270 @@
+/*
+ * Copyright © 2026 The python-neuroshare contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Minimal portable threading primitives (and a monotonic clock) used by
+ * the glue code. None of these functions need (or touch) the Python GIL. */
+
+#ifndef NSPY_THREAD_H
+#define NSPY_THREAD_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef void (*NsThreadFunc) (void *data);
+
+typedef struct {
+  NsThreadFunc func;
+  void        *data;
+} NsThreadStart;
+
+#ifdef _WIN32
+
+typedef CRITICAL_SECTION NsMutex;
+
+static inline void
+ns_mutex_init (NsMutex *mutex)
+{
+  InitializeCriticalSection (mutex);
+}
+
+static inline void
+ns_mutex_clear (NsMutex *mutex)
+{
+  DeleteCriticalSection (mutex);
+}
+
+static inline void
+ns_mutex_lock (NsMutex *mutex)
+{
+  EnterCriticalSection (mutex);
+}
+
+static inline void
+ns_mutex_unlock (NsMutex *mutex)
+{
+  LeaveCriticalSection (mutex);
+}
+
+typedef CONDITION_VARIABLE NsCond;
+
+static inline void
+ns_cond_init (NsCond *cond)
+{
+  InitializeConditionVariable (cond);
+}
+
+static inline void
+ns_cond_clear (NsCond *cond)
+{
+}
+
+static inline void
+ns_cond_wait (NsCond *cond, NsMutex *mutex)
+{
+  SleepConditionVariableCS (cond, mutex, INFINITE);
+}
+
+static inline void
+ns_cond_broadcast (NsCond *cond)
+{
+  WakeAllConditionVariable (cond);
+}
+
+typedef HANDLE NsThread;
+
+static DWORD WINAPI
+ns_thread_trampoline (LPVOID arg)
+{
+  NsThreadStart start = * (NsThreadStart *) arg;
+
+  free (arg);
+  start.func (start.data);
+  return 0;
+}
+
+static inline int
+ns_thread_start (NsThread *thread, NsThreadFunc func, void *data)
+{
+  NsThreadStart *start;
+
+  start = malloc (sizeof (NsThreadStart));
+  start->func = func;
+  start->data = data;
+
+  *thread = CreateThread (NULL, 0, ns_thread_trampoline, start, 0, NULL);
+
+  if (*thread == NULL)
+    {
+      free (start);
+      return -1;
+    }
+
+  return 0;
+}
+
+static inline void
+ns_thread_join (NsThread thread)
+{
+  WaitForSingleObject (thread, INFINITE);
+  CloseHandle (thread);
+}
+
+static inline void
+ns_atomic_add (volatile uint64_t *value, uint64_t delta)
+{
+  InterlockedExchangeAdd64 ((volatile LONG64 *) value, (LONG64) delta);
+}
+
+/* Set *value to desired if it is expected; returns non-zero on success */
+static inline int
+ns_atomic_cas (volatile uint32_t *value, uint32_t expected, uint32_t desired)
+{
+  return InterlockedCompareExchange ((volatile LONG *) value,
+                                     (LONG) desired, (LONG) expected) == (LONG) expected;
+}
+
+static inline uint64_t
+ns_time_ns (void)
+{
+  LARGE_INTEGER counter, freq;
+
+  QueryPerformanceCounter (&counter);
+  QueryPerformanceFrequency (&freq);
+  return (uint64_t) ((double) counter.QuadPart * 1e9 / (double) freq.QuadPart);
+}
+
+#else
+
+#include <pthread.h>
+#include <time.h>
+
+typedef pthread_mutex_t NsMutex;
+
+static inline void
+ns_mutex_init (NsMutex *mutex)
+{
+  pthread_mutex_init (mutex, NULL);
+}
+
+static inline void
+ns_mutex_clear (NsMutex *mutex)
+{
+  pthread_mutex_destroy (mutex);
+}
+
+static inline void
+ns_mutex_lock (NsMutex *mutex)
+{
+  pthread_mutex_lock (mutex);
+}
+
+static inline void
+ns_mutex_unlock (NsMutex *mutex)
+{
+  pthread_mutex_unlock (mutex);
+}
+
+typedef pthread_cond_t NsCond;
+
+static inline void
+ns_cond_init (NsCond *cond)
+{
+  pthread_cond_init (cond, NULL);
+}
+
+static inline void
+ns_cond_clear (NsCond *cond)
+{
+  pthread_cond_destroy (cond);
+}
+
+static inline void
+ns_cond_wait (NsCond *cond, NsMutex *mutex)
+{
+  pthread_cond_wait (cond, mutex);
+}
+
+static inline void
+ns_cond_broadcast (NsCond *cond)
+{
+  pthread_cond_broadcast (cond);
+}
+
+typedef pthread_t NsThread;
+
+static void *
+ns_thread_trampoline (void *arg)
+{
+  NsThreadStart start = * (NsThreadStart *) arg;
+
+  free (arg);
+  start.func (start.data);
+  return NULL;
+}
+
+static inline int
+ns_thread_start (NsThread *thread, NsThreadFunc func, void *data)
+{
+  NsThreadStart *start;
+
+  start = malloc (sizeof (NsThreadStart));
+  start->func = func;
+  start->data = data;
+
+  if (pthread_create (thread, NULL, ns_thread_trampoline, start) != 0)
+    {
+      free (start);
+      return -1;
+    }
+
+  return 0;
+}
+
+static inline void
+ns_thread_join (NsThread thread)
+{
+  pthread_join (thread, NULL);
+}
+
+static inline void
+ns_atomic_add (volatile uint64_t *value, uint64_t delta)
+{
+  __atomic_fetch_add (value, delta, __ATOMIC_RELAXED);
+}
+
+/* Set *value to desired if it is expected; returns non-zero on success */
+static inline int
+ns_atomic_cas (volatile uint32_t *value, uint32_t expected, uint32_t desired)
+{
+  return __atomic_compare_exchange_n (value, &expected, desired, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline uint64_t
+ns_time_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+#endif
+
+#endif /* NSPY_THREAD_H */
@@ -0,0 +1,959 @@
+/*
+ * Copyright © 2026 The python-neuroshare contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Synthetic vendor library implementing the Neuroshare API, for
+ * benchmarks, load tests and for reproducing the behaviour of real
+ * vendor libraries. The data of all entities is computed on the fly.
+ *
+ * The file that is opened is a spec of the synthetic data: lines of
+ * "key = value" (and # comments), cf. mock_spec_keys for the keys and
+ * mock_default_spec for their defaults. A file that does not exist
+ * gets the default layout, a spec that can not be parsed is rejected
+ * with ns_FILEERROR.
+ *
+ * Items of each entity are evenly spaced in time at their rate; the
+ * samples of analog entities are interrupted every gap_every samples by
+ * a gap of gap_length seconds. Calls concerning a file can be slowed
+ * down (latency_us, latency_jitter_us) and made to fail (fail_every).
+ * Setting the environment variable NSMOCK_SINGLETHREADED makes the
+ * library not declare itself thread-safe. */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "nsAPItypes.h"
+#include "nsAPIdllimp.h"
+
+#ifdef _WIN32
+# include <windows.h>
+# define NS_EXPORT __declspec(dllexport)
+#else
+# include <time.h>
+# define NS_EXPORT __attribute__ ((visibility ("default")))
+#endif
+
+#ifdef _MSC_VER
+# define MOCK_THREAD_LOCAL __declspec(thread)
+#else
+# define MOCK_THREAD_LOCAL __thread
+#endif
+
+#define MOCK_MAX_FILES 64
+
+typedef struct {
+  double event_entities;
+  double analog_entities;
+  double segment_entities;
+  double neural_entities;
+
+  double event_count;       /* items per entity */
+  double event_rate;        /* items per second */
+  double event_type;        /* ns_EVENT_* */
+
+  double analog_count;
+  double sample_rate;
+  double gap_every;         /* samples between gaps, 0: no gaps */
+  double gap_length;        /* seconds */
+  double report_gaps;       /* 0: cont_count is always the full count */
+
+  double segment_count;
+  double segment_rate;
+  double segment_sources;
+  double segment_min_samples;
+  double segment_max_samples;
+  double segment_units;
+
+  double neural_count;
+  double neural_rate;
+
+  double latency_us;        /* added to every call concerning a file */
+  double latency_jitter_us;
+  double fail_every;        /* every n-th call fails with ns_LIBERROR */
+  double ignore_position;   /* GetIndexByTime always picks the closest */
+} MockSpec;
+
+static const MockSpec mock_default_spec = {
+  4, 16, 4, 4,
+  100000, 100.0, ns_EVENT_WORD,
+  30000 * 600, 30000.0, 0, 0.0, 1,
+  100000, 150.0, 1, 48, 48, 4,
+  100000, 150.0,
+  0, 0, 0, 0
+};
+
+typedef struct {
+  const char *name;
+  size_t      offset;
+  double      max;
+} MockSpecKey;
+
+#define MOCK_KEY(_name, _max) { #_name, offsetof (MockSpec, _name), _max }
+
+static const MockSpecKey mock_spec_keys[] = {
+  MOCK_KEY (event_entities, 65536),
+  MOCK_KEY (analog_entities, 65536),
+  MOCK_KEY (segment_entities, 65536),
+  MOCK_KEY (neural_entities, 65536),
+  MOCK_KEY (event_count, 4294967295.0),
+  MOCK_KEY (event_rate, 1e9),
+  MOCK_KEY (event_type, ns_EVENT_DWORD),
+  MOCK_KEY (analog_count, 4294967295.0),
+  MOCK_KEY (sample_rate, 1e9),
+  MOCK_KEY (gap_every, 4294967295.0),
+  MOCK_KEY (gap_length, 1e9),
+  MOCK_KEY (report_gaps, 1),
+  MOCK_KEY (segment_count, 2147483647.0),
+  MOCK_KEY (segment_rate, 1e9),
+  MOCK_KEY (segment_sources, 1024),
+  MOCK_KEY (segment_min_samples, 65536),
+  MOCK_KEY (segment_max_samples, 65536),
+  MOCK_KEY (segment_units, 65536),
+  MOCK_KEY (neural_count, 4294967295.0),
+  MOCK_KEY (neural_rate, 1e9),
+  MOCK_KEY (latency_us, 1e9),
+  MOCK_KEY (latency_jitter_us, 1e9),
+  MOCK_KEY (fail_every, 4294967295.0),
+  MOCK_KEY (ignore_position, 1),
+  { NULL, 0, 0 }
+};
+
+typedef struct {
+  volatile long used;
+  volatile long calls;
+  MockSpec      spec;
+} MockFile;
+
+static MockFile mock_files[MOCK_MAX_FILES];
+
+/* The library claims ns_LIBRARY_MULTITHREADED, so the message of the
+ * last error is per thread: ns_GetLastErrorMsg reports the error of a
+ * call made by the calling thread. */
+static MOCK_THREAD_LOCAL char mock_error[256] = "";
+
+static ns_RESULT
+mock_fail (ns_RESULT res, const char *message)
+{
+  snprintf (mock_error, sizeof (mock_error), "%s", message);
+  return res;
+}
+
+static int
+mock_claim_slot (volatile long *slot)
+{
+#ifdef _WIN32
+  return InterlockedCompareExchange (slot, 1, 0) == 0;
+#else
+  return __sync_bool_compare_and_swap (slot, 0, 1);
+#endif
+}
+
+static long
+mock_count_call (volatile long *calls)
+{
+#ifdef _WIN32
+  return InterlockedIncrement (calls);
+#else
+  return __sync_add_and_fetch (calls, 1);
+#endif
+}
+
+static void
+mock_sleep_us (double us)
+{
+#ifdef _WIN32
+  Sleep ((DWORD) (us / 1000.0));
+#else
+  struct timespec ts;
+
+  ts.tv_sec = (time_t) (us / 1e6);
+  ts.tv_nsec = (long) ((us - ts.tv_sec * 1e6) * 1000.0);
+  nanosleep (&ts, NULL);
+#endif
+}
+
+/* Parse the spec in filename into spec; returns 0 on success */
+static int
+mock_parse_spec (const char *filename, MockSpec *spec)
+{
+  const MockSpecKey *key;
+  FILE   *fp;
+  char    line[256];
+  char    name[64];
+  double  value;
+  int     lineno = 0;
+
+  *spec = mock_default_spec;
+  fp = fopen (filename, "r");
+
+  if (fp == NULL)
+    return 0;
+
+  while (fgets (line, sizeof (line), fp) != NULL)
+    {
+      char *comment = strchr (line, '#');
+
+      lineno++;
+
+      if (comment != NULL)
+        *comment = '\0';
+
+      if (sscanf (line, " %63[a-z_] = %lf", name, &value) != 2)
+        {
+          if (sscanf (line, " %63s", name) == 1)
+            {
+              snprintf (mock_error, sizeof (mock_error),
+                        "%s:%d: expected key = value", filename, lineno);
+              fclose (fp);
+              return -1;
+            }
+          continue;
+        }
+
+      for (key = mock_spec_keys; key->name != NULL; key++)
+        if (strcmp (key->name, name) == 0)
+          break;
+
+      if (key->name == NULL || value < 0 || value > key->max)
+        {
+          snprintf (mock_error, sizeof (mock_error), "%s:%d: %s %s",
+                    filename, lineno, key->name ? "invalid value for" : "unknown key",
+                    name);
+          fclose (fp);
+          return -1;
+        }
+
+      * (double *) ((char *) spec + key->offset) = value;
+    }
+
+  fclose (fp);
+
+  if (spec->segment_min_samples > spec->segment_max_samples ||
+      spec->sample_rate <= 0 || spec->event_rate <= 0 ||
+      spec->segment_rate <= 0 || spec->neural_rate <= 0 ||
+      spec->segment_units < 1)
+    {
+      snprintf (mock_error, sizeof (mock_error), "%s: inconsistent spec", filename);
+      return -1;
+    }
+
+  return 0;
+}
+
+/* The spec of an open file (or NULL); applies the injected latency and
+ * failures of the file, *res is the result the call should return */
+static const MockSpec *
+mock_enter (uint32 file_id, ns_RESULT *res)
+{
+  MockFile *file;
+  long      calls;
+
+  if (file_id < 1 || file_id > MOCK_MAX_FILES || !mock_files[file_id - 1].used)
+    {
+      *res = mock_fail (ns_BADFILE, "Invalid file handle");
+      return NULL;
+    }
+
+  file = &mock_files[file_id - 1];
+  calls = mock_count_call (&file->calls);
+
+  if (file->spec.latency_us > 0 || file->spec.latency_jitter_us > 0)
+    {
+      uint32 x = (uint32) calls * 2654435761u;
+      double jitter = file->spec.latency_jitter_us * (double) (x >> 8) / 16777216.0;
+
+      mock_sleep_us (file->spec.latency_us + jitter);
+    }
+
+  if (file->spec.fail_every > 0 && calls % (long) file->spec.fail_every == 0)
+    {
+      *res = mock_fail (ns_LIBERROR, "Injected failure");
+      return NULL;
+    }
+
+  *res = ns_OK;
+  return &file->spec;
+}
+
+static uint32
+mock_entity_count (const MockSpec *spec)
+{
+  return (uint32) (spec->event_entities + spec->analog_entities +
+                   spec->segment_entities + spec->neural_entities);
+}
+
+/* Type, number of items and item rate of an entity; returns
+ * ns_ENTITY_UNKNOWN for an invalid entity id. *offset is the index of
+ * the entity among the ones of its type. */
+static uint32
+mock_entity (const MockSpec *spec, uint32 entity_id,
+             uint32 *count, double *rate, uint32 *offset)
+{
+  if (entity_id < spec->event_entities)
+    {
+      *count = (uint32) spec->event_count;
+      *rate = spec->event_rate;
+      *offset = entity_id;
+      return ns_ENTITY_EVENT;
+    }
+  entity_id -= (uint32) spec->event_entities;
+
+  if (entity_id < spec->analog_entities)
+    {
+      *count = (uint32) spec->analog_count;
+      *rate = spec->sample_rate;
+      *offset = entity_id;
+      return ns_ENTITY_ANALOG;
+    }
+  entity_id -= (uint32) spec->analog_entities;
+
+  if (entity_id < spec->segment_entities)
+    {
+      *count = (uint32) spec->segment_count;
+      *rate = spec->segment_rate;
+      *offset = entity_id;
+      return ns_ENTITY_SEGMENT;
+    }
+  entity_id -= (uint32) spec->segment_entities;
+
+  if (entity_id < spec->neural_entities)
+    {
+      *count = (uint32) spec->neural_count;
+      *rate = spec->neural_rate;
+      *offset = entity_id;
+      return ns_ENTITY_NEURALEVENT;
+    }
+
+  return ns_ENTITY_UNKNOWN;
+}
+
+/* Samples between gaps of an entity (0: none) */
+static double
+mock_gap_every (const MockSpec *spec, uint32 type)
+{
+  return type == ns_ENTITY_ANALOG ? floor (spec->gap_every) : 0;
+}
+
+static double
+mock_time (const MockSpec *spec, uint32 type, uint32 index, double rate)
+{
+  double every = mock_gap_every (spec, type);
+  double t = (double) index / rate;
+
+  if (every > 0)
+    t += floor (index / every) * spec->gap_length;
+
+  return t;
+}
+
+/* Indices of the items at or before and at or after timepoint, may be
+ * out of [0, count) */
+static void
+mock_neighbours (const MockSpec *spec, uint32 type, double rate,
+                 double timepoint, double *before, double *after)
+{
+  double every = mock_gap_every (spec, type);
+  double x, k, start;
+
+  if (every > 0)
+    {
+      /* the continuous segment that starts before timepoint */
+      k = floor (timepoint / (every / rate + spec->gap_length));
+      if (k < 0)
+        k = 0;
+      start = k * every;
+      x = start + (timepoint - (start / rate + k * spec->gap_length)) * rate;
+
+      if (x > start + every - 1)
+        {
+          /* within the gap */
+          *before = start + every - 1;
+          *after = start + every;
+          return;
+        }
+    }
+  else
+    x = timepoint * rate;
+
+  *before = floor (x + 1e-9);
+  *after = ceil (x - 1e-9);
+}
+
+/* Cheap, deterministic noise in [-1, 1) */
+static double
+mock_value (uint32 index, uint32 seed)
+{
+  uint32 x = (index + seed * 7919u) * 2654435761u;
+
+  return (double) (int32) ((x >> 16) - 32768) / 32768.0;
+}
+
+/* ************************************************************************** */
+
+NS_EXPORT ns_RESULT
+ns_GetLibraryInfo (ns_LIBRARYINFO *info, uint32 info_size)
+{
+  if (info == NULL || info_size < sizeof (ns_LIBRARYINFO))
+    return mock_fail (ns_LIBERROR, "Invalid library info buffer");
+
+  memset (info, 0, sizeof (ns_LIBRARYINFO));
+  info->dwLibVersionMaj = 1;
+  info->dwLibVersionMin = 1;
+  info->dwAPIVersionMaj = 1;
+  info->dwAPIVersionMin = 0;
+  snprintf (info->szDescription, sizeof (info->szDescription),
+            "Synthetic data library");
+  snprintf (info->szCreator, sizeof (info->szCreator), "python-neuroshare");
+  info->dwTime_Year = 2013;
+  info->dwTime_Month = 0;
+  info->dwTime_Day = 1;
+  info->dwFlags = getenv ("NSMOCK_SINGLETHREADED") ? 0 : ns_LIBRARY_MULTITHREADED;
+  info->dwMaxFiles = MOCK_MAX_FILES;
+  info->dwFileDescCount = 1;
+  snprintf (info->FileDesc[0].szDescription,
+            sizeof (info->FileDesc[0].szDescription), "Synthetic data spec");
+  snprintf (info->FileDesc[0].szExtension,
+            sizeof (info->FileDesc[0].szExtension), "mock");
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_OpenFile (const char *filename, uint32 *file_id)
+{
+  MockSpec spec;
+  uint32   i;
+
+  if (filename == NULL || file_id == NULL)
+    return mock_fail (ns_LIBERROR, "Invalid arguments");
+
+  if (mock_parse_spec (filename, &spec) != 0)
+    return ns_FILEERROR;
+
+  for (i = 0; i < MOCK_MAX_FILES; i++)
+    if (mock_claim_slot (&mock_files[i].used))
+      {
+        mock_files[i].spec = spec;
+        mock_files[i].calls = 0;
+        *file_id = i + 1;
+        return ns_OK;
+      }
+
+  return mock_fail (ns_FILEERROR, "Too many open files");
+}
+
+NS_EXPORT ns_RESULT
+ns_CloseFile (uint32 file_id)
+{
+  ns_RESULT res;
+
+  if (mock_enter (file_id, &res) == NULL && res == ns_BADFILE)
+    return res;
+
+  mock_files[file_id - 1].used = 0;
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetFileInfo (uint32 file_id, ns_FILEINFO *info, uint32 info_size)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  if (info == NULL || info_size < sizeof (ns_FILEINFO))
+    return mock_fail (ns_LIBERROR, "Invalid file info buffer");
+
+  memset (info, 0, sizeof (ns_FILEINFO));
+  snprintf (info->szFileType, sizeof (info->szFileType), "Synthetic data");
+  info->dwEntityCount = mock_entity_count (spec);
+  info->dTimeStampResolution = 1.0 / spec->sample_rate;
+  info->dTimeSpan = mock_time (spec, ns_ENTITY_ANALOG,
+                               (uint32) spec->analog_count, spec->sample_rate);
+  snprintf (info->szAppName, sizeof (info->szAppName), "nsMock");
+  info->dwTime_Year = 2013;
+  info->dwTime_Month = 0;
+  info->dwTime_Day = 1;
+  snprintf (info->szFileComment, sizeof (info->szFileComment),
+            "Computed on the fly");
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetEntityInfo (uint32 file_id, uint32 entity_id,
+                  ns_ENTITYINFO *info, uint32 info_size)
+{
+  static const char *names[] = {"unknown", "event", "analog", "segment", "neural"};
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          type, count, offset;
+  double          rate;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  type = mock_entity (spec, entity_id, &count, &rate, &offset);
+
+  if (type == ns_ENTITY_UNKNOWN)
+    return mock_fail (ns_BADENTITY, "Invalid entity");
+
+  if (info == NULL || info_size < sizeof (ns_ENTITYINFO))
+    return mock_fail (ns_LIBERROR, "Invalid entity info buffer");
+
+  memset (info, 0, sizeof (ns_ENTITYINFO));
+  snprintf (info->szEntityLabel, sizeof (info->szEntityLabel), "%s %u",
+            names[type], offset);
+  info->dwEntityType = type;
+  info->dwItemCount = count;
+
+  return ns_OK;
+}
+
+/* Size of the value of an event */
+static uint32
+mock_event_size (const MockSpec *spec)
+{
+  switch ((int) spec->event_type)
+    {
+    case ns_EVENT_TEXT:
+    case ns_EVENT_CSV:
+      return 32;
+
+    case ns_EVENT_BYTE:
+      return sizeof (uint8);
+
+    case ns_EVENT_WORD:
+      return sizeof (uint16);
+
+    default:
+      return sizeof (uint32);
+    }
+}
+
+NS_EXPORT ns_RESULT
+ns_GetEventInfo (uint32 file_id, uint32 entity_id,
+                 ns_EVENTINFO *info, uint32 info_size)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          count, offset;
+  double          rate;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  if (mock_entity (spec, entity_id, &count, &rate, &offset) != ns_ENTITY_EVENT)
+    return mock_fail (ns_BADENTITY, "Not an event entity");
+
+  if (info == NULL || info_size < sizeof (ns_EVENTINFO))
+    return mock_fail (ns_LIBERROR, "Invalid event info buffer");
+
+  memset (info, 0, sizeof (ns_EVENTINFO));
+  info->dwEventType = (uint32) spec->event_type;
+  info->dwMinDataLength = spec->event_type <= ns_EVENT_CSV ? 1 : mock_event_size (spec);
+  info->dwMaxDataLength = mock_event_size (spec);
+
+  if (spec->event_type == ns_EVENT_CSV)
+    snprintf (info->szCSVDesc, sizeof (info->szCSVDesc), "index,entity");
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetEventData (uint32 file_id, uint32 entity_id, uint32 index,
+                 double *timestamp, void *data, uint32 data_size,
+                 uint32 *data_ret_size)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          count, offset, size;
+  double          rate;
+  uint8           u8;
+  uint16          u16;
+  uint32          u32;
+  char            text[32];
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  if (mock_entity (spec, entity_id, &count, &rate, &offset) != ns_ENTITY_EVENT)
+    return mock_fail (ns_BADENTITY, "Not an event entity");
+
+  if (index >= count)
+    return mock_fail (ns_BADINDEX, "Invalid index");
+
+  if (data == NULL)
+    return mock_fail (ns_LIBERROR, "Invalid event data buffer");
+
+  switch ((int) spec->event_type)
+    {
+    case ns_EVENT_TEXT:
+    case ns_EVENT_CSV:
+      size = (uint32) snprintf (text, sizeof (text),
+                                spec->event_type == ns_EVENT_TEXT ? "event %u/%u" : "%u,%u",
+                                index, offset);
+      if (data_size < size + 1)
+        return mock_fail (ns_LIBERROR, "Event data buffer too small");
+      memcpy (data, text, size + 1);
+      break;
+
+    case ns_EVENT_BYTE:
+      u8 = (uint8) (index + offset);
+      size = sizeof (u8);
+      if (data_size < size)
+        return mock_fail (ns_LIBERROR, "Event data buffer too small");
+      memcpy (data, &u8, size);
+      break;
+
+    case ns_EVENT_WORD:
+      u16 = (uint16) (index + offset);
+      size = sizeof (u16);
+      if (data_size < size)
+        return mock_fail (ns_LIBERROR, "Event data buffer too small");
+      memcpy (data, &u16, size);
+      break;
+
+    default:
+      u32 = index + offset;
+      size = sizeof (u32);
+      if (data_size < size)
+        return mock_fail (ns_LIBERROR, "Event data buffer too small");
+      memcpy (data, &u32, size);
+    }
+
+  *timestamp = mock_time (spec, ns_ENTITY_EVENT, index, rate);
+
+  if (data_ret_size != NULL)
+    *data_ret_size = size;
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetAnalogInfo (uint32 file_id, uint32 entity_id,
+                  ns_ANALOGINFO *info, uint32 info_size)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          count, offset;
+  double          rate;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  if (mock_entity (spec, entity_id, &count, &rate, &offset) != ns_ENTITY_ANALOG)
+    return mock_fail (ns_BADENTITY, "Not an analog entity");
+
+  if (info == NULL || info_size < sizeof (ns_ANALOGINFO))
+    return mock_fail (ns_LIBERROR, "Invalid analog info buffer");
+
+  memset (info, 0, sizeof (ns_ANALOGINFO));
+  info->dSampleRate = rate;
+  info->dMinVal = -1e-3;
+  info->dMaxVal = 1e-3;
+  snprintf (info->szUnits, sizeof (info->szUnits), "V");
+  info->dResolution = 2e-3 / 65536.0;
+  info->dLocationUser = offset;
+  snprintf (info->szHighFilterType, sizeof (info->szHighFilterType), "none");
+  snprintf (info->szLowFilterType, sizeof (info->szLowFilterType), "none");
+  snprintf (info->szProbeInfo, sizeof (info->szProbeInfo), "channel %u", offset);
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetAnalogData (uint32 file_id, uint32 entity_id, uint32 start_index,
+                  uint32 index_count, uint32 *cont_count, double *data)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          count, offset, i;
+  double          rate, every;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  if (mock_entity (spec, entity_id, &count, &rate, &offset) != ns_ENTITY_ANALOG)
+    return mock_fail (ns_BADENTITY, "Not an analog entity");
+
+  if (start_index > count || index_count > count - start_index)
+    return mock_fail (ns_BADINDEX, "Invalid index range");
+
+  if (data == NULL)
+    return mock_fail (ns_LIBERROR, "Invalid data buffer");
+
+  for (i = 0; i < index_count; i++)
+    data[i] = mock_value (start_index + i, offset) * 1e-3;
+
+  if (cont_count != NULL)
+    {
+      every = mock_gap_every (spec, ns_ENTITY_ANALOG);
+      *cont_count = index_count;
+
+      /* samples up to the next gap */
+      if (every > 0 && spec->report_gaps)
+        {
+          double left = every - fmod ((double) start_index, every);
+
+          if (left < index_count)
+            *cont_count = (uint32) left;
+        }
+    }
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetSegmentInfo (uint32 file_id, uint32 entity_id,
+                   ns_SEGMENTINFO *info, uint32 info_size)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          count, offset;
+  double          rate;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  if (mock_entity (spec, entity_id, &count, &rate, &offset) != ns_ENTITY_SEGMENT)
+    return mock_fail (ns_BADENTITY, "Not a segment entity");
+
+  if (info == NULL || info_size < sizeof (ns_SEGMENTINFO))
+    return mock_fail (ns_LIBERROR, "Invalid segment info buffer");
+
+  memset (info, 0, sizeof (ns_SEGMENTINFO));
+  info->dwSourceCount = (uint32) spec->segment_sources;
+  info->dwMinSampleCount = (uint32) spec->segment_min_samples;
+  info->dwMaxSampleCount = (uint32) spec->segment_max_samples;
+  info->dSampleRate = spec->sample_rate;
+  snprintf (info->szUnits, sizeof (info->szUnits), "V");
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetSegmentSourceInfo (uint32 file_id, uint32 entity_id, uint32 source_id,
+                         ns_SEGSOURCEINFO *info, uint32 info_size)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          count, offset;
+  double          rate;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  if (mock_entity (spec, entity_id, &count, &rate, &offset) != ns_ENTITY_SEGMENT)
+    return mock_fail (ns_BADENTITY, "Not a segment entity");
+
+  if (source_id >= spec->segment_sources)
+    return mock_fail (ns_BADSOURCE, "Invalid source");
+
+  if (info == NULL || info_size < sizeof (ns_SEGSOURCEINFO))
+    return mock_fail (ns_LIBERROR, "Invalid source info buffer");
+
+  memset (info, 0, sizeof (ns_SEGSOURCEINFO));
+  info->dMinVal = -1e-3;
+  info->dMaxVal = 1e-3;
+  info->dResolution = 2e-3 / 65536.0;
+  info->dLocationUser = source_id;
+  snprintf (info->szHighFilterType, sizeof (info->szHighFilterType), "none");
+  snprintf (info->szLowFilterType, sizeof (info->szLowFilterType), "none");
+  snprintf (info->szProbeInfo, sizeof (info->szProbeInfo), "source %u", source_id);
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetSegmentData (uint32 file_id, uint32 entity_id, int32 index,
+                   double *timestamp, double *data, uint32 data_size,
+                   uint32 *sample_count, uint32 *unit_id)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          count, offset, sources, samples, spread, i, k;
+  double          rate;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  if (mock_entity (spec, entity_id, &count, &rate, &offset) != ns_ENTITY_SEGMENT)
+    return mock_fail (ns_BADENTITY, "Not a segment entity");
+
+  if (index < 0 || (uint32) index >= count)
+    return mock_fail (ns_BADINDEX, "Invalid index");
+
+  /* the sample count varies between the minimum and the maximum */
+  sources = (uint32) spec->segment_sources;
+  spread = (uint32) (spec->segment_max_samples - spec->segment_min_samples) + 1;
+  samples = (uint32) spec->segment_min_samples + (uint32) index % spread;
+
+  if (data == NULL || data_size < (uint64_t) sources * samples * sizeof (double))
+    return mock_fail (ns_LIBERROR, "Segment data buffer too small");
+
+  for (k = 0; k < sources; k++)
+    for (i = 0; i < samples; i++)
+      data[k * samples + i] = mock_value ((uint32) index * 64 + i, offset + k) * 1e-3;
+
+  *timestamp = mock_time (spec, ns_ENTITY_SEGMENT, (uint32) index, rate);
+  *sample_count = samples;
+  *unit_id = (uint32) index % (uint32) spec->segment_units;
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetNeuralInfo (uint32 file_id, uint32 entity_id,
+                  ns_NEURALINFO *info, uint32 info_size)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          count, offset;
+  double          rate;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  if (mock_entity (spec, entity_id, &count, &rate, &offset) != ns_ENTITY_NEURALEVENT)
+    return mock_fail (ns_BADENTITY, "Not a neural entity");
+
+  if (info == NULL || info_size < sizeof (ns_NEURALINFO))
+    return mock_fail (ns_LIBERROR, "Invalid neural info buffer");
+
+  memset (info, 0, sizeof (ns_NEURALINFO));
+  info->dwSourceEntityID = (uint32) (spec->event_entities + spec->analog_entities);
+  info->dwSourceUnitID = offset % (uint32) spec->segment_units;
+  snprintf (info->szProbeInfo, sizeof (info->szProbeInfo), "unit %u", offset);
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetNeuralData (uint32 file_id, uint32 entity_id, uint32 start_index,
+                  uint32 index_count, double *data)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          count, offset, i;
+  double          rate;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  if (mock_entity (spec, entity_id, &count, &rate, &offset) != ns_ENTITY_NEURALEVENT)
+    return mock_fail (ns_BADENTITY, "Not a neural entity");
+
+  if (start_index > count || index_count > count - start_index)
+    return mock_fail (ns_BADINDEX, "Invalid index range");
+
+  if (data == NULL)
+    return mock_fail (ns_LIBERROR, "Invalid data buffer");
+
+  for (i = 0; i < index_count; i++)
+    data[i] = mock_time (spec, ns_ENTITY_NEURALEVENT, start_index + i, rate);
+
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetIndexByTime (uint32 file_id, uint32 entity_id, double timepoint,
+                   int32 flag, uint32 *index)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          type, count, offset;
+  double          rate, before, after, x;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  type = mock_entity (spec, entity_id, &count, &rate, &offset);
+
+  if (type == ns_ENTITY_UNKNOWN)
+    return mock_fail (ns_BADENTITY, "Invalid entity");
+
+  if (count == 0)
+    return mock_fail (ns_BADINDEX, "Entity has no items");
+
+  if (spec->ignore_position)
+    flag = ns_CLOSEST;
+
+  mock_neighbours (spec, type, rate, timepoint, &before, &after);
+
+  if ((flag == ns_BEFORE && before < 0) ||
+      (flag == ns_AFTER && after > count - 1.0))
+    return mock_fail (ns_BADINDEX, "No item at the requested position");
+
+  if (before > count - 1.0)
+    before = count - 1.0;
+  if (after < 0)
+    after = 0;
+
+  if (flag == ns_BEFORE)
+    x = before;
+  else if (flag == ns_AFTER)
+    x = after;
+  else if (before < 0 || after > count - 1.0)
+    x = before < 0 ? after : before;
+  else
+    x = timepoint - mock_time (spec, type, (uint32) before, rate) <=
+        mock_time (spec, type, (uint32) after, rate) - timepoint ? before : after;
+
+  *index = (uint32) x;
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetTimeByIndex (uint32 file_id, uint32 entity_id, uint32 index,
+                   double *timepoint)
+{
+  const MockSpec *spec;
+  ns_RESULT       res;
+  uint32          type, count, offset;
+  double          rate;
+
+  if ((spec = mock_enter (file_id, &res)) == NULL)
+    return res;
+
+  type = mock_entity (spec, entity_id, &count, &rate, &offset);
+
+  if (type == ns_ENTITY_UNKNOWN)
+    return mock_fail (ns_BADENTITY, "Invalid entity");
+
+  if (index >= count)
+    return mock_fail (ns_BADINDEX, "Invalid index");
+
+  *timepoint = mock_time (spec, type, index, rate);
+  return ns_OK;
+}
+
+NS_EXPORT ns_RESULT
+ns_GetLastErrorMsg (char *buffer, uint32 buffer_size)
+{
+  if (buffer == NULL || buffer_size == 0)
+    return ns_LIBERROR;
+
+  snprintf (buffer, buffer_size, "%s", mock_error);
+  return ns_OK;
+}
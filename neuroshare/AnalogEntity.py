@@ -1,5 +1,9 @@
 
+import numpy as np
+
 from .Entity import Entity
+from .WorkerPool import WorkerPool
+from . import _capi
 
 
 class AnalogEntity(Entity):
@@ -91,7 +95,33 @@ class AnalogEntity(Entity):
         """Additional information"""
         return self._info['ProbeInfo']
 
-    def get_data(self, index=0, count=-1):
+    @property
+    def int16_scale(self):
+        """The ``(scale, offset)`` used to represent the data as int16
+        (``value = raw * scale + offset``), derived from the resolution
+        and the minimum value of the entity."""
+        scale = self.resolution
+        if not scale > 0:
+            scale = (self.max_value - self.min_value) / 65535.0 or 1.0
+        return scale, self.min_value + 32768 * scale
+
+    def _segments(self):
+        if not self.sample_rate > 0:
+            return None
+
+        segments = None
+        if self._file._index is not None:
+            segments = self._file._index.segments(self._id)
+
+        cache = self._file._entity_cache(self._id)
+        if segments is None:
+            segments = cache.get('segments')
+        if segments is None:
+            segments = self._file.library._get_analog_segments(self)
+            cache['segments'] = segments
+        return segments
+
+    def get_data(self, index=0, count=-1, times=True, out=None, dtype=None):
         """Retrieve raw data from file starting at ``index`` up to ``count`` elements.
         If no parameters are given retrieves all available data.
 
@@ -100,10 +130,150 @@ class AnalogEntity(Entity):
         Example use: ``data, times, count = analog1.get_data()``
 
         Raw data and timestamp data are return as :class:`numpy.ndarray`.
+        If ``times`` is ``False`` no timestamps are computed and ``None`` is
+        returned in their place; use :func:`get_time_by_index` and
+        :attr:`sample_rate` instead.
+
+        To avoid allocating new arrays on each call the data can be read
+        into an existing C-contiguous float64 array ``out`` with room for at
+        least ``count`` elements; ``out`` itself is returned (as the
+        first element). Likewise ``times`` may be such an array.
+
+        The data is returned as float64 unless ``dtype`` is ``'float32'``
+        or ``'int16'``. In the latter case the raw counts are returned and
+        the tuple has a fourth element with the ``(scale, offset)`` to
+        convert them (cf. :attr:`int16_scale`).
+        Example use: ``raw, times, count, (scale, offset) = analog1.get_data(dtype='int16')``
+
+        If the file has a :class:`Cache` attached (cf.
+        :func:`File.attach_cache`) the data is served from it, as a
+        read-only view into the cache if it stores the data as ``dtype``
+        and ``out`` is not given.
         """
         if count < 0:
             count = self.item_count
 
-        lib = self.file.library
-        data = lib._get_analog_data(self, index, count)
+        dtype = np.dtype(dtype if dtype is not None else np.float64)
+        if dtype not in (np.float64, np.float32, np.int16):
+            raise ValueError("dtype must be float64, float32 or int16")
+        encoding = self.int16_scale if dtype == np.int16 else (1.0, 0.0)
+
+        cache = self.file.cache
+        column = cache.column(self.id) if cache is not None else None
+        if column is not None and column.contains(index, count) and \
+           (column.sample_rate > 0 or times is False or times is None):
+            data = self._get_cached_data(column, index, count, times, out,
+                                         dtype, encoding)
+        else:
+            lib = self.file.library
+            data = lib._get_analog_data(self, index, count, times, out,
+                                        dtype, encoding)
+
+        if dtype == np.int16:
+            data = data + (encoding,)
         return data
+
+    def get_envelope(self, index, count, bins):
+        """Minimum, maximum and mean of the data in each of ``bins`` equal
+        parts of the ``count`` (all remaining if negative) samples
+        starting at ``index``, e.g. to draw an overview of a long
+        recording. The data is reduced block by block as it is read, i.e.
+        it is never held in memory as a whole; gaps in the recording are
+        ignored, i.e. the samples the library returns for them are part
+        of the bins.
+
+        Returns a tuple of three float64 arrays of ``bins`` elements; bins
+        without samples (if ``bins > count``) are NaN.
+        Example use: ``low, high, mean = analog1.get_envelope(0, -1, 2000)``
+        """
+        if count < 0:
+            count = self.item_count - index
+        lib = self.file.library
+        return lib._get_analog_envelope(self, index, count, bins)
+
+    def get_decimated(self, factor, index=0, count=-1):
+        """The data, low-pass filtered (with a linear phase FIR filter at
+        the new Nyquist frequency) and decimated by ``factor``, i.e. at a
+        sample rate of :attr:`sample_rate` / ``factor``. Element ``j`` of
+        the result corresponds to the sample ``index + j * factor``. As
+        with :func:`get_envelope` the full rate data is only read in
+        blocks; gaps in the recording are ignored.
+
+        Returns a float64 array of ``ceil(count / factor)`` elements.
+        """
+        if count < 0:
+            count = self.item_count - index
+        lib = self.file.library
+        return lib._get_analog_decimated(self, index, count, factor)
+
+    def get_data_async(self, index=0, count=-1, times=True, out=None, dtype=None):
+        """Awaitable variant of :func:`get_data` (same arguments and
+        result): the data is read on the native worker pool (cf.
+        :class:`WorkerPool`) while the event loop keeps running.
+        Example use: ``data, times, count = await analog1.get_data_async()``
+
+        ``out`` (and ``times``, if it is an array) must not be used until
+        the read has completed."""
+        if count < 0:
+            count = self.item_count
+
+        dtype = np.dtype(dtype if dtype is not None else np.float64)
+        if dtype not in (np.float64, np.float32, np.int16):
+            raise ValueError("dtype must be float64, float32 or int16")
+        encoding = self.int16_scale if dtype == np.int16 else (1.0, 0.0)
+
+        pool = WorkerPool.get()
+        cache = self.file.cache
+        column = cache.column(self.id) if cache is not None else None
+        if column is not None and column.contains(index, count) and \
+           (column.sample_rate > 0 or times is False or times is None):
+            data = self._get_cached_data(column, index, count, times, out,
+                                         dtype, encoding)
+            return pool.completed(data + (encoding,) if dtype == np.int16 else data)
+
+        lib = self.file.library
+        token = lib._submit_analog_data(self, index, count, times, out, dtype, encoding)
+        if dtype == np.int16:
+            return pool.future(token, lambda data: data + (encoding,), owner=self)
+        return pool.future(token, owner=self)
+
+    @classmethod
+    def _get_cached_data(cls, column, index, count, times, out, dtype, encoding):
+        data = column.get_values(index, count, out, dtype, encoding)
+        if isinstance(times, np.ndarray):
+            times = column.get_times(index, count, times)
+        elif times:
+            times = column.get_times(index, count)
+        else:
+            times = None
+        return data, times, column.cont_count(index, count)
+
+    def iter_chunks(self, chunk_samples, overlap=0, prefetch=2, index=0, count=-1):
+        """Iterate over the data in chunks of ``chunk_samples`` samples
+        (the last one may be shorter), starting at ``index``, with
+        consecutive chunks overlapping by ``overlap`` samples. Up to
+        ``prefetch`` chunks are read ahead by a background thread while
+        the current one is processed, so memory use is bounded by
+        ``(prefetch + 1) * chunk_samples`` samples regardless of the
+        length of the recording.
+
+        Yields tuples with the index of the first sample of the chunk,
+        the raw data and how many of the data values are continuous.
+        Example use: ``for index, data, cont_count in analog1.iter_chunks(30000):``
+
+        .. note:: the data arrays are views into reused buffers and are only
+                  valid until the next chunk is requested; copy them to keep them.
+        """
+        if count < 0:
+            count = self.item_count - index
+
+        lib = self.file.library
+        stream = lib._open_analog_stream(self, index, count, chunk_samples, overlap, prefetch)
+        try:
+            while True:
+                chunk = _capi.analog_stream_next(stream)
+                if chunk is None:
+                    break
+                yield chunk
+        finally:
+            _capi.analog_stream_close(stream)
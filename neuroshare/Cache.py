@@ -0,0 +1,288 @@
+import os
+import json
+import numpy as np
+
+from .Entity import EntityType
+
+
+def _replace(src, dst):
+    if hasattr(os, 'replace'):
+        os.replace(src, dst)
+    else:
+        if os.path.exists(dst):
+            os.remove(dst)
+        os.rename(src, dst)
+
+
+def quantize(values, encoding, out):
+    """Encode ``values`` as int16 ``(values - offset) / scale`` (rounded,
+    saturated) into ``out``, like the native layer does"""
+    (scale, offset) = encoding
+    q = (values - offset) / scale
+    np.clip(q, -32768, 32767, out=q)
+    q += np.copysign(0.5, q)
+    out[:] = np.trunc(q)
+    return out
+
+
+class CachedColumn(object):
+    """Data of one analog or neural entity in a :class:`Cache`. Analog
+    data is stored as float64, float32 or int16 (scaled to the range of
+    the entity), neural timestamps always as float64. The gap table
+    holds the first index and timestamp of every continuous segment."""
+
+    def __init__(self, cache, entity_id, meta):
+        self._cache = cache
+        self._entity_id = entity_id
+        self._meta = meta
+        self._data = None
+        self.dtype = np.dtype(meta['DType'])
+        self.count = meta['Count']
+        self.scale = meta['Scale']
+        self.zero = meta['Zero']
+        self.sample_rate = meta['SampleRate']
+        self.gap_index = np.array(meta['GapIndex'], dtype=np.int64)
+        self.gap_time = np.array(meta['GapTime'], dtype=np.float64)
+
+    @property
+    def data(self):
+        """The raw column as (read-only) :class:`numpy.memmap`"""
+        if self._data is None and not self.count:
+            self._data = np.empty(0, dtype=self.dtype)
+        elif self._data is None:
+            self._data = np.memmap(self._cache.data_path, dtype=self.dtype,
+                                   mode='r', offset=self._meta['Offset'],
+                                   shape=(self.count,))
+        return self._data
+
+    def contains(self, index, count):
+        return 0 <= index and count >= 0 and index + count <= self.count
+
+    def get_values(self, index, count, out=None, dtype=np.float64, encoding=None):
+        """Values ``[index, index + count)`` as ``dtype`` (int16 values
+        are encoded with ``encoding``, i.e. ``(scale, offset)``). A view
+        into the cache is returned if it already holds the data in that
+        form, unless ``out`` is given."""
+        dtype = np.dtype(dtype)
+        raw = self.data[index:index + count]
+        if dtype == self.dtype and (dtype != np.int16 or
+                                    tuple(encoding) == (self.scale, self.zero)):
+            if out is None:
+                return raw
+            out[:count] = raw
+            return out
+
+        if self.dtype == np.int16:
+            values = raw * self.scale
+            values += self.zero
+        else:
+            values = raw
+
+        if out is None:
+            out = np.empty(count, dtype=dtype)
+        if dtype == np.int16:
+            quantize(values, encoding, out[:count])
+        else:
+            out[:count] = values
+        return out
+
+    def get_times(self, index, count, out=None):
+        if out is None:
+            out = np.empty(count)
+        idx = np.arange(index, index + count)
+        seg = np.searchsorted(self.gap_index, idx, side='right') - 1
+        np.subtract(idx, self.gap_index[seg], out=out[:count])
+        out[:count] /= self.sample_rate
+        out[:count] += self.gap_time[seg]
+        return out
+
+    def cont_count(self, index, count):
+        nxt = np.searchsorted(self.gap_index, index, side='right')
+        if nxt >= len(self.gap_index):
+            return count
+        return int(min(count, self.gap_index[nxt] - index))
+
+
+class Cache(object):
+    """Cache of the analog and neural data of a neuroshare file in a flat
+    binary file (``<file>.nscache/data.bin``) with one contiguous, page
+    aligned column per entity, described by ``<file>.nscache/meta.json``.
+    Columns are accessed via :class:`numpy.memmap`, i.e. reads are served
+    from the page cache, shared between processes, and no vendor library
+    is involved. The cache is only valid as long as size and modification
+    time of the file match."""
+
+    version = 1
+    alignment = 4096
+    chunk_size = 1 << 20
+
+    def __init__(self, path, meta):
+        self._path = path
+        self._meta = meta
+        self._columns = {}
+
+    @classmethod
+    def path_for(cls, filename):
+        return filename + '.nscache'
+
+    @classmethod
+    def _key(cls, filename):
+        st = os.stat(filename)
+        return st.st_size, st.st_mtime
+
+    @property
+    def data_path(self):
+        return os.path.join(self._path, 'data.bin')
+
+    @classmethod
+    def load(cls, filename):
+        """Load the cache of ``filename``. Returns ``None`` if there is no
+        cache or if it is out of date."""
+        path = cls.path_for(filename)
+        try:
+            (size, mtime) = cls._key(filename)
+            with open(os.path.join(path, 'meta.json')) as fd:
+                meta = json.load(fd)
+        except (IOError, OSError, ValueError):
+            return None
+
+        if meta.get('Version') != cls.version or \
+           meta.get('Size') != size or meta.get('MTime') != mtime:
+            return None
+
+        return Cache(path, meta)
+
+    @classmethod
+    def build(cls, nsfile, entity_ids=None, dtype='float64'):
+        """Materialize the analog (as ``dtype``, one of ``float64``,
+        ``float32`` or ``int16``) and neural entities ``entity_ids``
+        (default: all of them) of ``nsfile``."""
+        dtype = np.dtype(dtype)
+        if dtype not in (np.float64, np.float32, np.int16):
+            raise ValueError("Unsupported cache dtype %s" % dtype)
+
+        if entity_ids is None:
+            entity_ids = range(nsfile.entity_count)
+
+        entities = [nsfile.get_entity(eid) for eid in entity_ids]
+        entities = [e for e in entities if e.entity_type in
+                    (EntityType.Analog, EntityType.Neural)]
+
+        columns = {}
+        offset = 0
+        for entity in entities:
+            col_type = dtype if entity.entity_type == EntityType.Analog \
+                else np.dtype(np.float64)
+            (scale, zero) = cls._encoding(entity, col_type)
+            columns[str(entity.id)] = {'Type': entity.entity_type,
+                                       'DType': col_type.str,
+                                       'Offset': offset,
+                                       'Count': entity.item_count,
+                                       'Scale': scale,
+                                       'Zero': zero,
+                                       'SampleRate': 0.0,
+                                       'GapIndex': [],
+                                       'GapTime': []}
+            size = entity.item_count * col_type.itemsize
+            offset += -(-size // cls.alignment) * cls.alignment
+
+        path = cls.path_for(nsfile._filename)
+        if not os.path.isdir(path):
+            os.makedirs(path)
+
+        meta_path = os.path.join(path, 'meta.json')
+        if os.path.exists(meta_path):
+            os.remove(meta_path)
+
+        # filled aside and moved into place, so the maps of a live Cache of
+        # the old file keep their data
+        data_path = os.path.join(path, 'data.bin')
+        data_tmp = data_path + '.tmp'
+        with open(data_tmp, 'wb') as fd:
+            fd.truncate(offset)
+
+        for entity in entities:
+            column = columns[str(entity.id)]
+            if not column['Count']:
+                continue
+            mm = np.memmap(data_tmp, dtype=column['DType'], mode='r+',
+                           offset=column['Offset'], shape=(column['Count'],))
+            if entity.entity_type == EntityType.Analog:
+                cls._fill_analog(entity, mm, column)
+            else:
+                cls._fill_neural(entity, mm)
+            mm.flush()
+            del mm
+        _replace(data_tmp, data_path)
+
+        (size, mtime) = cls._key(nsfile._filename)
+        meta = {'Version': cls.version, 'Size': size, 'MTime': mtime,
+                'Entities': columns}
+
+        tmp = meta_path + '.tmp'
+        with open(tmp, 'w') as fd:
+            json.dump(meta, fd)
+        _replace(tmp, meta_path)
+
+        return Cache(path, meta)
+
+    @classmethod
+    def _encoding(cls, entity, dtype):
+        if dtype != np.int16:
+            return 1.0, 0.0
+        return entity.int16_scale
+
+    @classmethod
+    def _fill_analog(cls, analog, mm, column):
+        n = column['Count']
+        step = cls.chunk_size
+
+        column['SampleRate'] = analog.sample_rate
+        column['GapIndex'].append(0)
+        column['GapTime'].append(analog.get_time_by_index(0))
+
+        rate = analog.sample_rate
+        index = 0
+        while index < n:
+            count = min(step, n - index)
+            if index and index != column['GapIndex'][-1] and rate > 0:
+                # a gap right at the chunk boundary is not reported either
+                t = analog.get_time_by_index(index)
+                expected = column['GapTime'][-1] + \
+                    (index - column['GapIndex'][-1]) / rate
+                if abs(t - expected) > 0.5 / rate:
+                    column['GapIndex'].append(index)
+                    column['GapTime'].append(t)
+
+            # the native layer converts into the cache's dtype directly
+            res = analog.get_data(index, count, times=False,
+                                  out=mm[index:index + count], dtype=mm.dtype)
+            cont_count = res[2]
+
+            if 0 < cont_count < count:
+                # only the first discontinuity is reported, re-read the rest
+                index += cont_count
+                column['GapIndex'].append(index)
+                column['GapTime'].append(analog.get_time_by_index(index))
+            else:
+                index += count
+
+    @classmethod
+    def _fill_neural(cls, neural, mm):
+        n = len(mm)
+        step = cls.chunk_size
+        for index in range(0, n, step):
+            count = min(step, n - index)
+            neural.get_data(index, count, out=mm[index:index + count])
+
+    def column(self, entity_id):
+        """The :class:`CachedColumn` of an entity or ``None`` if the
+        entity is not cached"""
+        column = self._columns.get(entity_id)
+        if column is None:
+            meta = self._meta['Entities'].get(str(entity_id))
+            if meta is None:
+                return None
+            column = CachedColumn(self, entity_id, meta)
+            self._columns[entity_id] = column
+        return column
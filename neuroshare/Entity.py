@@ -1,3 +1,7 @@
+import weakref
+import numpy as np
+
+
 
 class EntityTime(object):
     Closest = 0
@@ -5,6 +9,42 @@ class EntityTime(object):
     After = 1
 
 
+class EntityInfo(dict):
+    """Metadata of an entity that starts out with the basic information
+    from :func:`File.scan` and fetches the complete information from
+    the library the first time a missing key is accessed. The complete
+    information is a (lazily decoded) :class:`_capi.Metadata` mapping,
+    a value is only converted (and then kept here) when it is used."""
+    def __init__(self, nsfile, entity_id, basic):
+        super(EntityInfo, self).__init__(basic)
+        # the file caches its entity infos, don't keep it alive
+        self._file = weakref.proxy(nsfile)
+        self._entity_id = entity_id
+        self._metadata = None
+
+    def load(self):
+        """The complete information of the entity"""
+        if self._metadata is None:
+            self._metadata = self._file.library._get_entity_info(self._file,
+                                                                 self._entity_id)
+        return self._metadata
+
+    def __missing__(self, key):
+        value = self.load()[key]
+        self[key] = value
+        return value
+
+    def _set_item_count(self, item_count):
+        # the entity grew: keep the basic information but fetch everything
+        # else (which may depend on the item count) from the library anew
+        basic = dict((k, self[k]) for k in ('EntityLabel', 'EntityType', 'SampleRate')
+                     if dict.__contains__(self, k))
+        self.clear()
+        self.update(basic)
+        self['ItemCount'] = item_count
+        self._metadata = None
+
+
 class Entity(object):
     """Base class of all entities that are contained in a neuroshare file
     """
@@ -25,6 +65,8 @@ class Entity(object):
 
     @property
     def metadata_raw(self):
+        if isinstance(self._info, EntityInfo):
+            return self._info.load()
         return self._info
 
     @property
@@ -43,7 +85,23 @@ class Entity(object):
         return self._info['ItemCount']
 
     def get_time_by_index(self, index):
-        """Convert from a given index to the corresponding timestamp"""
+        """Convert from a given index to the corresponding timestamp.
+        If ``index`` is an array (or sequence) of indices, an array of
+        timestamps of the same shape is returned; negative indices count
+        from the end, as in NumPy."""
+        if np.ndim(index) > 0:
+            index = np.asarray(index)
+            if index.size and index.min() < 0:
+                index = np.where(index < 0, index + self.item_count, index)
+                if index.min() < 0:
+                    raise IndexError("index out of range for %d items" % self.item_count)
+            return self._file.library._get_times_by_index(self, index,
+                                                          self._segments())
+
+        if self._file._index is not None:
+            timepoint = self._file._index.time_by_index(self._id, index)
+            if timepoint is not None:
+                return timepoint
         return self._file.library._get_time_by_index(self, index)
 
     def get_index_by_time(self, timepoint, position=EntityTime.Closest):
@@ -54,9 +112,44 @@ class Entity(object):
         * before and inclusive of the timepoint (``EntityTime.Before``)
         * after and inclusive of the timepoint (``EntityTime.After``)
         * closest to timepoint (``EntityTime.Closest``) [default]
+
+        If ``timepoint`` is an array (or sequence) of timestamps, an array
+        of (uint32) indices of the same shape is returned.
         """
+        if np.ndim(timepoint) > 0:
+            return self._file.library._get_indices_by_time(self, timepoint,
+                                                           position,
+                                                           self._segments())
+
+        if self._file._index is not None:
+            index = self._file._index.index_by_time(self._id, timepoint, position)
+            if index is not None:
+                return index
         return self._file.library._get_index_by_time(self, timepoint, position)
 
+    def read_new(self, max_count=-1):
+        """Read the data that was appended to the entity since the last
+        call (the first call reads everything), with the item counts of
+        the last :func:`File.refresh`; at most ``max_count`` items if it
+        is not negative. The data is as for :func:`File.slice`, i.e. the
+        data and the timestamps for analog entities.
+        Example use: ``datafile.refresh(); data, times = analog1.read_new()``
+        """
+        cache = self._file._entity_cache(self._id)
+        position = cache.get('read_position', 0)
+        count = max(0, self.item_count - position)
+        if max_count >= 0:
+            count = min(count, max_count)
+
+        data = self._file._read_range(self, position, count)
+        cache['read_position'] = position + count
+        return data
+
+    def _segments(self):
+        """Start indices and times of the continuous segments, for the
+        closed form lookups, or ``None`` if the entity has none"""
+        return None
+
     def __len__(self):
         return self.item_count
 
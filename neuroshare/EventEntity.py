@@ -1,5 +1,8 @@
 
+import numpy as np
+
 from .Entity import Entity
+from .WorkerPool import WorkerPool
 
 
 class EventEntity(Entity):
@@ -31,6 +34,20 @@ class EventEntity(Entity):
         """Description of the csv fields"""
         return self._info['CSVDesc']
 
+    @property
+    def csv_columns(self):
+        """The names of the csv fields (from :attr:`csv_desc`); unnamed
+        fields are called ``f0``, ``f1``, ..."""
+        names = [name.strip() for name in self.csv_desc.split(',')]
+        seen = set()
+        columns = []
+        for (i, name) in enumerate(names):
+            if not name or name in seen or name == 'timestamp':
+                name = 'f%d' % i
+            seen.add(name)
+            columns.append(name)
+        return columns
+
     @property
     def max_data_length(self):
         """Maximum length of the data for the event [in bytes]"""
@@ -45,7 +62,65 @@ class EventEntity(Entity):
         """Retrieve the data at ``index``. Returns a 2-tuple with the
         timestamp of the data at the first position (``[0]``) and the
         actual data a the second position (``[1]``)).
-        Example use: ``timestamp, data = event.get_data(0)``"""
+        Example use: ``timestamp, data = event.get_data(0)``
+
+        If ``index`` is a :class:`slice` all events in that range are
+        retrieved at once and returned as structured :class:`numpy.ndarray`
+        with the fields ``timestamp`` and ``value``.
+        Example use: ``data = event.get_data(slice(0, 100))``"""
         lib = self.file.library
+        if isinstance(index, slice):
+            indices = range(*index.indices(self.item_count))
+            if not indices:
+                return lib._get_event_data_range(self, 0, 0)
+            first = min(indices[0], indices[-1])
+            count = abs(indices[-1] - indices[0]) + 1
+            data = lib._get_event_data_range(self, first, count)
+            step = indices[1] - indices[0] if len(indices) > 1 else 1
+            return data if step == 1 else data[indices[0] - first::step]
+
         data = lib._get_event_data(self, index)
         return data
+
+    def get_csv_data(self, index=slice(None)):
+        """Retrieve the csv events in the range ``index`` (a :class:`slice`,
+        default: all) split into their fields, natively and in one go.
+        Returns a structured :class:`numpy.ndarray` with the field
+        ``timestamp`` and one (byte string) field per column of
+        :attr:`csv_columns`; missing values are empty, surplus ones stay
+        in the last field.
+        Example use: ``data = event.get_csv_data(); data['index'].astype(int)``"""
+        events = self.get_data(index)
+        columns = self.csv_columns
+        values = self.file.library._split_csv(
+            np.ascontiguousarray(events['value']), len(columns))
+
+        dtype = [('timestamp', 'f8')] + [(name, values.dtype) for name in columns]
+        data = np.empty(len(events), dtype=dtype)
+        data['timestamp'] = events['timestamp']
+        for (i, name) in enumerate(columns):
+            data[name] = values[:, i]
+        return data
+
+    def get_data_async(self, index):
+        """Awaitable variant of :func:`get_data` (for a single ``index``
+        or a :class:`slice`), the events are read on the native worker
+        pool (cf. :class:`WorkerPool`).
+        Example use: ``data = await event.get_data_async(slice(0, 100))``"""
+        lib = self.file.library
+        pool = WorkerPool.get()
+        if not isinstance(index, slice):
+            return pool.future(lib._submit_event_data_range(self, index, 1, single=True),
+                               owner=self)
+
+        indices = range(*index.indices(self.item_count))
+        if not indices:
+            return pool.future(lib._submit_event_data_range(self, 0, 0), owner=self)
+        first = min(indices[0], indices[-1])
+        count = abs(indices[-1] - indices[0]) + 1
+        token = lib._submit_event_data_range(self, first, count)
+        step = indices[1] - indices[0] if len(indices) > 1 else 1
+        if step == 1:
+            return pool.future(token, owner=self)
+        return pool.future(token, lambda data: data[indices[0] - first::step],
+                           owner=self)
@@ -1,6 +1,12 @@
 
+import weakref
+import numpy as np
+
 from .Library import Library
-from .Entity import EntityType
+from .Index import Index
+from .Cache import Cache
+from .WorkerPool import WorkerPool
+from .Entity import EntityType, EntityInfo
 from .EventEntity import EventEntity
 from .AnalogEntity import AnalogEntity
 from .SegmentEntity import SegmentEntity
@@ -27,35 +33,75 @@ class File(object):
     the location given by ``filename``. The file will be opened upon object
     construction.
 
+    If ``use_index`` is ``True`` the metadata of the file is kept in an
+    index file next to it (cf. :class:`Index`), which is created if it
+    does not exist or is out of date. With a valid index the vendor
+    library is only loaded and the file only opened once data is read;
+    metadata as well as :func:`Entity.get_index_by_time` and
+    :func:`Entity.get_time_by_index` queries are served from the index.
+
     Individual entities can be opened via the :func:`get_entity` function or
     the :func:`entities` property. NB: The first entity index is **0**
     """
 
-    def __init__(self, filename, library=None):
+    def __init__(self, filename, library=None, use_index=False):
         self._handle = None
+        self._closed = False
         self._filename = filename
-        if not library:
-            library = Library.for_file(filename)
-
         self._lib = library
-        (handle, info) = self._lib._open_file(filename)
+        self._index = Index.load(filename) if use_index else None
+        self._eproxy = EntityProxy(self)
+        self._scan = None
+        self._entity_infos = {}
+        self._entities = weakref.WeakValueDictionary()
+        self._cache = None
+        self._entity_caches = {}
+
+        if self._index is not None:
+            self._info = self._index.file_info
+            return
+
+        self._open()
+        if use_index:
+            index = Index.build(self)
+            try:
+                index.save(filename)
+            except (IOError, OSError):
+                pass
+            self._index = index
+
+    def _open(self):
+        if self._lib is None:
+            self._lib = Library.for_file(self._filename)
+
+        (handle, info) = self._lib._open_file(self._filename)
         self._handle = handle
         self._info = info
-        self._eproxy = EntityProxy(self)
 
     def __del__(self):
         self.close()
 
     def close(self):
         """Close the file."""
+        self._closed = True
         if self._handle:
             self._lib._close_file(self)
             self._handle = None
 
     @property
     def library(self):
+        if self._handle is None and not self._closed:
+            self._open()
         return self._lib
 
+    @property
+    def stats(self):
+        """Statistics of the calls into the library concerning this file,
+        cf. :attr:`Library.stats`"""
+        if self._handle is None:
+            return {}
+        return self._lib.stats['files'].get(self._handle, {})
+
     @property
     def file_type(self):
         """Text description of the file type"""
@@ -109,9 +155,129 @@ class File(object):
         ct = datetime(year, month, day, hour, minute, sec, msec)
         return ct
 
+    def scan(self):
+        """Retrieve the basic information of all entities with a single
+        call into the library. Returns a dictionary with the keys
+        ``EntityLabel`` (a list), ``EntityType``, ``ItemCount`` and
+        ``SampleRate`` (arrays, the latter is ``NaN`` for non-analog
+        entities), each indexed by the entity id. The result is cached.
+        Example use: ``labels = datafile.scan()['EntityLabel']``
+        """
+        if self._scan is None and self._index is not None:
+            self._scan = self._index.scan()
+        elif self._scan is None:
+            self._scan = self.library._scan_entities(self, self.entity_count)
+        return self._scan
+
+    def refresh(self, reopen=False):
+        """Pick up data that was appended to the file since it was opened
+        (or last refreshed), e.g. while it is still being recorded. The
+        file info and the item counts of all entities are queried again on
+        the open handle, without rebuilding any entity; libraries that only
+        read the header of a file when it is opened need ``reopen=True``,
+        which reopens the file first. Cached information derived from the
+        data of entities that grew is dropped, and the index of the file
+        (cf. ``use_index``) leaves their time queries to the library; it
+        keeps serving the other entities. An attached :class:`Cache` keeps
+        serving the data it holds, i.e. what there was before; call
+        :func:`attach_cache` again to materialize the new data (the cache
+        is out of date then and built anew).
+
+        Returns a dictionary that maps the id of every entity that grew
+        (or is new) to a tuple of its old and its new item count.
+        Example use: ``grown = datafile.refresh()``, cf. :func:`Entity.read_new`
+        """
+        old_count = self.entity_count
+        before = np.array(self.scan()['ItemCount'], dtype=np.uint32)
+
+        if reopen and self._handle is not None:
+            self._lib._close_file(self)
+            self._handle = None
+        if self._handle is None:
+            self._open()
+        else:
+            self._info = self._lib._get_file_info(self)
+
+        count = self.entity_count
+        known = min(old_count, count)
+        counts = np.asarray(self._lib._get_item_counts(self, known), dtype=np.uint32)
+        before = before[:known]
+
+        grown = {}
+        for eid in np.flatnonzero(counts != before):
+            eid = int(eid)
+            grown[eid] = (int(before[eid]), int(counts[eid]))
+            if self._index is not None:
+                self._index.grown(eid, int(counts[eid]))
+            info = self._entity_infos.get(eid)
+            if isinstance(info, EntityInfo):
+                info._set_item_count(int(counts[eid]))
+            elif info is not None:
+                info['ItemCount'] = int(counts[eid])
+            cache = self._entity_caches.get(eid, {})
+            cache.pop('segments', None)
+            cache.pop('units', None)
+
+        if count > known:
+            added = self._lib._scan_entities(self, count - known, known)
+            for (i, n) in enumerate(added['ItemCount']):
+                grown[known + i] = (0, int(n))
+        else:
+            added = None
+
+        self._scan = self._merge_scan(self._scan, known, counts, added)
+        return grown
+
+    @classmethod
+    def _merge_scan(cls, scan, known, counts, added):
+        merged = {'EntityLabel': list(scan['EntityLabel'][:known]),
+                  'EntityType': np.asarray(scan['EntityType'][:known], dtype=np.uint32),
+                  'ItemCount': counts,
+                  'SampleRate': np.asarray(scan['SampleRate'][:known], dtype=np.float64)}
+        if added is None:
+            return merged
+        merged['EntityLabel'].extend(added['EntityLabel'])
+        for key in ('EntityType', 'ItemCount', 'SampleRate'):
+            merged[key] = np.concatenate((merged[key], added[key]))
+        return merged
+
+    def _get_entity_info(self, entity_id):
+        info = self._entity_infos.get(entity_id)
+        if info is not None:
+            return info
+
+        scan = self.scan()
+        if not 0 <= entity_id < len(scan['EntityLabel']):
+            return self.library._get_entity_info(self, entity_id)
+
+        info = self._index.entity_info(entity_id) if self._index is not None else None
+        if info is not None:
+            self._entity_infos[entity_id] = info
+            return info
+
+        entity_type = int(scan['EntityType'][entity_id])
+        basic = {'EntityLabel': scan['EntityLabel'][entity_id],
+                 'EntityType': entity_type,
+                 'ItemCount': int(scan['ItemCount'][entity_id])}
+        if entity_type == EntityType.Analog:
+            basic['SampleRate'] = float(scan['SampleRate'][entity_id])
+
+        info = EntityInfo(self, entity_id, basic)
+        self._entity_infos[entity_id] = info
+        return info
+
+    def _entity_cache(self, entity_id):
+        # derived per-entity data that should outlive the entity objects
+        return self._entity_caches.setdefault(entity_id, {})
+
     def get_entity(self, entity_id):
-        """Open the entity at the given index."""
-        info = self._lib._get_entity_info(self, entity_id)
+        """Open the entity at the given index. Entities are cached, i.e.
+        repeated calls do not query the library again."""
+        entity = self._entities.get(entity_id)
+        if entity is not None:
+            return entity
+
+        info = self._get_entity_info(entity_id)
         entity_type = info['EntityType']
 
         if entity_type == EntityType.Event:
@@ -125,8 +291,238 @@ class File(object):
         else:
             return None  # should not happen, throw exception?
 
+        self._entities[entity_id] = entity
         return entity
 
+    def read_analog_block(self, entity_ids, start=0, count=-1, order='C', parallel=False):
+        """Read the analog data of the entities with the ids ``entity_ids``
+        starting at index ``start`` into a single 2-D array of shape
+        ``(len(entity_ids), count)``. If ``count`` is negative all data up to
+        the end of the shortest entity is read.
+
+        The array is C-contiguous unless ``order`` is ``'F'``. If
+        ``parallel`` is ``True`` (or the number of threads to use) and the
+        library is thread-safe (cf. :attr:`Library.lock_policy`) the entities
+        are read concurrently.
+
+        Returns a tuple of the data and an array with the number of
+        continuous samples of each row.
+        Example use: ``data, cont_counts = datafile.read_analog_block([1, 2, 3])``
+        """
+        entity_ids = list(entity_ids)
+        if count < 0:
+            counts = [self.get_entity(eid).item_count for eid in entity_ids]
+            count = max(0, min(counts) - start) if counts else 0
+
+        if parallel is True:
+            import multiprocessing
+            threads = multiprocessing.cpu_count()
+        else:
+            threads = int(parallel) or 1
+
+        fortran = order.upper() == 'F'
+        return self.library._get_analog_block(self, entity_ids, start, count, fortran, threads)
+
+    def bin_neural(self, entity_ids, t_start, t_stop, bin_width, sparse=False,
+                   parallel=False):
+        """Count the spikes of the neural entities ``entity_ids`` in bins
+        of ``bin_width`` seconds, i.e. bin ``k`` is ``[t_start + k *
+        bin_width, t_start + (k + 1) * bin_width)``, up to ``t_stop`` (the
+        last bin may be shorter). The timestamps are read and binned
+        natively, without an array per entity.
+
+        Returns a uint32 matrix of shape ``(len(entity_ids), bins)``, or
+        if ``sparse`` is ``True`` a :class:`scipy.sparse.csr_matrix` of
+        the same shape. ``parallel`` is as for :func:`read_analog_block`.
+        Example use: ``counts = datafile.bin_neural(units, 0.0, 60.0, 0.01)``
+        """
+        entity_ids = np.asarray(entity_ids, dtype=np.uint32).ravel()
+        item_counts = np.array([self.get_entity(int(eid)).item_count
+                                for eid in entity_ids], dtype=np.uint32)
+
+        if parallel is True:
+            import multiprocessing
+            threads = multiprocessing.cpu_count()
+        else:
+            threads = int(parallel) or 1
+
+        counts = self.library._bin_neural(self, entity_ids, item_counts, t_start,
+                                          t_stop, bin_width, sparse, threads)
+        if not sparse:
+            return counts
+
+        from scipy.sparse import csr_matrix
+        (data, indices, indptr, bins) = counts
+        return csr_matrix((data, indices, indptr), shape=(len(entity_ids), bins))
+
+    def slice(self, t_start, t_stop, entity_ids=None):
+        """Read all data of the entities ``entity_ids`` (default: all)
+        within the time window ``[t_start, t_stop)``. The index ranges of
+        all entities are resolved with a single call into the native
+        layer, the data of each entity is then read in bulk.
+
+        Returns a dictionary that maps each entity id to its data:
+
+        * analog: tuple of the data and the timestamps
+        * neural: the spike times
+        * event: structured array (cf. :func:`EventEntity.get_data`)
+        * segment: tuple of waveforms, timestamps, sample counts and
+          unit ids (cf. :func:`SegmentEntity.get_data`)
+
+        Example use: ``data = datafile.slice(1.5, 2.0, [0, 1, 2])``
+        """
+        return self.slice_many([(t_start, t_stop)], entity_ids)[0]
+
+    def slice_many(self, windows, entity_ids=None):
+        """Like :func:`slice` but for a sequence of ``(t_start, t_stop)``
+        windows, e.g. peri-stimulus windows. Overlapping (or adjacent)
+        windows are read only once per entity; the results of those
+        windows are views into the same data. Returns a list with one
+        dictionary per window."""
+        if entity_ids is None:
+            entity_ids = range(self.entity_count)
+
+        entities = [self.get_entity(eid) for eid in entity_ids]
+        windows = np.asarray(windows, dtype=np.float64).reshape(-1, 2)
+        results = [{} for _ in range(len(windows))]
+        if not entities or not len(windows):
+            return results
+
+        (first, count) = self.library._get_index_ranges(
+            self, [e.id for e in entities], [e.item_count for e in entities],
+            windows[:, 0], windows[:, 1])
+
+        for (i, entity) in enumerate(entities):
+            for (w, data) in self._read_ranges(entity, first[i], count[i]):
+                results[w][entity.id] = data
+
+        return results
+
+    def slice_async(self, t_start, t_stop, entity_ids=None):
+        """Awaitable variant of :func:`slice`: resolving the index ranges
+        and reading the data run on the native worker pool (cf.
+        :class:`WorkerPool`), the reads of the entities concurrently.
+        Example use: ``data = await datafile.slice_async(1.5, 2.0)``"""
+        pool = WorkerPool.get()
+        return pool.then(self.slice_many_async([(t_start, t_stop)], entity_ids),
+                         lambda results: results[0])
+
+    def slice_many_async(self, windows, entity_ids=None):
+        """Awaitable variant of :func:`slice_many`, cf. :func:`slice_async`"""
+        if entity_ids is None:
+            entity_ids = range(self.entity_count)
+
+        pool = WorkerPool.get()
+        entities = [self.get_entity(eid) for eid in entity_ids]
+        windows = np.asarray(windows, dtype=np.float64).reshape(-1, 2)
+        results = [{} for _ in range(len(windows))]
+        if not entities or not len(windows):
+            return pool.completed(results)
+
+        token = self.library._submit_index_ranges(
+            self, [e.id for e in entities], [e.item_count for e in entities],
+            windows[:, 0], windows[:, 1])
+
+        def read(ranges):
+            (first, count) = ranges
+            groups = []
+            reads = []
+            for (i, entity) in enumerate(entities):
+                for (start, stop, group) in self._range_groups(first[i], count[i]):
+                    groups.append((entity, start, group, first[i], count[i]))
+                    reads.append(self._read_range_async(entity, start, stop - start))
+            return pool.then(pool.gather(reads), lambda data: assemble(groups, data))
+
+        def assemble(groups, data):
+            for ((entity, start, group, first, count), part) in zip(groups, data):
+                for (w, x) in self._split_range(part, start, group, first, count):
+                    results[w][entity.id] = x
+            return results
+
+        return pool.then(pool.future(token, owner=self), read)
+
+    @classmethod
+    def _range_groups(cls, first, count):
+        """Merge the overlapping (or adjacent) index ranges ``[first[w],
+        first[w] + count[w])`` of the windows ``w``; returns a list of
+        ``[start, stop, windows]``. Empty ranges are kept on their own."""
+        order = sorted(range(len(first)), key=lambda w: first[w])
+        groups = []
+        current = None
+        for w in order:
+            a = int(first[w])
+            b = a + int(count[w])
+            if a == b:
+                groups.append([a, b, [w]])
+            elif current is not None and a <= current[1]:
+                current[1] = max(current[1], b)
+                current[2].append(w)
+            else:
+                current = [a, b, [w]]
+                groups.append(current)
+        return groups
+
+    @classmethod
+    def _split_range(cls, data, start, windows, first, count):
+        for w in windows:
+            a = int(first[w]) - start
+            b = a + int(count[w])
+            if isinstance(data, tuple):
+                yield w, tuple(x[a:b] for x in data)
+            else:
+                yield w, data[a:b]
+
+    @classmethod
+    def _read_ranges(cls, entity, first, count):
+        for (start, stop, windows) in cls._range_groups(first, count):
+            data = cls._read_range(entity, start, stop - start)
+            for item in cls._split_range(data, start, windows, first, count):
+                yield item
+
+    @classmethod
+    def _read_range(cls, entity, index, count):
+        entity_type = entity.entity_type
+        if entity_type in (EntityType.Event, EntityType.Segment):
+            return entity.get_data(slice(index, index + count))
+        if count == 0:
+            empty = np.empty(0)
+            return (empty, empty) if entity_type == EntityType.Analog else empty
+        if entity_type == EntityType.Analog:
+            return entity.get_data(index, count)[:2]
+        return entity.get_data(index, count)
+
+    @classmethod
+    def _read_range_async(cls, entity, index, count):
+        entity_type = entity.entity_type
+        if entity_type in (EntityType.Event, EntityType.Segment):
+            return entity.get_data_async(slice(index, index + count))
+        if count == 0:
+            return WorkerPool.get().completed(cls._read_range(entity, index, 0))
+        if entity_type == EntityType.Analog:
+            return WorkerPool.get().then(entity.get_data_async(index, count),
+                                         lambda data: data[:2])
+        return entity.get_data_async(index, count)
+
+    def attach_cache(self, build=True, dtype='float64', entity_ids=None):
+        """Serve the data of analog and neural entities from the
+        memory-mapped :class:`Cache` of this file. If there is no valid
+        cache and ``build`` is ``True``, the entities ``entity_ids``
+        (default: all) are materialized into the cache first, analog data
+        as ``dtype`` (``'float64'``, ``'float32'`` or ``'int16'``). An
+        existing valid cache is used as it is. Returns the cache (or
+        ``None``)."""
+        self._cache = None
+        cache = Cache.load(self._filename)
+        if cache is None and build:
+            cache = Cache.build(self, entity_ids, dtype)
+        self._cache = cache
+        return cache
+
+    @property
+    def cache(self):
+        """The attached :class:`Cache` or ``None``"""
+        return self._cache
+
     def list_entities(self, start=0, end=-1):
         """List all entities. The range can be limited
         via the ``start`` and ``end`` parameters."""
@@ -151,6 +547,8 @@ class File(object):
 
     @property
     def handle(self):
+        if self._handle is None and not self._closed:
+            self._open()
         return self._handle
 
     def __repr__(self):
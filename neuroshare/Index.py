@@ -0,0 +1,230 @@
+import os
+import json
+import bisect
+import numpy as np
+
+from .Entity import EntityType, EntityTime
+
+
+class Index(object):
+    """Sidecar index of a neuroshare file (stored next to it as
+    ``<file>.nsidx``) that contains the file info, the info of all
+    entities and a time to index table for each entity. It is only
+    valid as long as size and modification time of the file match.
+
+    For analog entities the table consists of the start index and start
+    time of each continuous segment, i.e. times and indices within a
+    segment are computed in closed form. For other entities all
+    timestamps are stored, up to ``dense_limit`` items per entity.
+    """
+
+    version = 1
+    dense_limit = 1 << 20
+
+    def __init__(self, meta, tables):
+        self._meta = meta
+        self._tables = tables
+
+    @classmethod
+    def path_for(cls, filename):
+        return filename + '.nsidx'
+
+    @classmethod
+    def _stat(cls, filename):
+        st = os.stat(filename)
+        return st.st_size, st.st_mtime
+
+    @classmethod
+    def load(cls, filename):
+        """Load the index of ``filename``. Returns ``None`` if there is no
+        index or if it is out of date."""
+        path = cls.path_for(filename)
+        try:
+            (size, mtime) = cls._stat(filename)
+            with open(path, 'rb') as fd:
+                npz = np.load(fd)
+                meta = json.loads(str(npz['meta']))
+                tables = dict((k, npz[k]) for k in npz.files if k != 'meta')
+        except (IOError, OSError, ValueError, KeyError):
+            return None
+
+        if meta.get('Version') != cls.version or \
+           meta.get('Size') != size or meta.get('MTime') != mtime:
+            return None
+
+        return Index(meta, tables)
+
+    @classmethod
+    def build(cls, nsfile):
+        """Build the index of the (open) :class:`File` ``nsfile``"""
+        (size, mtime) = cls._stat(nsfile._filename)
+        entities = []
+        tables = {}
+
+        for entity in nsfile.entities:
+            info = dict(entity.metadata_raw)
+            if entity.entity_type == EntityType.Segment:
+                info['SourceInfos'] = [dict(source)
+                                       for source in entity._info['SourceInfos']]
+            entities.append(info)
+
+            key = str(entity.id)
+            if entity.entity_type == EntityType.Analog:
+                (starts, times) = cls._analog_segments(entity)
+                tables['s' + key] = np.array(starts, dtype=np.uint32)
+                tables['t' + key] = np.array(times, dtype=np.float64)
+            elif entity.item_count <= cls.dense_limit:
+                tables['t' + key] = cls._timestamps(entity)
+
+        meta = {'Version': cls.version,
+                'Size': size,
+                'MTime': mtime,
+                'FileInfo': dict(nsfile.metadata_raw),
+                'Entities': entities}
+
+        return Index(meta, tables)
+
+    @classmethod
+    def _analog_segments(cls, analog):
+        if analog.item_count == 0 or not analog.sample_rate > 0:
+            return [], []
+        return analog.file.library._get_analog_segments(analog)
+
+    @classmethod
+    def _timestamps(cls, entity):
+        n = entity.item_count
+        if n == 0:
+            return np.empty(0)
+        if entity.entity_type == EntityType.Event:
+            return entity.get_data(slice(0, n))['timestamp'].copy()
+        if entity.entity_type == EntityType.Neural:
+            return entity.get_data(0, n)
+        return np.array([entity.get_time_by_index(i) for i in range(n)])
+
+    def save(self, filename):
+        """Write the index for ``filename``"""
+        path = self.path_for(filename)
+        tmp = path + '.tmp'
+        with open(tmp, 'wb') as fd:
+            np.savez(fd, meta=np.array(json.dumps(self._meta)), **self._tables)
+        if hasattr(os, 'replace'):
+            os.replace(tmp, path)
+        else:
+            if os.path.exists(path):
+                os.remove(path)
+            os.rename(tmp, path)
+
+    @property
+    def file_info(self):
+        return self._meta['FileInfo']
+
+    def entity_info(self, entity_id):
+        """The info of an entity or ``None`` if the index does not have
+        it (e.g. for an entity added by :func:`File.refresh`)"""
+        entities = self._meta['Entities']
+        if not 0 <= entity_id < len(entities):
+            return None
+        return entities[entity_id]
+
+    def grown(self, entity_id, item_count):
+        """Account that an entity grew to ``item_count`` items (cf.
+        :func:`File.refresh`): its time table is dropped, i.e. its time
+        and index queries are left to the library from then on"""
+        info = self.entity_info(entity_id)
+        if info is not None:
+            info['ItemCount'] = item_count
+        key = str(entity_id)
+        self._tables.pop('s' + key, None)
+        self._tables.pop('t' + key, None)
+
+    def scan(self):
+        """The basic entity information, cf. :func:`File.scan`"""
+        infos = self._meta['Entities']
+        rates = [info['SampleRate'] if info['EntityType'] == EntityType.Analog
+                 else float('nan') for info in infos]
+        return {'EntityLabel': [info['EntityLabel'] for info in infos],
+                'EntityType': np.array([info['EntityType'] for info in infos],
+                                       dtype=np.uint32),
+                'ItemCount': np.array([info['ItemCount'] for info in infos],
+                                      dtype=np.uint32),
+                'SampleRate': np.array(rates, dtype=np.float64)}
+
+    def segments(self, entity_id):
+        """Start indices and times of the continuous segments of an analog
+        entity or ``None`` if the index does not have them"""
+        key = str(entity_id)
+        starts = self._tables.get('s' + key)
+        if starts is None:
+            return None
+        return starts, self._tables['t' + key]
+
+    def time_by_index(self, entity_id, index):
+        """Timestamp of ``index`` or ``None`` if the index cannot answer"""
+        info = self.entity_info(entity_id)
+        if info is None or not 0 <= index < info['ItemCount']:
+            return None
+
+        key = str(entity_id)
+        times = self._tables.get('t' + key)
+        if times is None or not len(times):
+            return None
+        if info['EntityType'] != EntityType.Analog:
+            return float(times[index])
+
+        starts = self._tables['s' + key]
+        j = bisect.bisect_right(starts, index) - 1
+        return float(times[j]) + (index - int(starts[j])) / info['SampleRate']
+
+    def index_by_time(self, entity_id, timepoint, position=EntityTime.Closest):
+        """Index for ``timepoint`` (cf. :func:`Entity.get_index_by_time`)
+        or ``None`` if the index cannot answer, e.g. because there is no
+        item before or after ``timepoint``"""
+        info = self.entity_info(entity_id)
+        key = str(entity_id)
+        times = self._tables.get('t' + key)
+        if info is None or times is None or not len(times):
+            return None
+
+        if info['EntityType'] == EntityType.Analog:
+            (before, after) = self._analog_neighbours(info, key, timepoint)
+        else:
+            after = int(np.searchsorted(times, timepoint, side='left'))
+            before = int(np.searchsorted(times, timepoint, side='right')) - 1
+            if before < 0:
+                before = None
+            if after == len(times):
+                after = None
+
+        if position == EntityTime.Before:
+            return before
+        if position == EntityTime.After:
+            return after
+        if before is None or after is None:
+            return after if before is None else before
+
+        dt_before = timepoint - self.time_by_index(entity_id, before)
+        dt_after = self.time_by_index(entity_id, after) - timepoint
+        return before if dt_before <= dt_after else after
+
+    def _analog_neighbours(self, info, key, timepoint):
+        starts = self._tables['s' + key]
+        times = self._tables['t' + key]
+        rate = info['SampleRate']
+        n = info['ItemCount']
+        eps = 1e-6
+
+        j = int(np.searchsorted(times, timepoint, side='right')) - 1
+        if j < 0:
+            return None, 0
+
+        last = (int(starts[j + 1]) if j + 1 < len(starts) else n) - 1
+        x = int(starts[j]) + (timepoint - float(times[j])) * rate
+
+        before = min(int(np.floor(x + eps)), last)
+        after = int(np.ceil(x - eps))
+        if after > last:
+            after = last + 1
+        if after >= n:
+            after = None
+
+        return before, after
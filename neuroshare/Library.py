@@ -1,6 +1,7 @@
 import os
 import sys
 from . import _capi
+from .WorkerPool import WorkerPool
 
 
 class ArgumentError(Exception):
@@ -57,13 +58,34 @@ def _find_dll(library_name):
     return None
 
 
-def find_library_for_file(filename):
+dll_map = {"mcd": "nsMCDLibrary",
+           "plx": "nsPlxLibrary",
+           "map": "nsAOLibrary",
+           "nev": "nsNEVLibrary",
+           "nex": "NeuroExplorerNeuroShareLibrary"}
+
+# How calls into the vendor libraries have to be serialized:
+#  "none":   the library is reentrant, calls run fully concurrently
+#  "file":   calls for different files may run concurrently
+#  "global": all calls into the library are serialized
+# Libraries that are not listed here are locked globally, unless they
+# declare themselves as thread-safe via ns_LIBRARY_MULTITHREADED.
+dll_lock_policy = {"nsMCDLibrary": "global",
+                   "nsNEVLibrary": "global",
+                   "nsWineLibrary": "global"}
+
+# Libraries that are served by reader servers (cf. capi/nspy_server.c)
+# instead of being loaded into this process: library name -> address(es),
+# e.g. {"nsWineLibrary": "unix:/run/neuroshare/wine.sock"}. An entry for
+# nsWineLibrary serves all formats without a native library.
+dll_remote = {}
+
+_lock_policy_map = {"none": _capi.LOCK_NONE,
+                    "file": _capi.LOCK_FILE,
+                    "global": _capi.LOCK_GLOBAL}
 
-    dll_map = {"mcd": "nsMCDLibrary",
-               "plx": "nsPlxLibrary",
-               "map": "nsAOLibrary",
-               "nev": "nsNEVLibrary",
-               "nex": "NeuroExplorerNeuroShareLibrary"}
+
+def find_library_for_file(filename):
 
     (root, ext) = os.path.splitext(filename)
     if not ext or not ext.startswith('.'):
@@ -75,8 +97,14 @@ def find_library_for_file(filename):
         raise DLLTypeUnknown(root, ext)
 
     library_name = dll_map[ext]
+    if library_name in dll_remote:
+        return library_name, None
+
     path = _find_dll(library_name)
 
+    if not path and "nsWineLibrary" in dll_remote:
+        return library_name, None
+
     if not path:
         path = _find_dll("nsWineLibrary")
 
@@ -93,25 +121,104 @@ def load_library_for_file(filename):
 
 
 class Library(object):
+    """A vendor library at ``path``. Libraries are shared process-wide:
+    instances for the same (resolved) path use the same native handle,
+    i.e. the library is loaded and initialized only once and the lock
+    policy is shared, too (asking for another one raises an error). With
+    ``lazy`` the symbols of a newly loaded library are only resolved on
+    first use (``RTLD_LAZY``); a later non-lazy instance of an already
+    lazily loaded library only warns.
+
+    With ``address`` the library is not loaded but served by reader
+    servers (``ns-server``, one address or a list of them), e.g. to run
+    a Windows DLL hosted by Wine out of process, cf. :func:`connect`."""
 
     _loaded_libs = {}
 
     @classmethod
-    def for_file(cls, filename):
+    def for_file(cls, filename, lazy=False):
         (name, path) = find_library_for_file(filename)
         if name not in cls._loaded_libs:
-            lib = Library(name, path)
+            address = None
+            if path is None:
+                address = dll_remote.get(name, dll_remote.get("nsWineLibrary"))
+            lib = Library(name, path, lazy=lazy, address=address)
             cls._loaded_libs[name] = lib
 
         return cls._loaded_libs[name]
 
-    def __init__(self, name, path):
+    @classmethod
+    def warm_up(cls, extensions=None, lazy=False):
+        """Load (and initialize) the libraries for the file extensions
+        ``extensions`` (default: all known ones, cf. ``dll_map``) that
+        can be found. Meant to be called before forking worker processes:
+        the children inherit the loaded libraries and do not have to load
+        them again. Returns the list of loaded :class:`Library` objects."""
+        if extensions is None:
+            extensions = sorted(dll_map.keys())
+
+        libs = []
+        for ext in extensions:
+            try:
+                libs.append(cls.for_file('warm_up.' + ext.lstrip('.'), lazy))
+            except DLLException:
+                pass
+        return libs
+
+    @classmethod
+    def loaded_libraries(cls):
+        """Resolved paths and reference counts of all libraries loaded
+        in this process"""
+        return _capi.library_registry()
+
+    @classmethod
+    def connect(cls, address, name=None, lock_policy=None):
+        """The library served by the reader server(s) at ``address``:
+        ``"unix:PATH"`` or ``"tcp:HOST:PORT"``, or a list of them to
+        spread the files over several servers (e.g. one per core for a
+        library that is not thread-safe). Unix sockets transfer the bulk
+        data through shared memory (with one copy into the result). The server serializes the calls
+        according to its own lock policy, so the calls of the client are
+        not serialized (``lock_policy`` "none") unless requested.
+        Example use: ``fd = neuroshare.File('data.plx', library=Library.connect('unix:/tmp/plx.sock'))``
+        """
+        return cls(name or 'remote', None, lock_policy=lock_policy, address=address)
+
+    def __init__(self, name, path, lock_policy=None, lazy=False, address=None):
+        if isinstance(address, (list, tuple)):
+            address = ','.join(address)
+
+        # an explicit lock policy must match the one of a shared handle
+        kwargs = {}
+        if lock_policy in _lock_policy_map:
+            kwargs['lock_policy'] = _lock_policy_map[lock_policy]
+
         self._name = name
-        self._path = path
-        self._handle = _capi.library_open(path)
+        self._path = path if address is None else address
+        if address is not None:
+            self._handle = _capi.library_connect(address, **kwargs)
+        else:
+            if lazy:
+                kwargs['lazy'] = 1
+            self._handle = _capi.library_open(path, **kwargs)
         self._open_files = []
         self._info = _capi.get_library_info(self._handle)
 
+        # a shared handle keeps the policy it has
+        (_policy, refcount) = _capi.library_get_state(self._handle)
+        if lock_policy is None and refcount > 1:
+            return
+
+        if lock_policy is None and address is not None:
+            lock_policy = "none"
+        if lock_policy is None:
+            dll_name = os.path.splitext(os.path.basename(path))[0]
+            lock_policy = dll_lock_policy.get(dll_name)
+        if lock_policy is None:
+            threaded = self._info['Flags'] & _capi.LIBRARY_MULTITHREADED
+            lock_policy = "none" if threaded else "global"
+        self.lock_policy = lock_policy
+
     def _open_file(self, filename):
         (fh, file_info) = _capi.open_file(self._handle, filename)
         self._open_files.append(fh)
@@ -122,12 +229,24 @@ class Library(object):
         _capi.close_file(self._handle, fh)
         self._open_files.remove(fh)
 
+    def _get_file_info(self, nsfile):
+        return _capi.get_file_info(self._handle, nsfile.handle)
+
     def _get_entity_info(self, nsfile, entity_id):
         fh = nsfile.handle
         
         info = _capi.get_entity_info(self._handle, fh, entity_id)
         return info
 
+    def _scan_entities(self, nsfile, count, first=0):
+        fh = nsfile.handle
+
+        scan = _capi.scan_entities(self._handle, fh, count, first)
+        return scan
+
+    def _get_item_counts(self, nsfile, count):
+        return _capi.get_item_counts(self._handle, nsfile.handle, count)
+
     def _get_event_data(self, event, index):
         fh = event.file.handle
         entity_id = event.id
@@ -138,29 +257,120 @@ class Library(object):
         data = _capi.get_event_data(self._handle, fh, entity_id, index, event_type, max_data_len)
         return data
 
-    def _get_analog_data(self, analog, index, count):
+    def _get_event_data_range(self, event, index, count):
+        fh = event.file.handle
+        entity_id = event.id
+
+        event_type = event.event_type
+        max_data_len = event.max_data_length
+
+        data = _capi.get_event_data_range(self._handle, fh, entity_id, index, count,
+                                          event_type, max_data_len)
+        return data
+
+    def _split_csv(self, values, columns):
+        return _capi.split_csv(values, columns)
+
+    def _get_analog_data(self, analog, index, count, times=True, out=None,
+                         dtype=None, encoding=(1.0, 0.0)):
         fh = analog.file.handle
         entity_id = analog.id
-        
-        data = _capi.get_analog_data(self._handle, fh, entity_id, index, count)
-        return data 
+        sample_rate = analog.sample_rate
+        (scale, offset) = encoding
 
-    def _get_segment_data(self, segment, index):
+        data = _capi.get_analog_data(self._handle, fh, entity_id, index, count,
+                                     sample_rate=sample_rate, times=times, out=out,
+                                     dtype=dtype, scale=scale, offset=offset)
+        return data
+
+    def _get_analog_envelope(self, analog, index, count, bins):
+        fh = analog.file.handle
+        entity_id = analog.id
+
+        return _capi.get_analog_envelope(self._handle, fh, entity_id, index, count,
+                                         bins=bins)
+
+    def _get_analog_decimated(self, analog, index, count, factor):
+        fh = analog.file.handle
+        entity_id = analog.id
+
+        return _capi.get_analog_decimated(self._handle, fh, entity_id, index, count,
+                                          factor=factor)
+
+    def _open_analog_stream(self, analog, index, count, chunk, overlap, prefetch):
+        fh = analog.file.handle
+        entity_id = analog.id
+
+        stream = _capi.analog_stream_open(self._handle, fh, entity_id, index, count,
+                                          chunk, overlap=overlap, prefetch=prefetch)
+        return stream
+
+    def _get_analog_block(self, nsfile, entity_ids, index, count, fortran=False, threads=1):
+        fh = nsfile.handle
+
+        data = _capi.get_analog_block(self._handle, fh, entity_ids, index, count,
+                                      fortran=fortran, threads=threads)
+        return data
+
+    def _get_segment_data(self, segment, index, out=None):
         fh = segment.file.handle
         entity_id = segment.id
 
         source_count = segment.source_count
         max_sample_count = segment.max_sample_count
-        
-        data = _capi.get_segment_data(self._handle, fh, entity_id, index, source_count, max_sample_count)
-        return data  
 
-    def _get_neural_data(self, neural, index, count):
+        data = _capi.get_segment_data(self._handle, fh, entity_id, index, source_count, max_sample_count,
+                                      out=out)
+        return data
+
+    def _get_segment_data_range(self, segment, index, count, out=None):
+        fh = segment.file.handle
+        entity_id = segment.id
+
+        source_count = segment.source_count
+        max_sample_count = segment.max_sample_count
+
+        data = _capi.get_segment_data_range(self._handle, fh, entity_id, index, count,
+                                            source_count, max_sample_count, out=out)
+        return data
+
+    def _get_segment_data_at(self, segment, indices, out=None):
+        fh = segment.file.handle
+        entity_id = segment.id
+
+        source_count = segment.source_count
+        max_sample_count = segment.max_sample_count
+
+        data = _capi.get_segment_data_at(self._handle, fh, entity_id, indices,
+                                         source_count, max_sample_count, out=out)
+        return data
+
+    def _get_segment_unit_index(self, segment):
+        fh = segment.file.handle
+        entity_id = segment.id
+
+        count = segment.item_count
+        source_count = segment.source_count
+        max_sample_count = segment.max_sample_count
+
+        index = _capi.get_segment_unit_index(self._handle, fh, entity_id, count,
+                                             source_count, max_sample_count)
+        return index
+
+    def _get_neural_data(self, neural, index, count, out=None):
         fh = neural.file.handle
         entity_id = neural.id
-        
-        data = _capi.get_neural_data(self._handle, fh, entity_id, index, count)
-        return data  
+
+        data = _capi.get_neural_data(self._handle, fh, entity_id, index, count, out=out)
+        return data
+
+    def _bin_neural(self, nsfile, entity_ids, item_counts, t_start, t_stop, bin_width,
+                    sparse=False, threads=1):
+        fh = nsfile.handle
+
+        return _capi.bin_neural(self._handle, fh, entity_ids, item_counts,
+                                t_start, t_stop, bin_width, sparse=sparse,
+                                threads=threads)
 
     def _get_time_by_index(self, entity, index):
         fh = entity.file.handle
@@ -176,6 +386,101 @@ class Library(object):
         idx = _capi.get_index_by_time(self._handle, fh, entity_id, time, position)
         return idx
 
+    def _get_index_ranges(self, nsfile, entity_ids, item_counts, t_start, t_stop):
+        fh = nsfile.handle
+
+        ranges = _capi.get_index_ranges(self._handle, fh, entity_ids,
+                                        item_counts, t_start, t_stop)
+        return ranges
+
+    def _get_analog_segments(self, analog):
+        fh = analog.file.handle
+        entity_id = analog.id
+
+        segments = _capi.get_analog_segments(self._handle, fh, entity_id,
+                                             analog.item_count,
+                                             analog.sample_rate)
+        return segments
+
+    def _get_times_by_index(self, entity, indices, segments=None):
+        fh = entity.file.handle
+        entity_id = entity.id
+
+        kwargs = {}
+        if segments is not None:
+            kwargs = {'count': entity.item_count,
+                      'sample_rate': entity.sample_rate,
+                      'starts': segments[0],
+                      'times': segments[1]}
+
+        times = _capi.get_times_by_index(self._handle, fh, entity_id, indices,
+                                         **kwargs)
+        return times
+
+    def _get_indices_by_time(self, entity, times, position, segments=None):
+        fh = entity.file.handle
+        entity_id = entity.id
+
+        kwargs = {}
+        if segments is not None:
+            kwargs = {'count': entity.item_count,
+                      'sample_rate': entity.sample_rate,
+                      'starts': segments[0],
+                      'seg_times': segments[1]}
+
+        indices = _capi.get_indices_by_time(self._handle, fh, entity_id, times,
+                                            position, **kwargs)
+        return indices
+
+    # Asynchronous reads on the worker pool (cf. WorkerPool); they return
+    # the token of the queued job
+
+    def _submit_analog_data(self, analog, index, count, times=True, out=None,
+                            dtype=None, encoding=(1.0, 0.0)):
+        fh = analog.file.handle
+        (scale, offset) = encoding
+
+        pool = WorkerPool.get()
+        token = pool.submit(_capi.submit_analog_data, self._handle, fh, analog.id,
+                            index, count, sample_rate=analog.sample_rate,
+                            times=times, out=out, dtype=dtype, scale=scale,
+                            offset=offset)
+        return token
+
+    def _submit_neural_data(self, neural, index, count, out=None):
+        fh = neural.file.handle
+
+        pool = WorkerPool.get()
+        token = pool.submit(_capi.submit_neural_data, self._handle, fh, neural.id,
+                            index, count, out=out)
+        return token
+
+    def _submit_event_data_range(self, event, index, count, single=False):
+        fh = event.file.handle
+
+        pool = WorkerPool.get()
+        token = pool.submit(_capi.submit_event_data_range, self._handle, fh,
+                            event.id, index, count, event.event_type,
+                            event.max_data_length, single=int(bool(single)))
+        return token
+
+    def _submit_segment_data_range(self, segment, index, count, out=None):
+        fh = segment.file.handle
+
+        pool = WorkerPool.get()
+        token = pool.submit(_capi.submit_segment_data_range, self._handle, fh,
+                            segment.id, index, count, segment.source_count,
+                            segment.max_sample_count, out=out)
+        return token
+
+    def _submit_index_ranges(self, nsfile, entity_ids, item_counts, t_start, t_stop):
+        fh = nsfile.handle
+
+        pool = WorkerPool.get()
+        token = pool.submit(_capi.submit_index_ranges, self._handle, fh, entity_ids,
+                            item_counts, t_start, t_stop)
+        return token
+
     def __del__(self):
         _capi.library_close(self._handle)
 
@@ -215,6 +520,47 @@ class Library(object):
         day = self._info['Time_Day']
         return date(year, month, day)
 
+    @property
+    def lock_policy(self):
+        """How calls into the library are serialized between threads,
+        one of ``"none"``, ``"file"`` or ``"global"`` (shared by all
+        instances of the library)"""
+        (policy, _refcount) = _capi.library_get_state(self._handle)
+        for (name, value) in _lock_policy_map.items():
+            if value == policy:
+                return name
+
+    @lock_policy.setter
+    def lock_policy(self, policy):
+        if policy not in _lock_policy_map:
+            raise ArgumentError(policy, "Unknown locking policy")
+        _capi.library_set_lock_policy(self._handle, _lock_policy_map[policy])
+
+    @classmethod
+    def enable_stats(cls, enabled=True):
+        """Enable (or disable) collecting statistics of the calls into all
+        vendor libraries, cf. :attr:`stats`. Returns the previous state."""
+        return _capi.stats_enable(int(bool(enabled)))
+
+    @property
+    def stats(self):
+        """Statistics of the calls into the library while enabled (cf.
+        :func:`enable_stats`): a dictionary with the counters of each
+        vendor function (``calls``, ``ns`` spent in it, ``bytes`` of data
+        returned and ``errors``) under ``calls``, the same per file handle
+        under ``files`` and the number of errors that were raised as
+        exceptions under ``errors_raised``. ``scheduler`` has the counters
+        of the reads queued on the :class:`WorkerPool` (always collected):
+        the jobs ``queued`` right now (and ``max_queued``), the
+        ``requests`` run, the vendor ``reads`` they took and their ratio
+        (``coalescing``), and their latency from submitting to finishing
+        (``ns`` in total, ``max_ns`` and ``mean_ns``)."""
+        return _capi.stats(self._handle)
+
+    def reset_stats(self):
+        """Return the call statistics (cf. :attr:`stats`) and reset them"""
+        return _capi.stats(self._handle, reset=1)
+
     @property
     def name(self):
         return self._name
@@ -1,4 +1,5 @@
 from .Entity import Entity
+from .WorkerPool import WorkerPool
 
 
 class NeuralEntity(Entity):
@@ -27,12 +28,38 @@ class NeuralEntity(Entity):
         (cf. :func:`source_entity_id`)"""
         return self._info['SourceUnitID']
 
-    def get_data(self, index=0, count=-1):
+    def get_data(self, index=0, count=-1, out=None):
         """Retrieve the spike times associated with this entity. A subset
         of the data can be requested via the ``index`` and ``count``
-        parameters."""
-        lib = self.file.library
+        parameters. The data can be read into an existing C-contiguous
+        float64 array ``out`` (which is then returned) instead of a newly
+        allocated one. If the file has a :class:`Cache` attached the
+        data is served from it (as read-only view, unless ``out`` is
+        given)."""
         if count < 0:
             count = self.item_count
-        data = lib._get_neural_data(self, index, count)
+
+        cache = self.file.cache
+        column = cache.column(self.id) if cache is not None else None
+        if column is not None and column.contains(index, count):
+            return column.get_values(index, count, out)
+
+        lib = self.file.library
+        data = lib._get_neural_data(self, index, count, out)
         return data
+
+    def get_data_async(self, index=0, count=-1, out=None):
+        """Awaitable variant of :func:`get_data`, the spike times are read
+        on the native worker pool (cf. :class:`WorkerPool`)"""
+        if count < 0:
+            count = self.item_count
+
+        pool = WorkerPool.get()
+        cache = self.file.cache
+        column = cache.column(self.id) if cache is not None else None
+        if column is not None and column.contains(index, count):
+            return pool.completed(column.get_values(index, count, out))
+
+        lib = self.file.library
+        return pool.future(lib._submit_neural_data(self, index, count, out),
+                           owner=self)
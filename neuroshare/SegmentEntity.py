@@ -1,4 +1,21 @@
+import numpy as np
+
 from .Entity import Entity
+from .WorkerPool import WorkerPool
+
+
+def _fill_out(waveforms, out):
+    """Copy ``waveforms`` into the caller's ``out`` (cf. ``get_data``)"""
+    if out is None:
+        return waveforms
+    if not isinstance(out, np.ndarray) or out.dtype != np.float64:
+        raise TypeError("out must be a float64 numpy.ndarray")
+    if not out.flags.c_contiguous or not out.flags.writeable:
+        raise ValueError("out must be a writable, C-contiguous array")
+    if out.size < waveforms.size:
+        raise ValueError("out is too small (%d < %d items)" % (out.size, waveforms.size))
+    out.reshape(-1)[:waveforms.size] = waveforms.reshape(-1)
+    return out
 
 
 class SegmentSource(object):
@@ -107,11 +124,12 @@ class SegmentEntity(Entity):
     one or more sources that are usually short in time. Most prominent example are
     waveforms of action potentials from one ore more electrodes."""
     def __init__(self, nsfile, eid, info):
-        from copy import copy
-        self._source_infos = info['SourceInfos']
-        pure_info = copy(info)
-        del pure_info['SourceInfos']
-        super(SegmentEntity, self).__init__(eid, nsfile, pure_info)
+        super(SegmentEntity, self).__init__(eid, nsfile, info)
+
+    @property
+    def metadata_raw(self):
+        info = super(SegmentEntity, self).metadata_raw
+        return dict((k, v) for (k, v) in info.items() if k != 'SourceInfos')
 
     @property
     def max_sample_count(self):
@@ -131,10 +149,108 @@ class SegmentEntity(Entity):
         Returns a sequence of objects of type :class:`SegmentSource`.
         Metadata properties of a SegmentSource are analogous to the
         :class:`AnalogEntity`."""
-        return SourcesBag(self, self._source_infos)
+        return SourcesBag(self, self._info['SourceInfos'])
 
-    def get_data(self, index):
-        """Retrieve the data at ``index``"""
+    def get_data(self, index, out=None):
+        """Retrieve the data at ``index``. The waveform data can be read
+        into an existing C-contiguous float64 array ``out`` with room for at
+        least ``source_count * max_sample_count`` elements (which is then
+        returned) instead of a newly allocated one.
+
+        If ``index`` is a :class:`slice` all segments in that range are
+        retrieved at once. Returns a tuple with the waveforms as array of
+        shape ``(count, source_count, max_sample_count)`` (samples beyond
+        the sample count of a segment are zero) and arrays with the
+        timestamps, sample counts and unit ids of the segments. ``out``
+        then needs room for all waveforms.
+        Example use: ``data, timestamps, samples, units = segment.get_data(slice(0, 1000))``
+        """
         lib = self.file.library
-        data = lib._get_segment_data(self, index)
+        if isinstance(index, slice):
+            indices = range(*index.indices(self.item_count))
+            if not indices:
+                return lib._get_segment_data_range(self, 0, 0, out)
+            step = indices[1] - indices[0] if len(indices) > 1 else 1
+            if step != 1:
+                first = min(indices[0], indices[-1])
+                count = abs(indices[-1] - indices[0]) + 1
+                data = lib._get_segment_data_range(self, first, count)
+                (waveforms, timestamps, samples, units) = \
+                    tuple(x[indices[0] - first::step] for x in data)
+                return _fill_out(waveforms, out), timestamps, samples, units
+            return lib._get_segment_data_range(self, indices[0], len(indices), out)
+
+        data = lib._get_segment_data(self, index, out)
         return data
+
+    def get_data_async(self, index, out=None):
+        """Awaitable variant of :func:`get_data` (for a single ``index``
+        or a :class:`slice`), the segments are read on the native worker
+        pool (cf. :class:`WorkerPool`). ``out`` must not be used until
+        the read has completed."""
+        lib = self.file.library
+        pool = WorkerPool.get()
+        if not isinstance(index, slice):
+            token = lib._submit_segment_data_range(self, index, 1)
+
+            def single(data):
+                (waveforms, timestamps, samples, units) = data
+                waveforms = _fill_out(waveforms[0], out)
+                return waveforms, float(timestamps[0]), int(samples[0]), int(units[0])
+            return pool.future(token, single, owner=self)
+
+        indices = range(*index.indices(self.item_count))
+        if not indices:
+            return pool.future(lib._submit_segment_data_range(self, 0, 0, out),
+                               owner=self)
+        step = indices[1] - indices[0] if len(indices) > 1 else 1
+        if step == 1:
+            return pool.future(lib._submit_segment_data_range(self, indices[0],
+                                                              len(indices), out),
+                               owner=self)
+        first = min(indices[0], indices[-1])
+        count = abs(indices[-1] - indices[0]) + 1
+        token = lib._submit_segment_data_range(self, first, count)
+
+        def strided(data):
+            (waveforms, timestamps, samples, units) = \
+                tuple(x[indices[0] - first::step] for x in data)
+            return _fill_out(waveforms, out), timestamps, samples, units
+        return pool.future(token, strided, owner=self)
+
+    @property
+    def unit_index(self):
+        """Dictionary that maps each unit id to a tuple with the (sorted)
+        indices and the timestamps of the segments of that unit. It is
+        computed with a single pass over all segments on first access
+        and then cached."""
+        cache = self.file._entity_cache(self.id)
+        if 'units' not in cache:
+            lib = self.file.library
+            cache['units'] = lib._get_segment_unit_index(self)
+        return cache['units']
+
+    @property
+    def units(self):
+        """Sorted list of the unit ids of the segments"""
+        return sorted(self.unit_index.keys())
+
+    def get_unit(self, unit_id, t_start=None, t_stop=None, out=None):
+        """Retrieve the segments of unit ``unit_id``, optionally only those
+        with timestamps in ``[t_start, t_stop)``. Only the matching
+        segments are read (cf. :attr:`unit_index`). Returns a tuple like
+        ``get_data`` with a :class:`slice`, i.e. the waveforms, timestamps,
+        sample counts and unit ids.
+        Example use: ``data, timestamps, samples, units = segment.get_unit(3)``
+        """
+        (indices, timestamps) = self.unit_index.get(
+            unit_id, (np.empty(0, dtype=np.uint32), np.empty(0)))
+
+        mask = np.ones(len(indices), dtype=bool)
+        if t_start is not None:
+            mask &= timestamps >= t_start
+        if t_stop is not None:
+            mask &= timestamps < t_stop
+
+        lib = self.file.library
+        return lib._get_segment_data_at(self, indices[mask], out)
@@ -0,0 +1,284 @@
+import threading
+import numpy as np
+
+from .Library import Library
+from .File import File
+from .Entity import EntityType
+
+
+def _parallel_map(fn, items, threads):
+    """``[fn(x) for x in items]`` on up to ``threads`` threads; the first
+    exception (in the order of ``items``) is re-raised"""
+    items = list(items)
+    results = [None] * len(items)
+    errors = [None] * len(items)
+    if threads <= 1 or len(items) <= 1:
+        return [fn(x) for x in items]
+
+    lock = threading.Lock()
+    pending = list(range(len(items)))
+
+    def work():
+        while True:
+            with lock:
+                if not pending:
+                    return
+                i = pending.pop(0)
+            try:
+                results[i] = fn(items[i])
+            except Exception as e:
+                errors[i] = e
+
+    workers = [threading.Thread(target=work) for _ in range(min(threads, len(items)))]
+    for worker in workers:
+        worker.start()
+    for worker in workers:
+        worker.join()
+
+    for error in errors:
+        if error is not None:
+            raise error
+    return results
+
+
+class Session(object):
+    """A set of files ``filenames`` (e.g. the blocks of an experiment or
+    the files of several headstages) that are accessed as one: the files
+    are opened concurrently and their entities are numbered consecutively,
+    in the order of the files, i.e. the entity ids of the session are
+    global. ``library`` and ``use_index`` are passed on to :class:`File`.
+
+    Calls into the vendor libraries release the GIL and are serialized
+    according to the lock policy of each library (cf.
+    :attr:`Library.lock_policy`), so files of a thread-safe library (or
+    with a valid index) are opened in parallel on up to ``threads``
+    threads, while those of other libraries still open one at a time.
+
+    Times of the session are the times within each file shifted by its
+    offset (cf. :attr:`offsets`); ``offsets`` is a sequence with one
+    offset (in seconds) per file, ``'sequential'`` to place the files
+    one after the other (by :attr:`File.time_span`), ``'ctime'`` to
+    place them by their creation times relative to the first one, or
+    ``None`` for all zero.
+    """
+
+    def __init__(self, filenames, library=None, use_index=False, offsets=None,
+                 threads=8):
+        filenames = list(filenames)
+        self._threads = max(1, int(threads))
+
+        # load the libraries up front: each is initialized only once and
+        # concurrent opens do not race on loading it
+        if library is None:
+            libraries = [Library.for_file(name) for name in filenames]
+        else:
+            libraries = [library] * len(filenames)
+
+        open_file = lambda args: File(args[0], library=args[1], use_index=use_index)
+        self._files = _parallel_map(open_file, zip(filenames, libraries), self._threads)
+
+        self._offsets = self._compute_offsets(offsets)
+        counts = [f.entity_count for f in self._files]
+        self._first_ids = np.concatenate(([0], np.cumsum(counts))).astype(np.int64)
+
+    def _compute_offsets(self, offsets):
+        n = len(self._files)
+        if offsets is None:
+            return np.zeros(n)
+        if isinstance(offsets, str) and offsets == 'sequential':
+            spans = [f.time_span for f in self._files]
+            return np.concatenate(([0.0], np.cumsum(spans)[:-1])) if n else np.zeros(0)
+        if isinstance(offsets, str) and offsets == 'ctime':
+            if not n:
+                return np.zeros(0)
+            ctimes = [f.ctime for f in self._files]
+            return np.array([(t - ctimes[0]).total_seconds() for t in ctimes])
+
+        offsets = np.asarray(offsets, dtype=np.float64).ravel()
+        if len(offsets) != n:
+            raise ValueError("Need one offset per file")
+        return offsets
+
+    def close(self):
+        """Close all files."""
+        for f in self._files:
+            f.close()
+
+    @property
+    def files(self):
+        """The :class:`File` objects of the session, in order"""
+        return list(self._files)
+
+    @property
+    def offsets(self):
+        """The time offset of each file [in seconds], i.e. time ``t`` of
+        file ``i`` is time ``t + offsets[i]`` of the session"""
+        return self._offsets.copy()
+
+    @property
+    def entity_count(self):
+        """The number of entities in all files"""
+        return int(self._first_ids[-1])
+
+    @property
+    def time_span(self):
+        """Timespan of the session [in seconds], from time 0 to the end
+        of the file that ends last"""
+        ends = [o + f.time_span for (o, f) in zip(self._offsets, self._files)]
+        return max(ends) if ends else 0.0
+
+    def locate(self, entity_id):
+        """The file index and the entity id within that file of the
+        (session) entity ``entity_id``"""
+        if not 0 <= entity_id < self.entity_count:
+            raise IndexError("entity id out of range")
+        i = int(np.searchsorted(self._first_ids, entity_id, side='right')) - 1
+        return i, int(entity_id - self._first_ids[i])
+
+    def entity_id(self, file_index, entity_id):
+        """The session entity id of the entity ``entity_id`` of the file
+        ``file_index``"""
+        return int(self._first_ids[file_index] + entity_id)
+
+    def get_entity(self, entity_id):
+        """The entity with the (session) id ``entity_id``"""
+        (i, eid) = self.locate(entity_id)
+        return self._files[i].get_entity(eid)
+
+    def scan(self):
+        """The basic entity information of all files as with
+        :func:`File.scan`, indexed by the session entity id, plus the
+        keys ``File`` (the file index) and ``EntityID`` (the id within
+        that file)"""
+        scans = [f.scan() for f in self._files]
+        counts = [f.entity_count for f in self._files]
+        labels = []
+        for s in scans:
+            labels.extend(s['EntityLabel'])
+        concat = lambda key, dtype: np.concatenate(
+            [np.asarray(s[key], dtype=dtype) for s in scans]) if scans \
+            else np.empty(0, dtype=dtype)
+        return {'EntityLabel': labels,
+                'EntityType': concat('EntityType', np.uint32),
+                'ItemCount': concat('ItemCount', np.uint32),
+                'SampleRate': concat('SampleRate', np.float64),
+                'File': np.repeat(np.arange(len(counts), dtype=np.uint32), counts),
+                'EntityID': np.concatenate([np.arange(c, dtype=np.uint32) for c in counts])
+                if counts else np.empty(0, dtype=np.uint32)}
+
+    def _by_file(self, entity_ids):
+        """``{file index: [(position, entity id within the file), ...]}``
+        for the session entity ids ``entity_ids`` (default: all)"""
+        if entity_ids is None:
+            entity_ids = range(self.entity_count)
+        groups = {}
+        for (pos, eid) in enumerate(entity_ids):
+            (i, local) = self.locate(int(eid))
+            groups.setdefault(i, []).append((pos, local))
+        return groups
+
+    def slice(self, t_start, t_stop, entity_ids=None):
+        """Read all data of the (session) entities ``entity_ids`` (default:
+        all) within the session time window ``[t_start, t_stop)``, cf.
+        :func:`File.slice`. The files are read concurrently; timestamps
+        are in session time. Returns a dictionary that maps each session
+        entity id to its data."""
+        return self.slice_many([(t_start, t_stop)], entity_ids)[0]
+
+    def slice_many(self, windows, entity_ids=None):
+        """Like :func:`slice` but for a sequence of ``(t_start, t_stop)``
+        windows, cf. :func:`File.slice_many`"""
+        windows = np.asarray(windows, dtype=np.float64).reshape(-1, 2)
+        results = [{} for _ in range(len(windows))]
+        groups = sorted(self._by_file(entity_ids).items())
+
+        def read(group):
+            (i, members) = group
+            offset = self._offsets[i]
+            local = [eid for (_, eid) in members]
+            return self._files[i].slice_many(windows - offset, local)
+
+        parts = _parallel_map(read, groups, self._threads)
+        for ((i, members), part) in zip(groups, parts):
+            offset = self._offsets[i]
+            nsfile = self._files[i]
+            for (w, result) in enumerate(part):
+                for (_, eid) in members:
+                    entity_type = nsfile.get_entity(eid).entity_type
+                    data = self._shift(entity_type, result[eid], offset)
+                    results[w][self.entity_id(i, eid)] = data
+        return results
+
+    @classmethod
+    def _shift(cls, entity_type, data, offset):
+        if offset == 0:
+            return data
+        if entity_type == EntityType.Event:
+            data = data.copy()
+            data['timestamp'] += offset
+            return data
+        if entity_type == EntityType.Neural:
+            return data + offset
+        # analog (data, times) and segment (data, timestamps, ...) tuples
+        return (data[0], data[1] + offset) + tuple(data[2:])
+
+    def read_analog_block(self, entity_ids, start=0, count=-1, order='C', parallel=False):
+        """Read the analog data of the (session) entities ``entity_ids``,
+        which may belong to different files, into a single 2-D array, cf.
+        :func:`File.read_analog_block`; ``start`` and ``count`` are
+        indices within each entity. The files are read concurrently."""
+        entity_ids = list(entity_ids)
+        if count < 0:
+            counts = [self.get_entity(eid).item_count for eid in entity_ids]
+            count = max(0, min(counts) - start) if counts else 0
+
+        groups = sorted(self._by_file(entity_ids).items())
+        read = lambda group: self._files[group[0]].read_analog_block(
+            [eid for (_, eid) in group[1]], start, count, parallel=parallel)
+        parts = _parallel_map(read, groups, self._threads)
+
+        data = np.empty((len(entity_ids), count), order=order.upper())
+        cont_counts = np.empty(len(entity_ids), dtype=np.uint32)
+        for ((i, members), (block, conts)) in zip(groups, parts):
+            rows = [pos for (pos, _) in members]
+            data[rows] = block
+            cont_counts[rows] = conts
+        return data, cont_counts
+
+    def bin_neural(self, entity_ids, t_start, t_stop, bin_width, sparse=False,
+                   parallel=False):
+        """Spike counts of the (session) neural entities ``entity_ids`` in
+        bins of the session time window ``[t_start, t_stop)``, cf.
+        :func:`File.bin_neural`. The files are read concurrently."""
+        entity_ids = list(entity_ids)
+        groups = sorted(self._by_file(entity_ids).items())
+
+        def read(group):
+            (i, members) = group
+            offset = self._offsets[i]
+            return self._files[i].bin_neural([eid for (_, eid) in members],
+                                             t_start - offset, t_stop - offset,
+                                             bin_width, sparse, parallel)
+
+        parts = _parallel_map(read, groups, self._threads)
+        order = np.argsort([pos for (_, members) in groups for (pos, _) in members],
+                           kind='mergesort')
+        if not parts:
+            counts = np.zeros((0, 0), dtype=np.uint32)
+            if sparse:
+                from scipy.sparse import csr_matrix
+                counts = csr_matrix(counts)
+            return counts
+        if sparse:
+            from scipy.sparse import vstack
+            return vstack(parts).tocsr()[order]
+        return np.concatenate(parts)[order]
+
+    def __len__(self):
+        return len(self._files)
+
+    def __getitem__(self, file_index):
+        return self._files[file_index]
+
+    def __iter__(self):
+        return iter(self._files)
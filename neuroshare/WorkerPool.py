@@ -0,0 +1,201 @@
+import os
+import select
+import weakref
+import threading
+
+from . import _capi
+
+
+def _current_loop():
+    import asyncio
+    get_loop = getattr(asyncio, 'get_running_loop', asyncio.get_event_loop)
+    return get_loop()
+
+
+def _create_future(loop):
+    if hasattr(loop, 'create_future'):
+        return loop.create_future()
+    import asyncio
+    return asyncio.Future(loop=loop)
+
+
+class WorkerPool(object):
+    """Bridge between the native worker pool of the ``_capi`` module and
+    :mod:`asyncio`: reads are queued with one of the ``_capi.submit_*``
+    functions and run on the (``threads``) pool threads, never on the
+    interpreter thread; their results complete :class:`asyncio.Future`
+    objects. The pool has a single wakeup fd, which is watched by every
+    event loop that waits for results (or, if the loop can not watch it,
+    by one helper thread). Calls into a vendor library are serialized
+    according to its lock policy (cf. :attr:`Library.lock_policy`), as
+    for the synchronous reads.
+
+    The reads are queued per file and run in the order of the data in
+    the file; queued analog and neural reads of an entity that overlap
+    or are adjacent are merged into a single vendor call, and files whose
+    library is busy (per its lock policy) are skipped in favour of others.
+    The effect shows in the ``scheduler`` part of :attr:`Library.stats`."""
+
+    threads = _capi.POOL_THREADS
+    _instance = None
+
+    @classmethod
+    def get(cls):
+        """The pool of the process, started on first use; a forked child
+        gets one of its own (the threads of the parent are not forked)"""
+        if cls._instance is None or cls._instance._pid != os.getpid():
+            cls._instance = WorkerPool(cls.threads)
+        return cls._instance
+
+    def __init__(self, threads):
+        (self._fd, self._threads) = _capi.pool_start(threads=threads)
+        self._pid = os.getpid()
+        self._lock = threading.Lock()
+        self._futures = {}
+        self._pending = set()
+        self._orphans = {}
+        self._loops = weakref.WeakSet()
+        self._waiter = None
+
+    @property
+    def thread_count(self):
+        return self._threads
+
+    def submit(self, submit_fn, *args, **kwargs):
+        """Queue a job with ``submit_fn`` (one of the ``_capi.submit_*``
+        functions) and return its token, for :func:`future`. Results of
+        jobs that were not queued this way are not kept for a later
+        :func:`future` call but dropped when they are reaped."""
+        with self._lock:
+            token = submit_fn(*args, **kwargs)
+            self._pending.add(token)
+        return token
+
+    def future(self, token, transform=None, owner=None):
+        """Future (of the current event loop) for the result of the job
+        ``token``, with ``transform`` applied to it. ``owner`` (the entity
+        or file that is read) is kept alive until the job is done, so the
+        file is not closed under a pool thread that still reads it."""
+        loop = _current_loop()
+        fut = _create_future(loop)
+        with self._lock:
+            self._pending.discard(token)
+            done = self._orphans.pop(token, None)
+            if done is None:
+                self._futures[token] = (fut, transform, owner)
+        if done is not None:
+            self._complete(fut, transform, *done)
+        self._watch(loop)
+        return fut
+
+    def completed(self, result):
+        """A future that is already done, for results that are available
+        without a read (e.g. from a :class:`Cache`)"""
+        fut = _create_future(_current_loop())
+        fut.set_result(result)
+        return fut
+
+    def then(self, fut, fn):
+        """Future for ``fn(fut.result())``; if that is a future itself,
+        for its result"""
+        chained = _create_future(_current_loop())
+
+        def forward(f):
+            if chained.cancelled():
+                return
+            if f.cancelled():
+                chained.cancel()
+            elif f.exception() is not None:
+                chained.set_exception(f.exception())
+            else:
+                chained.set_result(f.result())
+
+        def step(f):
+            if chained.cancelled():
+                return
+            if f.cancelled():
+                chained.cancel()
+                return
+            try:
+                res = fn(f.result())
+            except Exception as e:
+                chained.set_exception(e)
+                return
+            if hasattr(res, 'add_done_callback'):
+                res.add_done_callback(forward)
+            else:
+                chained.set_result(res)
+
+        fut.add_done_callback(step)
+        return chained
+
+    def gather(self, futures):
+        """Future for the list of the results of ``futures``"""
+        import asyncio
+        if not futures:
+            return self.completed([])
+        return asyncio.gather(*futures)
+
+    def _watch(self, loop):
+        if loop in self._loops:
+            return
+        try:
+            loop.add_reader(self._fd, self._reap)
+        except (NotImplementedError, ValueError, OSError):
+            self._start_waiter()
+        self._loops.add(loop)
+
+    def _start_waiter(self):
+        with self._lock:
+            if self._waiter is not None:
+                return
+            self._waiter = threading.Thread(target=self._wait,
+                                            name='neuroshare-pool-waiter')
+            self._waiter.daemon = True
+        self._waiter.start()
+
+    def _wait(self):
+        while True:
+            if os.name == 'nt':
+                os.read(self._fd, 1)
+            else:
+                select.select([self._fd], [], [])
+            self._reap()
+
+    def _reap(self):
+        try:
+            loop = _current_loop()
+        except RuntimeError:
+            loop = None
+
+        for (token, result, error) in _capi.pool_reap():
+            with self._lock:
+                entry = self._futures.pop(token, None)
+                if entry is None:
+                    # reaped before its future was asked for
+                    if token in self._pending:
+                        self._pending.discard(token)
+                        self._orphans[token] = (result, error)
+                    continue
+            (fut, transform, _owner) = entry
+            fut_loop = fut.get_loop() if hasattr(fut, 'get_loop') else fut._loop
+            if fut_loop is loop:
+                self._complete(fut, transform, result, error)
+            elif not fut_loop.is_closed():
+                fut_loop.call_soon_threadsafe(self._complete, fut, transform,
+                                              result, error)
+
+    @classmethod
+    def _complete(cls, fut, transform, result, error):
+        if fut.done():
+            return
+        if error is not None:
+            fut.set_exception(error)
+            return
+        try:
+            if transform is not None:
+                result = transform(result)
+        except Exception as e:
+            fut.set_exception(e)
+            return
+        fut.set_result(result)
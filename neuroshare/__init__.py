@@ -12,3 +12,5 @@ from .EventEntity import EventEntity
 from .AnalogEntity import AnalogEntity
 from .SegmentEntity import SegmentEntity
 from .NeuralEntity import NeuralEntity
+from .WorkerPool import WorkerPool
+from .Session import Session
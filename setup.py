@@ -46,7 +46,8 @@ classifiers = [
 
 native_ext = Extension('neuroshare._capi',
                        include_dirs=[np.get_include()],
-                       sources=['capi/nspy_glue.c'])
+                       sources=['capi/nspy_glue.c'],
+                       depends=['capi/nspy_thread.h', 'capi/nspy_remote.h'])
 
 setup (name             = 'neuroshare',
        version          = metadata['version'],